@@ -92,7 +92,7 @@ try {
     
     $agentRequest = [
         'agentId' => $instance['agent_id'],
-        'userId' => $userId,
+        'userId' => (int)$userId,
         'instanceId' => $instance['instance_id'],
         'message' => $message,
         'agentConfig' => [
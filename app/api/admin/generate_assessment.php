@@ -514,52 +514,13 @@ function buildAssessmentPrompt($type, $title, $subject, $level, $objectives, $vo
  * Call Course Design Agent service
  */
 function callCourseDesignAgent($message, $timeout = 120) {
-    $agentServiceUrl = AGENT_SERVICE_URL . '/agent/chat';
-    
     $payload = [
         'userId' => 1,
         'agentId' => 2, // Course Design Agent
         'message' => $message
     ];
     
-    $ch = curl_init($agentServiceUrl);
-    curl_setopt($ch, CURLOPT_RETURNTRANSFER, true);
-    curl_setopt($ch, CURLOPT_POST, true);
-    curl_setopt($ch, CURLOPT_POSTFIELDS, json_encode($payload));
-    curl_setopt($ch, CURLOPT_HTTPHEADER, ['Content-Type: application/json']);
-    curl_setopt($ch, CURLOPT_TIMEOUT, $timeout);
-    
-    $response = curl_exec($ch);
-    $httpCode = curl_getinfo($ch, CURLINFO_HTTP_CODE);
-    $error = curl_error($ch);
-    
-    if ($error) {
-        return [
-            'success' => false,
-            'error' => "Agent service error: $error"
-        ];
-    }
-    
-    if ($httpCode !== 200) {
-        return [
-            'success' => false,
-            'error' => "Agent service returned HTTP $httpCode"
-        ];
-    }
-    
-    $responseData = json_decode($response, true);
-    
-    if (!$responseData || !isset($responseData['response'])) {
-        return [
-            'success' => false,
-            'error' => 'Invalid response from agent service'
-        ];
-    }
-    
-    return [
-        'success' => true,
-        'response' => $responseData['response']
-    ];
+    return runAgentJob($payload, $timeout);
 }
 
 /**
@@ -269,54 +269,13 @@ function callCourseDesignAgent($prompt) {
         ];
     }
     
-    $agentServiceUrl = AGENT_SERVICE_URL . '/agent/chat';
-    
     $payload = [
         'userId' => 1, // System user for generation
         'agentId' => $agent['agent_id'],
         'message' => $prompt
     ];
     
-    $ch = curl_init($agentServiceUrl);
-    curl_setopt($ch, CURLOPT_POST, true);
-    curl_setopt($ch, CURLOPT_POSTFIELDS, json_encode($payload));
-    curl_setopt($ch, CURLOPT_RETURNTRANSFER, true);
-    curl_setopt($ch, CURLOPT_TIMEOUT, 90); // 90 second timeout for outline
-    curl_setopt($ch, CURLOPT_HTTPHEADER, [
-        'Content-Type: application/json'
-    ]);
-    
-    $response = curl_exec($ch);
-    $httpCode = curl_getinfo($ch, CURLINFO_HTTP_CODE);
-    
-    if (curl_errno($ch)) {
-        $error = curl_error($ch);
-        return [
-            'success' => false,
-            'error' => "Agent service error: $error"
-        ];
-    }
-    
-    if ($httpCode !== 200) {
-        return [
-            'success' => false,
-            'error' => "Agent service returned HTTP $httpCode"
-        ];
-    }
-    
-    $data = json_decode($response, true);
-    
-    if (!$data || !isset($data['response'])) {
-        return [
-            'success' => false,
-            'error' => 'Invalid response from agent service'
-        ];
-    }
-    
-    return [
-        'success' => true,
-        'response' => $data['response']
-    ];
+    return runAgentJob($payload, 90);
 }
 
 /**
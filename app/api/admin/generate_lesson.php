@@ -244,46 +244,13 @@ function callCourseDesignAgent($prompt) {
         return ['success' => false, 'error' => 'No suitable agent found for lesson generation'];
     }
     
-    // Call agent_service via HTTP
-    $agentServiceUrl = AGENT_SERVICE_URL;
-    
-    $payload = json_encode([
+    $payload = [
         'userId' => 1, // Admin user
         'agentId' => $agent['agent_id'],
         'message' => $prompt
-    ]);
-    
-    $ch = curl_init("$agentServiceUrl/agent/chat");
-    curl_setopt($ch, CURLOPT_POST, true);
-    curl_setopt($ch, CURLOPT_POSTFIELDS, $payload);
-    curl_setopt($ch, CURLOPT_RETURNTRANSFER, true);
-    curl_setopt($ch, CURLOPT_TIMEOUT, 120); // 2 minute timeout for generation
-    curl_setopt($ch, CURLOPT_HTTPHEADER, [
-        'Content-Type: application/json',
-        'Content-Length: ' . strlen($payload)
-    ]);
-    
-    $response = curl_exec($ch);
-    $httpCode = curl_getinfo($ch, CURLINFO_HTTP_CODE);
-    $curlError = curl_error($ch);
-    
-    if ($curlError) {
-        return ['success' => false, 'error' => "Agent service error: $curlError"];
-    }
-    
-    if ($httpCode !== 200) {
-        return ['success' => false, 'error' => "Agent service returned HTTP $httpCode"];
-    }
-    
-    $data = json_decode($response, true);
-    if (!$data) {
-        return ['success' => false, 'error' => 'Invalid response from agent service'];
-    }
-    
-    return [
-        'success' => true,
-        'response' => $data['response'] ?? $data['message'] ?? ''
     ];
+    
+    return runAgentJob($payload, 120);
 }
 
 /**
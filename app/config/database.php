@@ -330,7 +330,8 @@ function callAgentService($endpoint, $data) {
             return ['success' => false, 'message' => 'Agent service unavailable'];
         }
         
-        if ($httpCode !== 200) {
+        // POST /jobs answers 202 Accepted once the job is queued
+        if ($httpCode < 200 || $httpCode >= 300) {
             error_log("Agent service error: HTTP $httpCode - $response");
             return ['success' => false, 'message' => 'Agent service error'];
         }
@@ -348,6 +349,82 @@ function callAgentService($endpoint, $data) {
     }
 }
 
+/**
+ * Submit a long-running generation to the agent service job queue.
+ * Returns immediately with ['success' => true, 'jobId' => ..., 'status' => 'queued'];
+ * poll getAgentJob() for the result instead of holding the request open.
+ */
+function submitAgentJob($data) {
+    return callAgentService('/jobs', $data);
+}
+
+/**
+ * Fetch the status of a job submitted with submitAgentJob().
+ * 'status' is one of queued, running, succeeded (with 'response') or failed (with 'error').
+ */
+function getAgentJob($jobId) {
+    $url = AGENT_SERVICE_URL . '/jobs/' . rawurlencode($jobId);
+    
+    $ch = curl_init();
+    curl_setopt_array($ch, [
+        CURLOPT_URL => $url,
+        CURLOPT_RETURNTRANSFER => true,
+        CURLOPT_TIMEOUT => 10,
+    ]);
+    
+    $response = curl_exec($ch);
+    $httpCode = curl_getinfo($ch, CURLINFO_HTTP_CODE);
+    curl_close($ch);
+    
+    if ($response === false) {
+        return ['success' => false, 'message' => 'Agent service unavailable'];
+    }
+    if ($httpCode === 404) {
+        return ['success' => false, 'message' => 'Job not found'];
+    }
+    
+    $decodedResponse = json_decode($response, true);
+    if ($httpCode !== 200 || $decodedResponse === null) {
+        error_log("Agent service job poll error: HTTP $httpCode - " . substr($response, 0, 200));
+        return ['success' => false, 'message' => 'Agent service error'];
+    }
+    
+    $decodedResponse['success'] = true;
+    return $decodedResponse;
+}
+
+/**
+ * Run a generation through the job queue and wait for its text.
+ * The agent service works on it in the low-priority queue instead of holding
+ * an HTTP thread; this request polls until the job finishes or $timeout
+ * seconds pass. Returns ['success' => true, 'response' => ...] or
+ * ['success' => false, 'error' => ...].
+ */
+function runAgentJob($data, $timeout = 120) {
+    $job = submitAgentJob($data);
+    if (empty($job['success']) || empty($job['jobId'])) {
+        return ['success' => false, 'error' => $job['message'] ?? 'Agent service rejected the job'];
+    }
+    
+    $giveUpAt = time() + $timeout;
+    while (time() < $giveUpAt) {
+        sleep(2);
+        $status = getAgentJob($job['jobId']);
+        if (empty($status['success'])) {
+            return ['success' => false, 'error' => $status['message']];
+        }
+        if ($status['status'] === 'succeeded') {
+            return ['success' => true, 'response' => $status['response'] ?? ''];
+        }
+        if ($status['status'] === 'failed') {
+            return ['success' => false, 'error' => 'Generation failed: ' . ($status['error'] ?? 'unknown error')];
+        }
+    }
+    
+    error_log("[runAgentJob] Job {$job['jobId']} still running after {$timeout}s");
+    return ['success' => false, 'error' => "Generation did not finish within {$timeout} seconds"];
+}
+
 /**
  * Resolve course identifier to both course_id and draft_id
  * Handles: numeric course_id, string courseId (like '2nd_grade_science'), or numeric draft_id
@@ -0,0 +1,127 @@
+// Chunker throughput (bytes/s column) on textbook-like text of growing size:
+// owning chunks, zero-copy spans, streamed input, an mmap'd file and
+// token-sized chunks.
+//
+//   cmake -S . -B build && cmake --build build --target agent_bench
+//   ./build/agent_bench --benchmark_filter=Chunk
+
+#include <benchmark/benchmark.h>
+#include "../include/chunker.h"
+#include "../include/mapped_file.h"
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+namespace {
+// Paragraphs of 3-12 sentences of 4-30 words, like lesson content
+std::string textbook(std::size_t bytes) {
+    static const char* const kWords[] = {
+        "the", "energy", "of", "a", "photosynthesis", "plant", "uses", "light", "to", "make", "sugar",
+        "students", "measure", "fraction", "numerator", "denominator", "equals", "water", "cycle", "evaporates",
+        "and", "condenses", "into", "clouds", "where", "temperature", "changes", "quickly", "because", "mass"};
+    static const char kEnds[] = {'.', '.', '.', '?', '!'};
+    std::mt19937 rng(7);
+    std::string text;
+    text.reserve(bytes + 256);
+    while (text.size() < bytes) {
+        const int sentences = 3 + static_cast<int>(rng() % 10);
+        for (int s = 0; s < sentences; ++s) {
+            const int words = 4 + static_cast<int>(rng() % 27);
+            for (int w = 0; w < words; ++w) {
+                if (w > 0) text += ' ';
+                text += kWords[rng() % (sizeof(kWords) / sizeof(kWords[0]))];
+            }
+            text += kEnds[rng() % sizeof(kEnds)];
+            text += ' ';
+        }
+        text += "\n\n";
+    }
+    return text;
+}
+
+void BM_ChunkOwned(benchmark::State& state) {
+    const std::string text = textbook(static_cast<std::size_t>(state.range(0)));
+    const Chunker chunker;
+    for (auto _ : state) {
+        std::vector<Chunk> chunks = chunker.chunk(text);
+        benchmark::DoNotOptimize(chunks.data());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(text.size()));
+}
+
+void BM_ChunkSpans(benchmark::State& state) {
+    const std::string text = textbook(static_cast<std::size_t>(state.range(0)));
+    const Chunker chunker;
+    for (auto _ : state) {
+        std::size_t covered = 0;
+        chunker.forEachChunk(text, [&](const ChunkSpan& span) { covered += span.length; });
+        benchmark::DoNotOptimize(covered);
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(text.size()));
+}
+
+void BM_ChunkStream(benchmark::State& state) {
+    const std::string text = textbook(static_cast<std::size_t>(state.range(0)));
+    const std::string_view input(text);
+    const Chunker chunker;
+    constexpr std::size_t kBlock = 64 * 1024;
+    for (auto _ : state) {
+        std::size_t covered = 0;
+        ChunkStream stream(chunker, [&](const ChunkSpan& span) { covered += span.length; });
+        for (std::size_t offset = 0; offset < input.size(); offset += kBlock) {
+            stream.feed(input.substr(offset, kBlock));
+        }
+        stream.finish();
+        benchmark::DoNotOptimize(covered);
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(text.size()));
+}
+
+void BM_ChunkTokens(benchmark::State& state) {
+    const std::string text = textbook(static_cast<std::size_t>(state.range(0)));
+    // One token per word, roughly what a subword tokenizer gives this vocabulary
+    std::vector<std::size_t> tokenStarts;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != ' ' && text[i] != '\n' && (i == 0 || text[i - 1] == ' ' || text[i - 1] == '\n')) {
+            tokenStarts.push_back(i);
+        }
+    }
+    const Chunker chunker(160, 32);
+    for (auto _ : state) {
+        std::size_t covered = 0;
+        chunker.forEachChunk(text, tokenStarts, [&](const ChunkSpan& span) { covered += span.length; });
+        benchmark::DoNotOptimize(covered);
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(text.size()));
+}
+
+void BM_ChunkMappedFile(benchmark::State& state) {
+    char path[] = "/tmp/chunker_benchXXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        state.SkipWithError("mkstemp failed");
+        return;
+    }
+    close(fd);
+    const std::string text = textbook(static_cast<std::size_t>(state.range(0)));
+    std::ofstream(path, std::ios::binary) << text;
+
+    const Chunker chunker;
+    for (auto _ : state) {
+        MappedFile file(path);
+        std::size_t covered = 0;
+        chunker.forEachChunk(file.view(), [&](const ChunkSpan& span) { covered += span.length; });
+        benchmark::DoNotOptimize(covered);
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(text.size()));
+    std::remove(path);
+}
+}
+
+BENCHMARK(BM_ChunkOwned)->Arg(64 << 10)->Arg(1 << 20)->Arg(16 << 20);
+BENCHMARK(BM_ChunkSpans)->Arg(64 << 10)->Arg(1 << 20)->Arg(16 << 20);
+BENCHMARK(BM_ChunkStream)->Arg(64 << 10)->Arg(1 << 20)->Arg(16 << 20);
+BENCHMARK(BM_ChunkTokens)->Arg(64 << 10)->Arg(1 << 20)->Arg(16 << 20);
+BENCHMARK(BM_ChunkMappedFile)->Arg(1 << 20)->Arg(16 << 20);
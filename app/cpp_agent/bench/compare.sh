@@ -0,0 +1,43 @@
+#!/bin/bash
+# Compare two agent_bench JSON results (make bench_json) benchmark by
+# benchmark on real time. With repetitions the median aggregate is used.
+# Exits 1 if any benchmark got slower by more than THRESHOLD percent.
+#
+# Usage: bench/compare.sh baseline.json candidate.json [THRESHOLD]
+
+set -euo pipefail
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 baseline.json candidate.json [threshold_percent]" >&2
+    exit 2
+fi
+
+BASELINE="$1"
+CANDIDATE="$2"
+THRESHOLD="${3:-5}"
+
+# name -> real_time (ns), medians when the run has aggregates
+times() {
+    jq -r '
+        .benchmarks as $all
+        | ([$all[] | select(.aggregate_name == "median")] | if length > 0 then . else [$all[] | select(.run_type != "aggregate")] end)
+        | .[]
+        | [(.run_name // .name), (.real_time * (if .time_unit == "us" then 1000 elif .time_unit == "ms" then 1000000 elif .time_unit == "s" then 1000000000 else 1 end))]
+        | @tsv' "$1"
+}
+
+join -t $'\t' <(times "$BASELINE" | sort) <(times "$CANDIDATE" | sort) |
+awk -F'\t' -v threshold="$THRESHOLD" '
+    BEGIN { printf "%-40s %14s %14s %9s\n", "benchmark", "baseline ns", "candidate ns", "change" }
+    {
+        change = ($2 > 0) ? ($3 - $2) * 100 / $2 : 0
+        flag = ""
+        if (change > threshold) { flag = "  REGRESSION"; regressions++ }
+        printf "%-40s %14.0f %14.0f %+8.1f%%%s\n", $1, $2, $3, change, flag
+    }
+    END {
+        if (regressions > 0) {
+            printf "\n%d benchmark(s) slower by more than %s%%\n", regressions, threshold
+            exit 1
+        }
+    }'
@@ -0,0 +1,54 @@
+// HTTP framing on every request: request-line/body split, header lookup and
+// response assembly. Bodies are the size of a typical /agent/chat exchange.
+
+#include <benchmark/benchmark.h>
+#include "../include/http_server.h"
+#include <string>
+
+namespace {
+std::string chatRequest() {
+    const std::string body =
+        "{\"userId\":42,\"agentId\":3,\"message\":\"" + std::string(1500, 'x') + "\",\"ragContext\":\"\"}";
+    return "POST /agent/chat HTTP/1.1\r\n"
+           "Host: localhost:8080\r\n"
+           "User-Agent: PHP/8.2\r\n"
+           "Accept: application/json\r\n"
+           "Content-Type: application/json\r\n"
+           "X-Request-Deadline: 30000\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+           "\r\n" + body;
+}
+
+void BM_ParseHTTPRequest(benchmark::State& state) {
+    const std::string request = chatRequest();
+    for (auto _ : state) {
+        std::string method;
+        std::string path;
+        std::string body = HTTPServer::parseHTTPRequest(request, method, path);
+        benchmark::DoNotOptimize(body.data());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(request.size()));
+}
+
+void BM_HeaderValue(benchmark::State& state) {
+    const std::string request = chatRequest();
+    for (auto _ : state) {
+        std::string deadline = HTTPServer::headerValue(request, "x-request-deadline");
+        benchmark::DoNotOptimize(deadline.data());
+    }
+}
+
+void BM_CreateHTTPResponse(benchmark::State& state) {
+    const std::string body = "{\"success\":true,\"response\":\"" + std::string(static_cast<std::size_t>(state.range(0)), 'y') +
+                             "\",\"agentName\":\"Professor Hawkeinstein\"}";
+    for (auto _ : state) {
+        std::string response = HTTPServer::createHTTPResponse(200, body, "application/json", "X-Request-Id: 7f3a\r\n");
+        benchmark::DoNotOptimize(response.data());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(body.size()));
+}
+}
+
+BENCHMARK(BM_ParseHTTPRequest);
+BENCHMARK(BM_HeaderValue);
+BENCHMARK(BM_CreateHTTPResponse)->Arg(512)->Arg(4096);
@@ -0,0 +1,81 @@
+// jsoncpp parsing of llama-server responses, as LlamaCppClient does for every
+// completion and embedding. Payloads mirror llama-server's shape, including
+// the generation_settings and timings blocks it always sends.
+
+#include <benchmark/benchmark.h>
+#include "../include/llamacpp_client.h"
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace {
+std::string completionBody(std::size_t contentBytes) {
+    Json::Value response;
+    response["content"] = std::string(contentBytes, 'a');
+    response["id_slot"] = 2;
+    response["stop"] = true;
+    response["model"] = "qwen2.5-3b-instruct-q4_k_m.gguf";
+    response["tokens_predicted"] = 212;
+    response["tokens_evaluated"] = 1430;
+    response["tokens_cached"] = 1184;
+    response["truncated"] = false;
+    response["stop_type"] = "eos";
+    Json::Value& settings = response["generation_settings"];
+    settings["n_ctx"] = 4096;
+    settings["temperature"] = 0.7;
+    settings["top_k"] = 40;
+    settings["top_p"] = 0.95;
+    settings["min_p"] = 0.05;
+    settings["repeat_penalty"] = 1.0;
+    settings["n_predict"] = 512;
+    settings["stream"] = false;
+    for (const char* sampler : {"dry", "top_k", "typ_p", "top_p", "min_p", "temperature"}) {
+        settings["samplers"].append(sampler);
+    }
+    Json::Value& timings = response["timings"];
+    timings["prompt_n"] = 246;
+    timings["prompt_ms"] = 310.4;
+    timings["prompt_per_token_ms"] = 1.26;
+    timings["predicted_n"] = 212;
+    timings["predicted_ms"] = 5120.9;
+    timings["predicted_per_token_ms"] = 24.15;
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, response);
+}
+
+std::string embeddingBody(std::size_t dimension) {
+    // Written the way llama-server prints floats, not through jsoncpp
+    std::mt19937 rng(5);
+    std::normal_distribution<float> normal(0.0f, 0.05f);
+    std::ostringstream body;
+    body.precision(9);
+    body << "{\"embedding\":[";
+    for (std::size_t i = 0; i < dimension; ++i) {
+        body << (i > 0 ? "," : "") << normal(rng);
+    }
+    body << "]}";
+    return body.str();
+}
+
+void BM_ParseCompletionResponse(benchmark::State& state) {
+    const std::string body = completionBody(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        Json::Value response = LlamaCppClient::parseCompletionResponse(body);
+        benchmark::DoNotOptimize(response.get("content", "").asString().size());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(body.size()));
+}
+
+void BM_ParseEmbeddingResponse(benchmark::State& state) {
+    const std::string body = embeddingBody(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        std::vector<float> values = LlamaCppClient::parseEmbeddingResponse(body);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(body.size()));
+}
+}
+
+BENCHMARK(BM_ParseCompletionResponse)->Arg(256)->Arg(2048);
+BENCHMARK(BM_ParseEmbeddingResponse)->Arg(384)->Arg(1024);
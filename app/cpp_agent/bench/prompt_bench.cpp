@@ -0,0 +1,70 @@
+// Prompt assembly as AgentManager::buildPrompt does it: token-budgeted
+// packing of retrieved chunks behind the agent's system prompt. Token counts
+// come from a memoizing TokenCounter (warm, as in steady state) or from the
+// per-chunk counts stored at ingestion.
+
+#include <benchmark/benchmark.h>
+#include "../include/prompt_builder.h"
+#include "../include/token_counter.h"
+#include <string>
+#include <vector>
+
+namespace {
+constexpr int kContextTokens = 4096;
+constexpr int kMaxTokens = 512;
+const char* const kModel = "bench-model";
+
+Agent tutor() {
+    Agent agent{};
+    agent.id = 3;
+    agent.name = "Professor Hawkeinstein";
+    agent.systemPrompt = "You are Professor Hawkeinstein, a patient science tutor for elementary and middle school "
+                         "students. Explain ideas step by step with everyday examples, check understanding with a "
+                         "short question, and never give answers to graded work outright.";
+    return agent;
+}
+
+std::vector<RetrievedChunk> retrieved(int count, bool precounted) {
+    std::vector<RetrievedChunk> chunks;
+    for (int i = 0; i < count; ++i) {
+        RetrievedChunk chunk{};
+        chunk.contentId = 100 + i;
+        chunk.chunkIndex = i % 4;
+        chunk.text = "Lesson " + std::to_string(i) + ": plants take in carbon dioxide and water and use the energy "
+                     "of sunlight to make sugar and oxygen. " + std::string(600, 'e');
+        chunk.similarity = 0.9f - 0.01f * static_cast<float>(i);
+        chunk.gradeLevel = "grade_5";
+        chunk.subject = "science";
+        if (precounted) {
+            chunk.tokenCount = TokenCounter::estimate(chunk.text);
+            chunk.tokenizer = kModel;
+        }
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
+
+void buildPrompts(benchmark::State& state, bool precounted) {
+    TokenCounter counter([](const std::string& text) { return TokenCounter::estimate(text); }, 8192, kModel);
+    const PromptBuilder builder(counter, kContextTokens);
+    const Agent agent = tutor();
+    const std::vector<RetrievedChunk> chunks = retrieved(static_cast<int>(state.range(0)), precounted);
+    const std::string message = "Why do plants need sunlight? My teacher said something about sugar.";
+    for (auto _ : state) {
+        PromptBudget budget;
+        std::string prompt = builder.build(agent, message, chunks, kMaxTokens, &budget);
+        benchmark::DoNotOptimize(prompt.data());
+    }
+}
+
+void BM_BuildPrompt(benchmark::State& state) {
+    buildPrompts(state, false);
+}
+
+void BM_BuildPromptPrecounted(benchmark::State& state) {
+    buildPrompts(state, true);
+}
+}
+
+BENCHMARK(BM_BuildPrompt)->Arg(5)->Arg(20);
+BENCHMARK(BM_BuildPromptPrecounted)->Arg(5)->Arg(20);
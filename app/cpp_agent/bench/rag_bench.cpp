@@ -0,0 +1,44 @@
+// The grouping step of RAGEngine::search: vector search rows (best first)
+// reduced to the top k documents, with a varying share of rows that repeat
+// a document already seen.
+
+#include <benchmark/benchmark.h>
+#include "../include/content_top_k.h"
+#include <random>
+#include <vector>
+
+namespace {
+// `rows` rows in descending similarity; each row starts a new document with
+// probability (100 - duplicatePercent)%
+std::vector<RetrievedChunk> searchRows(int rows, int duplicatePercent) {
+    std::mt19937 rng(3);
+    std::vector<RetrievedChunk> chunks;
+    int documents = 0;
+    for (int i = 0; i < rows; ++i) {
+        RetrievedChunk chunk{};
+        const bool repeat = documents > 0 && static_cast<int>(rng() % 100) < duplicatePercent;
+        chunk.contentId = repeat ? 1000 + static_cast<int>(rng() % documents) : 1000 + documents++;
+        chunk.chunkIndex = i;
+        chunk.text = "chunk text";
+        chunk.similarity = 0.95f - 0.002f * static_cast<float>(i);
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
+
+void BM_ContentTopK(benchmark::State& state) {
+    const std::vector<RetrievedChunk> rows = searchRows(static_cast<int>(state.range(0)),
+                                                        static_cast<int>(state.range(1)));
+    for (auto _ : state) {
+        ContentTopK top(5);
+        for (const RetrievedChunk& row : rows) {
+            top.offer(row);
+        }
+        std::vector<RetrievedChunk> documents = top.take();
+        benchmark::DoNotOptimize(documents.data());
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0));
+}
+}
+
+BENCHMARK(BM_ContentTopK)->Args({15, 20})->Args({15, 60})->Args({256, 60})->Args({256, 90});
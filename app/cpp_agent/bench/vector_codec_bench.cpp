@@ -0,0 +1,42 @@
+// VECTOR text codec used for every embedding written to or read from
+// MariaDB (VEC_FromText / VEC_ToText), at the embedding model's dimension.
+
+#include <benchmark/benchmark.h>
+#include "../include/vector_codec.h"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+std::vector<float> embedding(std::size_t dimension) {
+    std::mt19937 rng(11);
+    std::normal_distribution<float> normal(0.0f, 0.05f);
+    std::vector<float> values(dimension);
+    for (float& value : values) {
+        value = normal(rng);
+    }
+    return values;
+}
+
+void BM_SerializeVector(benchmark::State& state) {
+    const std::vector<float> values = embedding(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        std::string text = serializeVector(values);
+        benchmark::DoNotOptimize(text.data());
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0));
+}
+
+void BM_ParseVector(benchmark::State& state) {
+    const std::string text = serializeVector(embedding(static_cast<std::size_t>(state.range(0))));
+    for (auto _ : state) {
+        std::vector<float> values = parseVector(text);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0));
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(text.size()));
+}
+}
+
+BENCHMARK(BM_SerializeVector)->Arg(384)->Arg(1024);
+BENCHMARK(BM_ParseVector)->Arg(384)->Arg(1024);
@@ -4,34 +4,73 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <jsoncpp/json/json.h>
 #include "config.h"
 #include "database.h"
+#include "deadline.h"
+#include "model_router.h"
 #include "rag_engine.h"
+#include "single_flight.h"
 
 class LlamaCppClient;  // Forward declaration
+struct CompletionOptions;
+class EmbeddingCache;
 
 class AgentManager {
 private:
     Config& config;
-    // Map of model_name -> LlamaCppClient for multi-model support
-    std::map<std::string, std::unique_ptr<LlamaCppClient>> llamaClients;
+    // Map of model_name -> LlamaCppClient for multi-model support; models
+    // served by the same llama-server(s) share one client
+    std::map<std::string, std::shared_ptr<LlamaCppClient>> llamaClients;
     std::unique_ptr<Database> database;
+    std::unique_ptr<EmbeddingCache> embeddingCache;
     std::unique_ptr<RAGEngine> ragEngine;
+    std::unique_ptr<ModelRouter> router;
+    std::mutex agentMutex;
     std::map<int, Agent> agentCache;
+    // Backend each cached agent's model name resolved to when it was loaded
+    std::map<int, ModelRouter::Backend*> agentBackends;
+    // Identical in-flight completions (same model, sampling params and prompt) share one llama-server call
+    SingleFlight<std::string, std::string> inflightGenerations;
+    std::thread warmupThread;
+    std::atomic<bool> stopping{false};
     
     Agent loadAgent(int agentId);
-    std::vector<RetrievedChunk> retrieveRelevantContext(const Agent& agent, const std::string& query);
+    std::vector<RetrievedChunk> retrieveRelevantContext(const Agent& agent, const std::string& query,
+                                                        RequestContext* request = nullptr);
     void storeMemory(int userId, int agentId, const std::string& userMessage, const std::string& agentResponse);
-    std::string buildPrompt(const Agent& agent, const std::string& userMessage, const std::vector<RetrievedChunk>& contextChunks);
-    LlamaCppClient* getClientForModel(const std::string& modelName);
+    std::string buildPrompt(const Agent& agent, const std::string& userMessage, const std::vector<RetrievedChunk>& contextChunks,
+                            LlamaCppClient* client, int maxTokens);
+    ModelRouter::Backend* routeRequest(const Agent& agent, const std::string& message, int maxTokens,
+                                       const std::string& classHint, RequestClass& requestClass);
+    void startPrefixWarmup();
+    std::string generateCoalesced(LlamaCppClient* client, const std::string& modelName, const std::string& prompt,
+                                  const CompletionOptions& options);
+    // Records what a request gave up to meet its deadline
+    void degrade(RequestContext& request, const std::string& reason);
     
 public:
     AgentManager(Config& config);
+    // Uses `store` instead of connecting to the configured MySQL database
+    AgentManager(Config& config, std::unique_ptr<Database> store);
     ~AgentManager();
     
-    std::string processMessage(int userId, int agentId, const std::string& message);
-    std::string processMessageWithContext(int userId, int agentId, const std::string& message, const std::string& ragContext);
+    // With a request context, DeadlineExceeded propagates instead of being
+    // turned into an apology so the caller can answer with a fast 504.
+    std::string processMessage(int userId, int agentId, const std::string& message, RequestContext* request = nullptr);
+    std::string processMessageWithContext(int userId, int agentId, const std::string& message, const std::string& ragContext,
+                                          RequestContext* request = nullptr);
+    // Like processMessage/processMessageWithContext (empty ragContext retrieves
+    // context), but throws instead of returning an apology. `requestClass`
+    // overrides routing classification ("short", "chat", "generation").
+    // `request` carries the deadline and collects degradations.
+    std::string generateReply(int userId, int agentId, const std::string& message, const std::string& ragContext,
+                              const std::string& requestClass = "", RequestContext* request = nullptr);
+    // Embeds educational_content rows for RAG; with an agent, chunks carry its rag_scope
+    IngestionStats indexContent(const std::vector<int>& contentIds, IngestionOptions options, int agentId = 0);
     Json::Value listAgents();
     Json::Value getAgent(int agentId);
 };
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstddef>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct Chunk {
@@ -8,16 +11,83 @@ struct Chunk {
     int index;
 };
 
+// A chunk as a byte range of the source. `text` views the source (or the
+// stream's window) and is only valid inside the callback.
+struct ChunkSpan {
+    std::size_t offset;
+    std::size_t length;
+    int index;
+    std::string_view text;
+};
+
+using ChunkCallback = std::function<void(const ChunkSpan&)>;
+
+// Splits text into sentences (ending at . ! ? or a newline) and packs them
+// into chunks of at most chunkSize bytes; each chunk after the first starts
+// `overlap` bytes before the end of the previous one. A sentence longer than
+// chunkSize is cut at whitespace. Chunks are contiguous ranges of the
+// source, trimmed of surrounding whitespace.
+//
+// Sizes are in bytes unless token start offsets are supplied, in which case
+// chunkSize and overlap count tokens of that tokenization instead.
 class Chunker {
 public:
     Chunker(std::size_t chunkSize = 750, std::size_t overlap = 150);
+
     std::vector<Chunk> chunk(const std::string& text) const;
+    // Zero-copy: spans point into `text` (e.g. a MappedFile)
+    void forEachChunk(std::string_view text, const ChunkCallback& emit) const;
+    // Token-sized: `tokenStarts` holds the ascending byte offset in `text` at
+    // which each token of the embedding model's tokenization begins
+    void forEachChunk(std::string_view text, const std::vector<std::size_t>& tokenStarts,
+                      const ChunkCallback& emit) const;
+
+    std::size_t chunkSize() const { return chunkSize_; }
+    std::size_t overlap() const { return overlap_; }
 
 private:
     std::size_t chunkSize_;
     std::size_t overlap_;
+};
+
+// Incremental form of Chunker::forEachChunk for input that arrives in pieces
+// (a socket, a file read in blocks). Only the bytes of the chunk being built
+// are retained, so memory stays around chunkSize plus one piece however long
+// the input is. Offsets are relative to the start of the stream.
+class ChunkStream {
+public:
+    ChunkStream(const Chunker& chunker, ChunkCallback emit);
+
+    void feed(std::string_view data);
+    // Emits the final chunk; the stream cannot be fed afterwards
+    void finish();
+
+private:
+    friend class Chunker;
+
+    std::size_t chunkSize_;
+    std::size_t overlap_;
+    ChunkCallback emit_;
+    const std::vector<std::size_t>* tokenStarts_ = nullptr;  // sizes in tokens when set
+
+    std::string buffer_;
+    std::size_t bufferBase_ = 0;  // stream offset of buffer_[0]
+    std::string_view window_;     // data being scanned
+    std::size_t windowBase_ = 0;  // stream offset of window_[0]
+
+    std::size_t scanPos_ = 0;        // next byte to look at
+    std::size_t sentenceStart_ = 0;  // first non-space byte of the pending sentence
+    bool hasCurrent_ = false;        // a chunk is being built
+    std::size_t chunkStart_ = 0;
+    std::size_t chunkEnd_ = 0;
+    int index_ = 0;
 
-    std::vector<std::string> splitSentences(const std::string& text) const;
-    static std::string trim(const std::string& input);
-    std::string tailOverlap(const std::string& text) const;
+    char at(std::size_t pos) const { return window_[pos - windowBase_]; }
+    // Size of [start, end) and positions `n` units away, in bytes or tokens
+    std::size_t measure(std::size_t start, std::size_t end) const;
+    std::size_t advance(std::size_t pos, std::size_t n) const;
+    std::size_t retreat(std::size_t pos, std::size_t n) const;
+    void scan(bool final);
+    void addSentence(std::size_t start, std::size_t end);
+    void emitChunk(std::size_t start, std::size_t end);
 };
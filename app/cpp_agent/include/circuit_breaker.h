@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class Counter;
+class Gauge;
+
+struct CircuitBreakerPolicy {
+    int consecutiveFailures = 5;    // trip after this many failures in a row
+    double failureRatio = 0.5;      // ...or when this share of the recent window failed
+    int window = 20;                // outcomes remembered for the ratio
+    int minRequests = 10;           // outcomes needed before the ratio is trusted
+    int openSeconds = 15;           // first trip; doubles on repeat trips, capped at 8x
+    int halfOpenProbes = 1;         // concurrent trial requests allowed while half-open
+};
+
+// Per-backend breaker. Closed passes traffic and counts outcomes; Open
+// rejects immediately for a cool-down so callers fail fast instead of waiting
+// out a request timeout; HalfOpen lets a few probes through and closes on the
+// first success or re-opens on a failure.
+class CircuitBreaker {
+public:
+    enum class State { Closed = 0, HalfOpen = 1, Open = 2 };
+
+    CircuitBreaker(const CircuitBreakerPolicy& policy, Gauge* stateGauge = nullptr, Counter* opensCounter = nullptr);
+
+    // True if a request may be sent now. Moves Open to HalfOpen once the
+    // cool-down has expired, and while half-open claims one of the probes;
+    // the request's outcome hook returns it.
+    bool available();
+    // Whether available() would admit a request, without claiming a probe
+    bool admits() const;
+
+    // Outcome hooks; every request admitted by available() ends in exactly one.
+    void onSuccess();
+    // Returns true if this failure tripped the breaker open.
+    bool onFailure();
+    // The request was abandoned by the caller; counts neither way.
+    void onCancelled();
+
+    State state() const { return state_.load(std::memory_order_relaxed); }
+    static const char* name(State state);
+
+private:
+    CircuitBreakerPolicy policy_;
+    Gauge* stateGauge_;
+    Counter* opensCounter_;
+
+    mutable std::mutex mutex_;
+    std::atomic<State> state_{State::Closed};
+    std::vector<bool> outcomes_;   // ring of recent results, true = failure
+    std::size_t next_ = 0;
+    std::size_t recorded_ = 0;
+    int consecutive_ = 0;
+    int trips_ = 0;
+    std::atomic<int> probesInFlight_{0};
+    std::chrono::steady_clock::time_point openUntil_;
+
+    bool claimProbe();
+    void releaseProbe();
+    void transition(State to);
+    void trip();
+    std::size_t recentFailures() const;
+};
@@ -3,8 +3,15 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <fstream>
 #include <jsoncpp/json/json.h>
+#include "ingestion_pipeline.h"
+#include "llm_scheduler.h"
+#include "logger.h"
+#include "rate_limiter.h"
+#include "replica_set.h"
+#include "traffic_capture.h"
 
 struct ModelConfig {
     int port = 8090;
@@ -12,6 +19,25 @@ struct ModelConfig {
     std::string file;
     int ctxSize = 4096;
     int threads = 4;
+    int parallel = 2;  // llama-server --parallel (number of slots)
+    // Extra llama-server processes serving the same file; `url` is always the first replica
+    std::vector<std::string> replicas;
+
+    std::vector<std::string> replicaUrls() const {
+        std::vector<std::string> urls{url};
+        for (const auto& replica : replicas) {
+            if (replica != url) urls.push_back(replica);
+        }
+        return urls;
+    }
+};
+
+// Sends one request class ("short", "chat" or "generation") to the first of
+// `models` whose measured p95 latency for that class is within maxLatencyMs.
+struct RoutingRuleConfig {
+    std::string requestClass;
+    std::vector<std::string> models;
+    int maxLatencyMs = 0;
 };
 
 struct Config {
@@ -25,6 +51,19 @@ struct Config {
     
     // Multi-model support: model_name -> ModelConfig
     std::map<std::string, ModelConfig> models;
+    // Agent model names that refer to a configured model: alias -> model_name
+    std::map<std::string, std::string> modelAliases;
+    std::vector<RoutingRuleConfig> routingRules;
+    int routingShortMaxChars = 280;         // messages up to this length are "short"
+    int routingGenerationMinTokens = 1024;  // max_tokens from here up are "generation"
+    
+    // Generation jobs (POST /jobs): worker count caps the llama-server slots
+    // authoring work can hold; finished jobs are kept retention_days
+    bool jobsEnabled = true;
+    int jobsConcurrency = 1;
+    int jobsMaxQueued = 200;
+    int jobsMaxAttempts = 3;
+    int jobsRetentionDays = 7;
     
     // Database configuration
     std::string dbHost = "localhost";
@@ -39,6 +78,50 @@ struct Config {
     int topK = 40;
     float topP = 0.9;
     
+    // Embedding cache (capacity 0 disables; empty persist path keeps it in memory)
+    int embeddingCacheCapacity = 20000;
+    int embeddingCacheShards = 16;
+    std::string embeddingCachePath;
+    
+    // KV prefix warmup: prefill each active agent's system prompt at startup and,
+    // when llama-server runs with --slot-save-path, save/restore slot states
+    bool warmupSystemPrompts = true;
+    bool persistSlotStates = false;
+    
+    // Balancing, circuit breaking and hedging across a model's replicas
+    LoadBalancerPolicy loadBalancing;
+    HedgePolicy hedging;
+    // Slot admission between interactive chat and batch generation
+    SchedulerPolicy scheduling;
+    // Per-user token buckets at /agent/chat and fair-queueing weights, by agent
+    RateLimitPolicy rateLimits;
+    
+    // Chat deadlines: X-Request-Deadline (ms from now) or default_ms. RAG gets
+    // rag_share of what is left and is skipped under rag_min_ms; max_tokens is
+    // cut to fit the rest minus prefill_share, failing fast below min_tokens.
+    int deadlineDefaultMs = 60000;
+    double deadlineRagShare = 0.25;
+    int deadlineRagMinMs = 1500;
+    double deadlinePrefillShare = 0.2;
+    int deadlineMinTokens = 32;
+    
+    // Stage spans kept in per-thread ring buffers (GET /debug/trace); written
+    // as Chrome trace JSON to export_path on shutdown when set
+    bool tracingEnabled = true;
+    int tracingSpansPerThread = 1024;
+    std::string tracingExportPath;
+    
+    // POST /rag/index: chunk batches embedded by `workers` concurrent
+    // requests, at most max_in_flight_batches chunked ahead of them
+    IngestionConfig ingestion;
+    
+    // Asynchronous logger; debug lines below AGENT_LOG_LEVEL are compiled out
+    LogOptions logging;
+    
+    // Request log for tools/replay: arrival, duration, status and the body
+    // (full, redacted or none) of requests on the listed routes
+    CaptureOptions capture;
+    
     bool load(const std::string& configPath) {
         std::ifstream file(configPath);
         if (!file.is_open()) {
@@ -77,6 +160,136 @@ struct Config {
             if (agent.isMember("top_p")) topP = agent["top_p"].asFloat();
         }
         
+        if (root.isMember("embedding_cache")) {
+            auto cache = root["embedding_cache"];
+            if (cache.isMember("capacity")) embeddingCacheCapacity = cache["capacity"].asInt();
+            if (cache.isMember("shards")) embeddingCacheShards = cache["shards"].asInt();
+            if (cache.isMember("persist_path")) embeddingCachePath = cache["persist_path"].asString();
+        }
+        
+        if (root.isMember("kv_cache")) {
+            auto kv = root["kv_cache"];
+            if (kv.isMember("warmup_system_prompts")) warmupSystemPrompts = kv["warmup_system_prompts"].asBool();
+            if (kv.isMember("persist_slots")) persistSlotStates = kv["persist_slots"].asBool();
+        }
+        
+        if (root.isMember("load_balancing")) {
+            auto lb = root["load_balancing"];
+            if (lb.isMember("strategy")) loadBalancing.strategy = lb["strategy"].asString();
+            if (lb.isMember("eject_seconds")) loadBalancing.ejectSeconds = lb["eject_seconds"].asInt();
+            if (lb.isMember("slow_factor")) loadBalancing.slowFactor = lb["slow_factor"].asDouble();
+            if (lb.isMember("min_samples_for_slow")) loadBalancing.minSamplesForSlow = lb["min_samples_for_slow"].asInt();
+        }
+        
+        if (root.isMember("circuit_breaker")) {
+            auto cb = root["circuit_breaker"];
+            auto& breaker = loadBalancing.breaker;
+            if (cb.isMember("consecutive_failures")) breaker.consecutiveFailures = cb["consecutive_failures"].asInt();
+            if (cb.isMember("failure_ratio")) breaker.failureRatio = cb["failure_ratio"].asDouble();
+            if (cb.isMember("window")) breaker.window = cb["window"].asInt();
+            if (cb.isMember("min_requests")) breaker.minRequests = cb["min_requests"].asInt();
+            if (cb.isMember("open_seconds")) breaker.openSeconds = cb["open_seconds"].asInt();
+            if (cb.isMember("half_open_probes")) breaker.halfOpenProbes = cb["half_open_probes"].asInt();
+        }
+        
+        if (root.isMember("hedging")) {
+            auto h = root["hedging"];
+            if (h.isMember("embeddings")) hedging.embeddings = h["embeddings"].asBool();
+            if (h.isMember("generations")) hedging.generations = h["generations"].asBool();
+            if (h.isMember("max_tokens")) hedging.maxTokens = h["max_tokens"].asInt();
+            if (h.isMember("percentile")) hedging.percentile = h["percentile"].asDouble();
+            if (h.isMember("min_delay_ms")) hedging.minDelayMs = h["min_delay_ms"].asInt();
+            if (h.isMember("max_delay_ms")) hedging.maxDelayMs = h["max_delay_ms"].asInt();
+            if (h.isMember("min_samples")) hedging.minSamples = h["min_samples"].asInt();
+        }
+        
+        if (root.isMember("scheduler")) {
+            auto sched = root["scheduler"];
+            if (sched.isMember("interactive_reserved_slots")) {
+                scheduling.interactiveReservedSlots = sched["interactive_reserved_slots"].asInt();
+            }
+            if (sched.isMember("preempt_batch")) scheduling.preemptBatch = sched["preempt_batch"].asBool();
+            if (sched.isMember("max_preemptions")) scheduling.maxPreemptions = sched["max_preemptions"].asInt();
+        }
+        
+        if (root.isMember("deadlines")) {
+            auto dl = root["deadlines"];
+            if (dl.isMember("default_ms")) deadlineDefaultMs = dl["default_ms"].asInt();
+            if (dl.isMember("rag_share")) deadlineRagShare = dl["rag_share"].asDouble();
+            if (dl.isMember("rag_min_ms")) deadlineRagMinMs = dl["rag_min_ms"].asInt();
+            if (dl.isMember("prefill_share")) deadlinePrefillShare = dl["prefill_share"].asDouble();
+            if (dl.isMember("min_tokens")) deadlineMinTokens = dl["min_tokens"].asInt();
+        }
+        
+        if (root.isMember("tracing")) {
+            auto tr = root["tracing"];
+            if (tr.isMember("enabled")) tracingEnabled = tr["enabled"].asBool();
+            if (tr.isMember("spans_per_thread")) tracingSpansPerThread = tr["spans_per_thread"].asInt();
+            if (tr.isMember("export_path")) tracingExportPath = tr["export_path"].asString();
+        }
+        
+        if (root.isMember("logging")) {
+            auto lg = root["logging"];
+            if (lg.isMember("level")) logging.level = parseLogLevel(lg["level"].asString(), logging.level);
+            if (lg.isMember("format")) logging.json = lg["format"].asString() == "json";
+            if (lg.isMember("buffer_kb")) logging.bufferBytes = static_cast<std::size_t>(lg["buffer_kb"].asInt()) * 1024;
+            if (lg.isMember("flush_interval_ms")) logging.flushIntervalMs = lg["flush_interval_ms"].asInt();
+        }
+        
+        if (root.isMember("capture")) {
+            auto cp = root["capture"];
+            if (cp.isMember("enabled")) capture.enabled = cp["enabled"].asBool();
+            if (cp.isMember("path")) capture.path = cp["path"].asString();
+            if (cp.isMember("payload")) capture.payload = parseCapturePayload(cp["payload"].asString(), capture.payload);
+            if (cp.isMember("routes")) {
+                capture.routes.clear();
+                for (const auto& route : cp["routes"]) {
+                    capture.routes.insert(route.asString());
+                }
+            }
+            if (cp.isMember("buffer_kb")) capture.bufferBytes = static_cast<std::size_t>(cp["buffer_kb"].asInt()) * 1024;
+            if (cp.isMember("flush_interval_ms")) capture.flushIntervalMs = cp["flush_interval_ms"].asInt();
+            if (cp.isMember("max_mb")) capture.maxBytes = static_cast<std::uint64_t>(cp["max_mb"].asInt64()) * 1024 * 1024;
+        }
+        
+        if (root.isMember("rate_limit")) {
+            auto rl = root["rate_limit"];
+            auto parseQuota = [](const Json::Value& json, UserQuota& quota) {
+                if (json.isMember("requests_per_minute")) quota.requestsPerMinute = json["requests_per_minute"].asDouble();
+                if (json.isMember("burst")) quota.burst = json["burst"].asDouble();
+                if (json.isMember("weight")) quota.weight = json["weight"].asDouble();
+            };
+            if (rl.isMember("enabled")) rateLimits.enabled = rl["enabled"].asBool();
+            if (rl.isMember("max_tracked_users")) rateLimits.maxTrackedUsers = rl["max_tracked_users"].asInt();
+            if (rl.isMember("shards")) rateLimits.shards = rl["shards"].asInt();
+            if (rl.isMember("exempt_users")) {
+                rateLimits.exemptUsers.clear();
+                for (const auto& user : rl["exempt_users"]) {
+                    rateLimits.exemptUsers.insert(user.asInt());
+                }
+            }
+            parseQuota(rl, rateLimits.defaults);
+            if (rl.isMember("agents")) {
+                for (const auto& agentId : rl["agents"].getMemberNames()) {
+                    int id = 0;
+                    std::size_t used = 0;
+                    try {
+                        id = std::stoi(agentId, &used);
+                    } catch (const std::exception&) {
+                        used = 0;
+                    }
+                    if (used == 0 || used != agentId.size()) {
+                        LOG_WARN << "[Config] Ignoring rate_limit.agents entry '" << agentId
+                                 << "': keys must be agent ids";
+                        continue;
+                    }
+                    UserQuota quota = rateLimits.defaults;
+                    parseQuota(rl["agents"][agentId], quota);
+                    rateLimits.agents[id] = quota;
+                }
+            }
+        }
+        
         // Load multi-model configuration
         if (root.isMember("models")) {
             auto modelsJson = root["models"];
@@ -84,14 +297,69 @@ struct Config {
                 ModelConfig mc;
                 auto m = modelsJson[modelName];
                 if (m.isMember("port")) mc.port = m["port"].asInt();
-                if (m.isMember("url")) mc.url = m["url"].asString();
+                // "url" may be a single URL or a list of replica URLs
+                if (m.isMember("url") && m["url"].isArray()) {
+                    for (const auto& u : m["url"]) mc.replicas.push_back(u.asString());
+                } else if (m.isMember("url")) {
+                    mc.url = m["url"].asString();
+                }
+                if (m.isMember("replicas")) {
+                    for (const auto& u : m["replicas"]) mc.replicas.push_back(u.asString());
+                }
+                if (!mc.replicas.empty() && (!m.isMember("url") || m["url"].isArray())) {
+                    mc.url = mc.replicas.front();
+                }
                 if (m.isMember("file")) mc.file = m["file"].asString();
                 if (m.isMember("ctx_size")) mc.ctxSize = m["ctx_size"].asInt();
                 if (m.isMember("threads")) mc.threads = m["threads"].asInt();
+                if (m.isMember("parallel")) mc.parallel = m["parallel"].asInt();
                 models[modelName] = mc;
             }
         }
         
+        if (root.isMember("jobs")) {
+            auto jobs = root["jobs"];
+            if (jobs.isMember("enabled")) jobsEnabled = jobs["enabled"].asBool();
+            if (jobs.isMember("concurrency")) jobsConcurrency = jobs["concurrency"].asInt();
+            if (jobs.isMember("max_queued")) jobsMaxQueued = jobs["max_queued"].asInt();
+            if (jobs.isMember("max_attempts")) jobsMaxAttempts = jobs["max_attempts"].asInt();
+            if (jobs.isMember("retention_days")) jobsRetentionDays = jobs["retention_days"].asInt();
+        }
+        
+        if (root.isMember("ingestion")) {
+            auto ing = root["ingestion"];
+            if (ing.isMember("workers")) ingestion.workers = ing["workers"].asInt();
+            if (ing.isMember("batch_size")) ingestion.batchSize = ing["batch_size"].asInt();
+            if (ing.isMember("max_in_flight_batches")) ingestion.maxInFlightBatches = ing["max_in_flight_batches"].asInt();
+            if (ing.isMember("insert_rows")) ingestion.insertRows = ing["insert_rows"].asInt();
+            if (ing.isMember("chunk_size")) ingestion.chunkSize = ing["chunk_size"].asInt();
+            if (ing.isMember("chunk_overlap")) ingestion.chunkOverlap = ing["chunk_overlap"].asInt();
+            if (ing.isMember("chunk_tokens")) ingestion.chunkTokens = ing["chunk_tokens"].asInt();
+            if (ing.isMember("chunk_overlap_tokens")) ingestion.chunkOverlapTokens = ing["chunk_overlap_tokens"].asInt();
+            if (ing.isMember("dedup_distance")) ingestion.dedupDistance = ing["dedup_distance"].asInt();
+            if (ing.isMember("backend_share")) ingestion.backendShare = ing["backend_share"].asDouble();
+        }
+        
+        if (root.isMember("model_aliases")) {
+            auto aliases = root["model_aliases"];
+            for (const auto& alias : aliases.getMemberNames()) {
+                modelAliases[alias] = aliases[alias].asString();
+            }
+        }
+        
+        if (root.isMember("routing")) {
+            auto routing = root["routing"];
+            if (routing.isMember("short_max_chars")) routingShortMaxChars = routing["short_max_chars"].asInt();
+            if (routing.isMember("generation_min_tokens")) routingGenerationMinTokens = routing["generation_min_tokens"].asInt();
+            for (const auto& r : routing["rules"]) {
+                RoutingRuleConfig rule;
+                rule.requestClass = r.get("class", "").asString();
+                for (const auto& m : r["models"]) rule.models.push_back(m.asString());
+                rule.maxLatencyMs = r.get("max_latency_ms", 0).asInt();
+                routingRules.push_back(rule);
+            }
+        }
+        
         return true;
     }
     
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include "rag_engine.h"
+
+// Top-k by document rather than by chunk: collects the best `perContent`
+// chunks of each of the first k distinct content ids offered. Rows are
+// expected in descending similarity (vector search order), so once k
+// documents are in, every later document is worse and is refused; later
+// chunks of documents already in still compete for their per-content heap.
+class ContentTopK {
+public:
+    ContentTopK(std::size_t k, std::size_t perContent = 1);
+
+    // False if the chunk was not kept (a new document once full, or worse
+    // than the chunks its document already holds)
+    bool offer(const RetrievedChunk& chunk);
+    // k distinct documents have been found
+    bool full() const { return order_.size() >= k_; }
+    std::size_t documents() const { return order_.size(); }
+    // Rows offered until the k-th document arrived (all offered rows while
+    // not full): the over-fetch a search like this one needed
+    std::size_t rowsToFill() const { return rowsToFill_; }
+    // Chunks turned away or evicted because their document was already in
+    std::size_t duplicates() const { return duplicates_; }
+
+    // Documents in order of their best chunk, each document's chunks best
+    // first; the collector is empty afterwards
+    std::vector<RetrievedChunk> take();
+
+private:
+    std::size_t k_;
+    std::size_t perContent_;
+    std::size_t offered_ = 0;
+    std::size_t rowsToFill_ = 0;
+    std::size_t duplicates_ = 0;
+    std::vector<int> order_;                                      // content ids, first seen first
+    std::unordered_map<int, std::vector<RetrievedChunk>> heaps_;  // min-heaps on similarity
+};
@@ -1,10 +1,13 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
 #include <mysql/mysql.h>
+#include "simhash.h"
 
 // Forward declaration - no includes to avoid circular dependency
 struct Agent {
@@ -25,6 +28,8 @@ struct VectorSearchResult {
     std::string gradeLevel;
     std::string subject;
     std::string agentScope;
+    int tokenCount = -1;    // token_count column, -1 when NULL
+    std::string tokenizer;  // model whose tokenizer produced tokenCount (model_used)
 };
 
 struct VectorSearchFilters {
@@ -36,6 +41,74 @@ struct VectorSearchFilters {
     bool hasSubject() const { return !subject.empty(); }
 };
 
+// An educational_content row as the ingestion pipeline reads it
+struct IndexableContent {
+    int contentId = 0;
+    std::string title;
+    std::string text;
+    std::string gradeLevel;
+    std::string subject;
+    bool hasEmbeddings = false;
+    // chunk_metadata of its current chunks (agent_scope etc.), kept when re-embedding
+    std::string chunkMetadata;
+};
+
+// One content_embeddings row; `metadata` is the chunk_metadata JSON document
+struct EmbeddingRow {
+    int contentId = 0;
+    int chunkIndex = 0;
+    std::string text;
+    std::string metadata;
+    std::vector<float> embedding;
+    int tokenCount = -1;  // stored as NULL when unknown
+    std::string model;    // embedding model, also the tokenizer of tokenCount
+    std::uint64_t simhash = 0;
+};
+
+// A chunk that was not embedded because it nearly repeats a stored one; the
+// back-reference lives in <embeddings table>_duplicates
+struct ChunkDuplicateRow {
+    int contentId = 0;
+    int chunkIndex = 0;
+    int canonicalContentId = 0;
+    int canonicalChunkIndex = 0;
+    int distance = 0;  // SimHash bits apart
+};
+
+// A `reembed` run and its checkpoint (table embedding_reembed_runs,
+// migrations/017_embedding_reembed_runs.sql)
+struct ReembedRun {
+    std::string id;
+    std::string shadowTable;
+    std::string status;  // running, completed, failed
+    int lastContentId = 0;
+    int documents = 0;
+    int chunks = 0;
+    int failed = 0;
+    std::string error;
+    std::string startedAt;  // set by the database when the run is first saved
+};
+
+// A long-running generation submitted through POST /jobs
+// (table generation_jobs, migrations/016_generation_jobs.sql)
+struct GenerationJob {
+    std::string id;
+    std::string kind = "generation";  // or "index": POST /rag/index, the request body in message
+    std::string status;          // queued, running, succeeded, failed
+    int userId = 0;
+    int agentId = 0;
+    std::string message;
+    std::string ragContext;
+    std::string result;
+    std::string error;
+    int attempts = 0;
+    std::string createdAt;
+    std::string startedAt;
+    std::string finishedAt;
+};
+
+// One MySQL connection. The calls are virtual so the service can also run
+// against an in-memory store (tools/loadtest.cpp).
 class Database {
 private:
     MYSQL* connection;
@@ -44,29 +117,95 @@ private:
     std::string dbName;
     std::string user;
     std::string password;
+    std::mutex connectionMutex;  // held by ConnectionGuard for each public call
     
+    class ConnectionGuard;
     void connect();
     void disconnect();
+    std::string escape(const std::string& value);
+    // Bodies of the calls below, for callers already holding the connection
+    void deleteEmbeddingsLocked(int contentId, const std::string& table);
+    int insertEmbeddingsLocked(const std::vector<EmbeddingRow>& rows, const std::string& table);
+    void insertChunkDuplicatesLocked(const std::vector<ChunkDuplicateRow>& rows, const std::string& table);
+    std::vector<IndexableContent> queryContent(const std::string& where);
+    
+protected:
+    // No connection: for in-memory stand-ins that override every call they
+    // serve (tools/fake_database.h)
+    Database();
     
 public:
     Database(const std::string& host, int port, const std::string& dbName, 
              const std::string& user, const std::string& password);
-    ~Database();
+    virtual ~Database();
+    
+    virtual Agent getAgent(int agentId);
+    virtual std::vector<Agent> getAllAgents();
+    virtual std::vector<Agent> getStudentVisibleAgents();
+    virtual void storeMemory(int userId, int agentId, const std::string& userMessage, const std::string& agentResponse);
+    virtual std::vector<std::string> getRAGDocuments(int agentId, const std::vector<float>& embedding, int limit);
+    virtual std::vector<VectorSearchResult> vectorSearch(const std::vector<float>& embedding,
+                                                        int topK = 5,
+                                                        const std::string& metric = "cosine",
+                                                        const VectorSearchFilters* filters = nullptr);
+    // Ingestion (RAGEngine::indexContent)
+    virtual bool getContentForIndexing(int contentId, IndexableContent& content);
+    // Content with content_id > afterContentId in id order, read as a stream
+    virtual std::vector<IndexableContent> getContentPage(int afterContentId, int limit);
+    // Also drops the document's duplicate back-references, and those of
+    // other documents that pointed at its chunks
+    virtual void deleteEmbeddings(int contentId, const std::string& table = "content_embeddings");
+    // One multi-row INSERT; returns the number of rows written
+    virtual int insertEmbeddings(const std::vector<EmbeddingRow>& rows, const std::string& table = "content_embeddings");
+    // deleteEmbeddings() of each document, then both inserts, in one
+    // transaction: on failure the documents keep the rows they had
+    virtual void replaceEmbeddings(const std::vector<int>& contentIds, const std::vector<EmbeddingRow>& rows,
+                                   const std::vector<ChunkDuplicateRow>& duplicates,
+                                   const std::string& table = "content_embeddings");
+    // Sets has_embeddings/embedding_count/last_embedded on educational_content
+    virtual void markContentEmbedded(int contentId, int embeddingCount);
+    // Near-duplicate detection: SimHash of every stored chunk that has one
+    virtual std::vector<ChunkSignature> getChunkSignatures(const std::string& table = "content_embeddings");
+    virtual void insertChunkDuplicates(const std::vector<ChunkDuplicateRow>& rows,
+                                       const std::string& table = "content_embeddings");
     
-    Agent getAgent(int agentId);
-    std::vector<Agent> getAllAgents();
-    std::vector<Agent> getStudentVisibleAgents();
-    void storeMemory(int userId, int agentId, const std::string& userMessage, const std::string& agentResponse);
-    std::vector<std::string> getRAGDocuments(int agentId, const std::vector<float>& embedding, int limit);
-    std::vector<VectorSearchResult> vectorSearch(const std::vector<float>& embedding,
-                                                int topK = 5,
-                                                const std::string& metric = "cosine",
-                                                const VectorSearchFilters* filters = nullptr);
-    void storeEmbedding(int documentId, const std::vector<float>& embedding);
-    std::vector<float> getEmbedding(int embeddingId);
+    // Re-embedding into a shadow table
+    virtual bool getReembedRun(const std::string& runId, ReembedRun& run);
+    // Saving a run without startedAt (re)starts its clock
+    virtual void saveReembedRun(const ReembedRun& run);
+    // Content up to throughContentId the run still has to embed: documents
+    // with text but no chunks in `table` (failed or never reached), and
+    // documents edited since `changedSince` (educational_content.updated_at)
+    virtual std::vector<IndexableContent> getContentToReembed(const std::string& table, int throughContentId,
+                                                              const std::string& changedSince);
+    // Empty copy of content_embeddings and its duplicates table (indexes
+    // included); existing tables are kept unless `reset`
+    virtual void createShadowEmbeddingsTable(const std::string& table, bool reset);
+    // Atomically renames `table` (and its duplicates) to content_embeddings;
+    // the old tables are kept as content_embeddings_old or dropped
+    virtual void swapEmbeddingsTable(const std::string& table, bool keepOld);
+    // Recomputes has_embeddings/embedding_count from content_embeddings and
+    // its duplicates
+    virtual void refreshEmbeddingCounts();
+    virtual std::vector<float> getEmbedding(int embeddingId);
+    // Every stored chunk vector with its content id, chunk index and model
+    // (text and metadata left empty), for offline evaluation (tools/rag_eval.cpp)
+    virtual std::vector<EmbeddingRow> getStoredEmbeddings(const std::string& table = "content_embeddings");
+    // Candidates the HNSW vector index visits per search on this connection
+    // (MariaDB mhnsw_ef_search); higher trades latency for recall
+    virtual void setVectorIndexEfSearch(int efSearch);
     
     // FULLTEXT search on educational_content table (generated lessons)
-    std::vector<std::pair<std::string, std::string>> searchEducationalContent(const std::string& query, int limit = 3);
+    virtual std::vector<std::pair<std::string, std::string>> searchEducationalContent(const std::string& query, int limit = 3);
+    
+    // Generation jobs
+    virtual void createJob(const GenerationJob& job);
+    // Persists status, result, error and attempts; stamps started_at/finished_at on the matching transitions
+    virtual void updateJob(const GenerationJob& job);
+    virtual bool getJob(const std::string& jobId, GenerationJob& job);
+    // Queued and running jobs, oldest first (running ones were interrupted by a restart)
+    virtual std::vector<GenerationJob> getUnfinishedJobs();
+    virtual int purgeFinishedJobs(int olderThanDays);
 };
 
 #endif // DATABASE_H
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Thrown when a request can no longer be answered within its deadline.
+class DeadlineExceeded : public std::runtime_error {
+public:
+    explicit DeadlineExceeded(const std::string& stage) : std::runtime_error("Deadline exceeded before " + stage) {}
+};
+
+// Point in time a request must be answered by. Default-constructed means no deadline.
+class Deadline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Deadline() : at_(Clock::time_point::max()) {}
+
+    static Deadline in(std::chrono::milliseconds budget) {
+        Deadline deadline;
+        deadline.at_ = Clock::now() + budget;
+        return deadline;
+    }
+
+    bool unlimited() const { return at_ == Clock::time_point::max(); }
+    Clock::time_point at() const { return at_; }
+    bool expired() const { return !unlimited() && Clock::now() >= at_; }
+
+    std::int64_t remainingMs() const {
+        if (unlimited()) {
+            return std::numeric_limits<std::int64_t>::max();
+        }
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(at_ - Clock::now()).count();
+        return std::max<std::int64_t>(0, left);
+    }
+
+    // Deadline for a stage that may use `fraction` of the time left, leaving
+    // the rest to the stages after it.
+    Deadline share(double fraction) const {
+        if (unlimited()) {
+            return *this;
+        }
+        return in(std::chrono::milliseconds(static_cast<std::int64_t>(remainingMs() * fraction)));
+    }
+
+private:
+    Clock::time_point at_;
+};
+
+// Per-request state carried from the HTTP entry point through AgentManager.
+struct RequestContext {
+    Deadline deadline;
+    // True when `deadline` is the configured default rather than one the caller asked for
+    bool defaultDeadline = false;
+    // What was given up to meet the deadline ("rag_skipped", "max_tokens_reduced", ...)
+    std::vector<std::string> degradations;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "hashing.h"
+
+// Sharded LRU cache of fixed-dimension embedding vectors.
+//
+// Vectors live in a single slab of fixed-size records; each shard owns a
+// contiguous range of records and keeps its own LRU list and index, so lookups
+// on different shards never contend. When a persist path is configured the slab
+// is a memory-mapped file and survives restarts; on open, valid records are
+// re-indexed in their previous recency order.
+class EmbeddingCache {
+public:
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t inserts = 0;
+        std::uint64_t evictions = 0;
+        std::uint64_t savedMicros = 0;
+        std::size_t entries = 0;
+        std::size_t capacity = 0;
+    };
+
+    EmbeddingCache(std::size_t capacity, std::size_t shards, int dimension, const std::string& persistPath = "");
+    ~EmbeddingCache();
+
+    EmbeddingCache(const EmbeddingCache&) = delete;
+    EmbeddingCache& operator=(const EmbeddingCache&) = delete;
+
+    // Key over the model id and the whitespace-normalized text.
+    static Hash128 makeKey(const std::string& modelId, const std::string& text);
+    static std::string normalize(const std::string& text);
+
+    bool lookup(const Hash128& key, std::vector<float>& out);
+    void insert(const Hash128& key, const std::vector<float>& embedding);
+
+    // Feeds the running average used to estimate latency saved by each hit.
+    void recordMissLatency(std::chrono::microseconds latency);
+
+    // Locks every shard to count entries; for reporting, not per request
+    Stats stats() const;
+    // Hits plus misses so far, without locking
+    std::uint64_t lookups() const {
+        return hits_.load(std::memory_order_relaxed) + misses_.load(std::memory_order_relaxed);
+    }
+    int dimension() const { return dimension_; }
+    bool persistent() const { return mapped_; }
+
+private:
+    struct RecordHeader {
+        std::uint64_t hi;
+        std::uint64_t lo;
+        std::uint64_t tick;
+        std::uint32_t valid;
+        std::uint32_t reserved;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<std::size_t> lru;  // record indexes, most recent first
+        std::unordered_map<Hash128, std::list<std::size_t>::iterator, Hash128Hasher> index;
+        std::vector<std::size_t> freeRecords;
+    };
+
+    std::size_t capacity_;
+    std::size_t perShard_;
+    int dimension_;
+    std::size_t recordSize_;
+    std::string persistPath_;
+    bool mapped_ = false;
+    int fd_ = -1;
+    std::size_t mappedBytes_ = 0;
+    unsigned char* base_ = nullptr;        // file header (mapped) or slab start (heap)
+    std::vector<unsigned char> heapSlab_;
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<std::uint64_t> tick_{0};
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    std::atomic<std::uint64_t> inserts_{0};
+    std::atomic<std::uint64_t> evictions_{0};
+    std::atomic<std::uint64_t> savedMicros_{0};
+    std::atomic<std::uint64_t> avgMissMicros_{0};
+
+    bool openMapped();
+    void loadRecords();
+    std::size_t shardFor(const Hash128& key) const;
+    RecordHeader* record(std::size_t index) const;
+    float* vectorAt(std::size_t index) const;
+};
@@ -2,16 +2,23 @@
 
 #include <vector>
 #include <string>
+#include "deadline.h"
+#include "single_flight.h"
 
 class LlamaCppClient;
+class EmbeddingCache;
 
 class EmbeddingGenerator {
 public:
-    explicit EmbeddingGenerator(LlamaCppClient* client, int expectedDimension = 384);
-    std::vector<float> generate(const std::string& text) const;
+    explicit EmbeddingGenerator(LlamaCppClient* client, int expectedDimension = 384, EmbeddingCache* cache = nullptr);
+    // Empty on failure; throws DeadlineExceeded if `deadline` passes first
+    std::vector<float> generate(const std::string& text, const Deadline& deadline = Deadline()) const;
     int expectedDimension() const { return expectedDimension_; }
 
 private:
     LlamaCppClient* client_;
     int expectedDimension_;
+    EmbeddingCache* cache_;
+    // Concurrent requests for the same text wait on a single /embedding call
+    mutable SingleFlight<std::string, std::vector<float>> inflight_;
 };
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// 128-bit content hash used for cache keys where a collision would hand one
+// user another user's data (embeddings, token counts). MurmurHash3 x64_128.
+struct Hash128 {
+    std::uint64_t hi = 0;
+    std::uint64_t lo = 0;
+
+    bool operator==(const Hash128& other) const { return hi == other.hi && lo == other.lo; }
+    bool operator!=(const Hash128& other) const { return !(*this == other); }
+};
+
+struct Hash128Hasher {
+    std::size_t operator()(const Hash128& h) const { return static_cast<std::size_t>(h.lo ^ (h.hi * 0x9E3779B97F4A7C15ULL)); }
+};
+
+Hash128 hash128(const void* data, std::size_t length, std::uint64_t seed = 0);
+
+inline Hash128 hash128(std::string_view text, std::uint64_t seed = 0) {
+    return hash128(text.data(), text.size(), seed);
+}
+
+std::string toHex(const Hash128& hash);
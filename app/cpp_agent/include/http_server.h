@@ -4,12 +4,17 @@
 #include <string>
 #include <thread>
 #include <atomic>
+#include <memory>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <jsoncpp/json/json.h>
 #include "agent_manager.h"
 #include "config.h"
+#include "rate_limiter.h"
+#include "traffic_capture.h"
+
+class JobQueue;
 
 class HTTPServer {
 private:
@@ -18,15 +23,25 @@ private:
     std::atomic<bool> running;
     std::thread serverThread;
     AgentManager& agentManager;
+    JobQueue* jobQueue;  // nullptr when the job subsystem is disabled or unavailable
     Config& config;  // Add config reference for model path resolution
+    std::unique_ptr<RateLimiter> rateLimiter;  // nullptr when rate limiting is disabled
+    std::unique_ptr<TrafficCapture> capture;  // nullptr when capture is disabled
     static const int REQUEST_TIMEOUT = 300;  // 5 minutes
     
     void handleClient(int clientSocket);
-    std::string parseHTTPRequest(const std::string& request, std::string& method, std::string& path);
-    std::string createHTTPResponse(int statusCode, const std::string& body, const std::string& contentType = "application/json");
     
 public:
-    HTTPServer(int port, AgentManager& manager, Config& cfg);
+    // Request parsing and response framing; static so they can be exercised
+    // without a socket (bench/)
+    static std::string parseHTTPRequest(const std::string& request, std::string& method, std::string& path);
+    // Case-insensitive header lookup; empty if absent
+    static std::string headerValue(const std::string& request, const std::string& name);
+    static std::string createHTTPResponse(int statusCode, const std::string& body,
+                                          const std::string& contentType = "application/json",
+                                          const std::string& extraHeaders = "");
+
+    HTTPServer(int port, AgentManager& manager, Config& cfg, JobQueue* jobs = nullptr);
     ~HTTPServer();
     
     void start();
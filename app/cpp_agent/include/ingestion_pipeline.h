@@ -0,0 +1,106 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "chunker.h"
+#include "simhash.h"
+#include "thread_pool.h"
+
+class Database;
+class LlamaCppClient;
+struct IndexableContent;
+
+struct IngestionConfig {
+    int workers = 4;             // concurrent /embedding requests
+    int batchSize = 16;          // chunks per /embedding request
+    int maxInFlightBatches = 8;  // chunked batches waiting for a worker
+    int insertRows = 64;         // rows per INSERT into content_embeddings
+    int chunkSize = 750;
+    int chunkOverlap = 150;
+    // When > 0, chunks are sized in tokens of the embedding model instead of
+    // chunkSize bytes (falling back to bytes if the text cannot be tokenized)
+    int chunkTokens = 0;
+    int chunkOverlapTokens = 32;
+    // Chunks whose SimHash is within this many bits of a stored chunk are
+    // recorded as duplicates of it instead of being embedded; < 0 disables
+    int dedupDistance = 6;
+    // Fraction of its workers' time the pipeline may keep llama-server busy
+    double backendShare = 1.0;
+};
+
+struct IngestionOptions {
+    // Re-embed documents that already have embeddings
+    bool force = false;
+    // Written into every chunk's metadata for vectorSearch filtering
+    std::string agentScope;
+    // Extra string fields for chunk_metadata
+    std::map<std::string, std::string> metadata;
+    // Rows go here instead of content_embeddings (a re-embedding shadow table)
+    std::string table = "content_embeddings";
+    // Update has_embeddings/embedding_count on educational_content
+    bool markContent = true;
+    // Nothing else writes `table` while this pipeline lives, so its chunk
+    // signatures are loaded once instead of at the start of every run
+    bool exclusiveTable = false;
+};
+
+struct IngestionStats {
+    int documents = 0;  // fully embedded and stored
+    int skipped = 0;    // already embedded (without force), empty or missing
+    int failed = 0;
+    int chunks = 0;
+    int duplicates = 0;  // chunks collapsed into an existing chunk, not embedded
+    double seconds = 0.0;
+};
+
+// Chunks documents, embeds the chunks in batches and bulk-inserts them into
+// content_embeddings, then marks the documents embedded. Each chunk is
+// stored with its token count under the embedding model, so prompt assembly
+// does not have to tokenize retrieved chunks again. A chunk that nearly
+// repeats one already stored (SimHash within dedupDistance bits) is not
+// embedded; it is recorded as a back-reference to that canonical chunk.
+//
+// The calling thread loads and chunks documents and pushes batches into a
+// bounded queue; each batch is embedded by a task on the pool; a store
+// thread collects the results into multi-row inserts. Both queues are
+// bounded, so chunking never runs more than a few batches ahead of
+// llama-server and embeddings never pile up behind a slow database. A
+// document's old rows are replaced only once all its chunks have embedded.
+class IngestionPipeline {
+public:
+    IngestionPipeline(Database& database, LlamaCppClient& client, const IngestionConfig& config);
+    ~IngestionPipeline();
+
+    IngestionStats run(const std::vector<int>& contentIds, const IngestionOptions& options);
+    // Documents supplied by the caller; rows for their contentIds are replaced
+    IngestionStats run(const std::vector<IndexableContent>& documents, const IngestionOptions& options);
+
+private:
+    struct Batch;
+    struct Document;
+
+    Database& database_;
+    LlamaCppClient& client_;
+    IngestionConfig config_;
+    Chunker chunker_;
+    Chunker tokenChunker_;  // chunkTokens / chunkOverlapTokens, measured in tokens
+    WorkStealingPool pool_;
+    std::mutex runMutex_;  // one run at a time; they would share the pool and connection
+    std::map<std::string, std::unique_ptr<SimHashIndex>> signatures_;  // per embeddings table
+
+    template <typename Load>
+    IngestionStats execute(std::size_t count, Load load, const IngestionOptions& options);
+    SimHashIndex* signatureIndex(const IngestionOptions& options);
+    void storeRunDuplicates(std::deque<Document>& documents, SimHashIndex& index,
+                            const IngestionOptions& options, IngestionStats& stored);
+    void rollBack(Document& document, SimHashIndex& index, const IngestionOptions& options,
+                  IngestionStats& stored);
+    std::vector<Chunk> chunkText(const IndexableContent& content);
+    void embed(Batch& batch);
+    void embedChunks(Batch& batch, const std::vector<std::string>& texts);
+    std::string chunkMetadata(const IndexableContent& content, const IngestionOptions& options) const;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "config.h"
+#include "database.h"
+
+class AgentManager;
+class Counter;
+class Gauge;
+
+// Thrown by JobQueue::submit when max_queued jobs are already waiting.
+class JobQueueFull : public std::runtime_error {
+public:
+    JobQueueFull() : std::runtime_error("Job queue is full") {}
+};
+
+// Runs long generations (lessons, question banks, outlines) and content
+// indexing off the HTTP request path. Jobs are persisted in generation_jobs through a dedicated
+// database connection and executed by a small worker pool whose size caps how
+// many llama-server slots authoring work can hold at once. Jobs left queued or
+// running by a previous process are picked up again at startup.
+class JobQueue {
+public:
+    JobQueue(const Config& config, AgentManager& agents);
+    // Stops taking new work and waits for in-flight jobs to finish.
+    ~JobQueue();
+
+    // Persists and enqueues a job; returns its id.
+    std::string submit(int userId, int agentId, const std::string& message, const std::string& ragContext);
+    // Same for POST /rag/index: `request` is {contentIds, force, metadata},
+    // indexed for agentId's scope when it is > 0. The job's result is the
+    // ingestion counts as JSON.
+    std::string submitIndexing(int agentId, const std::string& request);
+    bool get(const std::string& jobId, GenerationJob& job);
+
+private:
+    AgentManager& agents_;
+    std::unique_ptr<Database> db_;
+    std::mutex dbMutex_;          // MYSQL handles are not thread-safe
+
+    std::mutex mutex_;
+    std::condition_variable available_;
+    std::deque<std::string> queue_;
+    // Queued and running jobs, plus the most recently finished ones so a
+    // poll right after completion does not need the database.
+    std::unordered_map<std::string, GenerationJob> jobs_;
+    std::list<std::string> finished_;
+    std::size_t maxQueued_;
+    int maxAttempts_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+
+    Gauge* queuedGauge_;
+    Gauge* runningGauge_;
+    Counter* succeeded_;
+    Counter* failed_;
+
+    std::string enqueue(GenerationJob job);
+    void workerLoop();
+    void run(GenerationJob job);
+    void index(GenerationJob& job);
+    void persist(const GenerationJob& job);
+    void recover(int retentionDays);
+    static std::string newJobId();
+};
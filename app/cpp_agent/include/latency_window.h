@@ -0,0 +1,25 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Fixed-size ring of recent latencies with on-demand percentiles. Small
+// enough (a few hundred samples) that sorting a copy per query is cheaper
+// than maintaining a histogram.
+class LatencyWindow {
+public:
+    explicit LatencyWindow(std::size_t capacity = 256);
+
+    void add(std::chrono::microseconds latency);
+    // Latency at quantile `q` (0..1) in microseconds, or -1 with fewer than `minSamples` samples.
+    std::int64_t percentileMicros(double q, std::size_t minSamples = 1) const;
+    std::size_t count() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::int64_t> samples_;
+    std::size_t next_ = 0;
+    std::size_t count_ = 0;
+};
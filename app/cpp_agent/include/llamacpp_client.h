@@ -21,22 +21,156 @@
 #include <string>
 #include <curl/curl.h>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <jsoncpp/json/json.h>
+#include "deadline.h"
+#include "latency_window.h"
+#include "llm_scheduler.h"
+#include "replica_set.h"
+#include "token_counter.h"
+
+class Counter;
+class Histogram;
+
+struct CompletionOptions {
+    int maxTokens = -1;
+    float temperature = -1.0f;
+    // Stable leading part of the prompt (the agent system prompt). Requests
+    // with the same prefix are pinned to the slot already holding it.
+    std::string cachePrefix;
+    // Batch generations give way to interactive ones and are streamed so they
+    // can be interrupted and resumed from their partial output.
+    Priority priority = Priority::Interactive;
+    // Fair-queueing flow (the user) and its weight when slots are contended
+    std::uint64_t flow = 0;
+    double flowWeight = 1.0;
+    // Queueing and the HTTP call are cut off here (throwing DeadlineExceeded
+    // while still queued); callers size maxTokens to fit beforehand.
+    Deadline deadline;
+};
 
 class LlamaCppClient {
 public:
-    LlamaCppClient(const std::string& serverUrl, const std::string& modelPath, int contextLength = 2048, float temperature = 0.7f);
+    LlamaCppClient(const std::string& serverUrl, const std::string& modelPath, int contextLength = 2048,
+                   float temperature = 0.7f, int parallelSlots = 2);
+    // One client over several llama-server processes serving the same model
+    // (e.g. one per NUMA node); requests are balanced across them.
+    LlamaCppClient(const std::vector<std::string>& serverUrls, const std::string& modelPath, int contextLength,
+                   float temperature, int parallelSlots, const LoadBalancerPolicy& policy = LoadBalancerPolicy());
     ~LlamaCppClient();
     std::string generate(const std::string& prompt, int maxTokens = -1, float temperature = -1.0f);
-    std::vector<float> embed(const std::string& text, int expectedDimensions = 384);
+    std::string generate(const std::string& prompt, const CompletionOptions& options);
+    // Batch embeddings queue for a slot behind interactive work like batch
+    // generations do; interactive ones (queries) are not queued. The HTTP
+    // call is cut off at `deadline`, throwing DeadlineExceeded.
+    std::vector<float> embed(const std::string& text, int expectedDimensions = 384,
+                             Priority priority = Priority::Interactive, const Deadline& deadline = Deadline());
+    // Embeds several texts in one /embedding request, results in input order.
+    // Bypasses hedging and queues at batch priority; meant for bulk indexing
+    // rather than the chat path.
+    std::vector<std::vector<float>> embedBatch(const std::vector<std::string>& texts, int expectedDimensions = 384);
+    // Model file name (without directory), used to key caches per model
+    const std::string& modelId() const { return modelId_; }
+    // Context window of a single slot: llama-server splits --ctx-size across --parallel slots
+    int slotContextLength() const { return contextLength_ / replicas_->at(0).slots->slots(); }
+    ReplicaSet& replicas() { return *replicas_; }
+
+    // llama-server response bodies, throwing on malformed JSON or an error
+    // object. Static so they can be exercised without a server (bench/).
+    static Json::Value parseCompletionResponse(const std::string& body);
+    // The vector of an /embedding response (first row when per-token)
+    static std::vector<float> parseEmbeddingResponse(const std::string& body);
+
+    // Token count via llama-server /tokenize; -1 if the server cannot be reached
+    int tokenize(const std::string& text);
+    // Byte offset in `text` where each of its tokens begins, from /tokenize
+    // with pieces; empty if the server is unreachable or the pieces cannot be
+    // lined up with the text (e.g. a normalizing tokenizer)
+    std::vector<std::size_t> tokenStarts(const std::string& text);
+    // Memoizing counter backed by tokenize()
+    TokenCounter& tokenCounter() { return *tokenCounter_; }
+    // Recent decode speed reported by llama-server; -1 until the first completion
+    double msPerToken() const { return msPerToken_.load(std::memory_order_relaxed); }
+
+    // Prefills `prefix` into a slot's KV cache on every replica ahead of the first real request.
+    // With slot persistence enabled the slot state is first restored from, or
+    // afterwards saved to, llama-server's --slot-save-path so later requests
+    // can restore it on demand instead of re-prefilling.
+    bool warmPrefix(const std::string& prefix);
+    void setSlotPersistence(bool enabled) { persistSlots_ = enabled; }
+    void setHedging(const HedgePolicy& policy) { hedge_ = policy; }
+    // Replaces the slot scheduler; call before the client starts serving.
+    void setScheduling(const SchedulerPolicy& policy);
 
 private:
-    std::string serverUrl_;
+    std::string modelId_;
     int contextLength_;
     float temperature_;
-    CURL* curl_;
-    
+    std::unique_ptr<ReplicaSet> replicas_;
+    std::unique_ptr<TokenCounter> tokenCounter_;
+    std::unique_ptr<LlmScheduler> scheduler_;
+    Counter* prefillSavedTokens_;
+    Counter* promptTokens_;
+    Counter* slotAffinityHits_;
+    Counter* slotAffinityMisses_;
+    Counter* slotRestores_;
+    Counter* completionTokens_;
+    Counter* embeddings_;
+    Histogram* generationLatency_;
+    Histogram* embeddingLatency_;
+    bool persistSlots_ = false;
+    std::atomic<double> msPerToken_{-1.0};
+
+    struct HedgeStats {
+        LatencyWindow latency;
+        Counter* sent = nullptr;
+        Counter* won = nullptr;
+    };
+    HedgePolicy hedge_;
+    HedgeStats embedHedge_;
+    HedgeStats generationHedge_;
+
+    using BodySink = std::function<void(const char*, std::size_t)>;
+
     static size_t writeCallback(void* contents, size_t size, size_t nmemb, std::string* userp);
-    std::string makeRequest(const std::string& prompt, int maxTokens = -1, float temperature = -1.0f);
-    std::string performPost(const std::string& path, const Json::Value& payload, long timeoutSeconds);
+    // /completion request body; `timeout` receives the matching transfer timeout
+    Json::Value buildCompletion(const std::string& prompt, int maxTokens, float temperature, int slotId,
+                                long& timeout) const;
+    std::string makeRequest(Replica& replica, const std::string& prompt, int maxTokens = -1,
+                            float temperature = -1.0f, int slotId = -1, const Deadline& deadline = Deadline());
+    // Shortens a transfer timeout to what is left of `deadline`
+    static long capTimeout(long timeoutSeconds, const Deadline& deadline);
+    // Decode speed estimate plus prefill/decode spans from a response's `timings`
+    void recordTimings(const Json::Value& timings);
+    // Throws RequestCancelled if `cancel` is set while the transfer is running.
+    // With a sink the body is handed over as it arrives and nothing is returned.
+    std::string performPost(const std::string& baseUrl, const std::string& path, const Json::Value& payload,
+                            long timeoutSeconds, const std::atomic<bool>* cancel = nullptr,
+                            const BodySink* sink = nullptr);
+    // performPost against a replica, feeding the outcome to its health tracking.
+    // The timeout is cut to `deadline`; running out of that budget throws
+    // DeadlineExceeded and does not count as a replica failure.
+    std::string postTo(Replica& replica, const std::string& path, const Json::Value& payload, long timeoutSeconds,
+                       const std::atomic<bool>* cancel = nullptr, const BodySink* sink = nullptr,
+                       const Deadline& deadline = Deadline());
+    // Takes the slot holding `prefix` on `replica`, restoring saved state when worthwhile
+    SlotTracker::Assignment claimSlot(Replica& replica, const Hash128& prefix);
+    // Batch generation that yields its slot when preempted and continues from the partial output
+    std::string generateResumable(const std::string& prompt, const CompletionOptions& options);
+    // Streams one completion into `output`; false if `cancel` interrupted it
+    bool streamCompletion(Replica& replica, const Json::Value& request, long timeoutSeconds,
+                          const Deadline& deadline, const std::atomic<bool>* cancel, std::string& output, int& produced, Json::Value& final);
+    // postTo with a hedge to a second replica after the stats' percentile delay.
+    // `hedgePayload` is sent to the second replica (e.g. without a slot pin).
+    std::string postHedged(Replica& primary, const std::string& path, const Json::Value& payload,
+                           const Json::Value& hedgePayload, long timeoutSeconds, HedgeStats& stats,
+                           const Deadline& deadline = Deadline());
+    bool warmPrefixOn(Replica& replica, const std::string& prefix);
+    std::string slotStateFile(const Hash128& prefix) const;
+    bool hasSavedState(Replica& replica, const Hash128& prefix);
+    // POST /slots/{id}?action=save|restore
+    bool slotAction(Replica& replica, int slot, const std::string& action, const std::string& filename);
 };
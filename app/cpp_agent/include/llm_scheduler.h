@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "deadline.h"
+
+class Counter;
+class Gauge;
+
+enum class Priority { Interactive = 0, Batch = 1 };
+
+struct SchedulerPolicy {
+    int interactiveReservedSlots = 1;  // slots batch work may never occupy
+    bool preemptBatch = true;          // interactive arrivals may interrupt running batch work
+    int maxPreemptions = 3;            // after this many a batch task runs to completion
+};
+
+// Admission control in front of one model's llama-server slots. Interactive
+// requests are always admitted ahead of batch ones, batch work is kept out of
+// the reserved slots, and when every slot is busy an interactive arrival asks
+// a running batch task to stop at its next checkpoint (see Lease::preempt).
+// Within a class, waiting requests are served by start-time fair queueing
+// over their flow (the user), so one user's burst queues behind everyone
+// else's next request instead of in front of it.
+class LlmScheduler {
+public:
+    struct Lease {
+        Priority priority = Priority::Interactive;
+        // Set by the scheduler when a batch task should yield its slot.
+        std::shared_ptr<std::atomic<bool>> preempt;
+        std::list<std::shared_ptr<std::atomic<bool>>>::iterator position;
+        bool preemptible = false;
+    };
+
+    LlmScheduler(int slots, const SchedulerPolicy& policy, const std::string& model);
+
+    // Blocks until the request may use a slot. A batch lease that is not
+    // preemptible will not be interrupted. Requests of the same `flow` share
+    // one fair-queueing share scaled by `weight`; flow 0 is anonymous.
+    // Throws DeadlineExceeded if no slot frees up before `deadline`.
+    Lease acquire(Priority priority, bool preemptible = true, std::uint64_t flow = 0, double weight = 1.0,
+                  const Deadline& deadline = Deadline());
+    // Takes a slot only if one is free now and no request of `priority` is
+    // queued for it; never waits. For speculative work such as hedges.
+    bool tryAcquire(Priority priority, Lease& lease);
+    void release(Lease& lease);
+
+    const SchedulerPolicy& policy() const { return policy_; }
+    void recordPreemption();
+
+private:
+    int slots_;
+    SchedulerPolicy policy_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    int running_[2] = {0, 0};
+    int waiting_[2] = {0, 0};
+    // Fair queueing per class: waiting tickets ordered by (start tag, arrival),
+    // the virtual time, and each flow's last finish tag while it is ahead of it
+    std::set<std::pair<double, std::uint64_t>> queue_[2];
+    double virtualTime_[2] = {0.0, 0.0};
+    std::unordered_map<std::uint64_t, double> finishTags_[2];
+    std::uint64_t nextTicket_ = 0;
+    // Running preemptible batch leases, oldest first
+    std::list<std::shared_ptr<std::atomic<bool>>> batch_;
+
+    Gauge* runningGauge_[2];
+    Gauge* waitingGauge_[2];
+    Counter* waitMicros_[2];
+    Counter* preemptions_;
+
+    bool admissible(Priority priority) const;
+    void requestPreemption();
+    void publish();
+};
+
+// Returns a lease to the scheduler when it goes out of scope.
+class LeaseGuard {
+public:
+    LeaseGuard(LlmScheduler* scheduler, LlmScheduler::Lease lease) : scheduler_(scheduler), lease_(std::move(lease)) {}
+    ~LeaseGuard() {
+        if (scheduler_) scheduler_->release(lease_);
+    }
+    LeaseGuard(const LeaseGuard&) = delete;
+    LeaseGuard& operator=(const LeaseGuard&) = delete;
+
+    const std::atomic<bool>* preempt() const { return lease_.preempt.get(); }
+
+private:
+    LlmScheduler* scheduler_;
+    LlmScheduler::Lease lease_;
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class LogLevel : int { Debug = 0, Info = 1, Warn = 2, Error = 3, Off = 4 };
+
+// Levels below this are compiled out: the statement, including the
+// formatting of its arguments, never runs. Set from CMake (AGENT_LOG_LEVEL).
+#ifndef AGENT_LOG_COMPILED_LEVEL
+#define AGENT_LOG_COMPILED_LEVEL 0
+#endif
+
+// Unknown names fall back to `fallback`.
+LogLevel parseLogLevel(const std::string& name, LogLevel fallback = LogLevel::Info);
+
+struct LogOptions {
+    LogLevel level = LogLevel::Info;
+    bool json = false;                   // one JSON object per line instead of plain text
+    std::size_t bufferBytes = 256 * 1024;  // per thread; lines that do not fit are dropped
+    int flushIntervalMs = 50;
+};
+
+// Asynchronous logger. Each thread appends finished lines to its own
+// single-producer ring buffer, so logging is a memcpy and a release store and
+// never waits on stdout. A background thread drains the buffers, orders the
+// batch by timestamp and writes it with one fwrite per stream. When a
+// buffer is full the line is dropped and counted rather than blocking the
+// request thread. Until start() is called (and after stop()) lines are
+// written synchronously, which keeps startup output and CLI tools simple.
+class Logger {
+public:
+    static Logger& instance();
+
+    void start(const LogOptions& options);
+    // Drains everything buffered and stops the writer thread.
+    void stop();
+
+    bool enabled(LogLevel level) const {
+        return static_cast<int>(level) >= level_.load(std::memory_order_relaxed);
+    }
+    void write(LogLevel level, const char* text, std::size_t size);
+
+    std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    Logger() = default;
+
+    struct ThreadBuffer {
+        std::unique_ptr<char[]> data;
+        std::size_t capacity = 0;  // power of two
+        std::atomic<std::uint64_t> head{0};  // written by the owning thread
+        std::atomic<std::uint64_t> tail{0};  // written by the writer thread
+        std::atomic<bool> inUse{false};
+    };
+
+    struct Record {
+        std::int64_t timeUs;
+        LogLevel level;
+        std::string text;
+    };
+
+    friend struct LogBufferHolder;
+
+    std::atomic<int> level_{static_cast<int>(LogLevel::Info)};
+    std::atomic<bool> running_{false};
+    std::atomic<int> writers_{0};  // write() calls that may be appending to a buffer
+    std::atomic<std::uint64_t> dropped_{0};
+    bool json_ = false;
+    std::size_t bufferBytes_ = 256 * 1024;
+    int flushIntervalMs_ = 50;
+
+    std::mutex buffersMutex_;  // registration and draining only
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    std::uint64_t reportedDrops_ = 0;  // under buffersMutex_
+
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread writer_;
+    std::mutex syncMutex_;  // synchronous mode
+
+    ThreadBuffer* localBuffer();
+    void run();
+    void drain();
+    std::string format(const Record& record) const;
+};
+
+// Fixed-point formatting for the next floating point value, e.g.
+// `<< logFixed(2) << similarity` (std::fixed + std::setprecision(2)).
+struct LogFixed {
+    int precision;
+};
+inline LogFixed logFixed(int precision) { return LogFixed{precision}; }
+
+// One log line, built on the stack and handed to the logger when the
+// statement ends. Lines longer than kMaxLine are truncated.
+class LogLine {
+public:
+    explicit LogLine(LogLevel level, std::uint64_t suppressed = 0) : level_(level), suppressed_(suppressed) {}
+    ~LogLine();
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    LogLine& operator<<(std::string_view text) {
+        append(text.data(), text.size());
+        return *this;
+    }
+    LogLine& operator<<(const std::string& text) { return *this << std::string_view(text); }
+    LogLine& operator<<(const char* text) { return *this << std::string_view(text ? text : "(null)"); }
+    LogLine& operator<<(char c) {
+        append(&c, 1);
+        return *this;
+    }
+    LogLine& operator<<(LogFixed fixed) {
+        precision_ = fixed.precision;
+        return *this;
+    }
+    LogLine& operator<<(double value);
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, char>::value, int>::type = 0>
+    LogLine& operator<<(T value) {
+        if (std::is_signed<T>::value) {
+            appendSigned(static_cast<long long>(value));
+        } else {
+            appendUnsigned(static_cast<unsigned long long>(value));
+        }
+        return *this;
+    }
+
+    // Enums (CURLcode, ...) print as their numeric value, as with iostreams
+    template <typename T, typename std::enable_if<std::is_enum<T>::value, int>::type = 0>
+    LogLine& operator<<(T value) {
+        return *this << static_cast<typename std::underlying_type<T>::type>(value);
+    }
+
+    static constexpr std::size_t kMaxLine = 2048;
+
+private:
+    LogLevel level_;
+    std::uint64_t suppressed_;
+    int precision_ = -1;
+    std::size_t size_ = 0;
+    char buffer_[kMaxLine];
+
+    void append(const char* data, std::size_t size);
+    void appendSigned(long long value);
+    void appendUnsigned(unsigned long long value);
+};
+
+// Lets at most `perSecond` lines a second through from one call site; the
+// rest are counted and reported on the next line that gets through.
+class LogSampler {
+public:
+    explicit LogSampler(std::uint32_t perSecond) : perSecond_(perSecond) {}
+    bool allow(std::uint64_t& suppressed);
+
+private:
+    std::uint32_t perSecond_;
+    std::atomic<std::uint64_t> window_{0};  // second << 32 | lines allowed in it
+    std::atomic<std::uint64_t> suppressed_{0};
+};
+
+#define AGENT_LOG_ENABLED(level) \
+    (static_cast<int>(level) >= AGENT_LOG_COMPILED_LEVEL && Logger::instance().enabled(level))
+
+#define AGENT_LOG(level) \
+    if (!AGENT_LOG_ENABLED(level)) {} else LogLine(level)
+
+// For lines emitted per item in a loop (per candidate, per chunk): each call
+// site gets its own sampler, so a busy site cannot flood the log.
+#define AGENT_LOG_SAMPLED(level, perSecond)                                                            \
+    if (!AGENT_LOG_ENABLED(level)) {                                                                   \
+    } else if (std::uint64_t logSuppressed = 0;                                                        \
+               ![]() -> LogSampler& { static LogSampler sampler(perSecond); return sampler; }().allow( \
+                   logSuppressed)) {                                                                   \
+    } else LogLine(level, logSuppressed)
+
+#define LOG_DEBUG AGENT_LOG(LogLevel::Debug)
+#define LOG_INFO AGENT_LOG(LogLevel::Info)
+#define LOG_WARN AGENT_LOG(LogLevel::Warn)
+#define LOG_ERROR AGENT_LOG(LogLevel::Error)
+#define LOG_DEBUG_SAMPLED(perSecond) AGENT_LOG_SAMPLED(LogLevel::Debug, perSecond)
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide metrics registry rendered in Prometheus text format by
+// GET /metrics. Metric objects are created once and never removed, so callers
+// may cache the returned references and update them without locking.
+//
+// Recording is wait-free: counters are spread over cache-line-sized shards
+// picked per thread, so request threads bumping the same counter do not
+// bounce one cache line between cores; reads sum the shards.
+class Counter {
+public:
+    void inc(std::uint64_t delta = 1) { shards_[shardIndex()].value.fetch_add(delta, std::memory_order_relaxed); }
+    std::uint64_t value() const;
+
+    static constexpr std::size_t kShards = 16;
+    // Per-thread shard, assigned round-robin on first use
+    static std::size_t shardIndex();
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<std::uint64_t> value{0};
+    };
+    Shard shards_[kShards];
+};
+
+class Gauge {
+public:
+    void set(std::int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    void add(std::int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+    std::int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::int64_t> value_{0};
+};
+
+// HDR-style latency histogram over microseconds: exact below 32us, then 32
+// log-linear sub-buckets per power of two (at most ~3% relative error) up to
+// ~2^40us. observe() is two relaxed increments and a bit scan. The
+// Prometheus `le` bounds are only used when rendering, so they can change
+// without losing history.
+class Histogram {
+public:
+    explicit Histogram(std::vector<double> bounds);
+    void observe(double seconds) { observeMicros(static_cast<std::int64_t>(seconds * 1e6)); }
+    void observeMicros(std::int64_t micros);
+
+    const std::vector<double>& bounds() const { return bounds_; }
+    // Observations at or below `seconds`, interpolated within the straddling bucket
+    std::uint64_t countAtOrBelow(double seconds) const;
+    std::uint64_t count() const;
+    double sum() const { return static_cast<double>(sumMicros_.value()) / 1e6; }
+    // Approximate q-quantile in seconds; 0 when empty
+    double quantile(double q) const;
+
+    // 1ms .. 5min, suited to everything from a vector search to a long generation
+    static const std::vector<double>& latencyBounds();
+
+private:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr int kMaxOctave = 40;
+    static constexpr std::size_t kBuckets = (kMaxOctave - kSubBucketBits + 2) << kSubBucketBits;
+
+    static std::size_t bucketFor(std::uint64_t micros);
+    static std::uint64_t bucketUpper(std::size_t index);  // exclusive, in microseconds
+
+    std::vector<double> bounds_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> counts_;
+    Counter sumMicros_;
+};
+
+// Observes the time from construction to destruction into `histogram`.
+class LatencyObserver {
+public:
+    explicit LatencyObserver(Histogram* histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~LatencyObserver() {
+        histogram_->observeMicros(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+    }
+    LatencyObserver(const LatencyObserver&) = delete;
+    LatencyObserver& operator=(const LatencyObserver&) = delete;
+
+private:
+    Histogram* histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+class Metrics {
+public:
+    static Metrics& instance();
+
+    // `labels` is the already formatted label set without braces, e.g.
+    // model="qwen2.5-3b". The same name/labels pair always returns the same object.
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "",
+                         const std::vector<double>& bounds = Histogram::latencyBounds());
+
+    std::string renderPrometheus() const;
+
+private:
+    Metrics() = default;
+
+    struct Family {
+        std::string help;
+        std::string type;
+        std::map<std::string, std::unique_ptr<Counter>> counters;
+        std::map<std::string, std::unique_ptr<Gauge>> gauges;
+        std::map<std::string, std::unique_ptr<Histogram>> histograms;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family> families_;
+};
+
+// Formats a single label pair, escaping the value as Prometheus requires.
+std::string metricLabel(const std::string& name, const std::string& value);
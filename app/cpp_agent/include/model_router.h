@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "latency_window.h"
+
+class Counter;
+class LlamaCppClient;
+
+enum class RequestClass { Short = 0, Chat = 1, Generation = 2 };
+
+// Maps agent model names to llama-server clients. Names are resolved once,
+// by exact name or explicit alias, never by substring. Routing rules can move
+// a request class to a different model based on measured latency.
+class ModelRouter {
+public:
+    struct Backend {
+        std::string name;
+        LlamaCppClient* client = nullptr;
+        LatencyWindow latency[3];   // per RequestClass
+        Counter* requests[3] = {nullptr, nullptr, nullptr};
+    };
+
+    ModelRouter(const std::map<std::string, std::shared_ptr<LlamaCppClient>>& clients, const Config& config);
+
+    // Backend for a configured model name or alias; the default model for
+    // anything else. nullptr only when no models are configured.
+    Backend* resolve(const std::string& modelName) const;
+
+    // `hint` is the agent's request_class parameter and wins when set.
+    RequestClass classify(const std::string& message, int maxTokens, const std::string& hint) const;
+
+    // Applies the routing rule for `requestClass`, if any; otherwise `pinned`.
+    Backend* route(Backend* pinned, RequestClass requestClass);
+
+    void record(Backend* backend, RequestClass requestClass, std::chrono::microseconds latency);
+
+    static const char* className(RequestClass requestClass);
+
+private:
+    struct Rule {
+        std::vector<Backend*> candidates;   // in preference order
+        int maxLatencyMs = 0;               // 0: always take the first candidate
+        std::atomic<std::uint64_t> routed{0};
+    };
+
+    std::map<std::string, std::unique_ptr<Backend>> backends_;
+    std::map<std::string, Backend*> aliases_;
+    Backend* default_ = nullptr;
+    std::unique_ptr<Rule> rules_[3];
+    int shortMaxChars_;
+    int generationMinTokens_;
+
+    Backend* lookup(const std::string& name) const;
+};
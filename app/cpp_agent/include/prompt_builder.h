@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "database.h"
+#include "rag_engine.h"
+
+class TokenCounter;
+
+// How much of the RAG context budget a single prompt used.
+struct PromptBudget {
+    int contextTokens = 0;      // per-slot context window
+    int reservedTokens = 0;     // max_tokens reserved for the completion
+    int fixedTokens = 0;        // system prompt + student turn + scaffolding
+    int budgetTokens = 0;       // left over for retrieved knowledge
+    int usedTokens = 0;
+    int chunksOffered = 0;
+    int chunksInjected = 0;
+    bool truncated = false;     // the best chunk was cut at a sentence/word boundary
+
+    double fill() const { return budgetTokens > 0 ? static_cast<double>(usedTokens) / budgetTokens : 0.0; }
+};
+
+// Assembles the agent prompt, packing retrieved chunks into whatever the
+// model's context window has left after the system prompt, the student turn
+// and the completion reservation. Sizes are in real tokens.
+class PromptBuilder {
+public:
+    PromptBuilder(TokenCounter& counter, int contextTokens);
+
+    std::string build(const Agent& agent,
+                      const std::string& userMessage,
+                      const std::vector<RetrievedChunk>& chunks,
+                      int maxTokens,
+                      PromptBudget* budget = nullptr) const;
+
+private:
+    TokenCounter& counter_;
+    int contextTokens_;
+
+    int chunkTokens(const RetrievedChunk& chunk) const;
+    std::string truncateToTokens(const std::string& text, int tokens) const;
+};
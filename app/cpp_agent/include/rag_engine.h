@@ -4,11 +4,16 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include "deadline.h"
+#include "ingestion_pipeline.h"
 
 // Forward declarations
 class Database;
 class LlamaCppClient;
 class EmbeddingGenerator;
+class EmbeddingCache;
 
 struct RetrievedChunk {
     int contentId;
@@ -18,6 +23,8 @@ struct RetrievedChunk {
     std::string gradeLevel;
     std::string subject;
     std::string agentScope;
+    int tokenCount = -1;  // precomputed token count of `text`, -1 if unknown
+    std::string tokenizer;  // model tokenCount was counted with
 };
 
 struct RAGSearchContext {
@@ -25,9 +32,12 @@ struct RAGSearchContext {
     std::string agentScope;
     std::string gradeLevel;
     std::string subject;
-    int topK = -1;
+    int topK = -1;             // distinct documents to return
+    int chunksPerContent = 1;  // best chunks kept per document
     float similarityThreshold = -1.0f;
     std::string metric;
+    // Retrieval gives up (returning nothing) once this passes
+    Deadline deadline;
 };
 
 class RAGEngine {
@@ -38,12 +48,26 @@ private:
     int defaultTopK_;
     float similarityThreshold_;
     std::string metric_;
+    IngestionConfig ingestionConfig_;
+    std::mutex ingestionMutex_;
+    std::unique_ptr<IngestionPipeline> ingestion_;  // created on first use
+    // Chunk rows fetched per requested document, learned from how many rows
+    // recent searches needed to find topK distinct documents
+    std::atomic<double> overfetch_;
+
+    IngestionPipeline* ingestion();
 
 public:
-    RAGEngine(Database* db, LlamaCppClient* llamaClient);
+    RAGEngine(Database* db, LlamaCppClient* llamaClient, EmbeddingCache* embeddingCache = nullptr);
     ~RAGEngine();
     
+    // Throws DeadlineExceeded if context.deadline passes while the query is embedded
     std::vector<RetrievedChunk> search(const RAGSearchContext& context, const std::string& query);
+    // Call before the first indexContent()
+    void setIngestion(const IngestionConfig& config) { ingestionConfig_ = config; }
+    // Chunks, embeds and stores educational_content rows (replacing their old chunks)
+    IngestionStats indexContent(const std::vector<int>& contentIds, const IngestionOptions& options);
+    // Indexes `content` as the text of educational_content row `documentId`
     void indexDocument(int agentId, int documentId, const std::string& content);
 };
 
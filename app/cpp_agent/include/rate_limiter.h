@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+
+class Counter;
+
+// Per-agent traffic allowance for a single user.
+struct UserQuota {
+    double requestsPerMinute = 20.0;  // <= 0 disables the limit
+    double burst = 5.0;
+    double weight = 1.0;              // share of a model's queue when users compete for slots
+};
+
+struct RateLimitPolicy {
+    bool enabled = true;
+    UserQuota defaults;
+    std::map<int, UserQuota> agents;  // overrides by agent id
+    std::set<int> exemptUsers = {0, 1};  // system accounts driving the authoring pipelines
+    int maxTrackedUsers = 16384;      // fixed table size; idle users are recycled
+    int shards = 64;
+
+    const UserQuota& forAgent(int agentId) const {
+        auto it = agents.find(agentId);
+        return it != agents.end() ? it->second : defaults;
+    }
+};
+
+// Token buckets per (user, agent), checked at the /agent/chat entry before
+// any database or model work is done. Buckets live in a fixed-size table
+// split into shards by user hash; lookups and updates are single CAS
+// operations, so request threads never block on each other. When a shard
+// is full the least recently used bucket in the probe window is recycled,
+// which is exact for any user idle long enough for their bucket to refill.
+class RateLimiter {
+public:
+    explicit RateLimiter(const RateLimitPolicy& policy);
+
+    // Takes one request from the bucket. On refusal `retryAfterSeconds`
+    // holds the time until the next request would be allowed.
+    bool tryAcquire(int userId, int agentId, int& retryAfterSeconds);
+
+private:
+    // state = last update (centiseconds since epoch_) << kTokenBits | millitokens.
+    // 40 bits of centiseconds last for centuries, so an idle bucket never
+    // appears to have been updated in the future.
+    static constexpr int kTokenBits = 24;
+    static constexpr std::uint64_t kTokenMask = (std::uint64_t(1) << kTokenBits) - 1;  // also caps the burst
+
+    struct Entry {
+        std::atomic<std::uint64_t> key{0};
+        std::atomic<std::uint64_t> state{0};
+    };
+
+    RateLimitPolicy policy_;
+    std::size_t shardCount_;
+    std::size_t shardSize_;
+    std::unique_ptr<Entry[]> entries_;
+    std::chrono::steady_clock::time_point epoch_;
+
+    Counter* allowed_;
+    Counter* limited_;
+    Counter* evictions_;
+
+    Entry* find(std::uint64_t key, std::uint64_t now);
+    std::uint64_t nowTicks() const;
+};
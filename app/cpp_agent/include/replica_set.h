@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "circuit_breaker.h"
+#include "hashing.h"
+#include "slot_tracker.h"
+
+class Counter;
+class Gauge;
+
+struct LoadBalancerPolicy {
+    std::string strategy = "p2c";          // "p2c" (power of two choices) or "least_outstanding"
+    int ejectSeconds = 30;                 // first slow ejection; doubles on repeat, capped at 8x
+    double slowFactor = 3.0;               // eject when EWMA latency exceeds this multiple of the fastest replica
+    int minSamplesForSlow = 20;
+    CircuitBreakerPolicy breaker;          // failed requests are handled by each replica's breaker
+};
+
+// Hedged requests: if the first attempt has not answered by the observed
+// percentile latency, a duplicate goes to another replica and whichever
+// answers first wins; the other is cancelled.
+struct HedgePolicy {
+    bool embeddings = false;
+    bool generations = false;
+    int maxTokens = 256;         // only generations with max_tokens at or below this are hedged
+    double percentile = 0.95;
+    int minDelayMs = 20;
+    int maxDelayMs = 10000;
+    int minSamples = 20;         // no hedging until this many latencies were observed
+};
+
+// Endpoints whose latencies are comparable with each other. Slowness is
+// judged per class, so a replica that happened to serve more completions
+// than embeddings does not look slower than its peers; other calls
+// (/tokenize, slot saves) are not sampled.
+enum class LatencyClass { Completion, Embedding, None };
+constexpr int kLatencyClasses = 2;
+
+LatencyClass latencyClass(const std::string& path);
+
+// One llama-server process serving a model. Everything that lives in that
+// process's memory (slot KV prefixes, saved slot files) is tracked here.
+struct Replica {
+    std::string url;
+    std::unique_ptr<SlotTracker> slots;
+    std::unique_ptr<CircuitBreaker> breaker;
+
+    std::atomic<int> outstanding{0};
+    // Per LatencyClass
+    std::atomic<std::uint64_t> ewmaMicros[kLatencyClasses] = {{0}, {0}};
+    std::atomic<std::uint64_t> samples[kLatencyClasses] = {{0}, {0}};
+    // Consecutive slow ejections; forgotten after a full backoff period
+    // without one
+    std::atomic<int> ejections{0};
+    std::atomic<std::int64_t> ejectedUntilMs{0};
+
+    std::mutex savedMutex;
+    std::unordered_set<Hash128, Hash128Hasher> savedPrefixes;
+
+    Gauge* outstandingGauge = nullptr;
+    Gauge* healthyGauge = nullptr;
+    Counter* requestsCounter = nullptr;
+    Counter* failuresCounter = nullptr;
+    Counter* ejectionsCounter = nullptr;
+
+    bool ejected(std::int64_t nowMs) const { return ejectedUntilMs.load(std::memory_order_relaxed) > nowMs; }
+};
+
+// Client-side balancer over the llama-server replicas of one model.
+// Health is tracked passively from request outcomes: failures trip the
+// replica's circuit breaker, and a replica much slower than its peers is
+// ejected for a cool-down, becoming eligible again once it expires.
+class ReplicaSet {
+public:
+    ReplicaSet(const std::vector<std::string>& urls, int slotsPerReplica, const std::string& model,
+               const LoadBalancerPolicy& policy = LoadBalancerPolicy());
+
+    // Chooses a replica. With a prefix, a replica already holding it in a slot
+    // is preferred unless it is clearly busier than the alternative. Throws
+    // if every replica's circuit breaker is open. A half-open replica is
+    // returned with its probe claimed: send the request to it.
+    Replica& pick(const Hash128* prefix = nullptr);
+    // Like pick() but never returns `exclude`; nullptr if nothing else is available.
+    Replica* tryPick(const Hash128* prefix, const Replica* exclude);
+
+    // Request lifecycle hooks; every onStart must be paired with one outcome.
+    void onStart(Replica& replica);
+    void onSuccess(Replica& replica, std::chrono::microseconds latency, LatencyClass cls = LatencyClass::None);
+    void onFailure(Replica& replica);
+    // Abandoned by the caller (e.g. the losing side of a hedge)
+    void onCancelled(Replica& replica);
+
+    std::size_t size() const { return replicas_.size(); }
+    Replica& at(std::size_t index) { return *replicas_[index]; }
+    std::size_t healthyCount() const;
+
+    static std::int64_t nowMs();
+
+private:
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    LoadBalancerPolicy policy_;
+    std::string model_;
+    Counter* rejections_ = nullptr;
+
+    void eject(Replica& replica, const char* reason);
+    Replica& leastOutstanding(const std::vector<Replica*>& candidates) const;
+    Replica* choose(const Hash128* prefix, const std::vector<Replica*>& available,
+                    const std::vector<Replica*>& healthy) const;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 64-bit SimHash over a text's word 3-shingles (case-insensitive, punctuation
+// ignored). Near-identical texts get signatures a few bits apart; unrelated
+// texts differ in about half of the bits.
+std::uint64_t simhash(std::string_view text);
+
+inline int hammingDistance(std::uint64_t a, std::uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+}
+
+// Retrieval scope of a chunk: the metadata RAG searches filter on. Chunks are
+// only duplicates of chunks in the same scope, since a search restricted to
+// one scope never sees a canonical chunk stored under another.
+std::uint64_t signatureScope(std::string_view agentScope, std::string_view gradeLevel, std::string_view subject);
+
+struct ChunkSignature {
+    int contentId = 0;
+    int chunkIndex = 0;
+    std::uint64_t simhash = 0;
+    std::uint64_t scope = 0;  // signatureScope() of the chunk's metadata
+};
+
+// Signatures of stored chunks, searchable by Hamming distance. Signatures are
+// split into maxDistance + 1 bands; two signatures at most maxDistance bits
+// apart agree on at least one whole band, so only entries sharing a band
+// with the query are compared. Band keys include the scope, so entries of
+// other scopes are never candidates. Not thread-safe.
+class SimHashIndex {
+public:
+    explicit SimHashIndex(int maxDistance = 3);
+
+    // Closest signature of the same scope within maxDistance bits; false if
+    // there is none
+    bool find(std::uint64_t signature, std::uint64_t scope, ChunkSignature& match, int& distance) const;
+    void insert(const ChunkSignature& entry);
+    void removeContent(int contentId);
+    std::size_t size() const { return live_; }
+
+private:
+    int maxDistance_;
+    int bands_;
+    int bandBits_;
+    std::vector<ChunkSignature> entries_;
+    std::vector<bool> removed_;
+    std::vector<std::unordered_map<std::uint64_t, std::vector<std::uint32_t>>> buckets_;  // per band
+    std::unordered_map<int, std::vector<std::uint32_t>> byContent_;
+    std::size_t live_ = 0;
+
+    std::uint64_t band(std::uint64_t signature, std::uint64_t scope, int b) const;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "deadline.h"
+
+// Coalesces identical in-flight calls: the first caller for a key runs the work,
+// later callers with the same key block on the leader's result instead of
+// issuing a duplicate request. Entries are removed as soon as the leader
+// finishes, so this is not a cache - a request that arrives after completion
+// runs again.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class SingleFlight {
+public:
+    // Runs fn() for the first caller of `key`; concurrent callers share its
+    // result (or rethrow its exception). `shared` is set to true for followers.
+    // A follower stops waiting at its `deadline`, throwing DeadlineExceeded.
+    Value run(const Key& key, const std::function<Value()>& fn, bool* shared = nullptr,
+              const Deadline& deadline = Deadline()) {
+        std::shared_future<Value> pending;
+        std::shared_ptr<std::promise<Value>> leader;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = inflight_.find(key);
+            if (it != inflight_.end()) {
+                pending = it->second;
+            } else {
+                leader = std::make_shared<std::promise<Value>>();
+                pending = leader->get_future().share();
+                inflight_.emplace(key, pending);
+            }
+        }
+
+        if (!leader) {
+            coalesced_.fetch_add(1, std::memory_order_relaxed);
+            if (shared) {
+                *shared = true;
+            }
+            if (!deadline.unlimited() && pending.wait_until(deadline.at()) == std::future_status::timeout) {
+                throw DeadlineExceeded("a coalesced call finished");
+            }
+            return pending.get();
+        }
+
+        if (shared) {
+            *shared = false;
+        }
+        leaders_.fetch_add(1, std::memory_order_relaxed);
+
+        try {
+            leader->set_value(fn());
+        } catch (...) {
+            leader->set_exception(std::current_exception());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            inflight_.erase(key);
+        }
+        return pending.get();
+    }
+
+    std::size_t inflight() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return inflight_.size();
+    }
+
+    std::uint64_t leaders() const { return leaders_.load(std::memory_order_relaxed); }
+    std::uint64_t coalesced() const { return coalesced_.load(std::memory_order_relaxed); }
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<Key, std::shared_future<Value>, Hash> inflight_;
+    std::atomic<std::uint64_t> leaders_{0};
+    std::atomic<std::uint64_t> coalesced_{0};
+};
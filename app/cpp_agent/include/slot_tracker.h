@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "hashing.h"
+
+// Tracks which prompt prefix (agent system prompt) each llama-server slot
+// currently holds in its KV cache so requests sharing a prefix can be pinned to
+// the same slot with `id_slot` and skip re-prefilling it.
+class SlotTracker {
+public:
+    struct Assignment {
+        int slot = -1;
+        bool prefixHit = false;   // slot already held this prefix
+        bool idle = false;        // no other request was using the slot
+    };
+
+    explicit SlotTracker(int slots);
+
+    // Picks a slot for a request whose prompt starts with `prefix`:
+    //  1. an idle slot already holding the prefix,
+    //  2. otherwise the least-recently-used idle slot (which is re-labelled),
+    //  3. if every slot is busy, the slot holding the prefix (llama-server
+    //     queues the task) or the least-recently-used slot.
+    Assignment acquire(const Hash128& prefix);
+    void release(int slot);
+
+    // Records that `slot` now holds `prefix` without counting a request,
+    // e.g. after restoring a saved slot state.
+    void assign(int slot, const Hash128& prefix);
+    // Returns the slot holding `prefix`, or -1.
+    int find(const Hash128& prefix) const;
+    // Forgets every slot's prefix (llama-server restarted or was flushed).
+    void reset();
+
+    int slots() const { return static_cast<int>(slots_.size()); }
+    int busy() const;
+
+private:
+    struct Slot {
+        Hash128 prefix;
+        bool hasPrefix = false;
+        int inflight = 0;
+        std::uint64_t lastUsed = 0;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<Slot> slots_;
+    std::uint64_t clock_ = 0;
+};
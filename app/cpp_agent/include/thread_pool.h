@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool with one task deque per worker. Tasks submitted from a
+// worker go to the front of its own deque and are run LIFO while they are
+// still hot; tasks from outside are dealt round-robin. A worker whose deque
+// is empty steals from the back of the others, so one slow task (a
+// llama-server call stuck behind a long generation) does not strand the
+// work queued behind it.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(std::size_t threads);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(std::function<void()> task);
+    std::size_t size() const { return workers_.size(); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<std::size_t> nextQueue_{0};
+    std::atomic<std::size_t> pending_{0};
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+
+    void run(std::size_t self);
+    bool take(std::size_t self, std::function<void()>& task);
+};
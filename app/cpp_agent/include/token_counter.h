@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "hashing.h"
+
+class Counter;
+
+// Counts tokens with the model's real tokenizer (llama-server /tokenize) and
+// memoizes the result per text, so repeated chunks and system prompts are only
+// tokenized once. When the tokenizer is unreachable a conservative byte-based
+// estimate is returned and not cached.
+class TokenCounter {
+public:
+    // Returns the token count, or a negative value on failure.
+    using TokenizeFn = std::function<int(const std::string&)>;
+
+    // `model` labels the token_count_cache_* metrics; empty leaves them unlabelled.
+    explicit TokenCounter(TokenizeFn tokenize, std::size_t capacity = 8192, const std::string& model = "");
+
+    int count(const std::string& text);
+    static int estimate(const std::string& text);
+    // Model whose tokenizer this counts with
+    const std::string& model() const { return model_; }
+
+    std::uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    std::uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    TokenizeFn tokenize_;
+    std::size_t capacity_;
+    std::string model_;
+    std::mutex mutex_;
+    std::list<std::pair<Hash128, int>> lru_;
+    std::unordered_map<Hash128, std::list<std::pair<Hash128, int>>::iterator, Hash128Hasher> index_;
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    Counter* hitsTotal_;
+    Counter* missesTotal_;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Histogram;
+
+// In-process span recorder for the chat pipeline. Each thread writes into its
+// own fixed-size ring buffer, so recording a span is a few relaxed stores and
+// never takes a lock; old spans are overwritten. Buffers are handed back when
+// a thread exits and reused by the next one, which bounds memory by the peak
+// number of concurrent request threads. Spans are exported on demand as Chrome
+// trace event JSON (chrome://tracing, Perfetto).
+//
+// Every span also feeds chat_stage_duration_seconds{stage} so stage latency
+// is visible in /metrics without exporting traces.
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static Tracer& instance();
+
+    // Call before the first span is recorded.
+    void configure(bool enabled, std::size_t spansPerThread);
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    static std::uint64_t newTraceId();
+    // Trace the calling thread is working on (0 = none); set with TraceScope
+    static std::uint64_t currentTrace();
+
+    // `name` must be a string literal or otherwise outlive the tracer.
+    void record(const char* name, Clock::time_point start, Clock::time_point end);
+
+    // Buffered spans as Chrome trace JSON; traceId 0 exports every trace.
+    std::string chromeTraceJson(std::uint64_t traceId = 0) const;
+    bool writeChromeTrace(const std::string& path, std::uint64_t traceId = 0) const;
+
+private:
+    Tracer();
+
+    // Fields are individually atomic so the exporter may read a slot while
+    // its owner overwrites it; `seq` tells it whether the copy is whole.
+    struct Slot {
+        std::atomic<std::uint64_t> seq{0};
+        std::atomic<std::uint64_t> traceId{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<std::int64_t> startUs{0};
+        std::atomic<std::int64_t> durationUs{0};
+        std::atomic<std::uint32_t> threadId{0};
+    };
+
+    struct ThreadBuffer {
+        std::unique_ptr<Slot[]> slots;
+        std::size_t capacity = 0;
+        std::atomic<std::uint64_t> head{0};
+        std::atomic<bool> inUse{false};
+        std::uint32_t threadId = 0;
+        // Owner-thread cache of stage histograms, keyed by name pointer
+        std::vector<std::pair<const char*, Histogram*>> histograms;
+    };
+
+    struct SpanCopy {
+        std::uint64_t traceId;
+        const char* name;
+        std::int64_t startUs;
+        std::int64_t durationUs;
+        std::uint32_t threadId;
+    };
+
+    friend struct ThreadBufferHolder;
+
+    std::atomic<bool> enabled_{true};
+    std::size_t spansPerThread_ = 1024;
+    Clock::time_point epoch_;
+
+    mutable std::mutex buffersMutex_;  // registration and export only
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    std::uint32_t nextThreadId_ = 1;
+
+    ThreadBuffer* localBuffer();
+    static Histogram* stageHistogram(ThreadBuffer& buffer, const char* name);
+    std::vector<SpanCopy> snapshot(std::uint64_t traceId) const;
+};
+
+// Makes `traceId` the calling thread's current trace for its lifetime.
+class TraceScope {
+public:
+    explicit TraceScope(std::uint64_t traceId);
+    ~TraceScope();
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    std::uint64_t previous_;
+};
+
+// Records the enclosing block as a span of the current trace.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : name_(name), start_(Tracer::Clock::now()) {}
+    ~TraceSpan() { Tracer::instance().record(name_, start_, Tracer::Clock::now()); }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;
+    Tracer::Clock::time_point start_;
+};
+
+std::string traceIdHex(std::uint64_t traceId);
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+// What a capture keeps of each request body
+enum class CapturePayload : std::uint8_t { None = 0, Full = 1, Redacted = 2 };
+
+CapturePayload parseCapturePayload(const std::string& name, CapturePayload fallback);
+
+struct CaptureOptions {
+    bool enabled = false;
+    std::string path = "traffic.cap";
+    CapturePayload payload = CapturePayload::Redacted;
+    std::set<std::string> routes = {"/agent/chat", "/jobs"};  // http_* route labels
+    std::size_t bufferBytes = 1024 * 1024;  // records that do not fit are dropped
+    int flushIntervalMs = 200;
+    std::uint64_t maxBytes = 1024ULL * 1024 * 1024;  // file size at which capture stops
+};
+
+struct CapturedRequest {
+    std::int64_t arrivalUs = 0;  // unix time of arrival, microseconds
+    std::uint32_t durationUs = 0;  // read to response sent
+    std::uint16_t status = 0;
+    CapturePayload payload = CapturePayload::None;  // what `body` holds
+    std::uint32_t deadlineMs = 0;  // X-Request-Deadline, 0 when absent
+    std::uint64_t bodyHash = 0;  // captureDigest() of the original body
+    std::uint32_t bodyBytes = 0;  // size of the original body
+    std::string method;
+    std::string path;
+    std::string body;
+};
+
+// Appends requests to a compact binary log for tools/replay.cpp. record()
+// encodes on the calling thread and copies the bytes into a shared buffer
+// under a short lock; a writer thread flushes it every flush interval, so
+// request threads never wait on the disk. Records that do not fit in the
+// buffer are dropped and counted.
+//
+// File: "PHCAP\1\0\0", then records, each a little-endian u32 size followed
+// by arrivalUs (i64), durationUs (u32), status (u16), payload (u8),
+// deadlineMs (u32), bodyHash (u64), bodyBytes (u32), then method and path
+// (u16 length + bytes each) and the stored body (u32 length + bytes).
+// Restarts append to the same file; arrival times are wall-clock anchored.
+//
+// Pseudonyms and body hashes are keyed with a secret drawn when the capture
+// starts and never written out, so they cannot be reversed by hashing
+// guessed words or bodies. They are consistent within one process's records
+// only.
+class TrafficCapture {
+public:
+    // Throws std::runtime_error when the file cannot be opened
+    explicit TrafficCapture(const CaptureOptions& options);
+    ~TrafficCapture();
+
+    bool wants(const std::string& route) const { return options_.routes.count(route) > 0; }
+    void record(std::chrono::steady_clock::time_point received, std::uint32_t durationUs, int status,
+                const std::string& method, const std::string& path, const std::string& body,
+                std::uint32_t deadlineMs);
+
+    std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    CaptureOptions options_;
+    std::string secret_;
+    std::FILE* file_ = nullptr;
+    std::uint64_t fileBytes_ = 0;  // writer thread only
+    bool full_ = false;            // writer thread only
+    // Maps steady-clock arrivals to wall-clock time
+    std::chrono::steady_clock::time_point steadyStart_;
+    std::int64_t unixStartUs_ = 0;
+
+    std::mutex pendingMutex_;
+    std::string pending_;
+    std::atomic<std::uint64_t> dropped_{0};
+
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread writer_;
+
+    void run();
+    void flush();
+};
+
+// First 8 bytes of HMAC-SHA256(secret, data)
+std::uint64_t captureDigest(const std::string& secret, const std::string& data);
+
+// `body` with every JSON string value pseudonymized word by word: each run
+// of letters or digits becomes as many letters or digits derived from its
+// keyed digest. Keys, numbers and structure are kept, and equal words stay
+// equal under one secret, so prompt sizes and cache hit patterns survive;
+// the text does not. Bodies that are not JSON become the same number of 'x'.
+std::string redactPayload(const std::string& body, const std::string& secret);
+
+// Reads a capture file record by record
+class CaptureReader {
+public:
+    // Throws std::runtime_error when the file is missing or not a capture
+    explicit CaptureReader(const std::string& path);
+    ~CaptureReader();
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    // False at the end of the file; a truncated last record counts as the end
+    bool next(CapturedRequest& request);
+
+private:
+    std::FILE* file_ = nullptr;
+};
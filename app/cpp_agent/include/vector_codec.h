@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Text form of a VECTOR column as VEC_FromText / VEC_ToText use it:
+// "[0.12345678,-0.5,...]" with 8 decimals per component.
+std::string serializeVector(const std::vector<float>& embedding);
+// Inverse of serializeVector; brackets are optional and empty fields skipped
+std::vector<float> parseVector(const std::string& text);
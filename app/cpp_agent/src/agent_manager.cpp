@@ -1,35 +1,98 @@
 #include "../include/agent_manager.h"
 #include "../include/llamacpp_client.h"
-#include <iostream>
+#include "../include/embedding_cache.h"
+#include "../include/logger.h"
+#include "../include/metrics.h"
+#include "../include/prompt_builder.h"
+#include "../include/tracer.h"
 #include <sstream>
 #include <algorithm>
-#include <iomanip>
+#include <chrono>
 
-AgentManager::AgentManager(Config& config) : config(config) {
-    std::cout << "Initializing Agent Manager with multi-model support..." << std::endl;
+namespace {
+// Identical completions are only coalesced when their deadlines fall in the same bucket
+constexpr std::int64_t kCoalesceDeadlineBucketMs = 500;
+}
+
+AgentManager::AgentManager(Config& config) : AgentManager(config, nullptr) {}
+
+AgentManager::AgentManager(Config& config, std::unique_ptr<Database> store)
+    : config(config), database(std::move(store)) {
+    LOG_INFO << "Initializing Agent Manager with multi-model support...";
     
-    // Initialize llama.cpp clients for each configured model
+    // Initialize llama.cpp clients for each configured model. A llama-server
+    // has one set of slots whatever model names point at it, so models on
+    // the same server(s) share a client and with it slot tracking and
+    // scheduling; otherwise each would think it had every slot to itself.
+    std::map<std::vector<std::string>, std::vector<std::string>> modelsByUrls;  // sorted replica URLs -> models
+    std::map<std::string, std::string> modelsByUrl;
     for (const auto& [modelName, modelConfig] : config.models) {
-        // Use per-model URL for multi-model support
-        std::string serverUrl = modelConfig.url;
+        // Use per-model URLs for multi-model support; a model may have several replicas
+        std::vector<std::string> urlKey = modelConfig.replicaUrls();
+        std::sort(urlKey.begin(), urlKey.end());
+        if (modelsByUrls.find(urlKey) == modelsByUrls.end()) {
+            for (const auto& url : urlKey) {
+                auto owner = modelsByUrl.find(url);
+                if (owner != modelsByUrl.end()) {
+                    throw std::runtime_error("Models " + owner->second + " and " + modelName + " both use " + url +
+                                             " but list different replicas; give them the same replicas or separate servers");
+                }
+                modelsByUrl[url] = modelName;
+            }
+        }
+        modelsByUrls[urlKey].push_back(modelName);
+    }
+
+    for (const auto& [urlKey, modelNames] : modelsByUrls) {
+        // The shared client takes its name (metrics, slot files) and its
+        // settings from the model the server runs: default_model when it is
+        // one of them, otherwise they must all name the same file.
+        std::string owner = modelNames.front();
+        if (std::find(modelNames.begin(), modelNames.end(), config.defaultModel) != modelNames.end()) {
+            owner = config.defaultModel;
+        } else {
+            for (const auto& modelName : modelNames) {
+                if (config.models.at(modelName).file != config.models.at(owner).file) {
+                    throw std::runtime_error("Models " + owner + " and " + modelName +
+                                             " use the same llama-server but different files; give them separate "
+                                             "servers or make the one it serves default_model");
+                }
+            }
+        }
+
+        const auto& modelConfig = config.models.at(owner);
+        std::vector<std::string> serverUrls = modelConfig.replicaUrls();
         std::string modelPath = config.modelsBasePath + "/" + modelConfig.file;
         
-        std::cout << "Registering model: " << modelName << " at " << serverUrl << std::endl;
+        LOG_INFO << "Registering model: " << owner << " at " << serverUrls.front()
+                 << (serverUrls.size() > 1 ? " (+" + std::to_string(serverUrls.size() - 1) + " replicas)" : "");
         
-        llamaClients[modelName] = std::make_unique<LlamaCppClient>(
-            serverUrl,
+        llamaClients[owner] = std::make_shared<LlamaCppClient>(
+            serverUrls,
             modelPath,
             modelConfig.ctxSize,
-            config.temperature
+            config.temperature,
+            modelConfig.parallel,
+            config.loadBalancing
         );
+        llamaClients[owner]->setSlotPersistence(config.persistSlotStates);
+        llamaClients[owner]->setHedging(config.hedging);
+        llamaClients[owner]->setScheduling(config.scheduling);
+
+        for (const auto& modelName : modelNames) {
+            if (modelName == owner) continue;
+            LOG_WARN << "Model " << modelName << " is served by the same llama-server as " << owner
+                     << "; they share its slots";
+            llamaClients[modelName] = llamaClients[owner];
+        }
     }
     
     // Also create a default client for backward compatibility
     if (llamaClients.empty()) {
         std::string modelPath = config.modelsBasePath + "/" + config.defaultModel;
-        std::cout << "No models configured, using default: " << modelPath << std::endl;
+        LOG_INFO << "No models configured, using default: " << modelPath;
         
-        llamaClients[config.defaultModel] = std::make_unique<LlamaCppClient>(
+        llamaClients[config.defaultModel] = std::make_shared<LlamaCppClient>(
             config.llamaServerUrl,
             modelPath,
             config.maxContextLength,
@@ -37,67 +100,123 @@ AgentManager::AgentManager(Config& config) : config(config) {
         );
     }
     
-    database = std::make_unique<Database>(config.dbHost, config.dbPort, config.dbName, config.dbUser, config.dbPassword);
+    router = std::make_unique<ModelRouter>(llamaClients, config);
+    
+    if (!database) {
+        database = std::make_unique<Database>(config.dbHost, config.dbPort, config.dbName, config.dbUser,
+                                              config.dbPassword);
+    }
 
     LlamaCppClient* ragClient = nullptr;
     if (!llamaClients.empty()) {
-        ragClient = getClientForModel(config.defaultModel);
+        ragClient = router->resolve(config.defaultModel)->client;
     }
-    ragEngine = std::make_unique<RAGEngine>(database.get(), ragClient);
+    if (config.embeddingCacheCapacity > 0) {
+        embeddingCache = std::make_unique<EmbeddingCache>(
+            static_cast<std::size_t>(config.embeddingCacheCapacity),
+            static_cast<std::size_t>(std::max(1, config.embeddingCacheShards)),
+            384,
+            config.embeddingCachePath
+        );
+    }
+    ragEngine = std::make_unique<RAGEngine>(database.get(), ragClient, embeddingCache.get());
+    ragEngine->setIngestion(config.ingestion);
     
-    std::cout << "Agent Manager initialized with " << llamaClients.size() << " model(s)" << std::endl;
+    LOG_INFO << "Agent Manager initialized with " << llamaClients.size() << " model(s)";
+
+    if (config.warmupSystemPrompts) {
+        startPrefixWarmup();
+    }
 }
 
 AgentManager::~AgentManager() {
+    stopping = true;
+    if (warmupThread.joinable()) {
+        warmupThread.join();
+    }
 }
 
-LlamaCppClient* AgentManager::getClientForModel(const std::string& modelName) {
-    // Try exact match first
-    auto it = llamaClients.find(modelName);
-    if (it != llamaClients.end()) {
-        return it->second.get();
+void AgentManager::startPrefixWarmup() {
+    // Read the agent list up front: the database connection is not shared with
+    // the warmup thread, which only talks to llama-server.
+    std::vector<std::pair<LlamaCppClient*, Agent>> targets;
+    try {
+        for (const auto& agent : database->getAllAgents()) {
+            ModelRouter::Backend* backend = router->resolve(agent.modelName);
+            if (backend && !agent.systemPrompt.empty()) {
+                targets.emplace_back(backend->client, agent);
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG_WARN << "[AgentManager] Skipping prefix warmup: " << e.what();
+        return;
     }
-    
-    // Try partial match (e.g., "llama-2-7b-chat" matches "llama-2-7b-chat.Q4_0.gguf")
-    for (auto& [name, client] : llamaClients) {
-        if (name.find(modelName) != std::string::npos || modelName.find(name) != std::string::npos) {
-            std::cout << "Matched model '" << modelName << "' to '" << name << "'" << std::endl;
-            return client.get();
+
+    warmupThread = std::thread([this, targets = std::move(targets)]() {
+        int warmed = 0;
+        for (const auto& [client, agent] : targets) {
+            if (stopping) {
+                break;
+            }
+            if (client->warmPrefix(agent.systemPrompt)) {
+                ++warmed;
+            }
+        }
+        LOG_INFO << "[AgentManager] Prefix warmup finished: " << warmed << "/" << targets.size()
+                 << " agent system prompt(s)";
+    });
+}
+
+ModelRouter::Backend* AgentManager::routeRequest(const Agent& agent, const std::string& message, int maxTokens,
+                                                const std::string& classHint, RequestClass& requestClass) {
+    ModelRouter::Backend* pinned = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(agentMutex);
+        auto it = agentBackends.find(agent.id);
+        if (it != agentBackends.end()) {
+            pinned = it->second;
         }
     }
-    
-    // Fallback to default model
-    std::cout << "Model '" << modelName << "' not found, using default: " << config.defaultModel << std::endl;
-    it = llamaClients.find(config.defaultModel);
-    if (it != llamaClients.end()) {
-        return it->second.get();
+    if (!pinned) {
+        pinned = router->resolve(agent.modelName);
     }
-    
-    // Last resort: return first available client
-    if (!llamaClients.empty()) {
-        return llamaClients.begin()->second.get();
+
+    auto param = agent.parameters.find("request_class");
+    const std::string hint = !classHint.empty() ? classHint : param != agent.parameters.end() ? param->second : "";
+    requestClass = router->classify(message, maxTokens, hint);
+
+    auto routing = agent.parameters.find("model_routing");
+    if (routing != agent.parameters.end() && routing->second == "pinned") {
+        return pinned;
     }
-    
-    return nullptr;
+    return router->route(pinned, requestClass);
 }
 
 Agent AgentManager::loadAgent(int agentId) {
     // Check cache first
-    auto it = agentCache.find(agentId);
-    if (it != agentCache.end()) {
-        return it->second;
+    {
+        std::lock_guard<std::mutex> lock(agentMutex);
+        auto it = agentCache.find(agentId);
+        if (it != agentCache.end()) {
+            return it->second;
+        }
     }
     
-    // Load from database
+    // Load from database and resolve its model once, not per message
     Agent agent = database->getAgent(agentId);
+    ModelRouter::Backend* backend = router->resolve(agent.modelName);
+    
+    std::lock_guard<std::mutex> lock(agentMutex);
     agentCache[agentId] = agent;
+    agentBackends[agentId] = backend;
     
     return agent;
 }
 
-std::vector<RetrievedChunk> AgentManager::retrieveRelevantContext(const Agent& agent, const std::string& query) {
+std::vector<RetrievedChunk> AgentManager::retrieveRelevantContext(const Agent& agent, const std::string& query,
+                                                                  RequestContext* request) {
     if (!ragEngine) {
-        std::cerr << "[AgentManager] RAG engine unavailable" << std::endl;
+        LOG_ERROR << "[AgentManager] RAG engine unavailable";
         return {};
     }
 
@@ -115,7 +234,7 @@ std::vector<RetrievedChunk> AgentManager::retrieveRelevantContext(const Agent& a
         try {
             ctx.topK = std::stoi(customTopK);
         } catch (...) {
-            std::cerr << "[AgentManager] Invalid rag_top_k value for agent " << agent.id << std::endl;
+            LOG_WARN << "[AgentManager] Invalid rag_top_k value for agent " << agent.id;
         }
     }
 
@@ -124,7 +243,7 @@ std::vector<RetrievedChunk> AgentManager::retrieveRelevantContext(const Agent& a
         try {
             ctx.similarityThreshold = std::stof(customThreshold);
         } catch (...) {
-            std::cerr << "[AgentManager] Invalid rag_min_similarity value for agent " << agent.id << std::endl;
+            LOG_WARN << "[AgentManager] Invalid rag_min_similarity value for agent " << agent.id;
         }
     }
 
@@ -139,181 +258,259 @@ std::vector<RetrievedChunk> AgentManager::retrieveRelevantContext(const Agent& a
         ctx.agentScope = getParam("agent_scope");
     }
 
-    auto chunks = ragEngine->search(ctx, query);
+    if (request) {
+        ctx.deadline = request->deadline.share(config.deadlineRagShare);
+    }
+    std::vector<RetrievedChunk> chunks;
+    try {
+        chunks = ragEngine->search(ctx, query);
+    } catch (const DeadlineExceeded& e) {
+        // The query embedding did not come back within the retrieval share
+        LOG_WARN << "[AgentManager] " << e.what() << ", answering without RAG context";
+        if (request) {
+            degrade(*request, "rag_skipped");
+        }
+        return {};
+    }
+    if (request && ctx.deadline.expired()) {
+        degrade(*request, "rag_truncated");
+    }
     if (chunks.empty()) {
-        std::cout << "[AgentManager] No RAG context returned for agent " << agent.id << std::endl;
+        LOG_INFO << "[AgentManager] No RAG context returned for agent " << agent.id;
     } else {
-        std::cout << "[AgentManager] Retrieved " << chunks.size() << " filtered RAG chunk(s) for agent "
-                  << agent.id << std::endl;
+        LOG_INFO << "[AgentManager] Retrieved " << chunks.size() << " filtered RAG chunk(s) for agent "
+                 << agent.id;
     }
     return chunks;
 }
 
-void AgentManager::storeMemory(int userId, int agentId, const std::string& userMessage, const std::string& agentResponse) {
-    database->storeMemory(userId, agentId, userMessage, agentResponse);
-}
-
-std::string AgentManager::buildPrompt(const Agent& agent, const std::string& userMessage, const std::vector<RetrievedChunk>& contextChunks) {
-    std::ostringstream prompt;
-    prompt << agent.systemPrompt << "\n\n";
-
-    const std::size_t kContextBudget = 1200;
-    std::size_t usedChars = 0;
-    bool headerWritten = false;
+std::string AgentManager::generateCoalesced(LlamaCppClient* client, const std::string& modelName,
+                                            const std::string& prompt, const CompletionOptions& options) {
+    // The full prompt is part of the key so two requests only ever share a
+    // completion when llama-server would have received byte-identical input.
+    // Priority changes how the completion is scheduled, and a follower must
+    // not wait on a leader allowed to run much longer than itself, so both
+    // are in the key too (deadlines in half-second buckets).
+    std::ostringstream key;
+    key << modelName << '\x1f' << options.maxTokens << '\x1f' << options.temperature << '\x1f'
+        << static_cast<int>(options.priority) << '\x1f';
+    if (!options.deadline.unlimited()) {
+        key << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   options.deadline.at().time_since_epoch()).count() / kCoalesceDeadlineBucketMs;
+    }
+    key << '\x1f' << prompt;
 
-    auto appendChunk = [&](const RetrievedChunk& chunk) -> bool {
-        if (chunk.text.empty()) {
-            return false;
-        }
-        if (usedChars >= kContextBudget) {
-            return false;
+    bool shared = false;
+    std::string response;
+    try {
+        response = inflightGenerations.run(key.str(), [&]() {
+            return client->generate(prompt, options);
+        }, &shared);
+    } catch (const DeadlineExceeded&) {
+        // The leader's deadline can fall up to a bucket before this one's
+        if (!shared || options.deadline.expired()) {
+            throw;
         }
+        LOG_INFO << "[AgentManager] Coalesced completion hit its leader's deadline, retrying with "
+                 << options.deadline.remainingMs() << "ms left";
+        return client->generate(prompt, options);
+    }
 
-        std::string snippet = chunk.text;
-        if (usedChars + snippet.size() > kContextBudget) {
-            std::size_t remaining = kContextBudget - usedChars;
-            if (remaining == 0) {
-                return false;
-            }
-            snippet = snippet.substr(0, remaining);
-        }
+    if (shared) {
+        LOG_INFO << "[AgentManager] Coalesced identical in-flight completion (total coalesced="
+                 << inflightGenerations.coalesced() << ")";
+    }
+    return response;
+}
 
-        const std::string gradeLabel = chunk.gradeLevel.empty() ? "any" : chunk.gradeLevel;
-        const std::string subjectLabel = chunk.subject.empty() ? "any" : chunk.subject;
+void AgentManager::degrade(RequestContext& request, const std::string& reason) {
+    request.degradations.push_back(reason);
+    Metrics::instance()
+        .counter("request_degradations_total", "Chat requests degraded to meet their deadline",
+                 metricLabel("reason", reason))
+        .inc();
+    LOG_INFO << "[AgentManager] Degraded request (" << reason << "), " << request.deadline.remainingMs()
+             << "ms left";
+}
 
-        std::ostringstream metaLine;
-        metaLine << "[grade=" << gradeLabel
-                 << " subject=" << subjectLabel
-                 << " similarity=" << std::fixed << std::setprecision(2) << chunk.similarity << "]";
-        const std::string meta = metaLine.str();
+void AgentManager::storeMemory(int userId, int agentId, const std::string& userMessage, const std::string& agentResponse) {
+    database->storeMemory(userId, agentId, userMessage, agentResponse);
+}
 
-        if (usedChars + meta.size() >= kContextBudget) {
-            return false;
-        }
+std::string AgentManager::buildPrompt(const Agent& agent, const std::string& userMessage,
+                                      const std::vector<RetrievedChunk>& contextChunks,
+                                      LlamaCppClient* client, int maxTokens) {
+    static Counter& budgetTokens = Metrics::instance().counter(
+        "prompt_context_budget_tokens_total", "Tokens available for RAG context across prompts");
+    static Counter& usedTokens = Metrics::instance().counter(
+        "prompt_context_used_tokens_total", "Tokens of RAG context actually injected across prompts");
+    static Counter& truncatedChunks = Metrics::instance().counter(
+        "prompt_context_truncated_total", "Prompts whose best chunk was cut to fit the token budget");
 
-        if (!headerWritten) {
-            prompt << "Relevant knowledge:\n";
-            headerWritten = true;
-        }
+    PromptBuilder builder(client->tokenCounter(), client->slotContextLength());
+    PromptBudget budget;
+    std::string prompt = builder.build(agent, userMessage, contextChunks, maxTokens, &budget);
 
-        std::size_t remaining = kContextBudget - usedChars - meta.size();
-        if (remaining == 0) {
-            return false;
-        }
+    budgetTokens.inc(static_cast<std::uint64_t>(budget.budgetTokens));
+    usedTokens.inc(static_cast<std::uint64_t>(budget.usedTokens));
+    if (budget.truncated) {
+        truncatedChunks.inc();
+    }
 
-        if (snippet.size() > remaining) {
-            snippet = snippet.substr(0, remaining);
-        }
+    if (budget.chunksInjected > 0) {
+        LOG_INFO << "[AgentManager] Injected " << budget.chunksInjected << "/" << budget.chunksOffered
+                 << " RAG chunk(s) (" << budget.usedTokens << "/" << budget.budgetTokens << " tokens, "
+                 << logFixed(0) << budget.fill() * 100.0 << "% of budget"
+                 << (budget.truncated ? ", truncated" : "") << ")";
+    } else if (budget.budgetTokens == 0) {
+        LOG_INFO << "[AgentManager] RAG: no context budget left for agent " << agent.id
+                 << " (ctx=" << budget.contextTokens << " reserved=" << budget.reservedTokens
+                 << " fixed=" << budget.fixedTokens << ")";
+    } else {
+        LOG_INFO << "[AgentManager] RAG: no context met threshold for agent " << agent.id;
+    }
 
-        prompt << meta << "\n";
-        prompt << snippet << "\n";
-        usedChars += meta.size() + snippet.size();
-        return true;
-    };
+    return prompt;
+}
 
-    int injectedChunks = 0;
-    for (const auto& chunk : contextChunks) {
-        if (appendChunk(chunk)) {
-            ++injectedChunks;
-        }
+std::string AgentManager::generateReply(int userId, int agentId, const std::string& message,
+                                        const std::string& ragContext, const std::string& requestClass,
+                                        RequestContext* request) {
+    if (request && request->deadline.expired()) {
+        degrade(*request, "deadline_exceeded");
+        throw DeadlineExceeded("loading the agent");
     }
 
-    if (headerWritten) {
-        prompt << "\n";
-        std::cout << "[AgentManager] Injected " << injectedChunks << " RAG chunk(s) (" << usedChars
-                  << " chars of context)" << std::endl;
+    // Load agent configuration
+    Agent agent;
+    {
+        TraceSpan span("agent_load");
+        agent = loadAgent(agentId);
+    }
+    
+    // Use provided RAG context, or retrieve relevant context (agent-aware filters).
+    // Retrieval is the first thing dropped when the deadline is tight.
+    std::vector<RetrievedChunk> context;
+    if (!ragContext.empty()) {
+        context.push_back({-1, 0, ragContext, 1.0f, "", "", "", -1, ""});
+        LOG_INFO << "RAG context injected into prompt";
+    } else if (request && request->deadline.remainingMs() < config.deadlineRagMinMs) {
+        degrade(*request, "rag_skipped");
     } else {
-        std::cout << "[AgentManager] RAG: no context met threshold for agent " << agent.id << std::endl;
+        context = retrieveRelevantContext(agent, message, request);
+        LOG_INFO << "[AgentManager] Retrieved " << context.size() << " RAG context items";
     }
-
-    prompt << "Student: " << userMessage << "\n";
-    prompt << "Professor Hawkeinstein: ";
     
-    return prompt.str();
-}
-
-std::string AgentManager::processMessage(int userId, int agentId, const std::string& message) {
-    std::cout << "Processing message for user " << userId << " with agent " << agentId << std::endl;
+    // Extract temperature and max_tokens from agent parameters
+    int maxTokens = agent.parameters.count("max_tokens") ? std::stoi(agent.parameters["max_tokens"]) : 512;
+    float temperature = agent.parameters.count("temperature") ? std::stof(agent.parameters["temperature"]) : 0.7f;
     
+    // Get the backend for this agent's model and request class
+    RequestClass cls;
+    ModelRouter::Backend* backend = routeRequest(agent, message, maxTokens, requestClass, cls);
+    if (!backend) {
+        throw std::runtime_error("No LLM client available for model: " + agent.modelName);
+    }
+    LlamaCppClient* client = backend->client;
+    
+    // Authoring generations legitimately run for minutes; the chat default
+    // does not apply to them, only a deadline the caller set explicitly.
+    if (request && request->defaultDeadline && cls == RequestClass::Generation) {
+        request->deadline = Deadline();
+    }
+    
+    // Cap the completion at what the model can decode in the time left,
+    // keeping a share for queueing and prefill.
+    if (request && !request->deadline.unlimited()) {
+        const double msPerToken = client->msPerToken();
+        const std::int64_t remaining = request->deadline.remainingMs();
+        const int affordable = msPerToken > 0.0
+            ? static_cast<int>(remaining * (1.0 - config.deadlinePrefillShare) / msPerToken)
+            : maxTokens;
+        if (remaining <= 0 || affordable < config.deadlineMinTokens) {
+            degrade(*request, "deadline_exceeded");
+            throw DeadlineExceeded("generation");
+        }
+        if (affordable < maxTokens) {
+            LOG_INFO << "[AgentManager] max_tokens " << maxTokens << " -> " << affordable << " to meet deadline";
+            maxTokens = affordable;
+            degrade(*request, "max_tokens_reduced");
+        }
+    }
+    
+    // Build prompt with system prompt + context + user message, budgeted
+    // against the model's context window minus the completion reservation
+    std::string prompt;
+    {
+        TraceSpan span("build_prompt");
+        prompt = buildPrompt(agent, message, context, client, maxTokens);
+    }
+    
+    LOG_INFO << "Querying llama.cpp with model: " << backend->name << " (" << ModelRouter::className(cls)
+             << ", max_tokens=" << maxTokens << ", temp=" << temperature << ")";
+    
+    // Query llama.cpp with agent-specific parameters
+    const auto started = std::chrono::steady_clock::now();
+    CompletionOptions options;
+    options.maxTokens = maxTokens;
+    options.temperature = temperature;
+    options.cachePrefix = agent.systemPrompt;
+    // Long authoring generations yield their slots to chat traffic
+    options.priority = cls == RequestClass::Generation ? Priority::Batch : Priority::Interactive;
+    // Fair queueing follows whoever started a coalesced completion
+    options.flow = static_cast<std::uint64_t>(static_cast<std::uint32_t>(userId)) + 1;
+    options.flowWeight = config.rateLimits.forAgent(agentId).weight;
+    if (request) {
+        options.deadline = request->deadline;
+    }
+    std::string response;
     try {
-        // Load agent configuration
-        Agent agent = loadAgent(agentId);
-        
-        // Retrieve relevant context from RAG (agent-aware filters)
-        std::vector<RetrievedChunk> context = retrieveRelevantContext(agent, message);
-        std::cout << "[AgentManager] Retrieved " << context.size() << " RAG context items" << std::endl;
-        
-        // Build prompt with system prompt + context + user message
-        std::string prompt = buildPrompt(agent, message, context);
-        
-        // Extract temperature and max_tokens from agent parameters
-        int maxTokens = agent.parameters.count("max_tokens") ? std::stoi(agent.parameters["max_tokens"]) : 512;
-        float temperature = agent.parameters.count("temperature") ? std::stof(agent.parameters["temperature"]) : 0.7f;
-        
-        // Get the appropriate client for this agent's model
-        LlamaCppClient* client = getClientForModel(agent.modelName);
-        if (!client) {
-            throw std::runtime_error("No LLM client available for model: " + agent.modelName);
+        TraceSpan span("generate");
+        response = generateCoalesced(client, backend->name, prompt, options);
+    } catch (const DeadlineExceeded&) {
+        if (request) {
+            degrade(*request, "deadline_exceeded");
         }
-        
-        std::cout << "Querying llama.cpp with model: " << agent.modelName 
-                  << " (max_tokens=" << maxTokens << ", temp=" << temperature << ")" << std::endl;
-        
-        // Query llama.cpp with agent-specific parameters
-        std::string response = client->generate(prompt, maxTokens, temperature);
-        
-        // Store conversation in memory
+        throw;
+    }
+    router->record(backend, cls, std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now() - started));
+    
+    // Store conversation in memory
+    {
+        TraceSpan span("store_memory");
         storeMemory(userId, agentId, message, response);
-        
-        std::cout << "Response generated successfully" << std::endl;
+    }
+    return response;
+}
+
+std::string AgentManager::processMessage(int userId, int agentId, const std::string& message, RequestContext* request) {
+    LOG_INFO << "Processing message for user " << userId << " with agent " << agentId;
+    
+    try {
+        std::string response = generateReply(userId, agentId, message, "", "", request);
+        LOG_INFO << "Response generated successfully";
         return response;
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
-        std::cerr << "Error processing message: " << e.what() << std::endl;
+        LOG_ERROR << "Error processing message: " << e.what();
         return "I apologize, but I'm having trouble processing your request right now. Please try again later.";
     }
 }
 
-std::string AgentManager::processMessageWithContext(int userId, int agentId, const std::string& message, const std::string& ragContext) {
-    std::cout << "Processing message with RAG context for user " << userId << " with agent " << agentId << std::endl;
+std::string AgentManager::processMessageWithContext(int userId, int agentId, const std::string& message, const std::string& ragContext,
+                                                    RequestContext* request) {
+    LOG_INFO << "Processing message with RAG context for user " << userId << " with agent " << agentId;
     
     try {
-        // Load agent configuration
-        Agent agent = loadAgent(agentId);
-        
-        // Use provided RAG context
-        std::vector<RetrievedChunk> context;
-        if (!ragContext.empty()) {
-            context.push_back({-1, 0, ragContext, 1.0f, "", "", ""});
-            std::cout << "RAG context injected into prompt" << std::endl;
-        }
-        
-        // Build prompt with system prompt + RAG context + user message
-        std::string prompt = buildPrompt(agent, message, context);
-        
-        // Extract temperature and max_tokens from agent parameters
-        int maxTokens = agent.parameters.count("max_tokens") ? std::stoi(agent.parameters["max_tokens"]) : 512;
-        float temperature = agent.parameters.count("temperature") ? std::stof(agent.parameters["temperature"]) : 0.7f;
-        
-        // Get the appropriate client for this agent's model
-        LlamaCppClient* client = getClientForModel(agent.modelName);
-        if (!client) {
-            throw std::runtime_error("No LLM client available for model: " + agent.modelName);
-        }
-        
-        std::cout << "Querying llama.cpp with model: " << agent.modelName 
-                  << " (max_tokens=" << maxTokens << ", temp=" << temperature << ")" << std::endl;
-        
-        // Query llama.cpp with agent-specific parameters
-        std::string response = client->generate(prompt, maxTokens, temperature);
-        
-        // Store conversation in memory
-        storeMemory(userId, agentId, message, response);
-        
-        std::cout << "Response generated successfully with RAG context" << std::endl;
+        std::string response = generateReply(userId, agentId, message, ragContext, "", request);
+        LOG_INFO << "Response generated successfully with RAG context";
         return response;
-        
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& e) {
-        std::cerr << "Error processing message: " << e.what() << std::endl;
+        LOG_ERROR << "Error processing message: " << e.what();
         return "I apologize, but I'm having trouble processing your request right now. Please try again in a moment.";
     }
 }
@@ -334,12 +531,27 @@ Json::Value AgentManager::listAgents() {
             agents.append(agentJson);
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error listing agents: " << e.what() << std::endl;
+        LOG_ERROR << "Error listing agents: " << e.what();
     }
     
     return agents;
 }
 
+IngestionStats AgentManager::indexContent(const std::vector<int>& contentIds, IngestionOptions options, int agentId) {
+    if (agentId > 0 && options.agentScope.empty()) {
+        // Chunks are tagged with the scope this agent's searches filter on
+        Agent agent = loadAgent(agentId);
+        auto scope = agent.parameters.find("rag_scope");
+        if (scope == agent.parameters.end() || scope->second.empty()) {
+            scope = agent.parameters.find("agent_scope");
+        }
+        if (scope != agent.parameters.end()) {
+            options.agentScope = scope->second;
+        }
+    }
+    return ragEngine->indexContent(contentIds, options);
+}
+
 Json::Value AgentManager::getAgent(int agentId) {
     Json::Value result;
     
@@ -366,7 +578,7 @@ Json::Value AgentManager::getAgent(int agentId) {
             result["max_tokens"] = 512;
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error getting agent " << agentId << ": " << e.what() << std::endl;
+        LOG_ERROR << "Error getting agent " << agentId << ": " << e.what();
         result["error"] = "Agent not found";
     }
     
@@ -1,6 +1,24 @@
 #include "../include/chunker.h"
-#include <cctype>
 #include <algorithm>
+#include <limits>
+
+namespace {
+bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Byte lookup for . ! ? and newline, the sentence terminators
+struct SentenceEnds {
+    bool table[256] = {};
+    SentenceEnds() {
+        for (unsigned char c : {'.', '!', '?', '\n'}) {
+            table[c] = true;
+        }
+    }
+    bool test(char c) const { return table[static_cast<unsigned char>(c)]; }
+};
+const SentenceEnds kSentenceEnd;
+}
 
 Chunker::Chunker(std::size_t chunkSize, std::size_t overlap)
     : chunkSize_(chunkSize), overlap_(std::min(overlap, chunkSize / 2)) {
@@ -9,104 +27,168 @@ Chunker::Chunker(std::size_t chunkSize, std::size_t overlap)
     }
 }
 
-std::vector<std::string> Chunker::splitSentences(const std::string& text) const {
-    std::vector<std::string> sentences;
-    std::string buffer;
-
-    const auto flushBuffer = [&]() {
-        std::string trimmed = trim(buffer);
-        if (!trimmed.empty()) {
-            sentences.push_back(trimmed);
-        }
-        buffer.clear();
-    };
-
-    for (std::size_t i = 0; i < text.size(); ++i) {
-        const char current = text[i];
-        buffer.push_back(current);
+std::vector<Chunk> Chunker::chunk(const std::string& text) const {
+    std::vector<Chunk> chunks;
+    forEachChunk(text, [&](const ChunkSpan& span) { chunks.push_back({std::string(span.text), span.index}); });
+    return chunks;
+}
 
-        if (current == '\n') {
-            flushBuffer();
-            continue;
-        }
+void Chunker::forEachChunk(std::string_view text, const ChunkCallback& emit) const {
+    // The whole input is already in memory: scan it in place, no buffer
+    ChunkStream stream(*this, emit);
+    stream.window_ = text;
+    stream.scan(true);
+}
 
-        if (current == '.' || current == '!' || current == '?') {
-            flushBuffer();
-        }
-    }
+void Chunker::forEachChunk(std::string_view text, const std::vector<std::size_t>& tokenStarts,
+                           const ChunkCallback& emit) const {
+    ChunkStream stream(*this, emit);
+    stream.tokenStarts_ = &tokenStarts;
+    stream.window_ = text;
+    stream.scan(true);
+}
 
-    if (!buffer.empty()) {
-        flushBuffer();
-    }
+ChunkStream::ChunkStream(const Chunker& chunker, ChunkCallback emit)
+    : chunkSize_(chunker.chunkSize()), overlap_(chunker.overlap()), emit_(std::move(emit)) {}
 
-    if (sentences.empty()) {
-        std::string trimmed = trim(text);
-        if (!trimmed.empty()) {
-            sentences.push_back(trimmed);
-        }
+void ChunkStream::feed(std::string_view data) {
+    // Drop what no future chunk can contain
+    const std::size_t keepFrom = hasCurrent_ ? chunkStart_ : sentenceStart_;
+    if (keepFrom > bufferBase_) {
+        buffer_.erase(0, std::min(buffer_.size(), keepFrom - bufferBase_));
+        bufferBase_ = keepFrom;
     }
+    buffer_.append(data.data(), data.size());
+    window_ = buffer_;
+    windowBase_ = bufferBase_;
+    scan(false);
+}
 
-    return sentences;
+void ChunkStream::finish() {
+    window_ = buffer_;
+    windowBase_ = bufferBase_;
+    scan(true);
 }
 
-std::string Chunker::trim(const std::string& input) {
-    auto begin = std::find_if_not(input.begin(), input.end(), [](unsigned char ch) { return std::isspace(ch); });
-    auto end = std::find_if_not(input.rbegin(), input.rend(), [](unsigned char ch) { return std::isspace(ch); }).base();
-    if (begin >= end) {
-        return "";
+std::size_t ChunkStream::measure(std::size_t start, std::size_t end) const {
+    if (!tokenStarts_) {
+        return end - start;
     }
-    return std::string(begin, end);
+    // Tokens beginning inside the range
+    const auto first = std::lower_bound(tokenStarts_->begin(), tokenStarts_->end(), start);
+    return static_cast<std::size_t>(std::lower_bound(first, tokenStarts_->end(), end) - first);
 }
 
-std::string Chunker::tailOverlap(const std::string& text) const {
-    if (overlap_ == 0 || text.size() <= overlap_) {
-        return text;
+std::size_t ChunkStream::advance(std::size_t pos, std::size_t n) const {
+    if (!tokenStarts_) {
+        return pos + n;
     }
-    return text.substr(text.size() - overlap_);
+    const auto token = std::lower_bound(tokenStarts_->begin(), tokenStarts_->end(), pos);
+    if (static_cast<std::size_t>(tokenStarts_->end() - token) <= n) {
+        return std::numeric_limits<std::size_t>::max();
+    }
+    return std::max(pos + 1, *(token + static_cast<std::ptrdiff_t>(n)));
 }
 
-std::vector<Chunk> Chunker::chunk(const std::string& text) const {
-    std::vector<Chunk> chunks;
-    auto sentences = splitSentences(text);
-    if (sentences.empty()) {
-        return chunks;
+std::size_t ChunkStream::retreat(std::size_t pos, std::size_t n) const {
+    if (!tokenStarts_) {
+        return pos - std::min(n, pos);
     }
+    const auto token = std::lower_bound(tokenStarts_->begin(), tokenStarts_->end(), pos);
+    if (static_cast<std::size_t>(token - tokenStarts_->begin()) < n) {
+        return 0;
+    }
+    return *(token - static_cast<std::ptrdiff_t>(n));
+}
 
-    std::string current;
-    int chunkIndex = 0;
-
-    for (const auto& sentence : sentences) {
-        if (sentence.empty()) {
+void ChunkStream::scan(bool final) {
+    const std::size_t end = windowBase_ + window_.size();
+    const char* data = window_.data();
+    while (scanPos_ < end) {
+        if (scanPos_ == sentenceStart_ && isSpace(data[scanPos_ - windowBase_])) {
+            // Leading whitespace is never part of a sentence
+            sentenceStart_ = ++scanPos_;
+            if (hasCurrent_ && measure(chunkEnd_, sentenceStart_) > chunkSize_) {
+                // Nothing after this gap fits the chunk being built
+                emitChunk(chunkStart_, chunkEnd_);
+                hasCurrent_ = false;
+            }
             continue;
         }
 
-        if (current.empty()) {
-            current = sentence;
-            continue;
+        // Find the end of the sentence, giving up once it is chunkSize long
+        const std::size_t limit = std::min(end, advance(sentenceStart_, chunkSize_));
+        std::size_t pos = scanPos_;
+        while (pos < limit && !kSentenceEnd.test(data[pos - windowBase_])) {
+            ++pos;
         }
-
-        if (current.size() + 1 + sentence.size() <= chunkSize_) {
-            current.append(" ").append(sentence);
+        if (pos < limit) {
+            addSentence(sentenceStart_, pos + 1);
+            sentenceStart_ = scanPos_ = pos + 1;
             continue;
         }
-
-        chunks.push_back({ trim(current), chunkIndex++ });
-        std::string overlapTail = tailOverlap(current);
-        current = overlapTail;
-        if (!current.empty() && !std::isspace(static_cast<unsigned char>(current.back()))) {
-            current.push_back(' ');
+        scanPos_ = pos;
+        if (pos == end) {
+            break;  // the sentence continues in the next piece
         }
-        current.append(sentence);
 
-        if (current.size() > chunkSize_) {
-            chunks.push_back({ trim(current), chunkIndex++ });
-            current.clear();
+        // Over-long sentence: cut at the last space that keeps it in size
+        std::size_t cut = pos;
+        while (cut > sentenceStart_ + 1 && !isSpace(data[cut - 1 - windowBase_])) {
+            --cut;
+        }
+        if (cut <= sentenceStart_ + 1) {
+            cut = pos;
+        }
+        addSentence(sentenceStart_, cut);
+        sentenceStart_ = scanPos_ = cut;
+    }
+    if (final) {
+        if (sentenceStart_ < end) {
+            addSentence(sentenceStart_, end);
+            sentenceStart_ = end;
+        }
+        if (hasCurrent_) {
+            emitChunk(chunkStart_, chunkEnd_);
+            hasCurrent_ = false;
         }
     }
+}
 
-    if (!current.empty()) {
-        chunks.push_back({ trim(current), chunkIndex++ });
+void ChunkStream::addSentence(std::size_t start, std::size_t end) {
+    while (end > start && isSpace(at(end - 1))) {
+        --end;
+    }
+    if (end == start) {
+        return;
+    }
+    if (!hasCurrent_) {
+        hasCurrent_ = true;
+        chunkStart_ = start;
+        chunkEnd_ = end;
+        return;
+    }
+    if (measure(chunkStart_, end) <= chunkSize_) {
+        chunkEnd_ = end;
+        return;
     }
 
-    return chunks;
+    emitChunk(chunkStart_, chunkEnd_);
+    // The next chunk repeats up to `overlap` of the previous one, as much as
+    // still leaves room for this sentence
+    const std::size_t overlapStart = retreat(chunkEnd_, overlap_);
+    const std::size_t fitStart = retreat(end, chunkSize_);
+    chunkStart_ = std::min(start, std::max({chunkStart_, overlapStart, fitStart}));
+    chunkEnd_ = end;
+}
+
+void ChunkStream::emitChunk(std::size_t start, std::size_t end) {
+    while (start < end && isSpace(at(start))) {
+        ++start;
+    }
+    if (start == end) {
+        return;
+    }
+    const ChunkSpan span{start, end - start, index_++, window_.substr(start - windowBase_, end - start)};
+    emit_(span);
 }
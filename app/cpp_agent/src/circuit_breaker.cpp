@@ -0,0 +1,148 @@
+#include "../include/circuit_breaker.h"
+#include "../include/metrics.h"
+#include <algorithm>
+
+CircuitBreaker::CircuitBreaker(const CircuitBreakerPolicy& policy, Gauge* stateGauge, Counter* opensCounter)
+    : policy_(policy), stateGauge_(stateGauge), opensCounter_(opensCounter),
+      outcomes_(static_cast<std::size_t>(std::max(1, policy.window)), false) {
+    if (stateGauge_) {
+        stateGauge_->set(static_cast<std::int64_t>(State::Closed));
+    }
+}
+
+const char* CircuitBreaker::name(State state) {
+    switch (state) {
+        case State::Closed: return "closed";
+        case State::HalfOpen: return "half_open";
+        case State::Open: return "open";
+    }
+    return "unknown";
+}
+
+bool CircuitBreaker::available() {
+    State state = state_.load(std::memory_order_acquire);
+    if (state == State::Open) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state = state_.load(std::memory_order_relaxed);
+        if (state == State::Open) {
+            if (std::chrono::steady_clock::now() < openUntil_) {
+                return false;
+            }
+            transition(State::HalfOpen);
+            state = State::HalfOpen;
+        }
+    }
+    return state == State::Closed || claimProbe();
+}
+
+bool CircuitBreaker::admits() const {
+    switch (state_.load(std::memory_order_acquire)) {
+        case State::Closed:
+            return true;
+        case State::Open: {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return std::chrono::steady_clock::now() >= openUntil_;
+        }
+        case State::HalfOpen:
+            return probesInFlight_.load(std::memory_order_relaxed) < policy_.halfOpenProbes;
+    }
+    return false;
+}
+
+// Checking the count and taking a probe are one step, so concurrent callers
+// cannot all pass the check and overrun halfOpenProbes.
+bool CircuitBreaker::claimProbe() {
+    int probes = probesInFlight_.load(std::memory_order_relaxed);
+    while (probes < policy_.halfOpenProbes) {
+        if (probesInFlight_.compare_exchange_weak(probes, probes + 1, std::memory_order_acq_rel)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CircuitBreaker::releaseProbe() {
+    int probes = probesInFlight_.load(std::memory_order_relaxed);
+    while (probes > 0 && !probesInFlight_.compare_exchange_weak(probes, probes - 1, std::memory_order_acq_rel)) {
+        // `probes` was reloaded; a transition may have reset it to 0
+    }
+}
+
+void CircuitBreaker::onSuccess() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_.load(std::memory_order_relaxed) == State::HalfOpen) {
+        releaseProbe();
+        trips_ = 0;
+        transition(State::Closed);
+        return;
+    }
+    consecutive_ = 0;
+    outcomes_[next_] = false;
+    next_ = (next_ + 1) % outcomes_.size();
+    recorded_ = std::min(recorded_ + 1, outcomes_.size());
+}
+
+bool CircuitBreaker::onFailure() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    switch (state_.load(std::memory_order_relaxed)) {
+        case State::HalfOpen:
+            releaseProbe();
+            trip();
+            return true;
+        case State::Open:
+            // A request admitted before the trip finished late; already open.
+            return false;
+        case State::Closed:
+            break;
+    }
+
+    consecutive_++;
+    outcomes_[next_] = true;
+    next_ = (next_ + 1) % outcomes_.size();
+    recorded_ = std::min(recorded_ + 1, outcomes_.size());
+
+    const bool tooManyInARow = consecutive_ >= policy_.consecutiveFailures;
+    const bool ratioExceeded = recorded_ >= static_cast<std::size_t>(std::max(1, policy_.minRequests)) &&
+                               static_cast<double>(recentFailures()) / recorded_ >= policy_.failureRatio;
+    if (tooManyInARow || ratioExceeded) {
+        trip();
+        return true;
+    }
+    return false;
+}
+
+void CircuitBreaker::onCancelled() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_.load(std::memory_order_relaxed) == State::HalfOpen) {
+        releaseProbe();
+    }
+}
+
+void CircuitBreaker::trip() {
+    const int multiplier = 1 << std::min(trips_, 3);
+    trips_++;
+    openUntil_ = std::chrono::steady_clock::now() + std::chrono::seconds(policy_.openSeconds * multiplier);
+    transition(State::Open);
+    if (opensCounter_) {
+        opensCounter_->inc();
+    }
+}
+
+void CircuitBreaker::transition(State to) {
+    probesInFlight_.store(0, std::memory_order_relaxed);
+    state_.store(to, std::memory_order_release);
+    if (to == State::Closed || to == State::Open) {
+        // Start the next closed period with a clean window.
+        std::fill(outcomes_.begin(), outcomes_.end(), false);
+        next_ = 0;
+        recorded_ = 0;
+        consecutive_ = 0;
+    }
+    if (stateGauge_) {
+        stateGauge_->set(static_cast<std::int64_t>(to));
+    }
+}
+
+std::size_t CircuitBreaker::recentFailures() const {
+    return static_cast<std::size_t>(std::count(outcomes_.begin(), outcomes_.end(), true));
+}
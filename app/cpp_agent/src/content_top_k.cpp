@@ -0,0 +1,74 @@
+#include "../include/content_top_k.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+// Heap order keeping the least similar chunk on top, the one to evict
+bool moreSimilar(const RetrievedChunk& a, const RetrievedChunk& b) {
+    return a.similarity > b.similarity;
+}
+}
+
+ContentTopK::ContentTopK(std::size_t k, std::size_t perContent)
+    : k_(std::max<std::size_t>(1, k)), perContent_(std::max<std::size_t>(1, perContent)) {
+    heaps_.reserve(k_);
+}
+
+bool ContentTopK::offer(const RetrievedChunk& chunk) {
+    ++offered_;
+    if (!full()) {
+        rowsToFill_ = offered_;
+    }
+
+    auto it = heaps_.find(chunk.contentId);
+    if (it == heaps_.end()) {
+        if (full()) {
+            return false;
+        }
+        order_.push_back(chunk.contentId);
+        heaps_[chunk.contentId].push_back(chunk);
+        return true;
+    }
+
+    std::vector<RetrievedChunk>& heap = it->second;
+    if (heap.size() < perContent_) {
+        heap.push_back(chunk);
+        std::push_heap(heap.begin(), heap.end(), moreSimilar);
+        return true;
+    }
+    ++duplicates_;
+    if (chunk.similarity <= heap.front().similarity) {
+        return false;
+    }
+    std::pop_heap(heap.begin(), heap.end(), moreSimilar);
+    heap.back() = chunk;
+    std::push_heap(heap.begin(), heap.end(), moreSimilar);
+    return true;
+}
+
+std::vector<RetrievedChunk> ContentTopK::take() {
+    std::vector<std::vector<RetrievedChunk>> documents;
+    documents.reserve(order_.size());
+    for (int contentId : order_) {
+        std::vector<RetrievedChunk>& heap = heaps_[contentId];
+        std::sort_heap(heap.begin(), heap.end(), moreSimilar);
+        documents.push_back(std::move(heap));
+    }
+    // Offered order is already best-first when the input was sorted; sort
+    // anyway so an unsorted caller still gets ranked documents
+    std::stable_sort(documents.begin(), documents.end(),
+                     [](const std::vector<RetrievedChunk>& a, const std::vector<RetrievedChunk>& b) {
+                         return a.front().similarity > b.front().similarity;
+                     });
+
+    std::vector<RetrievedChunk> chunks;
+    for (auto& document : documents) {
+        std::move(document.begin(), document.end(), std::back_inserter(chunks));
+    }
+    order_.clear();
+    heaps_.clear();
+    offered_ = 0;
+    rowsToFill_ = 0;
+    duplicates_ = 0;
+    return chunks;
+}
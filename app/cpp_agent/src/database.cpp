@@ -1,5 +1,7 @@
 #include "../include/database.h"
-#include <iostream>
+#include "../include/logger.h"
+#include "../include/metrics.h"
+#include "../include/vector_codec.h"
 #include <sstream>
 #include <stdexcept>
 #include <ctime>
@@ -9,46 +11,69 @@
 #include <cstdlib>
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 
 namespace {
 constexpr int kEmbeddingDimension = 384;
 
-std::string serializeVector(const std::vector<float>& embedding) {
-    std::ostringstream embStr;
-    embStr.setf(std::ios::fixed);
-    embStr << "[";
-    for (size_t i = 0; i < embedding.size(); ++i) {
-        if (i > 0) {
-            embStr << ",";
-        }
-        embStr << std::setprecision(8) << embedding[i];
+// Table names cannot be bound as parameters; only plain identifiers are
+// accepted and they are returned quoted.
+std::string quoteTable(const std::string& table) {
+    if (table.empty() || table.size() > 64 ||
+        !std::all_of(table.begin(), table.end(), [](unsigned char c) { return std::isalnum(c) || c == '_'; })) {
+        throw std::invalid_argument("Invalid table name: " + table);
     }
-    embStr << "]";
-    return embStr.str();
+    return "`" + table + "`";
 }
 
-std::vector<float> parseVector(const std::string& text) {
-    std::vector<float> values;
-    if (text.empty()) {
-        return values;
-    }
+// Near-duplicate back-references of an embeddings table's chunks
+std::string duplicatesTable(const std::string& table) {
+    return table + "_duplicates";
+}
 
-    std::string trimmed = text;
-    if (trimmed.front() == '[' && trimmed.back() == ']') {
-        trimmed = trimmed.substr(1, trimmed.size() - 2);
-    }
+// Shared by every Database instance; each instance is one connection.
+struct ConnectionMetrics {
+    Gauge& connections;
+    Gauge& inUse;
+    Gauge& waiters;
+    Histogram& wait;
+};
+
+ConnectionMetrics& connectionMetrics() {
+    static ConnectionMetrics m{
+        Metrics::instance().gauge("db_connections", "Open MySQL connections"),
+        Metrics::instance().gauge("db_connections_in_use", "MySQL connections currently running a query"),
+        Metrics::instance().gauge("db_connection_waiters", "Threads waiting for a busy MySQL connection"),
+        Metrics::instance().histogram("db_connection_wait_seconds", "Time spent waiting for a MySQL connection"),
+    };
+    return m;
+}
+}
 
-    std::stringstream ss(trimmed);
-    std::string token;
-    while (std::getline(ss, token, ',')) {
-        if (!token.empty()) {
-            values.push_back(static_cast<float>(std::atof(token.c_str())));
+// A MYSQL handle must not be used by two threads at once, and request
+// threads share the AgentManager's connection; this serializes them and
+// reports how often they queue for it.
+class Database::ConnectionGuard {
+public:
+    explicit ConnectionGuard(Database& db) : lock_(db.connectionMutex, std::defer_lock) {
+        ConnectionMetrics& metrics = connectionMetrics();
+        if (!lock_.try_lock()) {
+            metrics.waiters.add(1);
+            const auto start = std::chrono::steady_clock::now();
+            lock_.lock();
+            metrics.wait.observeMicros(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count());
+            metrics.waiters.add(-1);
+        } else {
+            metrics.wait.observeMicros(0);
         }
+        metrics.inUse.add(1);
     }
+    ~ConnectionGuard() { connectionMetrics().inUse.add(-1); }
 
-    return values;
-}
-}
+private:
+    std::unique_lock<std::mutex> lock_;
+};
 
 Database::Database(const std::string& host, int port, const std::string& dbName, 
                    const std::string& user, const std::string& password)
@@ -56,6 +81,8 @@ Database::Database(const std::string& host, int port, const std::string& dbName,
     connect();
 }
 
+Database::Database() : connection(nullptr), port(0) {}
+
 Database::~Database() {
     disconnect();
 }
@@ -74,17 +101,20 @@ void Database::connect() {
         throw std::runtime_error("Failed to connect to database: " + error);
     }
     
-    std::cout << "Connected to database: " << dbName << std::endl;
+    connectionMetrics().connections.add(1);
+    LOG_INFO << "Connected to database: " << dbName;
 }
 
 void Database::disconnect() {
     if (connection) {
         mysql_close(connection);
         connection = nullptr;
+        connectionMetrics().connections.add(-1);
     }
 }
 
 Agent Database::getAgent(int agentId) {
+    ConnectionGuard guard(*this);
     std::ostringstream query;
     query << "SELECT agent_id, agent_name, specialization, system_prompt, model_name, temperature, max_tokens "
           << "FROM agents WHERE agent_id = " << agentId;
@@ -112,13 +142,13 @@ Agent Database::getAgent(int agentId) {
         // Note: This is just the filename (e.g., "qwen2.5-1.5b-instruct-q4_k_m.gguf")
         // Full path construction happens in agent_manager or http_server
         agent.modelName = row[4] && strlen(row[4]) > 0 ? row[4] : "qwen2.5-1.5b-instruct-q4_k_m.gguf";
-        std::cout << "[Database] Loaded agent " << agent.name << " with model: " << agent.modelName << std::endl;
+        LOG_INFO << "[Database] Loaded agent " << agent.name << " with model: " << agent.modelName;
         
         // Load temperature and max_tokens from database
         agent.parameters["temperature"] = row[5] ? row[5] : "0.7";
         agent.parameters["max_tokens"] = row[6] ? row[6] : "512";
-        std::cout << "[Database] Agent parameters: temperature=" << agent.parameters["temperature"] 
-                  << ", max_tokens=" << agent.parameters["max_tokens"] << std::endl;
+        LOG_INFO << "[Database] Agent parameters: temperature=" << agent.parameters["temperature"] 
+                 << ", max_tokens=" << agent.parameters["max_tokens"];
     } else {
         mysql_free_result(result);
         throw std::runtime_error("Agent not found");
@@ -129,6 +159,7 @@ Agent Database::getAgent(int agentId) {
 }
 
 std::vector<Agent> Database::getAllAgents() {
+    ConnectionGuard guard(*this);
     std::vector<Agent> agents;
     
     const char* query = "SELECT agent_id, agent_name, specialization, system_prompt, model_name, temperature, max_tokens FROM agents WHERE is_active = 1 AND visible_to_students = 1";
@@ -153,7 +184,7 @@ std::vector<Agent> Database::getAllAgents() {
         
         // Model name from DB with fallback to default
         agent.modelName = row[4] && strlen(row[4]) > 0 ? row[4] : "qwen2.5-1.5b-instruct-q4_k_m.gguf";
-        std::cout << "[Database] Agent " << agent.name << " uses model: " << agent.modelName << std::endl;
+        LOG_INFO << "[Database] Agent " << agent.name << " uses model: " << agent.modelName;
         
         // Load temperature and max_tokens
         agent.parameters["temperature"] = row[5] ? row[5] : "0.7";
@@ -172,6 +203,7 @@ std::vector<Agent> Database::getStudentVisibleAgents() {
 }
 
 void Database::storeMemory(int userId, int agentId, const std::string& userMessage, const std::string& agentResponse) {
+    ConnectionGuard guard(*this);
     // Escape strings
     char* escapedUser = new char[userMessage.length() * 2 + 1];
     char* escapedAgent = new char[agentResponse.length() * 2 + 1];
@@ -187,11 +219,12 @@ void Database::storeMemory(int userId, int agentId, const std::string& userMessa
     delete[] escapedAgent;
     
     if (mysql_query(connection, query.str().c_str())) {
-        std::cerr << "Failed to store memory: " << mysql_error(connection) << std::endl;
+        LOG_ERROR << "Failed to store memory: " << mysql_error(connection);
     }
 }
 
 std::vector<std::string> Database::getRAGDocuments(int agentId, const std::vector<float>& embedding, int limit) {
+    ConnectionGuard guard(*this);
     std::vector<std::string> documents;
     (void)agentId; // Agent-specific filtering will be layered on later phases
 
@@ -200,8 +233,8 @@ std::vector<std::string> Database::getRAGDocuments(int agentId, const std::vecto
     }
 
     if (embedding.size() != static_cast<size_t>(kEmbeddingDimension)) {
-        std::cerr << "[Database] getRAGDocuments rejected vector with dimension " << embedding.size()
-                  << " (expected " << kEmbeddingDimension << ")" << std::endl;
+        LOG_ERROR << "[Database] getRAGDocuments rejected vector with dimension " << embedding.size()
+                  << " (expected " << kEmbeddingDimension << ")";
         return documents;
     }
 
@@ -216,12 +249,12 @@ std::vector<std::string> Database::getRAGDocuments(int agentId, const std::vecto
 
     MYSQL_STMT* stmt = mysql_stmt_init(connection);
     if (!stmt) {
-        std::cerr << "[Database] Failed to init statement for vector search" << std::endl;
+        LOG_ERROR << "[Database] Failed to init statement for vector search";
         return documents;
     }
 
     if (mysql_stmt_prepare(stmt, sql, std::strlen(sql)) != 0) {
-        std::cerr << "[Database] Failed to prepare vector search: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to prepare vector search: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return documents;
     }
@@ -241,19 +274,19 @@ std::vector<std::string> Database::getRAGDocuments(int agentId, const std::vecto
     params[1].buffer_length = sizeof(limitValue);
 
     if (mysql_stmt_bind_param(stmt, params) != 0) {
-        std::cerr << "[Database] Failed to bind vector search params: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to bind vector search params: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return documents;
     }
 
     if (mysql_stmt_execute(stmt) != 0) {
-        std::cerr << "[Database] Vector search execute failed: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Vector search execute failed: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return documents;
     }
 
     if (mysql_stmt_store_result(stmt) != 0) {
-        std::cerr << "[Database] Failed to buffer vector search results: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to buffer vector search results: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return documents;
     }
@@ -285,7 +318,7 @@ std::vector<std::string> Database::getRAGDocuments(int agentId, const std::vecto
     resultBinds[2].buffer = &distance;
 
     if (mysql_stmt_bind_result(stmt, resultBinds) != 0) {
-        std::cerr << "[Database] Failed to bind vector search results: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to bind vector search results: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return documents;
     }
@@ -315,7 +348,7 @@ std::vector<std::string> Database::getRAGDocuments(int agentId, const std::vecto
             break;
         }
         if (fetchStatus != 0 && fetchStatus != MYSQL_DATA_TRUNCATED) {
-            std::cerr << "[Database] Vector search fetch error: " << mysql_stmt_error(stmt) << std::endl;
+            LOG_ERROR << "[Database] Vector search fetch error: " << mysql_stmt_error(stmt);
             break;
         }
 
@@ -339,6 +372,7 @@ std::vector<VectorSearchResult> Database::vectorSearch(const std::vector<float>&
                                                        int topK,
                                                        const std::string& metric,
                                                        const VectorSearchFilters* filters) {
+    ConnectionGuard guard(*this);
     std::vector<VectorSearchResult> results;
 
     if (embedding.empty()) {
@@ -346,8 +380,8 @@ std::vector<VectorSearchResult> Database::vectorSearch(const std::vector<float>&
     }
 
     if (embedding.size() != static_cast<size_t>(kEmbeddingDimension)) {
-        std::cerr << "[Database] vectorSearch rejected vector with dimension " << embedding.size()
-                  << " (expected " << kEmbeddingDimension << ")" << std::endl;
+        LOG_ERROR << "[Database] vectorSearch rejected vector with dimension " << embedding.size()
+                  << " (expected " << kEmbeddingDimension << ")";
         return results;
     }
 
@@ -366,7 +400,8 @@ std::vector<VectorSearchResult> Database::vectorSearch(const std::vector<float>&
         "SELECT content_id, chunk_index, text_chunk, "
         "JSON_UNQUOTE(JSON_EXTRACT(chunk_metadata, '$.grade_level')) AS grade_level, "
         "JSON_UNQUOTE(JSON_EXTRACT(chunk_metadata, '$.subject')) AS subject, "
-        "JSON_UNQUOTE(JSON_EXTRACT(chunk_metadata, '$.agent_scope')) AS agent_scope, ";
+        "JSON_UNQUOTE(JSON_EXTRACT(chunk_metadata, '$.agent_scope')) AS agent_scope, "
+        "token_count, model_used, ";
     sql += distanceFunction;
     sql += "(embedding_vector, VEC_FromText(?)) AS distance "
            "FROM content_embeddings WHERE 1=1";
@@ -387,12 +422,12 @@ std::vector<VectorSearchResult> Database::vectorSearch(const std::vector<float>&
 
     MYSQL_STMT* stmt = mysql_stmt_init(connection);
     if (!stmt) {
-        std::cerr << "[Database] Failed to init statement for vectorSearch" << std::endl;
+        LOG_ERROR << "[Database] Failed to init statement for vectorSearch";
         return results;
     }
 
     if (mysql_stmt_prepare(stmt, sql.c_str(), sql.length()) != 0) {
-        std::cerr << "[Database] Failed to prepare vectorSearch: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to prepare vectorSearch: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return results;
     }
@@ -455,24 +490,24 @@ std::vector<VectorSearchResult> Database::vectorSearch(const std::vector<float>&
     params.push_back(limitBind);
 
     if (mysql_stmt_bind_param(stmt, params.data()) != 0) {
-        std::cerr << "[Database] Failed to bind vectorSearch params: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to bind vectorSearch params: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return results;
     }
 
     if (mysql_stmt_execute(stmt) != 0) {
-        std::cerr << "[Database] vectorSearch execute failed: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] vectorSearch execute failed: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return results;
     }
 
     if (mysql_stmt_store_result(stmt) != 0) {
-        std::cerr << "[Database] Failed to buffer vectorSearch results: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to buffer vectorSearch results: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return results;
     }
 
-    MYSQL_BIND resultBinds[7];
+    MYSQL_BIND resultBinds[9];
     std::memset(resultBinds, 0, sizeof(resultBinds));
     int contentId = 0;
     int chunkIndex = 0;
@@ -484,11 +519,16 @@ std::vector<VectorSearchResult> Database::vectorSearch(const std::vector<float>&
     unsigned long subjectLength = 0;
     bool scopeNull = false;
     unsigned long scopeLength = 0;
+    int tokenCount = 0;
+    bool tokenCountNull = false;
+    bool modelNull = false;
+    unsigned long modelLength = 0;
     float distance = 0.0f;
     char textStub = '\0';
     char gradeStub = '\0';
     char subjectStub = '\0';
     char scopeStub = '\0';
+    char modelStub = '\0';
 
     resultBinds[0].buffer_type = MYSQL_TYPE_LONG;
     resultBinds[0].buffer = &contentId;
@@ -522,12 +562,23 @@ std::vector<VectorSearchResult> Database::vectorSearch(const std::vector<float>&
     resultBinds[5].is_null = &scopeNull;
     resultBinds[5].length = &scopeLength;
 
-    resultBinds[6].buffer_type = MYSQL_TYPE_FLOAT;
-    resultBinds[6].buffer = &distance;
-    resultBinds[6].buffer_length = sizeof(distance);
+    resultBinds[6].buffer_type = MYSQL_TYPE_LONG;
+    resultBinds[6].buffer = &tokenCount;
+    resultBinds[6].buffer_length = sizeof(tokenCount);
+    resultBinds[6].is_null = &tokenCountNull;
+
+    resultBinds[7].buffer_type = MYSQL_TYPE_STRING;
+    resultBinds[7].buffer = &modelStub;
+    resultBinds[7].buffer_length = 0;
+    resultBinds[7].is_null = &modelNull;
+    resultBinds[7].length = &modelLength;
+
+    resultBinds[8].buffer_type = MYSQL_TYPE_FLOAT;
+    resultBinds[8].buffer = &distance;
+    resultBinds[8].buffer_length = sizeof(distance);
 
     if (mysql_stmt_bind_result(stmt, resultBinds) != 0) {
-        std::cerr << "[Database] Failed to bind vectorSearch results: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to bind vectorSearch results: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return results;
     }
@@ -557,7 +608,7 @@ std::vector<VectorSearchResult> Database::vectorSearch(const std::vector<float>&
             break;
         }
         if (fetchStatus != 0 && fetchStatus != MYSQL_DATA_TRUNCATED) {
-            std::cerr << "[Database] vectorSearch fetch error: " << mysql_stmt_error(stmt) << std::endl;
+            LOG_ERROR << "[Database] vectorSearch fetch error: " << mysql_stmt_error(stmt);
             break;
         }
 
@@ -568,6 +619,8 @@ std::vector<VectorSearchResult> Database::vectorSearch(const std::vector<float>&
         row.gradeLevel = gradeNull ? "" : fetchStringColumn(3, gradeLength);
         row.subject = subjectNull ? "" : fetchStringColumn(4, subjectLength);
         row.agentScope = scopeNull ? "" : fetchStringColumn(5, scopeLength);
+        row.tokenCount = tokenCountNull ? -1 : tokenCount;
+        row.tokenizer = modelNull ? "" : fetchStringColumn(7, modelLength);
         if (row.chunkText.empty()) {
             continue;
         }
@@ -587,74 +640,377 @@ std::vector<VectorSearchResult> Database::vectorSearch(const std::vector<float>&
     return results;
 }
 
-void Database::storeEmbedding(int documentId, const std::vector<float>& embedding) {
-    if (embedding.size() != static_cast<size_t>(kEmbeddingDimension)) {
-        std::cerr << "[Database] storeEmbedding rejected vector with dimension " << embedding.size()
-                  << " (expected " << kEmbeddingDimension << ")" << std::endl;
-        return;
+bool Database::getContentForIndexing(int contentId, IndexableContent& content) {
+    ConnectionGuard guard(*this);
+    std::ostringstream query;
+    query << "SELECT content_id, title, content_text, grade_level, subject, has_embeddings "
+          << "FROM educational_content WHERE content_id = " << contentId;
+
+    if (mysql_query(connection, query.str().c_str())) {
+        throw std::runtime_error("Failed to query content: " + std::string(mysql_error(connection)));
     }
 
-    const std::string serializedEmbedding = serializeVector(embedding);
-    const char* sql =
-        "INSERT INTO content_embeddings (content_id, chunk_index, text_chunk, chunk_metadata, embedding_vector, vector_dimension, model_used) "
-        "VALUES (?, 0, '', NULL, VEC_FromText(?), ?, 'llama.cpp')";
+    MYSQL_RES* result = mysql_store_result(connection);
+    if (!result) {
+        throw std::runtime_error("Failed to get result: " + std::string(mysql_error(connection)));
+    }
 
-    MYSQL_STMT* stmt = mysql_stmt_init(connection);
-    if (!stmt) {
-        std::cerr << "[Database] Failed to init statement for embedding insert" << std::endl;
-        return;
+    MYSQL_ROW row = mysql_fetch_row(result);
+    if (row) {
+        unsigned long* lengths = mysql_fetch_lengths(result);
+        auto text = [&](int i) { return row[i] ? std::string(row[i], lengths[i]) : std::string(); };
+        content.contentId = row[0] ? std::atoi(row[0]) : contentId;
+        content.title = text(1);
+        content.text = text(2);
+        content.gradeLevel = text(3);
+        content.subject = text(4);
+        content.hasEmbeddings = row[5] && std::atoi(row[5]) != 0;
     }
+    mysql_free_result(result);
+    return row != nullptr;
+}
 
-    if (mysql_stmt_prepare(stmt, sql, std::strlen(sql)) != 0) {
-        std::cerr << "[Database] Failed to prepare embedding insert: " << mysql_stmt_error(stmt) << std::endl;
-        mysql_stmt_close(stmt);
-        return;
+std::vector<IndexableContent> Database::getContentPage(int afterContentId, int limit) {
+    ConnectionGuard guard(*this);
+    std::ostringstream where;
+    where << "content_id > " << afterContentId << " ORDER BY content_id LIMIT " << limit;
+    return queryContent(where.str());
+}
+
+std::vector<IndexableContent> Database::getContentToReembed(const std::string& table, int throughContentId,
+                                                            const std::string& changedSince) {
+    ConnectionGuard guard(*this);
+    const std::string embedded = quoteTable(table);
+    const std::string duplicates = quoteTable(duplicatesTable(table));
+    std::ostringstream where;
+    where << "content_id <= " << throughContentId << " AND content_text IS NOT NULL AND content_text <> '' AND ("
+          << "(NOT EXISTS (SELECT 1 FROM " << embedded << " e WHERE e.content_id = ec.content_id) AND "
+          << "NOT EXISTS (SELECT 1 FROM " << duplicates << " d WHERE d.content_id = ec.content_id))";
+    if (!changedSince.empty()) {
+        where << " OR updated_at >= '" << escape(changedSince) << "'";
     }
+    where << ") ORDER BY content_id";
+    return queryContent(where.str());
+}
 
-    int contentId = documentId;
-    int dimension = kEmbeddingDimension;
-    unsigned long vectorLength = serializedEmbedding.size();
+// Caller holds the ConnectionGuard
+std::vector<IndexableContent> Database::queryContent(const std::string& where) {
+    std::vector<IndexableContent> page;
+    const std::string query =
+        "SELECT content_id, title, content_text, grade_level, subject, has_embeddings, "
+        "(SELECT chunk_metadata FROM content_embeddings ce WHERE ce.content_id = ec.content_id LIMIT 1) "
+        "FROM educational_content ec WHERE " + where;
 
-    MYSQL_BIND params[3];
-    std::memset(params, 0, sizeof(params));
-    params[0].buffer_type = MYSQL_TYPE_LONG;
-    params[0].buffer = &contentId;
-    params[0].buffer_length = sizeof(contentId);
+    if (mysql_query(connection, query.c_str())) {
+        throw std::runtime_error("Failed to query content: " + std::string(mysql_error(connection)));
+    }
 
-    params[1].buffer_type = MYSQL_TYPE_STRING;
-    params[1].buffer = const_cast<char*>(serializedEmbedding.c_str());
-    params[1].buffer_length = serializedEmbedding.size();
-    params[1].length = &vectorLength;
+    // Rows are fetched as the server sends them rather than buffered whole;
+    // content_text can be large. Paging by id (instead of one cursor over
+    // the table) keeps the cursor from sitting idle past net_write_timeout
+    // while a page is being embedded.
+    MYSQL_RES* result = mysql_use_result(connection);
+    if (!result) {
+        throw std::runtime_error("Failed to get result: " + std::string(mysql_error(connection)));
+    }
 
-    params[2].buffer_type = MYSQL_TYPE_LONG;
-    params[2].buffer = &dimension;
-    params[2].buffer_length = sizeof(dimension);
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        unsigned long* lengths = mysql_fetch_lengths(result);
+        auto text = [&](int i) { return row[i] ? std::string(row[i], lengths[i]) : std::string(); };
+        IndexableContent content;
+        content.contentId = row[0] ? std::atoi(row[0]) : 0;
+        content.title = text(1);
+        content.text = text(2);
+        content.gradeLevel = text(3);
+        content.subject = text(4);
+        content.hasEmbeddings = row[5] && std::atoi(row[5]) != 0;
+        content.chunkMetadata = text(6);
+        page.push_back(std::move(content));
+    }
+    const bool failed = mysql_errno(connection) != 0;
+    const std::string error = failed ? mysql_error(connection) : "";
+    mysql_free_result(result);
+    if (failed) {
+        throw std::runtime_error("Failed to read content: " + error);
+    }
+    return page;
+}
 
-    if (mysql_stmt_bind_param(stmt, params) != 0) {
-        std::cerr << "[Database] Failed to bind embedding insert params: " << mysql_stmt_error(stmt) << std::endl;
-        mysql_stmt_close(stmt);
+void Database::deleteEmbeddings(int contentId, const std::string& table) {
+    ConnectionGuard guard(*this);
+    deleteEmbeddingsLocked(contentId, table);
+}
+
+void Database::deleteEmbeddingsLocked(int contentId, const std::string& table) {
+    const std::string duplicates = quoteTable(duplicatesTable(table));
+    const std::string id = std::to_string(contentId);
+    std::vector<std::string> statements;
+    if (table == "content_embeddings") {
+        // Documents whose chunks were collapsed into this one's lose them
+        // with it; they are due for indexing again
+        statements.push_back("UPDATE educational_content SET has_embeddings = FALSE WHERE content_id IN "
+                             "(SELECT content_id FROM " + duplicates + " WHERE canonical_content_id = " + id +
+                             " AND content_id <> " + id + ")");
+    }
+    statements.push_back("DELETE FROM " + duplicates + " WHERE content_id = " + id + " OR canonical_content_id = " + id);
+    statements.push_back("DELETE FROM " + quoteTable(table) + " WHERE content_id = " + id);
+
+    for (const auto& statement : statements) {
+        if (mysql_query(connection, statement.c_str())) {
+            throw std::runtime_error("Failed to delete embeddings: " + std::string(mysql_error(connection)));
+        }
+    }
+}
+
+int Database::insertEmbeddings(const std::vector<EmbeddingRow>& rows, const std::string& table) {
+    ConnectionGuard guard(*this);
+    return insertEmbeddingsLocked(rows, table);
+}
+
+int Database::insertEmbeddingsLocked(const std::vector<EmbeddingRow>& rows, const std::string& table) {
+    if (rows.empty()) {
+        return 0;
+    }
+    std::string query = "INSERT INTO " + quoteTable(table) +
+                        " (content_id, chunk_index, text_chunk, chunk_metadata, embedding_vector, "
+                        "vector_dimension, model_used, token_count, simhash) VALUES ";
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        const EmbeddingRow& row = rows[i];
+        if (row.embedding.size() != static_cast<size_t>(kEmbeddingDimension)) {
+            throw std::runtime_error("Embedding for content " + std::to_string(row.contentId) + " chunk " +
+                                     std::to_string(row.chunkIndex) + " has dimension " +
+                                     std::to_string(row.embedding.size()));
+        }
+        if (i > 0) {
+            query += ", ";
+        }
+        query += "(" + std::to_string(row.contentId) + ", " + std::to_string(row.chunkIndex) + ", '" +
+                 escape(row.text) + "', " + (row.metadata.empty() ? std::string("NULL") : "'" + escape(row.metadata) + "'") +
+                 ", VEC_FromText('" + serializeVector(row.embedding) + "'), " + std::to_string(kEmbeddingDimension) +
+                 ", '" + (row.model.empty() ? std::string("llama.cpp") : escape(row.model)) + "', " +
+                 (row.tokenCount >= 0 ? std::to_string(row.tokenCount) : std::string("NULL")) + ", " +
+                 std::to_string(row.simhash) + ")";
+    }
+
+    if (mysql_real_query(connection, query.c_str(), query.size())) {
+        throw std::runtime_error("Embedding insert failed: " + std::string(mysql_error(connection)));
+    }
+    return static_cast<int>(mysql_affected_rows(connection));
+}
+
+void Database::replaceEmbeddings(const std::vector<int>& contentIds, const std::vector<EmbeddingRow>& rows,
+                                 const std::vector<ChunkDuplicateRow>& duplicates, const std::string& table) {
+    ConnectionGuard guard(*this);
+    if (mysql_query(connection, "START TRANSACTION")) {
+        throw std::runtime_error("Failed to start transaction: " + std::string(mysql_error(connection)));
+    }
+    try {
+        for (int contentId : contentIds) {
+            deleteEmbeddingsLocked(contentId, table);
+        }
+        insertEmbeddingsLocked(rows, table);
+        insertChunkDuplicatesLocked(duplicates, table);
+        if (mysql_query(connection, "COMMIT")) {
+            throw std::runtime_error("Failed to commit embeddings: " + std::string(mysql_error(connection)));
+        }
+    } catch (...) {
+        mysql_query(connection, "ROLLBACK");
+        throw;
+    }
+}
+
+void Database::markContentEmbedded(int contentId, int embeddingCount) {
+    ConnectionGuard guard(*this);
+    std::ostringstream query;
+    query << "UPDATE educational_content SET has_embeddings = " << (embeddingCount > 0 ? "TRUE" : "FALSE")
+          << ", embedding_count = " << embeddingCount << ", last_embedded = NOW(), updated_at = updated_at "
+          << "WHERE content_id = " << contentId;
+
+    if (mysql_query(connection, query.str().c_str())) {
+        throw std::runtime_error("Failed to update content embedding status: " +
+                                 std::string(mysql_error(connection)));
+    }
+}
+
+std::vector<ChunkSignature> Database::getChunkSignatures(const std::string& table) {
+    ConnectionGuard guard(*this);
+    const std::string query =
+        "SELECT content_id, chunk_index, simhash, "
+        "JSON_UNQUOTE(JSON_EXTRACT(chunk_metadata, '$.agent_scope')), "
+        "JSON_UNQUOTE(JSON_EXTRACT(chunk_metadata, '$.grade_level')), "
+        "JSON_UNQUOTE(JSON_EXTRACT(chunk_metadata, '$.subject')) FROM " +
+        quoteTable(table) + " WHERE simhash IS NOT NULL";
+    if (mysql_query(connection, query.c_str())) {
+        throw std::runtime_error("Failed to query chunk signatures: " + std::string(mysql_error(connection)));
+    }
+
+    MYSQL_RES* result = mysql_use_result(connection);
+    if (!result) {
+        throw std::runtime_error("Failed to get result: " + std::string(mysql_error(connection)));
+    }
+
+    std::vector<ChunkSignature> signatures;
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        ChunkSignature signature;
+        signature.contentId = row[0] ? std::atoi(row[0]) : 0;
+        signature.chunkIndex = row[1] ? std::atoi(row[1]) : 0;
+        signature.simhash = row[2] ? std::strtoull(row[2], nullptr, 10) : 0;
+        signature.scope = signatureScope(row[3] ? row[3] : "", row[4] ? row[4] : "", row[5] ? row[5] : "");
+        signatures.push_back(signature);
+    }
+    mysql_free_result(result);
+    return signatures;
+}
+
+void Database::insertChunkDuplicates(const std::vector<ChunkDuplicateRow>& rows, const std::string& table) {
+    ConnectionGuard guard(*this);
+    insertChunkDuplicatesLocked(rows, table);
+}
+
+void Database::insertChunkDuplicatesLocked(const std::vector<ChunkDuplicateRow>& rows, const std::string& table) {
+    if (rows.empty()) {
         return;
     }
+    std::ostringstream query;
+    query << "REPLACE INTO " << quoteTable(duplicatesTable(table))
+          << " (content_id, chunk_index, canonical_content_id, canonical_chunk_index, hamming_distance) VALUES ";
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        const ChunkDuplicateRow& row = rows[i];
+        query << (i > 0 ? ", " : "") << "(" << row.contentId << ", " << row.chunkIndex << ", "
+              << row.canonicalContentId << ", " << row.canonicalChunkIndex << ", " << row.distance << ")";
+    }
 
-    if (mysql_stmt_execute(stmt) != 0) {
-        std::cerr << "[Database] Embedding insert failed: " << mysql_stmt_error(stmt) << std::endl;
+    if (mysql_query(connection, query.str().c_str())) {
+        throw std::runtime_error("Duplicate chunk insert failed: " + std::string(mysql_error(connection)));
     }
+}
 
-    mysql_stmt_close(stmt);
+bool Database::getReembedRun(const std::string& runId, ReembedRun& run) {
+    ConnectionGuard guard(*this);
+    std::ostringstream query;
+    query << "SELECT run_id, shadow_table, status, last_content_id, documents, chunks, failed, error, started_at "
+          << "FROM embedding_reembed_runs WHERE run_id = '" << escape(runId) << "'";
+
+    if (mysql_query(connection, query.str().c_str())) {
+        throw std::runtime_error("Failed to query re-embed run: " + std::string(mysql_error(connection)));
+    }
+
+    MYSQL_RES* result = mysql_store_result(connection);
+    if (!result) {
+        throw std::runtime_error("Failed to get result: " + std::string(mysql_error(connection)));
+    }
+
+    MYSQL_ROW row = mysql_fetch_row(result);
+    if (row) {
+        run.id = row[0] ? row[0] : "";
+        run.shadowTable = row[1] ? row[1] : "";
+        run.status = row[2] ? row[2] : "";
+        run.lastContentId = row[3] ? std::atoi(row[3]) : 0;
+        run.documents = row[4] ? std::atoi(row[4]) : 0;
+        run.chunks = row[5] ? std::atoi(row[5]) : 0;
+        run.failed = row[6] ? std::atoi(row[6]) : 0;
+        run.error = row[7] ? row[7] : "";
+        run.startedAt = row[8] ? row[8] : "";
+    }
+    mysql_free_result(result);
+    return row != nullptr;
+}
+
+void Database::saveReembedRun(const ReembedRun& run) {
+    ConnectionGuard guard(*this);
+    const std::string error = run.error.empty() ? std::string("NULL") : "'" + escape(run.error) + "'";
+    const std::string finished = run.status == "running" ? "NULL" : "NOW()";
+    const std::string started = run.startedAt.empty() ? std::string("NOW()") : "'" + escape(run.startedAt) + "'";
+    std::ostringstream query;
+    query << "INSERT INTO embedding_reembed_runs "
+          << "(run_id, shadow_table, status, last_content_id, documents, chunks, failed, error, started_at, "
+          << "finished_at) VALUES ('"
+          << escape(run.id) << "', '" << escape(run.shadowTable) << "', '" << escape(run.status) << "', "
+          << run.lastContentId << ", " << run.documents << ", " << run.chunks << ", " << run.failed << ", "
+          << error << ", " << started << ", " << finished << ") "
+          << "ON DUPLICATE KEY UPDATE shadow_table = VALUES(shadow_table), status = VALUES(status), "
+          << "last_content_id = VALUES(last_content_id), documents = VALUES(documents), chunks = VALUES(chunks), "
+          << "failed = VALUES(failed), error = VALUES(error), started_at = VALUES(started_at), "
+          << "finished_at = VALUES(finished_at)";
+
+    if (mysql_query(connection, query.str().c_str())) {
+        throw std::runtime_error("Failed to save re-embed run: " + std::string(mysql_error(connection)));
+    }
+}
+
+void Database::createShadowEmbeddingsTable(const std::string& table, bool reset) {
+    if (table == "content_embeddings") {
+        throw std::invalid_argument("The shadow table cannot be content_embeddings itself");
+    }
+    ConnectionGuard guard(*this);
+    const std::string shadow = quoteTable(table);
+    const std::string shadowDuplicates = quoteTable(duplicatesTable(table));
+    if (reset && mysql_query(connection, ("DROP TABLE IF EXISTS " + shadow + ", " + shadowDuplicates).c_str())) {
+        throw std::runtime_error("Failed to drop " + table + ": " + std::string(mysql_error(connection)));
+    }
+    const std::string statements[] = {
+        "CREATE TABLE IF NOT EXISTS " + shadow + " LIKE content_embeddings",
+        "CREATE TABLE IF NOT EXISTS " + shadowDuplicates + " LIKE content_embeddings_duplicates",
+    };
+    for (const auto& statement : statements) {
+        if (mysql_query(connection, statement.c_str())) {
+            throw std::runtime_error("Failed to create " + table + ": " + std::string(mysql_error(connection)));
+        }
+    }
+}
+
+void Database::swapEmbeddingsTable(const std::string& table, bool keepOld) {
+    ConnectionGuard guard(*this);
+    const std::string shadow = quoteTable(table);
+    const std::string shadowDuplicates = quoteTable(duplicatesTable(table));
+    // RENAME TABLE swaps all names in one step; readers see either the old
+    // or the new tables, never neither.
+    const std::string statements[] = {
+        "DROP TABLE IF EXISTS content_embeddings_old, content_embeddings_old_duplicates",
+        "RENAME TABLE content_embeddings TO content_embeddings_old, " + shadow + " TO content_embeddings, "
+        "content_embeddings_duplicates TO content_embeddings_old_duplicates, " + shadowDuplicates +
+            " TO content_embeddings_duplicates",
+    };
+    for (const auto& statement : statements) {
+        if (mysql_query(connection, statement.c_str())) {
+            throw std::runtime_error("Failed to swap in " + table + ": " + std::string(mysql_error(connection)));
+        }
+    }
+    if (!keepOld && mysql_query(connection, "DROP TABLE content_embeddings_old, content_embeddings_old_duplicates")) {
+        LOG_WARN << "[Database] Could not drop content_embeddings_old: " << mysql_error(connection);
+    }
+}
+
+void Database::refreshEmbeddingCounts() {
+    ConnectionGuard guard(*this);
+    const char* query =
+        "UPDATE educational_content ec "
+        "LEFT JOIN (SELECT content_id, COUNT(*) AS chunks FROM "
+        "(SELECT content_id FROM content_embeddings UNION ALL SELECT content_id FROM content_embeddings_duplicates) c "
+        "GROUP BY content_id) e "
+        "ON e.content_id = ec.content_id "
+        "SET ec.has_embeddings = (e.chunks IS NOT NULL), ec.embedding_count = COALESCE(e.chunks, 0), "
+        "ec.last_embedded = IF(e.chunks IS NULL, ec.last_embedded, NOW()), ec.updated_at = ec.updated_at";
+    if (mysql_query(connection, query)) {
+        throw std::runtime_error("Failed to refresh embedding counts: " + std::string(mysql_error(connection)));
+    }
 }
 
 std::vector<float> Database::getEmbedding(int embeddingId) {
+    ConnectionGuard guard(*this);
     std::vector<float> embedding;
 
     const char* sql = "SELECT VEC_ToText(embedding_vector) FROM content_embeddings WHERE id = ?";
     MYSQL_STMT* stmt = mysql_stmt_init(connection);
     if (!stmt) {
-        std::cerr << "[Database] Failed to init statement for getEmbedding" << std::endl;
+        LOG_ERROR << "[Database] Failed to init statement for getEmbedding";
         return embedding;
     }
 
     if (mysql_stmt_prepare(stmt, sql, std::strlen(sql)) != 0) {
-        std::cerr << "[Database] Failed to prepare getEmbedding: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to prepare getEmbedding: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return embedding;
     }
@@ -664,13 +1020,13 @@ std::vector<float> Database::getEmbedding(int embeddingId) {
     param.buffer = &embeddingId;
     param.buffer_length = sizeof(embeddingId);
     if (mysql_stmt_bind_param(stmt, &param) != 0) {
-        std::cerr << "[Database] Failed to bind getEmbedding param: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to bind getEmbedding param: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return embedding;
     }
 
     if (mysql_stmt_execute(stmt) != 0) {
-        std::cerr << "[Database] getEmbedding execute failed: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] getEmbedding execute failed: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return embedding;
     }
@@ -683,13 +1039,13 @@ std::vector<float> Database::getEmbedding(int embeddingId) {
     resultBind.length = &valueLength;
 
     if (mysql_stmt_bind_result(stmt, &resultBind) != 0) {
-        std::cerr << "[Database] Failed to bind getEmbedding result: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to bind getEmbedding result: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return embedding;
     }
 
     if (mysql_stmt_store_result(stmt) != 0) {
-        std::cerr << "[Database] Failed to buffer getEmbedding result: " << mysql_stmt_error(stmt) << std::endl;
+        LOG_ERROR << "[Database] Failed to buffer getEmbedding result: " << mysql_stmt_error(stmt);
         mysql_stmt_close(stmt);
         return embedding;
     }
@@ -710,7 +1066,43 @@ std::vector<float> Database::getEmbedding(int embeddingId) {
     return embedding;
 }
 
+std::vector<EmbeddingRow> Database::getStoredEmbeddings(const std::string& table) {
+    ConnectionGuard guard(*this);
+    const std::string query = "SELECT content_id, chunk_index, model_used, VEC_ToText(embedding_vector) FROM " +
+                              quoteTable(table) + " ORDER BY id";
+    if (mysql_query(connection, query.c_str())) {
+        throw std::runtime_error("Failed to query stored embeddings: " + std::string(mysql_error(connection)));
+    }
+
+    MYSQL_RES* result = mysql_use_result(connection);
+    if (!result) {
+        throw std::runtime_error("Failed to get result: " + std::string(mysql_error(connection)));
+    }
+
+    std::vector<EmbeddingRow> rows;
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        EmbeddingRow embedding;
+        embedding.contentId = row[0] ? std::atoi(row[0]) : 0;
+        embedding.chunkIndex = row[1] ? std::atoi(row[1]) : 0;
+        embedding.model = row[2] ? row[2] : "";
+        embedding.embedding = row[3] ? parseVector(row[3]) : std::vector<float>();
+        rows.push_back(std::move(embedding));
+    }
+    mysql_free_result(result);
+    return rows;
+}
+
+void Database::setVectorIndexEfSearch(int efSearch) {
+    ConnectionGuard guard(*this);
+    const std::string query = "SET SESSION mhnsw_ef_search = " + std::to_string(efSearch);
+    if (mysql_query(connection, query.c_str())) {
+        throw std::runtime_error("Failed to set mhnsw_ef_search: " + std::string(mysql_error(connection)));
+    }
+}
+
 std::vector<std::pair<std::string, std::string>> Database::searchEducationalContent(const std::string& query, int limit) {
+    ConnectionGuard guard(*this);
     std::vector<std::pair<std::string, std::string>> results;
     
     // Escape the search query
@@ -729,16 +1121,16 @@ std::vector<std::pair<std::string, std::string>> Database::searchEducationalCont
     
     delete[] escapedQuery;
     
-    std::cout << "[RAG] Searching educational content for: " << query << std::endl;
+    LOG_INFO << "[RAG] Searching educational content for: " << query;
     
     if (mysql_query(connection, sql.str().c_str())) {
-        std::cerr << "[RAG] Search query failed: " << mysql_error(connection) << std::endl;
+        LOG_ERROR << "[RAG] Search query failed: " << mysql_error(connection);
         return results;
     }
     
     MYSQL_RES* result = mysql_store_result(connection);
     if (!result) {
-        std::cerr << "[RAG] Failed to store result" << std::endl;
+        LOG_ERROR << "[RAG] Failed to store result";
         return results;
     }
     
@@ -752,11 +1144,133 @@ std::vector<std::pair<std::string, std::string>> Database::searchEducationalCont
                 content = content.substr(0, 1500) + "...";
             }
             results.push_back({title, content});
-            std::cout << "[RAG] Found: " << title << " (relevance: " << (row[2] ? row[2] : "?") << ")" << std::endl;
+            LOG_INFO << "[RAG] Found: " << title << " (relevance: " << (row[2] ? row[2] : "?") << ")";
         }
     }
     
     mysql_free_result(result);
-    std::cout << "[RAG] Found " << results.size() << " relevant lessons" << std::endl;
+    LOG_INFO << "[RAG] Found " << results.size() << " relevant lessons";
     return results;
 }
+
+std::string Database::escape(const std::string& value) {
+    std::string escaped(value.length() * 2 + 1, '\0');
+    unsigned long length = mysql_real_escape_string(connection, &escaped[0], value.c_str(), value.length());
+    escaped.resize(length);
+    return escaped;
+}
+
+namespace {
+const char* const kJobColumns =
+    "job_id, status, user_id, agent_id, message, rag_context, result, error, attempts, "
+    "created_at, started_at, finished_at, kind";
+
+GenerationJob jobFromRow(MYSQL_ROW row, unsigned long* lengths) {
+    auto text = [&](int i) { return row[i] ? std::string(row[i], lengths[i]) : std::string(); };
+    GenerationJob job;
+    job.id = text(0);
+    job.status = text(1);
+    job.userId = row[2] ? std::atoi(row[2]) : 0;
+    job.agentId = row[3] ? std::atoi(row[3]) : 0;
+    job.message = text(4);
+    job.ragContext = text(5);
+    job.result = text(6);
+    job.error = text(7);
+    job.attempts = row[8] ? std::atoi(row[8]) : 0;
+    job.createdAt = text(9);
+    job.startedAt = text(10);
+    job.finishedAt = text(11);
+    job.kind = text(12);
+    return job;
+}
+}
+
+void Database::createJob(const GenerationJob& job) {
+    ConnectionGuard guard(*this);
+    std::ostringstream query;
+    query << "INSERT INTO generation_jobs (job_id, kind, status, user_id, agent_id, message, rag_context) VALUES ('"
+          << escape(job.id) << "', '" << escape(job.kind) << "', '" << escape(job.status) << "', " << job.userId
+          << ", " << job.agentId << ", '" << escape(job.message) << "', '" << escape(job.ragContext) << "')";
+
+    if (mysql_query(connection, query.str().c_str())) {
+        throw std::runtime_error("Failed to create job: " + std::string(mysql_error(connection)));
+    }
+}
+
+void Database::updateJob(const GenerationJob& job) {
+    ConnectionGuard guard(*this);
+    std::ostringstream query;
+    query << "UPDATE generation_jobs SET status = '" << escape(job.status) << "', "
+          << "result = " << (job.result.empty() ? std::string("NULL") : "'" + escape(job.result) + "'") << ", "
+          << "error = " << (job.error.empty() ? std::string("NULL") : "'" + escape(job.error) + "'") << ", "
+          << "attempts = " << job.attempts;
+    if (job.status == "running") {
+        query << ", started_at = NOW(), finished_at = NULL";
+    } else if (job.status == "succeeded" || job.status == "failed") {
+        query << ", finished_at = NOW()";
+    }
+    query << " WHERE job_id = '" << escape(job.id) << "'";
+
+    if (mysql_query(connection, query.str().c_str())) {
+        throw std::runtime_error("Failed to update job: " + std::string(mysql_error(connection)));
+    }
+}
+
+bool Database::getJob(const std::string& jobId, GenerationJob& job) {
+    ConnectionGuard guard(*this);
+    std::ostringstream query;
+    query << "SELECT " << kJobColumns << " FROM generation_jobs WHERE job_id = '" << escape(jobId) << "'";
+
+    if (mysql_query(connection, query.str().c_str())) {
+        throw std::runtime_error("Failed to query job: " + std::string(mysql_error(connection)));
+    }
+
+    MYSQL_RES* result = mysql_store_result(connection);
+    if (!result) {
+        throw std::runtime_error("Failed to get result: " + std::string(mysql_error(connection)));
+    }
+
+    MYSQL_ROW row = mysql_fetch_row(result);
+    if (row) {
+        job = jobFromRow(row, mysql_fetch_lengths(result));
+    }
+    mysql_free_result(result);
+    return row != nullptr;
+}
+
+std::vector<GenerationJob> Database::getUnfinishedJobs() {
+    ConnectionGuard guard(*this);
+    std::vector<GenerationJob> jobs;
+    std::ostringstream query;
+    query << "SELECT " << kJobColumns << " FROM generation_jobs "
+          << "WHERE status IN ('queued', 'running') ORDER BY created_at ASC";
+
+    if (mysql_query(connection, query.str().c_str())) {
+        throw std::runtime_error("Failed to query jobs: " + std::string(mysql_error(connection)));
+    }
+
+    MYSQL_RES* result = mysql_store_result(connection);
+    if (!result) {
+        throw std::runtime_error("Failed to get result: " + std::string(mysql_error(connection)));
+    }
+
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        jobs.push_back(jobFromRow(row, mysql_fetch_lengths(result)));
+    }
+    mysql_free_result(result);
+    return jobs;
+}
+
+int Database::purgeFinishedJobs(int olderThanDays) {
+    ConnectionGuard guard(*this);
+    std::ostringstream query;
+    query << "DELETE FROM generation_jobs WHERE status IN ('succeeded', 'failed') "
+          << "AND finished_at < NOW() - INTERVAL " << olderThanDays << " DAY";
+
+    if (mysql_query(connection, query.str().c_str())) {
+        LOG_ERROR << "[Database] Failed to purge old jobs: " << mysql_error(connection);
+        return 0;
+    }
+    return static_cast<int>(mysql_affected_rows(connection));
+}
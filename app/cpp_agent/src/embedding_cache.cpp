@@ -0,0 +1,299 @@
+#include "../include/embedding_cache.h"
+#include "../include/logger.h"
+#include "../include/metrics.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr char kMagic[8] = {'P', 'H', 'E', 'M', 'B', 'C', '0', '1'};
+constexpr std::uint32_t kVersion = 1;
+
+struct FileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t dimension;
+    std::uint64_t capacity;
+    std::uint64_t shards;
+};
+
+constexpr std::size_t kHeaderBytes = 64;
+static_assert(sizeof(FileHeader) <= kHeaderBytes, "file header must fit its reserved space");
+
+struct CacheMetrics {
+    Counter& hits;
+    Counter& misses;
+    Counter& evictions;
+    Counter& savedMicros;
+    Gauge& entries;
+};
+
+CacheMetrics& cacheMetrics() {
+    static CacheMetrics m{
+        Metrics::instance().counter("embedding_cache_hits_total", "Embedding lookups served from cache"),
+        Metrics::instance().counter("embedding_cache_misses_total", "Embedding lookups that required llama-server"),
+        Metrics::instance().counter("embedding_cache_evictions_total", "Embedding cache LRU evictions"),
+        Metrics::instance().counter("embedding_cache_saved_microseconds_total",
+                                    "Estimated llama-server latency avoided by cache hits"),
+        Metrics::instance().gauge("embedding_cache_entries", "Embedding vectors currently cached"),
+    };
+    return m;
+}
+} // namespace
+
+EmbeddingCache::EmbeddingCache(std::size_t capacity, std::size_t shards, int dimension, const std::string& persistPath)
+    : dimension_(dimension > 0 ? dimension : 384),
+      persistPath_(persistPath) {
+    if (shards == 0) {
+        shards = 1;
+    }
+    perShard_ = std::max<std::size_t>(1, (capacity + shards - 1) / shards);
+    capacity_ = perShard_ * shards;
+    recordSize_ = sizeof(RecordHeader) + static_cast<std::size_t>(dimension_) * sizeof(float);
+
+    shards_.reserve(shards);
+    for (std::size_t i = 0; i < shards; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+
+    if (!persistPath_.empty()) {
+        mapped_ = openMapped();
+        if (!mapped_) {
+            LOG_WARN << "[EmbeddingCache] Falling back to in-memory cache";
+        }
+    }
+
+    if (!mapped_) {
+        heapSlab_.assign(kHeaderBytes + capacity_ * recordSize_, 0);
+        base_ = heapSlab_.data();
+    }
+
+    loadRecords();
+
+    LOG_INFO << "[EmbeddingCache] capacity=" << capacity_ << " shards=" << shards_.size()
+             << " dimension=" << dimension_
+             << " backing=" << (mapped_ ? persistPath_ : std::string("memory"))
+             << " restored=" << stats().entries;
+}
+
+EmbeddingCache::~EmbeddingCache() {
+    if (mapped_ && base_) {
+        msync(base_, mappedBytes_, MS_SYNC);
+        munmap(base_, mappedBytes_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool EmbeddingCache::openMapped() {
+    fd_ = open(persistPath_.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+        LOG_ERROR << "[EmbeddingCache] Cannot open " << persistPath_ << ": " << std::strerror(errno);
+        return false;
+    }
+
+    mappedBytes_ = kHeaderBytes + capacity_ * recordSize_;
+    struct stat st{};
+    bool fresh = fstat(fd_, &st) != 0 || static_cast<std::size_t>(st.st_size) != mappedBytes_;
+    if (fresh && (ftruncate(fd_, 0) != 0 || ftruncate(fd_, static_cast<off_t>(mappedBytes_)) != 0)) {
+        LOG_ERROR << "[EmbeddingCache] Cannot size " << persistPath_ << ": " << std::strerror(errno);
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    void* region = mmap(nullptr, mappedBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (region == MAP_FAILED) {
+        LOG_ERROR << "[EmbeddingCache] mmap failed for " << persistPath_ << ": " << std::strerror(errno);
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    base_ = static_cast<unsigned char*>(region);
+
+    auto* header = reinterpret_cast<FileHeader*>(base_);
+    bool compatible = !fresh &&
+                      std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 &&
+                      header->version == kVersion &&
+                      header->dimension == static_cast<std::uint32_t>(dimension_) &&
+                      header->capacity == capacity_ &&
+                      header->shards == shards_.size();
+    if (!compatible) {
+        if (!fresh) {
+            LOG_INFO << "[EmbeddingCache] Layout changed, resetting " << persistPath_;
+        }
+        std::memset(base_, 0, mappedBytes_);
+        std::memcpy(header->magic, kMagic, sizeof(kMagic));
+        header->version = kVersion;
+        header->dimension = static_cast<std::uint32_t>(dimension_);
+        header->capacity = capacity_;
+        header->shards = shards_.size();
+    }
+    return true;
+}
+
+void EmbeddingCache::loadRecords() {
+    std::uint64_t maxTick = 0;
+    std::size_t restored = 0;
+
+    for (std::size_t s = 0; s < shards_.size(); ++s) {
+        Shard& shard = *shards_[s];
+        std::vector<std::pair<std::uint64_t, std::size_t>> live;
+        for (std::size_t i = s * perShard_; i < (s + 1) * perShard_; ++i) {
+            RecordHeader* rec = record(i);
+            Hash128 key{rec->hi, rec->lo};
+            if (rec->valid == 1 && shardFor(key) == s && shard.index.count(key) == 0) {
+                live.emplace_back(rec->tick, i);
+                shard.index.emplace(key, shard.lru.end());
+            } else {
+                rec->valid = 0;
+                shard.freeRecords.push_back(i);
+            }
+        }
+
+        std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        for (const auto& [tick, index] : live) {
+            RecordHeader* rec = record(index);
+            shard.lru.push_back(index);
+            shard.index[Hash128{rec->hi, rec->lo}] = std::prev(shard.lru.end());
+            maxTick = std::max(maxTick, tick);
+        }
+        restored += live.size();
+    }
+
+    tick_.store(maxTick + 1, std::memory_order_relaxed);
+    cacheMetrics().entries.set(static_cast<std::int64_t>(restored));
+}
+
+std::string EmbeddingCache::normalize(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    bool pendingSpace = false;
+    for (unsigned char c : text) {
+        if (std::isspace(c)) {
+            pendingSpace = !out.empty();
+            continue;
+        }
+        if (pendingSpace) {
+            out.push_back(' ');
+            pendingSpace = false;
+        }
+        out.push_back(static_cast<char>(c));
+    }
+    return out;
+}
+
+Hash128 EmbeddingCache::makeKey(const std::string& modelId, const std::string& text) {
+    std::string material = modelId;
+    material.push_back('\0');
+    material += normalize(text);
+    return hash128(material);
+}
+
+std::size_t EmbeddingCache::shardFor(const Hash128& key) const {
+    return static_cast<std::size_t>(key.hi % shards_.size());
+}
+
+EmbeddingCache::RecordHeader* EmbeddingCache::record(std::size_t index) const {
+    return reinterpret_cast<RecordHeader*>(base_ + kHeaderBytes + index * recordSize_);
+}
+
+float* EmbeddingCache::vectorAt(std::size_t index) const {
+    return reinterpret_cast<float*>(base_ + kHeaderBytes + index * recordSize_ + sizeof(RecordHeader));
+}
+
+bool EmbeddingCache::lookup(const Hash128& key, std::vector<float>& out) {
+    Shard& shard = *shards_[shardFor(key)];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            std::size_t index = *it->second;
+            record(index)->tick = tick_.fetch_add(1, std::memory_order_relaxed);
+            const float* vec = vectorAt(index);
+            out.assign(vec, vec + dimension_);
+        } else {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            cacheMetrics().misses.inc();
+            return false;
+        }
+    }
+
+    std::uint64_t saved = avgMissMicros_.load(std::memory_order_relaxed);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    savedMicros_.fetch_add(saved, std::memory_order_relaxed);
+    cacheMetrics().hits.inc();
+    cacheMetrics().savedMicros.inc(saved);
+    return true;
+}
+
+void EmbeddingCache::insert(const Hash128& key, const std::vector<float>& embedding) {
+    if (static_cast<int>(embedding.size()) != dimension_) {
+        return;
+    }
+
+    Shard& shard = *shards_[shardFor(key)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    std::size_t index;
+    auto existing = shard.index.find(key);
+    if (existing != shard.index.end()) {
+        index = *existing->second;
+        shard.lru.splice(shard.lru.begin(), shard.lru, existing->second);
+    } else {
+        if (!shard.freeRecords.empty()) {
+            index = shard.freeRecords.back();
+            shard.freeRecords.pop_back();
+            cacheMetrics().entries.add(1);
+        } else {
+            index = shard.lru.back();
+            shard.lru.pop_back();
+            RecordHeader* victim = record(index);
+            shard.index.erase(Hash128{victim->hi, victim->lo});
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+            cacheMetrics().evictions.inc();
+        }
+        shard.lru.push_front(index);
+        shard.index[key] = shard.lru.begin();
+    }
+
+    // Invalidate first so a crash mid-write never restores a torn vector.
+    RecordHeader* rec = record(index);
+    rec->valid = 0;
+    std::memcpy(vectorAt(index), embedding.data(), embedding.size() * sizeof(float));
+    rec->hi = key.hi;
+    rec->lo = key.lo;
+    rec->tick = tick_.fetch_add(1, std::memory_order_relaxed);
+    rec->valid = 1;
+    inserts_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EmbeddingCache::recordMissLatency(std::chrono::microseconds latency) {
+    // Exponential moving average (alpha = 1/8); races only blur the estimate.
+    std::uint64_t sample = static_cast<std::uint64_t>(std::max<std::int64_t>(0, latency.count()));
+    std::uint64_t current = avgMissMicros_.load(std::memory_order_relaxed);
+    std::uint64_t next = current == 0 ? sample : current - current / 8 + sample / 8;
+    avgMissMicros_.store(next, std::memory_order_relaxed);
+}
+
+EmbeddingCache::Stats EmbeddingCache::stats() const {
+    Stats s;
+    s.hits = hits_.load(std::memory_order_relaxed);
+    s.misses = misses_.load(std::memory_order_relaxed);
+    s.inserts = inserts_.load(std::memory_order_relaxed);
+    s.evictions = evictions_.load(std::memory_order_relaxed);
+    s.savedMicros = savedMicros_.load(std::memory_order_relaxed);
+    s.capacity = capacity_;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        s.entries += shard->index.size();
+    }
+    return s;
+}
@@ -1,32 +1,82 @@
 #include "../include/embedding_generator.h"
+#include "../include/embedding_cache.h"
 #include "../include/llamacpp_client.h"
-#include <iostream>
+#include "../include/logger.h"
+#include <chrono>
 
-EmbeddingGenerator::EmbeddingGenerator(LlamaCppClient* client, int expectedDimension)
-    : client_(client), expectedDimension_(expectedDimension) {
+namespace {
+constexpr std::uint64_t kStatsLogInterval = 1000;
 }
 
-std::vector<float> EmbeddingGenerator::generate(const std::string& text) const {
+EmbeddingGenerator::EmbeddingGenerator(LlamaCppClient* client, int expectedDimension, EmbeddingCache* cache)
+    : client_(client), expectedDimension_(expectedDimension), cache_(cache) {
+}
+
+std::vector<float> EmbeddingGenerator::generate(const std::string& text, const Deadline& deadline) const {
     if (!client_) {
-        std::cerr << "[EmbeddingGenerator] Llama client unavailable" << std::endl;
+        LOG_ERROR << "[EmbeddingGenerator] Llama client unavailable";
         return {};
     }
 
     if (text.empty()) {
-        std::cerr << "[EmbeddingGenerator] Empty chunk received" << std::endl;
+        LOG_ERROR << "[EmbeddingGenerator] Empty chunk received";
         return {};
     }
 
+    Hash128 cacheKey;
+    if (cache_) {
+        cacheKey = EmbeddingCache::makeKey(client_->modelId(), text);
+        std::vector<float> cached;
+        if (cache_->lookup(cacheKey, cached)) {
+            return cached;
+        }
+    }
+
     try {
-        auto embedding = client_->embed(text, expectedDimension_);
+        bool shared = false;
+        auto started = std::chrono::steady_clock::now();
+        // A follower whose leader ran out of its own (shorter) deadline
+        // tries once more with what is left of its own
+        std::vector<float> embedding;
+        try {
+            embedding = inflight_.run(text, [&]() {
+                return client_->embed(text, expectedDimension_, Priority::Interactive, deadline);
+            }, &shared, deadline);
+        } catch (const DeadlineExceeded&) {
+            if (!shared || deadline.expired()) {
+                throw;
+            }
+            shared = false;
+            embedding = client_->embed(text, expectedDimension_, Priority::Interactive, deadline);
+        }
+        if (shared) {
+            LOG_INFO << "[EmbeddingGenerator] Coalesced identical in-flight embedding (total coalesced="
+                     << inflight_.coalesced() << ")";
+        }
         if (static_cast<int>(embedding.size()) != expectedDimension_) {
-            std::cerr << "[EmbeddingGenerator] Dimension mismatch. Expected " << expectedDimension_
-                      << " got " << embedding.size() << std::endl;
+            LOG_ERROR << "[EmbeddingGenerator] Dimension mismatch. Expected " << expectedDimension_
+                      << " got " << embedding.size();
             return {};
         }
+
+        if (cache_) {
+            cache_->insert(cacheKey, embedding);
+            if (!shared) {
+                cache_->recordMissLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - started));
+            }
+            if (cache_->lookups() % kStatsLogInterval == 0) {
+                auto stats = cache_->stats();
+                LOG_INFO << "[EmbeddingGenerator] cache hits=" << stats.hits << " misses=" << stats.misses
+                         << " entries=" << stats.entries << "/" << stats.capacity
+                         << " saved_ms=" << stats.savedMicros / 1000;
+            }
+        }
         return embedding;
+    } catch (const DeadlineExceeded&) {
+        throw;
     } catch (const std::exception& ex) {
-        std::cerr << "[EmbeddingGenerator] Failed to generate embedding: " << ex.what() << std::endl;
+        LOG_ERROR << "[EmbeddingGenerator] Failed to generate embedding: " << ex.what();
         return {};
     }
 }
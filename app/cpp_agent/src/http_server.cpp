@@ -1,13 +1,104 @@
 #include "../include/http_server.h"
+#include "../include/job_queue.h"
 #include "../include/llamacpp_client.h"
-#include <iostream>
+#include "../include/logger.h"
+#include "../include/metrics.h"
+#include "../include/tracer.h"
 #include <sstream>
 #include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <chrono>
 #include <vector>
-#include <fstream>
 
-HTTPServer::HTTPServer(int port, AgentManager& manager, Config& cfg) 
-    : port(port), serverSocket(-1), running(false), agentManager(manager), config(cfg) {
+namespace {
+// Fixed route names for http_* metric labels, so ids in paths do not create
+// a new series per job or agent.
+const char* const kRoutes[] = {"/agent/chat", "/jobs", "/jobs/{id}", "/agent/list", "/agent/{id}", "/api/chat",
+                               "/rag/index", "/metrics", "/debug/trace", "/health", "other"};
+constexpr std::size_t kRouteCount = sizeof(kRoutes) / sizeof(kRoutes[0]);
+
+// Longest X-Request-Deadline honoured; longer ones would only overflow the clock
+constexpr long long kMaxDeadlineMs = 60LL * 60 * 1000;
+
+std::size_t routeIndex(const std::string& method, std::string path) {
+    path = path.substr(0, path.find('?'));
+    if (path == "/agent/chat") return 0;
+    if (path == "/jobs") return 1;
+    if (path.rfind("/jobs/", 0) == 0) return 2;
+    if (path == "/agent/list") return 3;
+    if (path.rfind("/agent/", 0) == 0 && method == "GET") return 4;
+    if (path == "/api/chat") return 5;
+    if (path == "/rag/index") return 6;
+    if (path == "/metrics") return 7;
+    if (path.rfind("/debug/trace", 0) == 0) return 8;
+    if (path == "/health") return 9;
+    return kRouteCount - 1;
+}
+
+class RequestMetrics {
+public:
+    static RequestMetrics& instance() {
+        static RequestMetrics metrics;
+        return metrics;
+    }
+
+    Gauge& inFlight() { return inFlight_; }
+
+    void record(std::size_t route, int status, std::int64_t micros) {
+        latency_[route]->observeMicros(micros);
+        requests(route, status).inc();
+    }
+
+private:
+    RequestMetrics()
+        : inFlight_(Metrics::instance().gauge("http_requests_in_flight", "HTTP requests currently being handled")) {
+        for (std::size_t route = 0; route < kRouteCount; ++route) {
+            latency_[route] = &Metrics::instance().histogram(
+                "http_request_duration_seconds", "HTTP request latency from read to response",
+                metricLabel("route", kRoutes[route]));
+            for (auto& counter : byStatus_[route]) {
+                counter.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Counters are looked up in the registry once per (route, status) and
+    // cached, keeping the registry lock off the request path.
+    Counter& requests(std::size_t route, int status) {
+        if (status < 100 || status > 599) {
+            status = 500;
+        }
+        std::atomic<Counter*>& slot = byStatus_[route][status - 100];
+        Counter* counter = slot.load(std::memory_order_acquire);
+        if (!counter) {
+            counter = &Metrics::instance().counter(
+                "http_requests_total", "HTTP requests handled by route and status",
+                metricLabel("route", kRoutes[route]) + "," + metricLabel("status", std::to_string(status)));
+            slot.store(counter, std::memory_order_release);
+        }
+        return *counter;
+    }
+
+    Gauge& inFlight_;
+    Histogram* latency_[kRouteCount];
+    std::atomic<Counter*> byStatus_[kRouteCount][500];
+};
+}
+
+HTTPServer::HTTPServer(int port, AgentManager& manager, Config& cfg, JobQueue* jobs) 
+    : port(port), serverSocket(-1), running(false), agentManager(manager), jobQueue(jobs), config(cfg) {
+    if (config.rateLimits.enabled) {
+        rateLimiter = std::make_unique<RateLimiter>(config.rateLimits);
+    }
+    if (config.capture.enabled) {
+        try {
+            capture = std::make_unique<TrafficCapture>(config.capture);
+        } catch (const std::exception& e) {
+            LOG_ERROR << "[HTTPServer] Traffic capture disabled: " << e.what();
+        }
+    }
 }
 
 HTTPServer::~HTTPServer() {
@@ -52,6 +143,8 @@ void HTTPServer::start() {
 void HTTPServer::stop() {
     running = false;
     if (serverSocket >= 0) {
+        // close() alone does not wake a thread blocked in accept()
+        shutdown(serverSocket, SHUT_RDWR);
         close(serverSocket);
         serverSocket = -1;
     }
@@ -68,7 +161,7 @@ void HTTPServer::run() {
         int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
         if (clientSocket < 0) {
             if (running) {
-                std::cerr << "Failed to accept connection" << std::endl;
+                LOG_ERROR << "Failed to accept connection";
             }
             continue;
         }
@@ -90,6 +183,10 @@ void HTTPServer::handleClient(int clientSocket) {
     buffer[bytesRead] = '\0';
     std::string request(buffer);
     
+    const auto received = std::chrono::steady_clock::now();
+    RequestMetrics& requestMetrics = RequestMetrics::instance();
+    requestMetrics.inFlight().add(1);
+    
     std::string method, path;
     std::string body = parseHTTPRequest(request, method, path);
     
@@ -98,52 +195,164 @@ void HTTPServer::handleClient(int clientSocket) {
     try {
         // Route handling
         if (path == "/agent/chat" && method == "POST") {
+            const std::uint64_t traceId = Tracer::newTraceId();
+            TraceScope traceScope(traceId);
+            
             // Parse JSON body
             Json::Value requestJson;
             Json::CharReaderBuilder builder;
             std::stringstream ss(body);
             std::string errs;
+            bool parsed;
+            {
+                TraceSpan span("parse");
+                parsed = Json::parseFromStream(builder, ss, &requestJson, &errs);
+            }
             
-            if (!Json::parseFromStream(builder, ss, &requestJson, &errs)) {
+            if (!parsed) {
                 response = createHTTPResponse(400, "{\"error\":\"Invalid JSON\"}");
+            } else if (!requestJson["userId"].isInt()) {
+                // Without it every caller would share user 0's rate limit
+                // exemption; system callers send 0 explicitly
+                response = createHTTPResponse(400, "{\"error\":\"userId must be an integer\"}");
             } else {
                 int userId = requestJson["userId"].asInt();
                 int agentId = requestJson["agentId"].asInt();
                 std::string message = requestJson["message"].asString();
                 std::string ragContext = requestJson.get("ragContext", "").asString();
                 
-                // DIAGNOSTIC LOGGING: Log exact message received before processing
-                std::cout << "\n===== AGENT SERVICE RECEIVED MESSAGE START =====" << std::endl;
-                std::cout << "userId: " << userId << std::endl;
-                std::cout << "agentId: " << agentId << std::endl;
-                std::cout << "RAW MESSAGE:\n" << message << std::endl;
-                std::cout << "===== AGENT SERVICE RECEIVED MESSAGE END =====" << std::endl;
+                int retryAfter = 0;
+                if (rateLimiter && !rateLimiter->tryAcquire(userId, agentId, retryAfter)) {
+                    LOG_INFO << "[HTTPServer] Rate limited user " << userId << " on agent " << agentId;
+                    Json::Value errorJson;
+                    errorJson["success"] = false;
+                    errorJson["error"] = "Too many requests, please slow down";
+                    errorJson["retryAfter"] = retryAfter;
+                    Json::StreamWriterBuilder writerBuilder;
+                    response = createHTTPResponse(429, Json::writeString(writerBuilder, errorJson), "application/json",
+                                                  "Retry-After: " + std::to_string(retryAfter) + "\r\n");
+                } else {
+                    LOG_DEBUG << "[HTTPServer] Chat request user=" << userId << " agent=" << agentId
+                              << " message_bytes=" << message.size();
                 
-                // Also write to file for easy inspection
-                std::ofstream logFile("/tmp/last_agent_message.txt");
-                logFile << "===== AGENT SERVICE RECEIVED MESSAGE START =====" << std::endl;
-                logFile << "userId: " << userId << std::endl;
-                logFile << "agentId: " << agentId << std::endl;
-                logFile << "RAW MESSAGE:\n" << message << std::endl;
-                logFile << "===== AGENT SERVICE RECEIVED MESSAGE END =====" << std::endl;
-                logFile.close();
+                    // The whole request shares one deadline: X-Request-Deadline
+                    // (milliseconds from now, at most kMaxDeadlineMs) or the
+                    // configured default; a malformed header counts as absent
+                    RequestContext requestContext;
+                    long long budgetMs = config.deadlineDefaultMs;
+                    bool requested = false;
+                    const std::string deadlineHeader = headerValue(request, "X-Request-Deadline");
+                    if (!deadlineHeader.empty()) {
+                        try {
+                            std::size_t parsedChars = 0;
+                            const long long value = std::stoll(deadlineHeader, &parsedChars);
+                            if (parsedChars != deadlineHeader.size()) {
+                                throw std::invalid_argument("trailing characters");
+                            }
+                            budgetMs = std::min(std::max(0LL, value), kMaxDeadlineMs);
+                            requested = true;
+                        } catch (...) {
+                            LOG_WARN << "[HTTPServer] Ignoring malformed X-Request-Deadline: " << deadlineHeader;
+                        }
+                    }
+                    if (budgetMs > 0 || requested) {
+                        requestContext.deadline = Deadline::in(std::chrono::milliseconds(budgetMs));
+                        requestContext.defaultDeadline = !requested;
+                    }
+                    
+                    Json::Value responseJson;
+                    int status = 200;
+                    try {
+                        // Process through agent manager with RAG context
+                        std::string agentResponse;
+                        if (!ragContext.empty()) {
+                            agentResponse = agentManager.processMessageWithContext(userId, agentId, message, ragContext,
+                                                                                   &requestContext);
+                        } else {
+                            agentResponse = agentManager.processMessage(userId, agentId, message, &requestContext);
+                        }
+                        responseJson["response"] = agentResponse;
+                        responseJson["success"] = true;
+                    } catch (const DeadlineExceeded& e) {
+                        responseJson["success"] = false;
+                        responseJson["error"] = e.what();
+                        status = 504;
+                    }
+                    if (!requestContext.degradations.empty()) {
+                        Json::Value degraded(Json::arrayValue);
+                        for (const auto& reason : requestContext.degradations) {
+                            degraded.append(reason);
+                        }
+                        responseJson["degraded"] = degraded;
+                    }
                 
-                // Process through agent manager with RAG context
-                std::string agentResponse;
-                if (!ragContext.empty()) {
-                    agentResponse = agentManager.processMessageWithContext(userId, agentId, message, ragContext);
-                } else {
-                    agentResponse = agentManager.processMessage(userId, agentId, message);
-                }
+                    responseJson["traceId"] = traceIdHex(traceId);
                 
-                Json::Value responseJson;
-                responseJson["response"] = agentResponse;
-                responseJson["success"] = true;
+                    Json::StreamWriterBuilder writerBuilder;
+                    std::string jsonResponse = Json::writeString(writerBuilder, responseJson);
                 
+                    response = createHTTPResponse(status, jsonResponse, "application/json",
+                                                  "X-Trace-Id: " + traceIdHex(traceId) + "\r\n");
+                }
+            }
+        } else if (path == "/jobs" && method == "POST") {
+            Json::Value requestJson;
+            Json::CharReaderBuilder builder;
+            std::stringstream ss(body);
+            std::string errs;
+            
+            if (!jobQueue) {
+                response = createHTTPResponse(503, "{\"error\":\"Job queue unavailable\"}");
+            } else if (!Json::parseFromStream(builder, ss, &requestJson, &errs) ||
+                       !requestJson.isMember("agentId") || requestJson["message"].asString().empty()) {
+                response = createHTTPResponse(400, "{\"error\":\"agentId and message are required\"}");
+            } else {
+                try {
+                    std::string jobId = jobQueue->submit(requestJson["userId"].asInt(),
+                                                         requestJson["agentId"].asInt(),
+                                                         requestJson["message"].asString(),
+                                                         requestJson.get("ragContext", "").asString());
+                    Json::Value responseJson;
+                    responseJson["success"] = true;
+                    responseJson["jobId"] = jobId;
+                    responseJson["status"] = "queued";
+                    Json::StreamWriterBuilder writerBuilder;
+                    response = createHTTPResponse(202, Json::writeString(writerBuilder, responseJson));
+                } catch (const JobQueueFull&) {
+                    response = createHTTPResponse(503, "{\"error\":\"Job queue is full, retry later\"}");
+                }
+            }
+        } else if (path.rfind("/jobs/", 0) == 0 && path.length() > 6 && method == "GET") {
+            GenerationJob job;
+            if (!jobQueue) {
+                response = createHTTPResponse(503, "{\"error\":\"Job queue unavailable\"}");
+            } else if (!jobQueue->get(path.substr(6), job)) {
+                response = createHTTPResponse(404, "{\"error\":\"Job not found\"}");
+            } else {
+                Json::Value responseJson;
+                responseJson["jobId"] = job.id;
+                responseJson["kind"] = job.kind;
+                responseJson["status"] = job.status;
+                responseJson["agentId"] = job.agentId;
+                responseJson["attempts"] = job.attempts;
+                if (job.kind == "index") {
+                    // Ingestion counts, also when some documents failed
+                    Json::Value stats;
+                    Json::CharReaderBuilder builder;
+                    std::istringstream in(job.result);
+                    std::string errs;
+                    if (!job.result.empty() && Json::parseFromStream(builder, in, &stats, &errs)) {
+                        responseJson["stats"] = stats;
+                    }
+                } else if (job.status == "succeeded") {
+                    responseJson["response"] = job.result;
+                }
+                if (!job.error.empty()) responseJson["error"] = job.error;
+                if (!job.createdAt.empty()) responseJson["createdAt"] = job.createdAt;
+                if (!job.startedAt.empty()) responseJson["startedAt"] = job.startedAt;
+                if (!job.finishedAt.empty()) responseJson["finishedAt"] = job.finishedAt;
                 Json::StreamWriterBuilder writerBuilder;
-                std::string jsonResponse = Json::writeString(writerBuilder, responseJson);
-                
-                response = createHTTPResponse(200, jsonResponse);
+                response = createHTTPResponse(200, Json::writeString(writerBuilder, responseJson));
             }
         } else if (path == "/agent/list" && method == "GET") {
             Json::Value agents = agentManager.listAgents();
@@ -164,7 +373,7 @@ void HTTPServer::handleClient(int clientSocket) {
             }
         } else if (path == "/api/chat" && method == "POST") {
             // DEPRECATED: /api/chat endpoint removed - use /agent/chat instead
-            std::cerr << "[FATAL] Deprecated endpoint /api/chat called - this should never happen" << std::endl;
+            LOG_ERROR << "[FATAL] Deprecated endpoint /api/chat called - this should never happen";
             Json::Value errorJson;
             errorJson["error"] = "Endpoint removed";
             errorJson["message"] = "/api/chat is deprecated and has been removed. Use /agent/chat instead.";
@@ -172,6 +381,72 @@ void HTTPServer::handleClient(int clientSocket) {
             Json::StreamWriterBuilder writerBuilder;
             std::string jsonResponse = Json::writeString(writerBuilder, errorJson);
             response = createHTTPResponse(410, jsonResponse);
+        } else if (path == "/rag/index" && method == "POST") {
+            // {contentId | contentIds, force?, agentId?, metadata?}; queued as
+            // an index job, whose counts GET /jobs/{id} reports
+            Json::Value requestJson;
+            Json::CharReaderBuilder builder;
+            std::stringstream ss(body);
+            std::string errs;
+            
+            Json::Value indexRequest;
+            indexRequest["contentIds"] = Json::Value(Json::arrayValue);
+            if (Json::parseFromStream(builder, ss, &requestJson, &errs)) {
+                if (requestJson["contentIds"].isArray()) {
+                    for (const auto& id : requestJson["contentIds"]) {
+                        indexRequest["contentIds"].append(id.asInt());
+                    }
+                } else if (requestJson.isMember("contentId")) {
+                    indexRequest["contentIds"].append(requestJson["contentId"].asInt());
+                }
+            }
+            
+            if (!jobQueue) {
+                response = createHTTPResponse(503, "{\"success\":false,\"message\":\"Job queue unavailable\"}");
+            } else if (indexRequest["contentIds"].empty()) {
+                response = createHTTPResponse(400, "{\"success\":false,\"message\":\"contentId or contentIds is required\"}");
+            } else {
+                indexRequest["force"] = requestJson.get("force", false).asBool();
+                const Json::Value& metadata = requestJson["metadata"];
+                if (metadata.isObject()) {
+                    for (const auto& key : metadata.getMemberNames()) {
+                        if (metadata[key].isString() || metadata[key].isNumeric() || metadata[key].isBool()) {
+                            indexRequest["metadata"][key] = metadata[key].asString();
+                        }
+                    }
+                }
+                
+                try {
+                    Json::StreamWriterBuilder writerBuilder;
+                    writerBuilder["indentation"] = "";
+                    std::string jobId = jobQueue->submitIndexing(requestJson.get("agentId", 0).asInt(),
+                                                                 Json::writeString(writerBuilder, indexRequest));
+                    Json::Value responseJson;
+                    responseJson["success"] = true;
+                    responseJson["jobId"] = jobId;
+                    responseJson["status"] = "queued";
+                    response = createHTTPResponse(202, Json::writeString(writerBuilder, responseJson));
+                } catch (const JobQueueFull&) {
+                    response = createHTTPResponse(503, "{\"success\":false,\"message\":\"Job queue is full, retry later\"}");
+                }
+            }
+        } else if (path == "/metrics" && method == "GET") {
+            response = createHTTPResponse(200, Metrics::instance().renderPrometheus(), "text/plain; version=0.0.4");
+        } else if (path.rfind("/debug/trace", 0) == 0 && method == "GET") {
+            // /debug/trace for every buffered span, /debug/trace/{traceId} for one request
+            std::uint64_t traceId = 0;
+            if (path.length() > 13 && path[12] == '/') {
+                try {
+                    traceId = std::stoull(path.substr(13), nullptr, 16);
+                } catch (...) {
+                    traceId = 0;
+                }
+            }
+            if (path.length() > 12 && traceId == 0) {
+                response = createHTTPResponse(404, "{\"error\":\"Unknown trace\"}");
+            } else {
+                response = createHTTPResponse(200, Tracer::instance().chromeTraceJson(traceId));
+            }
         } else if (path == "/health" && method == "GET") {
             response = createHTTPResponse(200, "{\"status\":\"ok\"}");
         } else if (method == "OPTIONS") {
@@ -190,6 +465,24 @@ void HTTPServer::handleClient(int clientSocket) {
     
     send(clientSocket, response.c_str(), response.length(), 0);
     close(clientSocket);
+    
+    // Status line is "HTTP/1.1 NNN Reason"
+    const int status = response.size() > 12 ? std::atoi(response.c_str() + 9) : 500;
+    const std::size_t route = routeIndex(method, path);
+    const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - received).count();
+    requestMetrics.record(route, status, micros);
+    requestMetrics.inFlight().add(-1);
+    
+    if (capture && capture->wants(kRoutes[route])) {
+        // Replay resends the client's own deadline, not the configured default
+        std::uint32_t deadlineMs = 0;
+        const std::string deadlineHeader = headerValue(request, "X-Request-Deadline");
+        if (!deadlineHeader.empty()) {
+            deadlineMs = static_cast<std::uint32_t>(std::strtoul(deadlineHeader.c_str(), nullptr, 10));
+        }
+        capture->record(received, static_cast<std::uint32_t>(micros), status, method, path, body, deadlineMs);
+    }
 }
 
 std::string HTTPServer::parseHTTPRequest(const std::string& request, std::string& method, std::string& path) {
@@ -211,21 +504,51 @@ std::string HTTPServer::parseHTTPRequest(const std::string& request, std::string
     return "";
 }
 
-std::string HTTPServer::createHTTPResponse(int statusCode, const std::string& body, const std::string& contentType) {
+std::string HTTPServer::headerValue(const std::string& request, const std::string& name) {
+    const std::size_t headersEnd = request.find("\r\n\r\n");
+    std::istringstream stream(request.substr(0, headersEnd));
+    std::string line;
+    std::getline(stream, line);  // request line
+    while (std::getline(stream, line)) {
+        const std::size_t colon = line.find(':');
+        if (colon == std::string::npos || colon != name.size()) {
+            continue;
+        }
+        bool match = true;
+        for (std::size_t i = 0; i < colon && match; ++i) {
+            match = std::tolower(static_cast<unsigned char>(line[i])) == std::tolower(static_cast<unsigned char>(name[i]));
+        }
+        if (!match) {
+            continue;
+        }
+        std::size_t begin = line.find_first_not_of(" \t", colon + 1);
+        std::size_t end = line.find_last_not_of(" \t\r");
+        return begin == std::string::npos || end < begin ? "" : line.substr(begin, end - begin + 1);
+    }
+    return "";
+}
+
+std::string HTTPServer::createHTTPResponse(int statusCode, const std::string& body, const std::string& contentType,
+                                           const std::string& extraHeaders) {
     std::ostringstream response;
     
     std::string statusText;
     switch (statusCode) {
         case 200: statusText = "OK"; break;
+        case 202: statusText = "Accepted"; break;
         case 400: statusText = "Bad Request"; break;
         case 404: statusText = "Not Found"; break;
+        case 429: statusText = "Too Many Requests"; break;
         case 500: statusText = "Internal Server Error"; break;
+        case 503: statusText = "Service Unavailable"; break;
+        case 504: statusText = "Gateway Timeout"; break;
         default: statusText = "Unknown"; break;
     }
     
     response << "HTTP/1.1 " << statusCode << " " << statusText << "\r\n";
     response << "Content-Type: " << contentType << "\r\n";
     response << "Content-Length: " << body.length() << "\r\n";
+    response << extraHeaders;
     response << "Access-Control-Allow-Origin: *\r\n";
     response << "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n";
     response << "Access-Control-Allow-Headers: Content-Type\r\n";
@@ -0,0 +1,563 @@
+#include "../include/ingestion_pipeline.h"
+#include "../include/bounded_queue.h"
+#include "../include/database.h"
+#include "../include/llamacpp_client.h"
+#include "../include/logger.h"
+#include "../include/metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iterator>
+#include <jsoncpp/json/json.h>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+struct IngestionMetrics {
+    Counter& chunks;
+    Counter& embedded;
+    Counter& skipped;
+    Counter& failed;
+    Counter& batchFallbacks;
+    Counter& duplicates;
+};
+
+IngestionMetrics& ingestionMetrics() {
+    static IngestionMetrics m{
+        Metrics::instance().counter("ingestion_chunks_total", "Chunks embedded and stored by the ingestion pipeline"),
+        Metrics::instance().counter("ingestion_documents_total", "Documents processed by the ingestion pipeline",
+                                    metricLabel("status", "embedded")),
+        Metrics::instance().counter("ingestion_documents_total", "Documents processed by the ingestion pipeline",
+                                    metricLabel("status", "skipped")),
+        Metrics::instance().counter("ingestion_documents_total", "Documents processed by the ingestion pipeline",
+                                    metricLabel("status", "failed")),
+        Metrics::instance().counter("ingestion_batch_fallbacks_total",
+                                    "Embedding batches retried one chunk per request"),
+        Metrics::instance().counter("ingestion_duplicate_chunks_total",
+                                    "Chunks collapsed into a near-identical stored chunk instead of embedded"),
+    };
+    return m;
+}
+
+// signatureScope() of chunk metadata as written by chunkMetadata(), matching
+// what Database::getChunkSignatures() reads back from stored rows
+std::uint64_t metadataScope(const std::string& metadata) {
+    Json::Value json;
+    Json::CharReaderBuilder builder;
+    std::istringstream in(metadata);
+    std::string errs;
+    if (!Json::parseFromStream(builder, in, &json, &errs) || !json.isObject()) {
+        return signatureScope("", "", "");
+    }
+    auto field = [&](const char* name) {
+        const Json::Value& value = json[name];
+        return !value.isNull() && value.isConvertibleTo(Json::stringValue) ? value.asString() : std::string();
+    };
+    return signatureScope(field("agent_scope"), field("grade_level"), field("subject"));
+}
+}
+
+struct IngestionPipeline::Document {
+    struct Duplicate {
+        ChunkDuplicateRow row;
+        Document* canonical;  // the canonical chunk's document if it is in this run
+    };
+
+    IndexableContent content;
+    std::string metadata;
+    std::vector<Duplicate> duplicates;
+    int batches = 0;   // set before the first batch is queued
+    int received = 0;  // store thread only from here on
+    bool failed = false;
+    bool committed = false;  // rows inserted and content marked
+    std::vector<EmbeddingRow> rows;  // until the document is complete
+    int stored = 0;
+};
+
+struct IngestionPipeline::Batch {
+    Document* document = nullptr;
+    std::vector<Chunk> chunks;
+    std::vector<std::uint64_t> signatures;
+    std::vector<std::vector<float>> embeddings;
+    std::vector<int> tokenCounts;  // -1 where the tokenizer was unreachable
+    std::string error;
+};
+
+IngestionPipeline::IngestionPipeline(Database& database, LlamaCppClient& client, const IngestionConfig& config)
+    : database_(database),
+      client_(client),
+      config_(config),
+      chunker_(static_cast<std::size_t>(std::max(1, config.chunkSize)),
+               static_cast<std::size_t>(std::max(0, config.chunkOverlap))),
+      tokenChunker_(static_cast<std::size_t>(std::max(1, config.chunkTokens)),
+                    static_cast<std::size_t>(std::max(0, config.chunkOverlapTokens))),
+      pool_(static_cast<std::size_t>(std::max(1, config.workers))) {
+    config_.batchSize = std::max(1, config_.batchSize);
+    config_.maxInFlightBatches = std::max(1, config_.maxInFlightBatches);
+    config_.insertRows = std::max(1, config_.insertRows);
+    config_.backendShare = std::min(1.0, std::max(0.05, config_.backendShare));
+}
+
+IngestionPipeline::~IngestionPipeline() = default;
+
+IngestionStats IngestionPipeline::run(const std::vector<int>& contentIds, const IngestionOptions& options) {
+    return execute(
+        contentIds.size(),
+        [&](std::size_t i, IndexableContent& content) {
+            return database_.getContentForIndexing(contentIds[i], content);
+        },
+        options);
+}
+
+IngestionStats IngestionPipeline::run(const std::vector<IndexableContent>& documents,
+                                      const IngestionOptions& options) {
+    IngestionOptions forced = options;
+    forced.force = true;
+    return execute(
+        documents.size(),
+        [&](std::size_t i, IndexableContent& content) {
+            content = documents[i];
+            return true;
+        },
+        forced);
+}
+
+template <typename Load>
+IngestionStats IngestionPipeline::execute(std::size_t count, Load load, const IngestionOptions& options) {
+    std::lock_guard<std::mutex> runLock(runMutex_);
+    const auto start = std::chrono::steady_clock::now();
+    IngestionMetrics& metrics = ingestionMetrics();
+
+    IngestionStats stats;
+    IngestionStats stored;
+    std::deque<Document> documents;  // stable addresses for the batches
+    std::unordered_map<int, Document*> runDocuments;
+    SimHashIndex* index = signatureIndex(options);
+    BoundedQueue<std::unique_ptr<Batch>> embedQueue(static_cast<std::size_t>(config_.maxInFlightBatches));
+    BoundedQueue<std::unique_ptr<Batch>> storeQueue(static_cast<std::size_t>(config_.maxInFlightBatches));
+    std::atomic<int> totalBatches{-1};
+
+    // Store stage: one consumer, since every insert goes through the same
+    // (serialized) database connection anyway.
+    std::thread storer([&] {
+        std::vector<EmbeddingRow> pending;
+        std::vector<ChunkDuplicateRow> pendingDuplicates;
+        std::vector<Document*> completed;  // rows in `pending`, marked after the insert
+
+        auto flush = [&] {
+            if (completed.empty()) {
+                return;
+            }
+            std::vector<int> contentIds;
+            for (Document* document : completed) {
+                contentIds.push_back(document->content.contentId);
+            }
+            try {
+                // Old rows go in the same transaction as the new ones, so a
+                // failed insert leaves the documents as they were
+                database_.replaceEmbeddings(contentIds, pending, pendingDuplicates, options.table);
+                for (Document* document : completed) {
+                    const int duplicates = static_cast<int>(document->duplicates.size());
+                    if (options.markContent) {
+                        database_.markContentEmbedded(document->content.contentId, document->stored + duplicates);
+                    }
+                    document->committed = true;
+                    stored.documents++;
+                    stored.chunks += document->stored;
+                    stored.duplicates += duplicates;
+                    metrics.embedded.inc();
+                    metrics.chunks.inc(static_cast<std::uint64_t>(document->stored));
+                    metrics.duplicates.inc(static_cast<std::uint64_t>(duplicates));
+                }
+            } catch (const std::exception& e) {
+                LOG_ERROR << "[Ingestion] Storing " << pending.size() << " rows failed, " << completed.size()
+                          << " documents keep their previous embeddings: " << e.what();
+                for (Document* document : completed) {
+                    document->failed = true;
+                    stored.failed++;
+                    metrics.failed.inc();
+                }
+            }
+            pending.clear();
+            pendingDuplicates.clear();
+            completed.clear();
+        };
+
+        int received = 0;
+        std::unique_ptr<Batch> batch;
+        while (totalBatches.load() < 0 || received < totalBatches.load()) {
+            if (!storeQueue.pop(batch)) {
+                break;
+            }
+            if (!batch) {
+                continue;  // end-of-input marker; totalBatches is set
+            }
+            ++received;
+            Document& document = *batch->document;
+            if (!batch->error.empty()) {
+                if (!document.failed) {
+                    LOG_ERROR << "[Ingestion] Embedding content " << document.content.contentId
+                              << " failed: " << batch->error;
+                }
+                document.failed = true;
+            } else {
+                for (std::size_t i = 0; i < batch->chunks.size(); ++i) {
+                    EmbeddingRow row;
+                    row.contentId = document.content.contentId;
+                    row.chunkIndex = batch->chunks[i].index;
+                    row.text = std::move(batch->chunks[i].text);
+                    row.metadata = document.metadata;
+                    row.embedding = std::move(batch->embeddings[i]);
+                    row.tokenCount = batch->tokenCounts[i];
+                    row.model = client_.modelId();
+                    row.simhash = batch->signatures[i];
+                    document.rows.push_back(std::move(row));
+                }
+            }
+            if (++document.received < document.batches) {
+                continue;
+            }
+
+            // Whole document embedded: its rows replace the stored ones at the next flush
+            if (document.failed) {
+                stored.failed++;
+                metrics.failed.inc();
+                document.rows.clear();
+                continue;
+            }
+            document.stored = static_cast<int>(document.rows.size());
+            std::move(document.rows.begin(), document.rows.end(), std::back_inserter(pending));
+            std::vector<EmbeddingRow>().swap(document.rows);
+            for (const Document::Duplicate& duplicate : document.duplicates) {
+                // References to another document of this run wait for the end
+                // of the run: that document may not be stored yet, and
+                // replacing its rows would drop references to it
+                if (!duplicate.canonical || duplicate.canonical == &document) {
+                    pendingDuplicates.push_back(duplicate.row);
+                }
+            }
+            completed.push_back(&document);
+            if (pending.size() >= static_cast<std::size_t>(config_.insertRows)) {
+                flush();
+            }
+        }
+        flush();
+    });
+
+    // Chunk stage, on this thread. push() blocks once maxInFlightBatches
+    // batches are waiting for a worker.
+    int batches = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        IndexableContent content;
+        try {
+            if (!load(i, content)) {
+                stats.skipped++;
+                metrics.skipped.inc();
+                continue;
+            }
+        } catch (const std::exception& e) {
+            LOG_ERROR << "[Ingestion] Loading document failed: " << e.what();
+            stats.failed++;
+            metrics.failed.inc();
+            continue;
+        }
+        if (content.hasEmbeddings && !options.force) {
+            stats.skipped++;
+            metrics.skipped.inc();
+            continue;
+        }
+
+        std::vector<Chunk> chunks = chunkText(content);
+        if (chunks.empty()) {
+            LOG_WARN << "[Ingestion] Content " << content.contentId << " has no text to embed";
+            stats.skipped++;
+            metrics.skipped.inc();
+            continue;
+        }
+
+        documents.emplace_back();
+        Document& document = documents.back();
+        document.metadata = chunkMetadata(content, options);
+        document.content = std::move(content);
+        document.content.text.clear();
+        runDocuments[document.content.contentId] = &document;
+
+        // Near-duplicates of stored chunks (or of earlier chunks in this
+        // run) are not embedded. The document's own old chunks are about to
+        // be replaced, so they are not candidates. Only chunks that searches
+        // filtered to the same scope would also find count as duplicates.
+        const std::uint64_t scope = metadataScope(document.metadata);
+        std::vector<std::uint64_t> signatures;
+        signatures.reserve(chunks.size());
+        if (index) {
+            index->removeContent(document.content.contentId);
+        }
+        std::size_t unique = 0;
+        for (Chunk& chunk : chunks) {
+            const std::uint64_t signature = simhash(chunk.text);
+            ChunkSignature match;
+            int distance = 0;
+            if (index && index->find(signature, scope, match, distance)) {
+                auto canonical = runDocuments.find(match.contentId);
+                document.duplicates.push_back(
+                    {{document.content.contentId, chunk.index, match.contentId, match.chunkIndex, distance},
+                     canonical == runDocuments.end() ? nullptr : canonical->second});
+                continue;
+            }
+            if (index) {
+                index->insert({document.content.contentId, chunk.index, signature, scope});
+            }
+            signatures.push_back(signature);
+            chunks[unique++] = std::move(chunk);
+        }
+        chunks.resize(unique);
+
+        if (chunks.empty()) {
+            // Nothing to embed: an empty batch carries the document to the store stage
+            auto batch = std::make_unique<Batch>();
+            batch->document = &document;
+            document.batches = 1;
+            storeQueue.push(std::move(batch));
+            ++batches;
+            continue;
+        }
+        document.batches = static_cast<int>((chunks.size() + config_.batchSize - 1) / config_.batchSize);
+        document.rows.reserve(chunks.size());
+
+        for (std::size_t offset = 0; offset < chunks.size(); offset += config_.batchSize) {
+            auto batch = std::make_unique<Batch>();
+            batch->document = &document;
+            const std::size_t end = std::min(chunks.size(), offset + static_cast<std::size_t>(config_.batchSize));
+            batch->chunks.assign(std::make_move_iterator(chunks.begin() + offset),
+                                 std::make_move_iterator(chunks.begin() + end));
+            batch->signatures.assign(signatures.begin() + offset, signatures.begin() + end);
+            embedQueue.push(std::move(batch));
+            ++batches;
+            // Each task takes whichever batch is at the head of the queue
+            pool_.submit([this, &embedQueue, &storeQueue] {
+                std::unique_ptr<Batch> next;
+                if (embedQueue.pop(next)) {
+                    embed(*next);
+                    storeQueue.push(std::move(next));
+                }
+            });
+        }
+        LOG_DEBUG << "[Ingestion] Queued content " << document.content.contentId << ": " << chunks.size()
+                  << " chunks in " << document.batches << " batches, " << document.duplicates.size()
+                  << " duplicates";
+    }
+
+    totalBatches.store(batches);
+    storeQueue.push(nullptr);
+    storer.join();
+
+    if (index) {
+        storeRunDuplicates(documents, *index, options, stored);
+    }
+
+    stats.documents = stored.documents;
+    stats.chunks = stored.chunks;
+    stats.duplicates = stored.duplicates;
+    stats.failed += stored.failed;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO << "[Ingestion] " << stats.documents << " documents (" << stats.chunks << " chunks, "
+             << stats.duplicates << " duplicates) embedded, " << stats.skipped << " skipped, " << stats.failed
+             << " failed in " << logFixed(2) << stats.seconds << "s";
+    return stats;
+}
+
+SimHashIndex* IngestionPipeline::signatureIndex(const IngestionOptions& options) {
+    if (config_.dedupDistance < 0) {
+        return nullptr;
+    }
+    std::unique_ptr<SimHashIndex>& index = signatures_[options.table];
+    if (index && options.exclusiveTable) {
+        return index.get();
+    }
+    // Reloaded per run otherwise: another process (a reembed swap, a second
+    // agent_service) may have rewritten the table since the last one
+    auto loaded = std::make_unique<SimHashIndex>(config_.dedupDistance);
+    try {
+        for (const ChunkSignature& signature : database_.getChunkSignatures(options.table)) {
+            loaded->insert(signature);
+        }
+    } catch (const std::exception& e) {
+        LOG_WARN << "[Ingestion] Near-duplicate detection is off for this run: " << e.what();
+        index.reset();
+        return nullptr;
+    }
+    index = std::move(loaded);
+    return index.get();
+}
+
+void IngestionPipeline::storeRunDuplicates(std::deque<Document>& documents, SimHashIndex& index,
+                                           const IngestionOptions& options, IngestionStats& stored) {
+    for (Document& document : documents) {
+        if (document.failed) {
+            index.removeContent(document.content.contentId);
+        }
+    }
+
+    // A duplicate whose canonical chunk belongs to a document of this run
+    // that failed points at nothing. Its document is rolled back so a later
+    // run indexes it again; that can orphan others in turn, hence the loop.
+    bool rolledBack = true;
+    while (rolledBack) {
+        rolledBack = false;
+        for (Document& document : documents) {
+            const bool orphaned = document.committed &&
+                std::any_of(document.duplicates.begin(), document.duplicates.end(),
+                            [](const Document::Duplicate& duplicate) {
+                                return duplicate.canonical && duplicate.canonical->failed;
+                            });
+            if (orphaned) {
+                LOG_WARN << "[Ingestion] Content " << document.content.contentId
+                         << " repeats chunks of a document that failed; rolling it back";
+                rollBack(document, index, options, stored);
+                rolledBack = true;
+            }
+        }
+    }
+
+    // Every canonical document left is stored: write the deferred references
+    std::vector<ChunkDuplicateRow> rows;
+    std::vector<Document*> referencing;
+    for (Document& document : documents) {
+        if (!document.committed) {
+            continue;
+        }
+        const std::size_t before = rows.size();
+        for (const Document::Duplicate& duplicate : document.duplicates) {
+            if (duplicate.canonical && duplicate.canonical != &document) {
+                rows.push_back(duplicate.row);
+            }
+        }
+        if (rows.size() > before) {
+            referencing.push_back(&document);
+        }
+    }
+    try {
+        database_.insertChunkDuplicates(rows, options.table);
+    } catch (const std::exception& e) {
+        LOG_ERROR << "[Ingestion] " << e.what();
+        for (Document* document : referencing) {
+            rollBack(*document, index, options, stored);
+        }
+    }
+}
+
+void IngestionPipeline::rollBack(Document& document, SimHashIndex& index, const IngestionOptions& options,
+                                 IngestionStats& stored) {
+    const int contentId = document.content.contentId;
+    document.committed = false;
+    document.failed = true;
+    index.removeContent(contentId);
+    stored.documents--;
+    stored.chunks -= document.stored;
+    stored.duplicates -= static_cast<int>(document.duplicates.size());
+    stored.failed++;
+    ingestionMetrics().failed.inc();
+    try {
+        database_.deleteEmbeddings(contentId, options.table);
+        if (options.markContent) {
+            database_.markContentEmbedded(contentId, 0);
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR << "[Ingestion] Rollback of content " << contentId << " failed: " << e.what();
+    }
+}
+
+std::vector<Chunk> IngestionPipeline::chunkText(const IndexableContent& content) {
+    if (config_.chunkTokens > 0) {
+        const std::vector<std::size_t> tokenStarts = client_.tokenStarts(content.text);
+        if (!tokenStarts.empty()) {
+            std::vector<Chunk> chunks;
+            tokenChunker_.forEachChunk(content.text, tokenStarts, [&](const ChunkSpan& span) {
+                chunks.push_back({std::string(span.text), span.index});
+            });
+            return chunks;
+        }
+        LOG_WARN << "[Ingestion] Could not tokenize content " << content.contentId
+                 << ", chunking it by bytes instead";
+    }
+    return chunker_.chunk(content.text);
+}
+
+void IngestionPipeline::embed(Batch& batch) {
+    std::vector<std::string> texts;
+    texts.reserve(batch.chunks.size());
+    for (const Chunk& chunk : batch.chunks) {
+        texts.push_back(chunk.text);
+    }
+
+    // Duty cycle: with backend_share s each worker rests (1 - s) / s times
+    // as long as its request took, so the pipeline keeps about s of its
+    // workers' slots busy and leaves the rest to chat traffic.
+    const auto start = std::chrono::steady_clock::now();
+    embedChunks(batch, texts);
+    // Counted per chunk rather than taken from the document's tokenization:
+    // a chunk tokenized on its own can differ at its edges. Like embeddings,
+    // these bypass the token count cache. Byte-sized chunks are not counted
+    // here (one /tokenize call each); NULL counts are taken at prompt time.
+    batch.tokenCounts.assign(texts.size(), -1);
+    if (batch.error.empty() && config_.chunkTokens > 0) {
+        for (std::size_t i = 0; i < texts.size(); ++i) {
+            batch.tokenCounts[i] = client_.tokenize(texts[i]);
+        }
+    }
+    if (config_.backendShare < 1.0) {
+        const auto busy = std::chrono::steady_clock::now() - start;
+        std::this_thread::sleep_for(std::chrono::duration_cast<std::chrono::microseconds>(
+            busy * ((1.0 - config_.backendShare) / config_.backendShare)));
+    }
+}
+
+void IngestionPipeline::embedChunks(Batch& batch, const std::vector<std::string>& texts) {
+    // The embedding cache is bypassed: bulk ingestion would only evict the
+    // query embeddings chat traffic benefits from. Requests queue at batch
+    // priority, behind chat, on the client's scheduler.
+    try {
+        batch.embeddings = client_.embedBatch(texts);
+        return;
+    } catch (const std::exception& e) {
+        LOG_WARN << "[Ingestion] Batch embedding failed (" << e.what() << "), retrying per chunk";
+        ingestionMetrics().batchFallbacks.inc();
+    }
+
+    batch.embeddings.clear();
+    try {
+        for (const std::string& text : texts) {
+            batch.embeddings.push_back(client_.embed(text, 384, Priority::Batch));
+        }
+    } catch (const std::exception& e) {
+        batch.error = e.what();
+        batch.embeddings.clear();
+    }
+}
+
+std::string IngestionPipeline::chunkMetadata(const IndexableContent& content,
+                                             const IngestionOptions& options) const {
+    Json::Value metadata(Json::objectValue);
+    if (!content.chunkMetadata.empty()) {
+        Json::CharReaderBuilder builder;
+        std::istringstream in(content.chunkMetadata);
+        std::string errs;
+        Json::Value existing;
+        if (Json::parseFromStream(builder, in, &existing, &errs) && existing.isObject()) {
+            metadata = existing;
+        }
+    }
+    for (const auto& field : options.metadata) {
+        metadata[field.first] = field.second;
+    }
+    if (!content.title.empty()) metadata["title"] = content.title;
+    if (!content.gradeLevel.empty()) metadata["grade_level"] = content.gradeLevel;
+    if (!content.subject.empty()) metadata["subject"] = content.subject;
+    if (!options.agentScope.empty()) metadata["agent_scope"] = options.agentScope;
+
+    Json::StreamWriterBuilder writerBuilder;
+    writerBuilder["indentation"] = "";
+    return Json::writeString(writerBuilder, metadata);
+}
@@ -0,0 +1,245 @@
+#include "../include/job_queue.h"
+#include "../include/agent_manager.h"
+#include "../include/logger.h"
+#include "../include/metrics.h"
+#include "../include/tracer.h"
+#include <chrono>
+#include <iomanip>
+#include <jsoncpp/json/json.h>
+#include <random>
+#include <sstream>
+
+namespace {
+constexpr std::size_t kRecentFinished = 256;
+}
+
+JobQueue::JobQueue(const Config& config, AgentManager& agents)
+    : agents_(agents),
+      db_(std::make_unique<Database>(config.dbHost, config.dbPort, config.dbName, config.dbUser, config.dbPassword)),
+      maxQueued_(static_cast<std::size_t>(std::max(1, config.jobsMaxQueued))),
+      maxAttempts_(std::max(1, config.jobsMaxAttempts)) {
+    Metrics& metrics = Metrics::instance();
+    queuedGauge_ = &metrics.gauge("generation_jobs_queued", "Generation jobs waiting for a worker");
+    runningGauge_ = &metrics.gauge("generation_jobs_running", "Generation jobs currently running");
+    succeeded_ = &metrics.counter("generation_jobs_completed_total", "Generation jobs finished",
+                                  metricLabel("status", "succeeded"));
+    failed_ = &metrics.counter("generation_jobs_completed_total", "Generation jobs finished",
+                               metricLabel("status", "failed"));
+
+    recover(config.jobsRetentionDays);
+
+    const int concurrency = std::max(1, config.jobsConcurrency);
+    for (int i = 0; i < concurrency; ++i) {
+        workers_.emplace_back(&JobQueue::workerLoop, this);
+    }
+    LOG_INFO << "[JobQueue] Started " << concurrency << " worker(s), " << queue_.size() << " job(s) recovered";
+}
+
+JobQueue::~JobQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    available_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+std::string JobQueue::newJobId() {
+    static std::mutex rngMutex;
+    static std::mt19937_64 rng(std::random_device{}());
+    std::lock_guard<std::mutex> lock(rngMutex);
+    std::ostringstream id;
+    id << std::hex << std::setfill('0') << std::setw(16) << rng() << std::setw(16) << rng();
+    return id.str();
+}
+
+void JobQueue::recover(int retentionDays) {
+    std::lock_guard<std::mutex> dbLock(dbMutex_);
+    if (retentionDays > 0) {
+        int purged = db_->purgeFinishedJobs(retentionDays);
+        if (purged > 0) {
+            LOG_INFO << "[JobQueue] Purged " << purged << " job(s) older than " << retentionDays << " day(s)";
+        }
+    }
+
+    for (GenerationJob& job : db_->getUnfinishedJobs()) {
+        // A job that keeps dying with the process is not retried forever.
+        if (job.status == "running" && job.attempts >= maxAttempts_) {
+            job.status = "failed";
+            job.error = "Interrupted by agent service restart " + std::to_string(job.attempts) + " time(s)";
+            db_->updateJob(job);
+            continue;
+        }
+        job.status = "queued";
+        db_->updateJob(job);
+        queue_.push_back(job.id);
+        jobs_[job.id] = std::move(job);
+    }
+    queuedGauge_->set(static_cast<std::int64_t>(queue_.size()));
+}
+
+std::string JobQueue::submit(int userId, int agentId, const std::string& message, const std::string& ragContext) {
+    GenerationJob job;
+    job.userId = userId;
+    job.agentId = agentId;
+    job.message = message;
+    job.ragContext = ragContext;
+    return enqueue(std::move(job));
+}
+
+std::string JobQueue::submitIndexing(int agentId, const std::string& request) {
+    GenerationJob job;
+    job.kind = "index";
+    job.agentId = agentId;
+    job.message = request;
+    return enqueue(std::move(job));
+}
+
+std::string JobQueue::enqueue(GenerationJob job) {
+    job.id = newJobId();
+    job.status = "queued";
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.size() >= maxQueued_) {
+            throw JobQueueFull();
+        }
+    }
+
+    // Persist before acknowledging so an accepted job survives a crash.
+    {
+        std::lock_guard<std::mutex> dbLock(dbMutex_);
+        db_->createJob(job);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(job.id);
+        jobs_[job.id] = job;
+        queuedGauge_->set(static_cast<std::int64_t>(queue_.size()));
+    }
+    available_.notify_one();
+    LOG_INFO << "[JobQueue] Queued " << job.kind << " job " << job.id << " for agent " << job.agentId;
+    return job.id;
+}
+
+bool JobQueue::get(const std::string& jobId, GenerationJob& job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = jobs_.find(jobId);
+        if (it != jobs_.end()) {
+            job = it->second;
+            return true;
+        }
+    }
+    std::lock_guard<std::mutex> dbLock(dbMutex_);
+    return db_->getJob(jobId, job);
+}
+
+void JobQueue::workerLoop() {
+    while (true) {
+        GenerationJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            available_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            const std::string id = queue_.front();
+            queue_.pop_front();
+            queuedGauge_->set(static_cast<std::int64_t>(queue_.size()));
+
+            GenerationJob& entry = jobs_[id];
+            entry.status = "running";
+            entry.attempts++;
+            job = entry;
+        }
+        run(std::move(job));
+    }
+}
+
+void JobQueue::run(GenerationJob job) {
+    TraceScope traceScope(Tracer::newTraceId());
+    persist(job);
+    runningGauge_->add(1);
+    const auto started = std::chrono::steady_clock::now();
+
+    try {
+        if (job.kind == "index") {
+            index(job);
+        } else {
+            job.result = agents_.generateReply(job.userId, job.agentId, job.message, job.ragContext, "generation");
+        }
+        job.status = "succeeded";
+        succeeded_->inc();
+    } catch (const std::exception& e) {
+        job.status = "failed";
+        job.error = e.what();
+        failed_->inc();
+    }
+    runningGauge_->add(-1);
+
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started);
+    LOG_INFO << "[JobQueue] Job " << job.id << " " << job.status << " after " << seconds.count() << "s"
+             << (job.error.empty() ? "" : ": " + job.error);
+
+    persist(job);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_[job.id] = job;
+    finished_.push_back(job.id);
+    if (finished_.size() > kRecentFinished) {
+        jobs_.erase(finished_.front());
+        finished_.pop_front();
+    }
+}
+
+void JobQueue::index(GenerationJob& job) {
+    Json::Value request;
+    Json::CharReaderBuilder builder;
+    std::istringstream in(job.message);
+    std::string errs;
+    if (!Json::parseFromStream(builder, in, &request, &errs) || !request["contentIds"].isArray()) {
+        throw std::runtime_error("Malformed index request: " + errs);
+    }
+    std::vector<int> contentIds;
+    for (const auto& id : request["contentIds"]) {
+        contentIds.push_back(id.asInt());
+    }
+    IngestionOptions options;
+    options.force = request.get("force", false).asBool();
+    const Json::Value& metadata = request["metadata"];
+    if (metadata.isObject()) {
+        for (const auto& key : metadata.getMemberNames()) {
+            options.metadata[key] = metadata[key].asString();
+        }
+    }
+
+    const IngestionStats stats = agents_.indexContent(contentIds, options, job.agentId);
+    Json::Value result;
+    result["documents"] = stats.documents;
+    result["chunks"] = stats.chunks;
+    result["duplicates"] = stats.duplicates;
+    result["skipped"] = stats.skipped;
+    result["failed"] = stats.failed;
+    result["seconds"] = stats.seconds;
+    Json::StreamWriterBuilder writerBuilder;
+    writerBuilder["indentation"] = "";
+    job.result = Json::writeString(writerBuilder, result);
+    if (stats.failed > 0) {
+        throw std::runtime_error(std::to_string(stats.failed) + " document(s) failed to index");
+    }
+}
+
+void JobQueue::persist(const GenerationJob& job) {
+    try {
+        std::lock_guard<std::mutex> dbLock(dbMutex_);
+        db_->updateJob(job);
+    } catch (const std::exception& e) {
+        LOG_ERROR << "[JobQueue] Failed to persist job " << job.id << ": " << e.what();
+    }
+}
@@ -0,0 +1,32 @@
+#include "../include/latency_window.h"
+#include <algorithm>
+
+LatencyWindow::LatencyWindow(std::size_t capacity) : samples_(capacity > 0 ? capacity : 1, 0) {
+}
+
+void LatencyWindow::add(std::chrono::microseconds latency) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples_[next_] = latency.count();
+    next_ = (next_ + 1) % samples_.size();
+    count_ = std::min(count_ + 1, samples_.size());
+}
+
+std::int64_t LatencyWindow::percentileMicros(double q, std::size_t minSamples) const {
+    std::vector<std::int64_t> copy;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ == 0 || count_ < minSamples) {
+            return -1;
+        }
+        copy.assign(samples_.begin(), samples_.begin() + static_cast<std::ptrdiff_t>(count_));
+    }
+    q = std::min(1.0, std::max(0.0, q));
+    auto nth = copy.begin() + static_cast<std::ptrdiff_t>(q * static_cast<double>(copy.size() - 1));
+    std::nth_element(copy.begin(), nth, copy.end());
+    return *nth;
+}
+
+std::size_t LatencyWindow::count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+}
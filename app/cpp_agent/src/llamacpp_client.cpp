@@ -3,51 +3,189 @@
  * Copyright (c) 2025 Your Name or Organization
  */
 #include "llamacpp_client.h"
-#include <iostream>
+#include "logger.h"
+#include "metrics.h"
+#include "tracer.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <sstream>
+#include <cctype>
 #include <stdexcept>
+#include <thread>
 #include <jsoncpp/json/json.h>
 
-LlamaCppClient::LlamaCppClient(const std::string& serverUrl, const std::string& modelPath, int contextLength, float temperature)
-    : serverUrl_(serverUrl), contextLength_(contextLength), temperature_(temperature), curl_(nullptr) {
+namespace {
+// Returns a slot taken from SlotTracker::acquire when the request finishes.
+struct SlotRelease {
+    SlotTracker* tracker;
+    int slot;
+    ~SlotRelease() {
+        if (slot >= 0) {
+            tracker->release(slot);
+        }
+    }
+};
+
+// Thrown when a transfer is aborted through its cancel flag.
+struct RequestCancelled : std::runtime_error {
+    RequestCancelled() : std::runtime_error("request cancelled") {}
+};
+
+// Thrown when a transfer runs into its timeout.
+struct RequestTimedOut : std::runtime_error {
+    explicit RequestTimedOut(const std::string& what) : std::runtime_error(what) {}
+};
+
+int cancelCallback(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return static_cast<const std::atomic<bool>*>(clientp)->load(std::memory_order_relaxed) ? 1 : 0;
+}
+
+size_t sinkCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t totalSize = size * nmemb;
+    (*static_cast<std::function<void(const char*, std::size_t)>*>(userp))(static_cast<const char*>(contents), totalSize);
+    return totalSize;
+}
+
+// An `embedding` node: a flat array, or (newer llama-server with pooling
+// none) one row per token, of which the first is taken.
+std::vector<float> embeddingValues(const Json::Value& node) {
+    const Json::Value& row = (!node.empty() && node[0].isArray()) ? node[0] : node;
+    std::vector<float> values;
+    values.reserve(row.size());
+    for (const auto& value : row) {
+        values.push_back(value.asFloat());
+    }
+    return values;
+}
+
+// Prompt size and the part of it llama-server took from the slot's KV cache,
+// from a completion's final response. tokens_cached is n_past (prompt plus
+// generated tokens), so it says nothing about reuse; timings.cache_n does,
+// and servers without it report the whole prompt as tokens_evaluated.
+struct PromptUsage {
+    int tokens = 0;
+    int cached = 0;
+};
+
+PromptUsage promptUsage(const Json::Value& response) {
+    const Json::Value& timings = response["timings"];
+    const int evaluated = timings.get("prompt_n", 0).asInt();
+    PromptUsage usage;
+    if (timings.isMember("cache_n")) {
+        usage.cached = timings["cache_n"].asInt();
+        usage.tokens = evaluated + usage.cached;
+    } else {
+        usage.tokens = std::max(evaluated, response.get("tokens_evaluated", 0).asInt());
+        usage.cached = usage.tokens - evaluated;
+    }
+    return usage;
+}
+
+// Shared between a hedged request and its attempts. Attempts run detached,
+// so everything they touch lives here rather than on the caller's stack.
+struct HedgeRace {
+    std::mutex mutex;
+    std::condition_variable done;
+    int finished = 0;
+    int winner = -1;
+    std::string body;
+    std::exception_ptr error;
+    std::atomic<bool> cancel[2] = {{false}, {false}};
+
+    void finish(int attempt, std::string result, std::exception_ptr failure) {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished++;
+        if (!failure && winner < 0) {
+            winner = attempt;
+            body = std::move(result);
+            cancel[1 - attempt].store(true, std::memory_order_relaxed);
+        } else if (failure && !error) {
+            error = failure;
+        }
+        done.notify_all();
+    }
+};
+}
+
+LlamaCppClient::LlamaCppClient(const std::string& serverUrl, const std::string& modelPath, int contextLength,
+                               float temperature, int parallelSlots)
+    : LlamaCppClient(std::vector<std::string>{serverUrl}, modelPath, contextLength, temperature, parallelSlots) {
+}
+
+LlamaCppClient::LlamaCppClient(const std::vector<std::string>& serverUrls, const std::string& modelPath,
+                               int contextLength, float temperature, int parallelSlots,
+                               const LoadBalancerPolicy& policy)
+    : contextLength_(contextLength), temperature_(temperature) {
+    if (serverUrls.empty()) {
+        throw std::invalid_argument("LlamaCppClient needs at least one server URL");
+    }
+    std::size_t slash = modelPath.find_last_of('/');
+    modelId_ = slash == std::string::npos ? modelPath : modelPath.substr(slash + 1);
+    tokenCounter_ = std::make_unique<TokenCounter>([this](const std::string& text) { return tokenize(text); }, 8192,
+                                                   modelId_);
+    replicas_ = std::make_unique<ReplicaSet>(serverUrls, parallelSlots, modelId_, policy);
+    setScheduling(SchedulerPolicy());
+
+    const std::string labels = metricLabel("model", modelId_);
+    Metrics& metrics = Metrics::instance();
+    prefillSavedTokens_ = &metrics.counter("llama_prefill_tokens_saved_total",
+                                           "Prompt tokens served from llama-server KV cache instead of prefill", labels);
+    promptTokens_ = &metrics.counter("llama_prompt_tokens_total", "Prompt tokens sent to llama-server", labels);
+    slotAffinityHits_ = &metrics.counter("llama_slot_affinity_hits_total",
+                                         "Completions routed to a slot already holding their prefix", labels);
+    slotAffinityMisses_ = &metrics.counter("llama_slot_affinity_misses_total",
+                                           "Completions that had to load their prefix into a slot", labels);
+    slotRestores_ = &metrics.counter("llama_slot_restores_total",
+                                     "Slot KV states restored from --slot-save-path", labels);
+    completionTokens_ = &metrics.counter("llama_completion_tokens_total", "Tokens generated by llama-server", labels);
+    embeddings_ = &metrics.counter("llama_embeddings_total", "Embeddings computed by llama-server", labels);
+    generationLatency_ = &metrics.histogram("llama_generation_duration_seconds",
+                                            "Completion latency including the wait for a slot", labels);
+    embeddingLatency_ = &metrics.histogram("llama_embedding_duration_seconds", "Embedding request latency", labels);
+    for (auto [stats, kind] : {std::make_pair(&embedHedge_, "embedding"), std::make_pair(&generationHedge_, "generation")}) {
+        const std::string kindLabels = labels + "," + metricLabel("kind", kind);
+        stats->sent = &metrics.counter("llama_hedges_total", "Hedged duplicate requests sent to a second replica",
+                                       kindLabels);
+        stats->won = &metrics.counter("llama_hedge_wins_total", "Hedged requests where the duplicate answered first",
+                                      kindLabels);
+    }
     // Initialize curl globally once
     curl_global_init(CURL_GLOBAL_DEFAULT);
-    std::cout << "[LlamaCppClient] Connected to llama-server at " << serverUrl_ << std::endl;
+    for (const auto& url : serverUrls) {
+        LOG_INFO << "[LlamaCppClient] Connected to llama-server at " << url;
+    }
+    if (serverUrls.size() > 1) {
+        LOG_INFO << "[LlamaCppClient] Balancing " << modelId_ << " across " << serverUrls.size()
+                 << " replicas (" << policy.strategy << ")";
+    }
 }
 
 LlamaCppClient::~LlamaCppClient() {
     curl_global_cleanup();
 }
 
+void LlamaCppClient::setScheduling(const SchedulerPolicy& policy) {
+    const int slots = static_cast<int>(replicas_->size()) * replicas_->at(0).slots->slots();
+    scheduler_ = std::make_unique<LlmScheduler>(slots, policy, modelId_);
+}
+
 size_t LlamaCppClient::writeCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
     size_t totalSize = size * nmemb;
     userp->append((char*)contents, totalSize);
     return totalSize;
 }
 
-std::string LlamaCppClient::makeRequest(const std::string& prompt, int maxTokens, float temperature) {
-    // Use provided maxTokens or determine based on prompt type
+Json::Value LlamaCppClient::buildCompletion(const std::string& prompt, int maxTokens, float temperature, int slotId,
+                                            long& timeout) const {
+    // The timeout follows n_predict alone; a request's deadline, when it
+    // has one, caps it further in postTo()
     int tokenLimit = maxTokens > 0 ? maxTokens : 512;
-    long timeout = 180L;    // 3 minutes default timeout
-    
-    if (maxTokens < 0) {
-        // Auto-detect token limit based on prompt type if not specified
-        if (prompt.find("Create") != std::string::npos || 
-            prompt.find("educational lesson") != std::string::npos ||
-            prompt.find("Generate") != std::string::npos ||
-            prompt.find("questions") != std::string::npos ||
-            prompt.find("fill-in-the-blank") != std::string::npos ||
-            prompt.find("multiple choice") != std::string::npos) {
-            tokenLimit = 1024;  // More tokens for content/question generation
-            timeout = 600L;     // 10 minutes for longer generations
-        }
-    } else {
-        // Adjust timeout based on token limit - be generous with timeouts
-        if (tokenLimit > 4000) timeout = 900L;  // 15 minutes for very large generations
-        else if (tokenLimit > 2000) timeout = 720L;  // 12 minutes for large generations (questions)
-        else if (tokenLimit > 1000) timeout = 480L;  // 8 minutes for medium
-        else timeout = 300L;  // 5 minutes for small requests
-    }
+    if (tokenLimit > 4000) timeout = 900L;  // 15 minutes for very large generations
+    else if (tokenLimit > 2000) timeout = 720L;  // 12 minutes for large generations (questions)
+    else if (tokenLimit > 1000) timeout = 480L;  // 8 minutes for medium
+    else timeout = 300L;  // 5 minutes for small requests
     
     // Use provided temperature or class default
     float actualTemp = temperature > 0.0f ? temperature : temperature_;
@@ -58,6 +196,9 @@ std::string LlamaCppClient::makeRequest(const std::string& prompt, int maxTokens
     request["n_predict"] = tokenLimit;
     request["temperature"] = actualTemp;
     request["cache_prompt"] = true;  // Enable KV cache reuse
+    if (slotId >= 0) {
+        request["id_slot"] = slotId;
+    }
     
     // Add stop sequences to prevent runaway generation
     Json::Value stopSequences(Json::arrayValue);
@@ -65,41 +206,261 @@ std::string LlamaCppClient::makeRequest(const std::string& prompt, int maxTokens
     stopSequences.append("\nUser:");
     stopSequences.append("\n\n\n");
     request["stop"] = stopSequences;
-    
-    return performPost("/completion", request, timeout);
+    return request;
+}
+
+std::string LlamaCppClient::makeRequest(Replica& replica, const std::string& prompt, int maxTokens,
+                                        float temperature, int slotId, const Deadline& deadline) {
+    long timeout = 0;
+    Json::Value request = buildCompletion(prompt, maxTokens, temperature, slotId, timeout);
+
+    // Short generations are cheap enough to duplicate; the hedge is not pinned
+    // to a slot since the other replica's slots hold different prefixes.
+    if (hedge_.generations && maxTokens > 0 && maxTokens <= hedge_.maxTokens) {
+        Json::Value hedgeRequest = request;
+        hedgeRequest.removeMember("id_slot");
+        return postHedged(replica, "/completion", request, hedgeRequest, timeout, generationHedge_, deadline);
+    }
+    return postTo(replica, "/completion", request, timeout, nullptr, nullptr, deadline);
 }
 
 std::string LlamaCppClient::generate(const std::string& prompt, int maxTokens, float temperature) {
-    std::cout << "[LlamaCppClient] Generating response for prompt length: " << prompt.length();
-    if (maxTokens > 0) std::cout << " max_tokens: " << maxTokens;
-    if (temperature > 0.0f) std::cout << " temperature: " << temperature;
-    std::cout << std::endl;
+    CompletionOptions options;
+    options.maxTokens = maxTokens;
+    options.temperature = temperature;
+    return generate(prompt, options);
+}
+
+std::string LlamaCppClient::generate(const std::string& prompt, const CompletionOptions& options) {
+    const int maxTokens = options.maxTokens;
+    const float temperature = options.temperature;
+    LOG_DEBUG << "[LlamaCppClient] Generating response for prompt length: " << prompt.length()
+              << (maxTokens > 0 ? " max_tokens: " + std::to_string(maxTokens) : "")
+              << (temperature > 0.0f ? " temperature: " + std::to_string(temperature) : "");
+
+    if (options.priority == Priority::Batch && scheduler_->policy().preemptBatch) {
+        return generateResumable(prompt, options);
+    }
+    const auto queued = Tracer::Clock::now();
+    LatencyObserver latency(generationLatency_);
+    LeaseGuard lease(scheduler_.get(), scheduler_->acquire(options.priority, false, options.flow, options.flowWeight,
+                                                                   options.deadline));
+    Tracer::instance().record("slot_wait", queued, Tracer::Clock::now());
+
+    // Pin to the replica and slot already holding this prefix; requests
+    // without a prefix go to the least loaded replica and let llama-server
+    // pick any free slot.
+    const bool pinned = !options.cachePrefix.empty() &&
+                        prompt.compare(0, options.cachePrefix.size(), options.cachePrefix) == 0;
+    const Hash128 prefixKey = pinned ? hash128(options.cachePrefix) : Hash128{};
+    Replica& replica = replicas_->pick(pinned ? &prefixKey : nullptr);
+
+    SlotTracker::Assignment slot;
+    if (pinned) {
+        slot = claimSlot(replica, prefixKey);
+    }
+    SlotRelease releaseGuard{replica.slots.get(), slot.slot};
     
     try {
-        std::string responseData = makeRequest(prompt, maxTokens, temperature);
+        std::string responseData = makeRequest(replica, prompt, maxTokens, temperature, slot.slot, options.deadline);
         
-        // Parse JSON response
-        Json::Value response;
-        Json::CharReaderBuilder reader;
-        std::stringstream ss(responseData);
-        std::string errs;
+        const Json::Value response = parseCompletionResponse(responseData);
+        std::string content = response.get("content", "").asString();
         
-        if (!Json::parseFromStream(reader, ss, &response, &errs)) {
-            throw std::runtime_error("Failed to parse response: " + errs);
-        }
+        const PromptUsage usage = promptUsage(response);
+        if (usage.cached > 0) prefillSavedTokens_->inc(static_cast<std::uint64_t>(usage.cached));
+        if (usage.tokens > 0) promptTokens_->inc(static_cast<std::uint64_t>(usage.tokens));
+        completionTokens_->inc(static_cast<std::uint64_t>(std::max(0, response.get("tokens_predicted", 0).asInt())));
+        recordTimings(response["timings"]);
         
-        std::string content = response.get("content", "").asString();
-        std::cout << "[LlamaCppClient] Response length: " << content.length() << std::endl;
+        LOG_INFO << "[LlamaCppClient] Response length: " << content.length()
+                 << (replicas_->size() > 1 ? " replica: " + replica.url : "")
+                 << (slot.slot >= 0 ? " slot: " + std::to_string(slot.slot) +
+                                          (slot.prefixHit ? " (prefix hit)" : " (prefix load)") +
+                                          " cached_tokens: " + std::to_string(usage.cached)
+                                    : "");
         
         return content;
         
     } catch (const std::exception& e) {
-        std::cerr << "[LlamaCppClient] Error: " << e.what() << std::endl;
+        LOG_ERROR << "[LlamaCppClient] Error: " << e.what();
         throw;
     }
 }
 
-std::string LlamaCppClient::performPost(const std::string& path, const Json::Value& payload, long timeoutSeconds) {
+long LlamaCppClient::capTimeout(long timeoutSeconds, const Deadline& deadline) {
+    if (deadline.unlimited()) {
+        return timeoutSeconds;
+    }
+    return std::max(1L, std::min(timeoutSeconds, static_cast<long>((deadline.remainingMs() + 999) / 1000)));
+}
+
+void LlamaCppClient::recordTimings(const Json::Value& timings) {
+    // llama-server reports how long prefill and decode took; place them
+    // back to back ending now so they show up inside the generate span.
+    const auto end = Tracer::Clock::now();
+    const auto decodeStart = end - std::chrono::microseconds(
+        static_cast<std::int64_t>(timings.get("predicted_ms", 0.0).asDouble() * 1000.0));
+    const auto prefillStart = decodeStart - std::chrono::microseconds(
+        static_cast<std::int64_t>(timings.get("prompt_ms", 0.0).asDouble() * 1000.0));
+    Tracer::instance().record("prefill", prefillStart, decodeStart);
+    Tracer::instance().record("decode", decodeStart, end);
+
+    const double perToken = timings.get("predicted_per_token_ms", 0.0).asDouble();
+    if (perToken <= 0.0) {
+        return;
+    }
+    // Lock-free EWMA; a lost update under contention only delays convergence.
+    const double previous = msPerToken_.load(std::memory_order_relaxed);
+    msPerToken_.store(previous < 0.0 ? perToken : previous * 0.8 + perToken * 0.2, std::memory_order_relaxed);
+}
+
+SlotTracker::Assignment LlamaCppClient::claimSlot(Replica& replica, const Hash128& prefix) {
+    SlotTracker::Assignment slot = replica.slots->acquire(prefix);
+    (slot.prefixHit ? slotAffinityHits_ : slotAffinityMisses_)->inc();
+
+    // Loading a saved prefix from disk is far cheaper than prefilling it on CPU.
+    if (slot.slot >= 0 && !slot.prefixHit && slot.idle && hasSavedState(replica, prefix)) {
+        if (slotAction(replica, slot.slot, "restore", slotStateFile(prefix))) {
+            slotRestores_->inc();
+        }
+    }
+    return slot;
+}
+
+std::string LlamaCppClient::generateResumable(const std::string& prompt, const CompletionOptions& options) {
+    long timeout = 0;
+    const Json::Value base = buildCompletion(prompt, options.maxTokens, options.temperature, -1, timeout);
+    const int tokenLimit = base["n_predict"].asInt();
+    const bool pinned = !options.cachePrefix.empty() &&
+                        prompt.compare(0, options.cachePrefix.size(), options.cachePrefix) == 0;
+    const Hash128 prefixKey = pinned ? hash128(options.cachePrefix) : Hash128{};
+
+    std::string output;
+    int produced = 0;
+    int preemptions = 0;
+    LatencyObserver latency(generationLatency_);
+    while (true) {
+        // Past max_preemptions the task keeps its slot so it cannot starve.
+        const bool preemptible = preemptions < scheduler_->policy().maxPreemptions;
+        const auto queued = Tracer::Clock::now();
+        LeaseGuard lease(scheduler_.get(),
+                         scheduler_->acquire(Priority::Batch, preemptible, options.flow, options.flowWeight,
+                                             options.deadline));
+        Tracer::instance().record("slot_wait", queued, Tracer::Clock::now());
+
+        Replica& replica = replicas_->pick(pinned ? &prefixKey : nullptr);
+        SlotTracker::Assignment slot;
+        if (pinned) {
+            slot = claimSlot(replica, prefixKey);
+        }
+        SlotRelease releaseGuard{replica.slots.get(), slot.slot};
+
+        // Resuming sends the partial output back as prompt; with cache_prompt
+        // the slot usually still holds it, so only the tail is prefilled.
+        Json::Value request = base;
+        request["prompt"] = prompt + output;
+        request["n_predict"] = tokenLimit - produced;
+        request["stream"] = true;
+        if (slot.slot >= 0) {
+            request["id_slot"] = slot.slot;
+        }
+
+        Json::Value final;
+        try {
+            if (streamCompletion(replica, request, timeout, options.deadline, lease.preempt(), output, produced,
+                                 final)) {
+                const PromptUsage usage = promptUsage(final);
+                if (usage.cached > 0) prefillSavedTokens_->inc(static_cast<std::uint64_t>(usage.cached));
+                if (usage.tokens > 0) promptTokens_->inc(static_cast<std::uint64_t>(usage.tokens));
+                completionTokens_->inc(static_cast<std::uint64_t>(produced));
+                recordTimings(final["timings"]);
+
+                LOG_INFO << "[LlamaCppClient] Response length: " << output.length() << " (batch"
+                         << (preemptions > 0 ? ", resumed " + std::to_string(preemptions) + "x" : "") << ")";
+                return output;
+            }
+        } catch (const std::exception& e) {
+            LOG_ERROR << "[LlamaCppClient] Error: " << e.what();
+            throw;
+        }
+
+        preemptions++;
+        scheduler_->recordPreemption();
+        LOG_INFO << "[LlamaCppClient] Batch generation preempted after " << produced << " tokens";
+        if (produced >= tokenLimit) {
+            completionTokens_->inc(static_cast<std::uint64_t>(produced));
+            return output;
+        }
+    }
+}
+
+bool LlamaCppClient::streamCompletion(Replica& replica, const Json::Value& request, long timeoutSeconds,
+                                      const Deadline& deadline, const std::atomic<bool>* cancel, std::string& output, int& produced,
+                                      Json::Value& final) {
+    // Server-sent events: one "data: {...}" line per generated token, the
+    // last one carrying stop=true and the usual completion statistics. Only
+    // whole events are applied, so a cancelled stream leaves `output` at a
+    // token boundary.
+    std::string pending;
+    std::string other;
+    bool stopped = false;
+    const std::function<void(const char*, std::size_t)> sink = [&](const char* data, std::size_t size) {
+        pending.append(data, size);
+        std::size_t end;
+        while ((end = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.compare(0, 6, "data: ") != 0) {
+                other += line;
+                continue;
+            }
+            Json::Value event;
+            Json::CharReaderBuilder reader;
+            std::stringstream ss(line.substr(6));
+            std::string errs;
+            if (!Json::parseFromStream(reader, ss, &event, &errs) || stopped) {
+                continue;
+            }
+            const std::string content = event.get("content", "").asString();
+            if (!content.empty()) {
+                output += content;
+                produced++;
+            }
+            if (event.get("stop", false).asBool()) {
+                stopped = true;
+                final = event;
+            }
+        }
+    };
+
+    try {
+        postTo(replica, "/completion", request, timeoutSeconds, cancel, &sink, deadline);
+    } catch (const RequestCancelled&) {
+        return false;
+    }
+    if (stopped) {
+        return true;
+    }
+
+    // Errors come back as a plain JSON body rather than an event.
+    Json::Value response;
+    Json::CharReaderBuilder reader;
+    std::stringstream ss(other + pending);
+    std::string errs;
+    if (Json::parseFromStream(reader, ss, &response, &errs) && response.isMember("error")) {
+        const Json::Value& error = response["error"];
+        throw std::runtime_error("llama-server error: " +
+                                 (error.isObject() ? error.get("message", "unknown").asString() : error.asString()));
+    }
+    throw std::runtime_error("llama-server stream ended without a final event");
+}
+
+std::string LlamaCppClient::performPost(const std::string& baseUrl, const std::string& path, const Json::Value& payload,
+                                        long timeoutSeconds, const std::atomic<bool>* cancel, const BodySink* sink) {
     Json::StreamWriterBuilder writer;
     std::string jsonRequest = Json::writeString(writer, payload);
     std::string responseData;
@@ -109,41 +470,365 @@ std::string LlamaCppClient::performPost(const std::string& path, const Json::Val
         throw std::runtime_error("Failed to initialize CURL handle");
     }
 
-    curl_easy_setopt(curl, CURLOPT_URL, (serverUrl_ + path).c_str());
+    curl_easy_setopt(curl, CURLOPT_URL, (baseUrl + path).c_str());
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonRequest.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseData);
+    if (sink) {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, sinkCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, const_cast<BodySink*>(sink));
+    } else {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseData);
+    }
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeoutSeconds);
     curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    if (cancel) {
+        // Aborting closes the connection, which makes llama-server drop the task.
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, cancelCallback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<std::atomic<bool>*>(cancel));
+    }
 
     struct curl_slist* headers = nullptr;
     headers = curl_slist_append(headers, "Content-Type: application/json");
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
     CURLcode res = curl_easy_perform(curl);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
     curl_slist_free_all(headers);
     curl_easy_cleanup(curl);
 
+    if (res == CURLE_ABORTED_BY_CALLBACK && cancel && cancel->load()) {
+        throw RequestCancelled();
+    }
+    if (res == CURLE_OPERATION_TIMEDOUT) {
+        throw RequestTimedOut("CURL request failed: " + std::string(curl_easy_strerror(res)));
+    }
     if (res != CURLE_OK) {
         throw std::runtime_error("CURL request failed: " + std::string(curl_easy_strerror(res)));
     }
+    // 5xx means the server itself is unwell (loading, out of memory, crashed
+    // slot); 4xx bodies carry a JSON error for the caller to report.
+    if (status >= 500) {
+        throw std::runtime_error("llama-server returned HTTP " + std::to_string(status) + " from " + baseUrl);
+    }
 
     return responseData;
 }
 
-std::vector<float> LlamaCppClient::embed(const std::string& text, int expectedDimensions) {
+std::string LlamaCppClient::postTo(Replica& replica, const std::string& path, const Json::Value& payload,
+                                   long timeoutSeconds, const std::atomic<bool>* cancel, const BodySink* sink,
+                                   const Deadline& deadline) {
+    const long timeout = capTimeout(timeoutSeconds, deadline);
+    replicas_->onStart(replica);
+    const auto started = std::chrono::steady_clock::now();
+    try {
+        std::string responseData = performPost(replica.url, path, payload, timeout, cancel, sink);
+        replicas_->onSuccess(replica,
+                             std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - started),
+                             latencyClass(path));
+        return responseData;
+    } catch (const RequestCancelled&) {
+        replicas_->onCancelled(replica);
+        throw;
+    } catch (const RequestTimedOut&) {
+        if (timeout < timeoutSeconds) {
+            // The caller's budget ran out, not the replica: no breaker or
+            // ejection penalty, and the caller sees a deadline error.
+            replicas_->onCancelled(replica);
+            throw DeadlineExceeded("llama-server answered");
+        }
+        replicas_->onFailure(replica);
+        throw;
+    } catch (...) {
+        replicas_->onFailure(replica);
+        throw;
+    }
+}
+
+std::string LlamaCppClient::postHedged(Replica& primary, const std::string& path, const Json::Value& payload,
+                                       const Json::Value& hedgePayload, long timeoutSeconds, HedgeStats& stats,
+                                       const Deadline& deadline) {
+    const std::int64_t p = stats.latency.percentileMicros(hedge_.percentile, static_cast<std::size_t>(hedge_.minSamples));
+    if (p < 0 || replicas_->size() < 2) {
+        const auto started = std::chrono::steady_clock::now();
+        std::string body = postTo(primary, path, payload, timeoutSeconds, nullptr, nullptr, deadline);
+        stats.latency.add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started));
+        return body;
+    }
+    const auto delay = std::chrono::microseconds(
+        std::min<std::int64_t>(std::max<std::int64_t>(p, hedge_.minDelayMs * 1000LL), hedge_.maxDelayMs * 1000LL));
+
+    // Attempts outlive this call when they lose, hence the shared state and
+    // detached threads; the client itself lives for the whole process.
+    auto race = std::make_shared<HedgeRace>();
+    auto launch = [this, race, path, timeoutSeconds, deadline, &stats](Replica& replica, Json::Value body,
+                                                                         int attempt,
+                                                                         std::shared_ptr<LeaseGuard> lease) {
+        std::thread([this, race, path, timeoutSeconds, deadline, &stats, &replica, body = std::move(body),
+                     attempt, lease = std::move(lease)]() {
+            const auto started = std::chrono::steady_clock::now();
+            try {
+                std::string result = postTo(replica, path, body, timeoutSeconds, &race->cancel[attempt], nullptr,
+                                            deadline);
+                stats.latency.add(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - started));
+                race->finish(attempt, std::move(result), nullptr);
+            } catch (...) {
+                race->finish(attempt, "", std::current_exception());
+            }
+        }).detach();
+    };
+
+    launch(primary, payload, 0, nullptr);  // the caller holds its lease
+    std::unique_lock<std::mutex> lock(race->mutex);
+    if (race->done.wait_for(lock, delay, [&] { return race->finished > 0; })) {
+        if (race->winner < 0) {
+            std::rethrow_exception(race->error);
+        }
+        return std::move(race->body);
+    }
+
+    // The duplicate runs on spare capacity only: a batch lease it takes if
+    // one is free right away, so it never queues or holds a slot that chat
+    // is waiting for. The replica is picked, claiming its breaker probe if
+    // half-open, only once the hedge is certain to be sent.
+    lock.unlock();
+    LlmScheduler::Lease lease;
+    std::shared_ptr<LeaseGuard> hedgeLease;
+    if (scheduler_->tryAcquire(Priority::Batch, lease)) {
+        hedgeLease = std::make_shared<LeaseGuard>(scheduler_.get(), std::move(lease));
+    }
+    lock.lock();
+    Replica* second = hedgeLease && race->finished == 0 ? replicas_->tryPick(nullptr, &primary) : nullptr;
+    int attempts = 1;
+    if (second) {
+        stats.sent->inc();
+        launch(*second, hedgePayload, 1, std::move(hedgeLease));
+        attempts = 2;
+    }
+
+    race->done.wait(lock, [&] { return race->winner >= 0 || race->finished == attempts; });
+    if (race->winner < 0) {
+        std::rethrow_exception(race->error);
+    }
+    if (race->winner == 1) {
+        stats.won->inc();
+    }
+    return std::move(race->body);
+}
+
+std::string LlamaCppClient::slotStateFile(const Hash128& prefix) const {
+    // llama-server rejects filenames containing path separators
+    std::string name;
+    for (char c : modelId_) {
+        name.push_back(std::isalnum(static_cast<unsigned char>(c)) ? c : '_');
+    }
+    return name + "_" + toHex(prefix) + ".bin";
+}
+
+bool LlamaCppClient::hasSavedState(Replica& replica, const Hash128& prefix) {
+    if (!persistSlots_) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(replica.savedMutex);
+    return replica.savedPrefixes.count(prefix) > 0;
+}
+
+bool LlamaCppClient::slotAction(Replica& replica, int slot, const std::string& action, const std::string& filename) {
+    Json::Value request;
+    request["filename"] = filename;
+
+    try {
+        std::string responseData = performPost(replica.url, "/slots/" + std::to_string(slot) + "?action=" + action,
+                                               request, 60L);
+
+        Json::Value response;
+        Json::CharReaderBuilder reader;
+        std::stringstream ss(responseData);
+        std::string errs;
+        if (!Json::parseFromStream(reader, ss, &response, &errs) || response.isMember("error")) {
+            LOG_ERROR << "[LlamaCppClient] Slot " << action << " failed for slot " << slot << " (" << filename << ")";
+            return false;
+        }
+        return true;
+    } catch (const std::exception& e) {
+        LOG_ERROR << "[LlamaCppClient] Slot " << action << " error: " << e.what();
+        return false;
+    }
+}
+
+bool LlamaCppClient::warmPrefix(const std::string& prefix) {
+    if (prefix.empty()) {
+        return false;
+    }
+
+    // Each replica has its own KV cache, so the prefix is warmed on all of them.
+    bool warmed = false;
+    for (std::size_t i = 0; i < replicas_->size(); ++i) {
+        warmed = warmPrefixOn(replicas_->at(i), prefix) || warmed;
+    }
+    return warmed;
+}
+
+bool LlamaCppClient::warmPrefixOn(Replica& replica, const std::string& prefix) {
+    const Hash128 prefixKey = hash128(prefix);
+    SlotTracker::Assignment slot = replica.slots->acquire(prefixKey);
+    SlotRelease releaseGuard{replica.slots.get(), slot.slot};
+
+    const std::string stateFile = slotStateFile(prefixKey);
+    bool restored = persistSlots_ && slotAction(replica, slot.slot, "restore", stateFile);
+    bool saved = false;
+
+    if (!restored) {
+        Json::Value request;
+        request["prompt"] = prefix;
+        request["n_predict"] = 1;
+        request["cache_prompt"] = true;
+        request["id_slot"] = slot.slot;
+        try {
+            postTo(replica, "/completion", request, 300L);
+        } catch (const std::exception& e) {
+            LOG_WARN << "[LlamaCppClient] Prefix warmup failed on " << replica.url << ": " << e.what();
+            return false;
+        }
+        saved = persistSlots_ && slotAction(replica, slot.slot, "save", stateFile);
+    }
+
+    if (restored || saved) {
+        std::lock_guard<std::mutex> lock(replica.savedMutex);
+        replica.savedPrefixes.insert(prefixKey);
+    }
+
+    LOG_INFO << "[LlamaCppClient] Warmed prefix " << toHex(prefixKey).substr(0, 12) << " on " << replica.url
+             << " slot " << slot.slot
+             << (restored ? " (restored from " + stateFile + ")" : saved ? " (saved to " + stateFile + ")" : "");
+    return true;
+}
+
+int LlamaCppClient::tokenize(const std::string& text) {
+    Json::Value request;
+    request["content"] = text;
+
+    try {
+        std::string responseData = postTo(replicas_->pick(), "/tokenize", request, 10L);
+
+        Json::Value response;
+        Json::CharReaderBuilder reader;
+        std::stringstream ss(responseData);
+        std::string errs;
+        if (!Json::parseFromStream(reader, ss, &response, &errs) || !response["tokens"].isArray()) {
+            return -1;
+        }
+        return static_cast<int>(response["tokens"].size());
+    } catch (const std::exception& e) {
+        LOG_ERROR << "[LlamaCppClient] Tokenize failed: " << e.what();
+        return -1;
+    }
+}
+
+std::vector<std::size_t> LlamaCppClient::tokenStarts(const std::string& text) {
+    std::vector<std::size_t> starts;
     if (text.empty()) {
-        throw std::runtime_error("Cannot embed empty text");
+        return starts;
     }
 
     Json::Value request;
     request["content"] = text;
+    request["with_pieces"] = true;
+
+    Json::Value response;
+    try {
+        std::string responseData = postTo(replicas_->pick(), "/tokenize", request, 60L);
+        Json::CharReaderBuilder reader;
+        std::stringstream ss(responseData);
+        std::string errs;
+        if (!Json::parseFromStream(reader, ss, &response, &errs) || !response["tokens"].isArray()) {
+            return starts;
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR << "[LlamaCppClient] Tokenize failed: " << e.what();
+        return starts;
+    }
 
-    std::string responseData = performPost("/embedding", request, 120L);
+    // Walk the text piece by piece. Whitespace is skipped on both sides since
+    // tokenizers add a leading space or collapse runs of blanks; anything else
+    // must line up byte for byte (case aside), or the offsets are unusable.
+    auto isBlank = [](char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; };
+    auto sameByte = [](char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+    };
+    const Json::Value& tokens = response["tokens"];
+    starts.reserve(tokens.size());
+    std::size_t pos = 0;
+    for (const Json::Value& token : tokens) {
+        if (!token.isObject()) {
+            return {};  // server without with_pieces support
+        }
+        std::string piece;
+        const Json::Value& value = token["piece"];
+        if (value.isString()) {
+            piece = value.asString();
+        } else if (value.isArray()) {
+            // Partial UTF-8 sequences come back as raw bytes
+            for (const Json::Value& byte : value) {
+                piece += static_cast<char>(byte.asInt());
+            }
+        }
 
+        std::size_t p = 0;
+        while (p < piece.size() && isBlank(piece[p])) {
+            ++p;
+        }
+        while (p < piece.size() && pos < text.size() && isBlank(text[pos])) {
+            ++pos;
+        }
+        if (p == piece.size()) {
+            continue;  // whitespace-only token: it belongs to the gap before the next word
+        }
+        if (starts.empty() || pos > starts.back()) {
+            starts.push_back(pos);
+        }
+        for (; p < piece.size(); ++p, ++pos) {
+            if (pos >= text.size() || !sameByte(text[pos], piece[p])) {
+                LOG_DEBUG << "[LlamaCppClient] Token pieces diverge from the text at byte " << pos;
+                return {};
+            }
+        }
+    }
+    while (pos < text.size() && isBlank(text[pos])) {
+        ++pos;
+    }
+    if (pos != text.size()) {
+        return {};
+    }
+    return starts;
+}
+
+Json::Value LlamaCppClient::parseCompletionResponse(const std::string& body) {
     Json::Value response;
     Json::CharReaderBuilder reader;
-    std::stringstream ss(responseData);
+    std::stringstream ss(body);
+    std::string errs;
+
+    if (!Json::parseFromStream(reader, ss, &response, &errs)) {
+        throw std::runtime_error("Failed to parse response: " + errs);
+    }
+
+    if (response.isMember("error")) {
+        const Json::Value& error = response["error"];
+        throw std::runtime_error("llama-server error: " +
+                                 (error.isObject() ? error.get("message", "unknown").asString() : error.asString()));
+    }
+    return response;
+}
+
+std::vector<float> LlamaCppClient::parseEmbeddingResponse(const std::string& body) {
+    Json::Value response;
+    Json::CharReaderBuilder reader;
+    std::stringstream ss(body);
     std::string errs;
 
     if (!Json::parseFromStream(reader, ss, &response, &errs)) {
@@ -163,18 +848,105 @@ std::vector<float> LlamaCppClient::embed(const std::string& text, int expectedDi
     if (!embeddingNode) {
         throw std::runtime_error("Embedding response missing 'embedding' array");
     }
+    return embeddingValues(*embeddingNode);
+}
 
-    std::vector<float> embedding;
-    embedding.reserve(embeddingNode->size());
-    for (const auto& value : *embeddingNode) {
-        embedding.push_back(value.asFloat());
+std::vector<float> LlamaCppClient::embed(const std::string& text, int expectedDimensions, Priority priority,
+                                         const Deadline& deadline) {
+    if (text.empty()) {
+        throw std::runtime_error("Cannot embed empty text");
+    }
+    if (deadline.expired()) {
+        throw DeadlineExceeded("the embedding request was sent");
     }
 
+    Json::Value request;
+    request["content"] = text;
+
+    // Not preemptible: an interrupted embedding has nothing to resume from
+    std::unique_ptr<LeaseGuard> lease;
+    if (priority == Priority::Batch) {
+        lease = std::make_unique<LeaseGuard>(scheduler_.get(),
+                                             scheduler_->acquire(Priority::Batch, false, 0, 1.0, deadline));
+    }
+    LatencyObserver latency(embeddingLatency_);
+    std::string responseData = hedge_.embeddings
+        ? postHedged(replicas_->pick(), "/embedding", request, request, 120L, embedHedge_, deadline)
+        : postTo(replicas_->pick(), "/embedding", request, 120L, nullptr, nullptr, deadline);
+
+    std::vector<float> embedding = parseEmbeddingResponse(responseData);
+
     if (expectedDimensions > 0 && static_cast<int>(embedding.size()) != expectedDimensions) {
         std::ostringstream oss;
         oss << "Expected embedding dimension " << expectedDimensions << " but received " << embedding.size();
         throw std::runtime_error(oss.str());
     }
 
+    embeddings_->inc();
     return embedding;
 }
+
+std::vector<std::vector<float>> LlamaCppClient::embedBatch(const std::vector<std::string>& texts,
+                                                           int expectedDimensions) {
+    std::vector<std::vector<float>> embeddings(texts.size());
+    if (texts.empty()) {
+        return embeddings;
+    }
+
+    Json::Value request;
+    request["content"] = Json::Value(Json::arrayValue);
+    for (const auto& text : texts) {
+        if (text.empty()) {
+            throw std::runtime_error("Cannot embed empty text");
+        }
+        request["content"].append(text);
+    }
+
+    // One request for the whole batch; llama-server spreads it over its
+    // slots. It takes one batch lease however many slots that is, which
+    // keeps it queued behind chat; the ingestion duty cycle does the rest.
+    LeaseGuard lease(scheduler_.get(), scheduler_->acquire(Priority::Batch, false));
+    LatencyObserver latency(embeddingLatency_);
+    const long timeout = 120L + 10L * static_cast<long>(texts.size());
+    std::string responseData = postTo(replicas_->pick(), "/embedding", request, timeout);
+
+    Json::Value response;
+    Json::CharReaderBuilder reader;
+    std::stringstream ss(responseData);
+    std::string errs;
+
+    if (!Json::parseFromStream(reader, ss, &response, &errs)) {
+        throw std::runtime_error("Failed to parse embedding response: " + errs);
+    }
+
+    // llama-server answers with [{index, embedding}, ...]; the OpenAI-style
+    // shape is {data: [{index, embedding}, ...]}.
+    const Json::Value& items = response.isArray() ? response : response["data"];
+    if (!items.isArray() || items.size() != texts.size()) {
+        throw std::runtime_error("Embedding response has " + std::to_string(items.isArray() ? items.size() : 0) +
+                                 " results for " + std::to_string(texts.size()) + " inputs");
+    }
+
+    for (Json::ArrayIndex i = 0; i < items.size(); ++i) {
+        const Json::Value& item = items[i];
+        const Json::ArrayIndex index = item.isMember("index") ? item["index"].asUInt() : i;
+        if (index >= texts.size() || !item.isMember("embedding") || !item["embedding"].isArray()) {
+            throw std::runtime_error("Malformed embedding batch item " + std::to_string(i));
+        }
+        embeddings[index] = embeddingValues(item["embedding"]);
+        if (expectedDimensions > 0 && static_cast<int>(embeddings[index].size()) != expectedDimensions) {
+            std::ostringstream oss;
+            oss << "Expected embedding dimension " << expectedDimensions << " but received "
+                << embeddings[index].size();
+            throw std::runtime_error(oss.str());
+        }
+    }
+    for (const auto& embedding : embeddings) {
+        if (embedding.empty()) {
+            throw std::runtime_error("Embedding response is missing results");
+        }
+    }
+
+    embeddings_->inc(texts.size());
+    return embeddings;
+}
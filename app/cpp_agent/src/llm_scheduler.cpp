@@ -0,0 +1,156 @@
+#include "../include/llm_scheduler.h"
+#include "../include/metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+LlmScheduler::LlmScheduler(int slots, const SchedulerPolicy& policy, const std::string& model)
+    : slots_(std::max(1, slots)), policy_(policy) {
+    Metrics& metrics = Metrics::instance();
+    for (Priority priority : {Priority::Interactive, Priority::Batch}) {
+        const int i = static_cast<int>(priority);
+        const std::string labels = metricLabel("model", model) + "," +
+                                   metricLabel("class", priority == Priority::Interactive ? "interactive" : "batch");
+        runningGauge_[i] = &metrics.gauge("llm_scheduler_running", "Requests holding a llama-server slot", labels);
+        waitingGauge_[i] = &metrics.gauge("llm_scheduler_waiting", "Requests waiting for a llama-server slot", labels);
+        waitMicros_[i] = &metrics.counter("llm_scheduler_wait_microseconds_total",
+                                          "Time requests spent waiting for a llama-server slot", labels);
+    }
+    preemptions_ = &metrics.counter("llm_scheduler_preemptions_total",
+                                    "Batch generations interrupted to make room for interactive requests",
+                                    metricLabel("model", model));
+}
+
+bool LlmScheduler::admissible(Priority priority) const {
+    const int total = running_[0] + running_[1];
+    if (total >= slots_) {
+        return false;
+    }
+    if (priority == Priority::Interactive) {
+        return true;
+    }
+    const int batchLimit = std::max(1, slots_ - policy_.interactiveReservedSlots);
+    return waiting_[static_cast<int>(Priority::Interactive)] == 0 && running_[static_cast<int>(Priority::Batch)] < batchLimit;
+}
+
+void LlmScheduler::requestPreemption() {
+    // One interrupted batch task per waiting interactive request is enough;
+    // the newest one has the least work to redo.
+    int pending = 0;
+    for (const auto& flag : batch_) {
+        pending += flag->load(std::memory_order_relaxed) ? 1 : 0;
+    }
+    if (pending >= waiting_[static_cast<int>(Priority::Interactive)]) {
+        return;
+    }
+    for (auto it = batch_.rbegin(); it != batch_.rend(); ++it) {
+        if (!(*it)->load(std::memory_order_relaxed)) {
+            (*it)->store(true, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+LlmScheduler::Lease LlmScheduler::acquire(Priority priority, bool preemptible, std::uint64_t flow, double weight,
+                                          const Deadline& deadline) {
+    const int i = static_cast<int>(priority);
+    const auto started = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    double start = virtualTime_[i];
+    if (flow != 0) {
+        auto tag = finishTags_[i].find(flow);
+        if (tag != finishTags_[i].end()) {
+            start = std::max(start, tag->second);
+        }
+        finishTags_[i][flow] = start + 1.0 / std::max(weight, 0.01);
+    }
+    const std::pair<double, std::uint64_t> ticket(start, nextTicket_++);
+    queue_[i].insert(ticket);
+    waiting_[i]++;
+    publish();
+    while (!admissible(priority) || *queue_[i].begin() != ticket) {
+        if (priority == Priority::Interactive && policy_.preemptBatch) {
+            requestPreemption();
+        }
+        if (deadline.unlimited()) {
+            changed_.wait(lock);
+        } else if (changed_.wait_until(lock, deadline.at()) == std::cv_status::timeout) {
+            queue_[i].erase(ticket);
+            waiting_[i]--;
+            publish();
+            lock.unlock();
+            changed_.notify_all();
+            throw DeadlineExceeded("a llama-server slot became free");
+        }
+    }
+    queue_[i].erase(queue_[i].begin());
+    virtualTime_[i] = std::max(virtualTime_[i], start);
+    waiting_[i]--;
+    running_[i]++;
+
+    // Flows whose last finish tag the virtual time has passed start afresh
+    // anyway; dropping them keeps the map bounded by the active flows.
+    if (finishTags_[i].size() > 2 * queue_[i].size() + 64) {
+        for (auto it = finishTags_[i].begin(); it != finishTags_[i].end();) {
+            it = it->second <= virtualTime_[i] ? finishTags_[i].erase(it) : std::next(it);
+        }
+    }
+
+    Lease lease;
+    lease.priority = priority;
+    lease.preempt = std::make_shared<std::atomic<bool>>(false);
+    if (priority == Priority::Batch && preemptible && policy_.preemptBatch) {
+        lease.position = batch_.insert(batch_.end(), lease.preempt);
+        lease.preemptible = true;
+    }
+    publish();
+    lock.unlock();
+
+    // The next ticket in line (or a batch task, once interactive demand has
+    // drained) may now be admissible; wake everyone to re-check.
+    changed_.notify_all();
+    waitMicros_[i]->inc(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count()));
+    return lease;
+}
+
+bool LlmScheduler::tryAcquire(Priority priority, Lease& lease) {
+    const int i = static_cast<int>(priority);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!queue_[i].empty() || !admissible(priority)) {
+            return false;
+        }
+        running_[i]++;
+        publish();
+    }
+    lease = Lease();
+    lease.priority = priority;
+    lease.preempt = std::make_shared<std::atomic<bool>>(false);
+    return true;
+}
+
+void LlmScheduler::release(Lease& lease) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_[static_cast<int>(lease.priority)]--;
+        if (lease.preemptible) {
+            batch_.erase(lease.position);
+            lease.preemptible = false;
+        }
+        publish();
+    }
+    changed_.notify_all();
+}
+
+void LlmScheduler::recordPreemption() {
+    preemptions_->inc();
+}
+
+void LlmScheduler::publish() {
+    for (int i = 0; i < 2; ++i) {
+        runningGauge_[i]->set(running_[i]);
+        waitingGauge_[i]->set(waiting_[i]);
+    }
+}
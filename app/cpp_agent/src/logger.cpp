@@ -0,0 +1,358 @@
+#include "../include/logger.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+namespace {
+struct RecordHeader {
+    std::uint32_t size;
+    LogLevel level;
+    std::int64_t timeUs;
+};
+
+std::int64_t wallMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+const char* levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info: return "INFO";
+        case LogLevel::Warn: return "WARN";
+        case LogLevel::Error: return "ERROR";
+        default: return "OFF";
+    }
+}
+
+void appendTimestamp(std::string& out, std::int64_t timeUs) {
+    const std::time_t seconds = static_cast<std::time_t>(timeUs / 1000000);
+    std::tm utc{};
+    gmtime_r(&seconds, &utc);
+    char text[32];
+    const std::size_t n = std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &utc);
+    out.append(text, n);
+    std::snprintf(text, sizeof(text), ".%03dZ", static_cast<int>((timeUs / 1000) % 1000));
+    out += text;
+}
+
+void appendJsonString(std::string& out, std::string_view value) {
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+void copyIn(char* ring, std::size_t capacity, std::uint64_t at, const void* data, std::size_t size) {
+    const std::size_t offset = static_cast<std::size_t>(at & (capacity - 1));
+    const std::size_t first = std::min(size, capacity - offset);
+    std::memcpy(ring + offset, data, first);
+    std::memcpy(ring, static_cast<const char*>(data) + first, size - first);
+}
+
+void copyOut(const char* ring, std::size_t capacity, std::uint64_t at, void* data, std::size_t size) {
+    const std::size_t offset = static_cast<std::size_t>(at & (capacity - 1));
+    const std::size_t first = std::min(size, capacity - offset);
+    std::memcpy(data, ring + offset, first);
+    std::memcpy(static_cast<char*>(data) + first, ring, size - first);
+}
+}
+
+// Hands the thread's buffer back when the thread exits; the writer keeps
+// draining it and the next new thread adopts it.
+struct LogBufferHolder {
+    Logger::ThreadBuffer* buffer = nullptr;
+    ~LogBufferHolder() {
+        if (buffer) {
+            buffer->inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+namespace {
+thread_local LogBufferHolder localHolder;
+}
+
+LogLevel parseLogLevel(const std::string& name, LogLevel fallback) {
+    std::string lower;
+    for (char c : name) {
+        lower += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    if (lower == "debug") return LogLevel::Debug;
+    if (lower == "info") return LogLevel::Info;
+    if (lower == "warn" || lower == "warning") return LogLevel::Warn;
+    if (lower == "error") return LogLevel::Error;
+    if (lower == "off" || lower == "none") return LogLevel::Off;
+    return fallback;
+}
+
+// Never destroyed: threads may still log during static destruction, and
+// main() stops the writer explicitly before returning.
+Logger& Logger::instance() {
+    static Logger* logger = new Logger();
+    return *logger;
+}
+
+void Logger::start(const LogOptions& options) {
+    stop();
+    level_.store(static_cast<int>(options.level), std::memory_order_relaxed);
+    json_ = options.json;
+    std::size_t capacity = 4096;
+    while (capacity < options.bufferBytes) {
+        capacity <<= 1;
+    }
+    bufferBytes_ = capacity;
+    flushIntervalMs_ = std::max(1, options.flushIntervalMs);
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        stopping_ = false;
+    }
+    running_.store(true, std::memory_order_release);
+    writer_ = std::thread(&Logger::run, this);
+}
+
+void Logger::stop() {
+    if (!writer_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    running_.store(false, std::memory_order_seq_cst);
+    // A write() that saw running_ before the store may still be appending
+    // to its buffer; wait for it so the last drain picks the line up.
+    while (writers_.load(std::memory_order_seq_cst) > 0) {
+        std::this_thread::yield();
+    }
+    // Lines written while the writer was exiting
+    drain();
+}
+
+Logger::ThreadBuffer* Logger::localBuffer() {
+    if (localHolder.buffer) {
+        return localHolder.buffer;
+    }
+    std::lock_guard<std::mutex> lock(buffersMutex_);
+    for (auto& candidate : buffers_) {
+        bool expected = false;
+        if (candidate->capacity == bufferBytes_ &&
+            candidate->inUse.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            localHolder.buffer = candidate.get();
+            return localHolder.buffer;
+        }
+    }
+    auto created = std::make_unique<ThreadBuffer>();
+    created->capacity = bufferBytes_;
+    created->data.reset(new char[created->capacity]);
+    created->inUse.store(true, std::memory_order_relaxed);
+    localHolder.buffer = created.get();
+    buffers_.push_back(std::move(created));
+    return localHolder.buffer;
+}
+
+void Logger::write(LogLevel level, const char* text, std::size_t size) {
+    const RecordHeader header{static_cast<std::uint32_t>(size), level, wallMicros()};
+    writers_.fetch_add(1, std::memory_order_seq_cst);
+    if (!running_.load(std::memory_order_seq_cst)) {
+        writers_.fetch_sub(1, std::memory_order_release);
+        const std::string line = format(Record{header.timeUs, level, std::string(text, size)});
+        std::lock_guard<std::mutex> lock(syncMutex_);
+        std::FILE* stream = level >= LogLevel::Warn ? stderr : stdout;
+        std::fwrite(line.data(), 1, line.size(), stream);
+        std::fflush(stream);
+        return;
+    }
+
+    ThreadBuffer& buffer = *localBuffer();
+    const std::size_t total = sizeof(header) + size;
+    const std::uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    const std::uint64_t tail = buffer.tail.load(std::memory_order_acquire);
+    if (total > buffer.capacity - static_cast<std::size_t>(head - tail)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        writers_.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    copyIn(buffer.data.get(), buffer.capacity, head, &header, sizeof(header));
+    copyIn(buffer.data.get(), buffer.capacity, head + sizeof(header), text, size);
+    buffer.head.store(head + total, std::memory_order_release);
+    writers_.fetch_sub(1, std::memory_order_release);
+    if (level >= LogLevel::Error) {
+        wake_.notify_one();
+    }
+}
+
+void Logger::run() {
+    std::unique_lock<std::mutex> lock(wakeMutex_);
+    while (!stopping_) {
+        wake_.wait_for(lock, std::chrono::milliseconds(flushIntervalMs_));
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+void Logger::drain() {
+    std::vector<Record> records;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex_);
+        for (auto& buffer : buffers_) {
+            std::uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+            const std::uint64_t head = buffer->head.load(std::memory_order_acquire);
+            while (tail < head) {
+                RecordHeader header;
+                copyOut(buffer->data.get(), buffer->capacity, tail, &header, sizeof(header));
+                Record record{header.timeUs, header.level, std::string(header.size, '\0')};
+                copyOut(buffer->data.get(), buffer->capacity, tail + sizeof(header), &record.text[0], header.size);
+                records.push_back(std::move(record));
+                tail += sizeof(header) + header.size;
+            }
+            buffer->tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    const std::uint64_t drops = dropped();
+    if (drops != reportedDrops_) {
+        records.push_back(Record{wallMicros(), LogLevel::Warn,
+                                 "[Logger] " + std::to_string(drops - reportedDrops_) +
+                                     " lines dropped, log buffers full"});
+        reportedDrops_ = drops;
+    }
+    if (records.empty()) {
+        return;
+    }
+
+    // Each buffer is in order already; this interleaves the threads.
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record& a, const Record& b) { return a.timeUs < b.timeUs; });
+    std::string out;
+    std::string err;
+    for (const Record& record : records) {
+        (record.level >= LogLevel::Warn ? err : out) += format(record);
+    }
+    if (!out.empty()) {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+    }
+    if (!err.empty()) {
+        std::fwrite(err.data(), 1, err.size(), stderr);
+        std::fflush(stderr);
+    }
+}
+
+std::string Logger::format(const Record& record) const {
+    std::string line;
+    line.reserve(record.text.size() + 64);
+    if (!json_) {
+        appendTimestamp(line, record.timeUs);
+        line += ' ';
+        line += levelName(record.level);
+        line += ' ';
+        line += record.text;
+        line += '\n';
+        return line;
+    }
+
+    // Split the conventional "[Component] " prefix into its own field.
+    std::string_view message = record.text;
+    std::string_view component;
+    if (message.size() > 2 && message.front() == '[') {
+        const std::size_t close = message.find("] ");
+        if (close != std::string_view::npos && close < 48) {
+            component = message.substr(1, close - 1);
+            message.remove_prefix(close + 2);
+        }
+    }
+    line += "{\"ts\":\"";
+    appendTimestamp(line, record.timeUs);
+    line += "\",\"level\":\"";
+    line += levelName(record.level);
+    line += '"';
+    if (!component.empty()) {
+        line += ",\"component\":";
+        appendJsonString(line, component);
+    }
+    line += ",\"msg\":";
+    appendJsonString(line, message);
+    line += "}\n";
+    return line;
+}
+
+LogLine::~LogLine() {
+    if (suppressed_ > 0) {
+        *this << " (" << suppressed_ << " similar suppressed)";
+    }
+    Logger::instance().write(level_, buffer_, size_);
+}
+
+void LogLine::append(const char* data, std::size_t size) {
+    const std::size_t room = kMaxLine - size_;
+    if (size > room) {
+        size = room;
+    }
+    std::memcpy(buffer_ + size_, data, size);
+    size_ += size;
+}
+
+void LogLine::appendSigned(long long value) {
+    char text[24];
+    const auto result = std::to_chars(text, text + sizeof(text), value);
+    append(text, static_cast<std::size_t>(result.ptr - text));
+}
+
+void LogLine::appendUnsigned(unsigned long long value) {
+    char text[24];
+    const auto result = std::to_chars(text, text + sizeof(text), value);
+    append(text, static_cast<std::size_t>(result.ptr - text));
+}
+
+LogLine& LogLine::operator<<(double value) {
+    char text[64];
+    const int n = precision_ >= 0 ? std::snprintf(text, sizeof(text), "%.*f", precision_, value)
+                                  : std::snprintf(text, sizeof(text), "%g", value);
+    if (n > 0) {
+        append(text, std::min(static_cast<std::size_t>(n), sizeof(text) - 1));
+    }
+    return *this;
+}
+
+bool LogSampler::allow(std::uint64_t& suppressed) {
+    const std::uint32_t now = static_cast<std::uint32_t>(
+        std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    std::uint64_t window = window_.load(std::memory_order_relaxed);
+    while (true) {
+        const bool sameSecond = static_cast<std::uint32_t>(window >> 32) == now;
+        if (sameSecond && static_cast<std::uint32_t>(window) >= perSecond_) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        const std::uint64_t next = sameSecond ? window + 1 : (static_cast<std::uint64_t>(now) << 32) | 1;
+        if (window_.compare_exchange_weak(window, next, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+    return true;
+}
@@ -1,4 +1,3 @@
-#include <iostream>
 #include <thread>
 #include <string>
 #include <csignal>
@@ -6,11 +5,17 @@
 #include "../include/http_server.h"
 #include "../include/agent_manager.h"
 #include "../include/config.h"
+#include "../include/job_queue.h"
+#include "../include/logger.h"
+#include "../include/tracer.h"
+#include <memory>
 
 std::atomic<bool> running(true);
+std::atomic<int> shutdownSignal(0);
 
+// Only async-signal-safe work here; the main loop logs the shutdown.
 void signalHandler(int signum) {
-    std::cout << "\nShutdown signal received (" << signum << ")..." << std::endl;
+    shutdownSignal = signum;
     running = false;
 }
 
@@ -19,32 +24,45 @@ int main(int argc, char* argv[]) {
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
 
-    std::cout << "Professor Hawkeinstein's Educational Foundation - Agent Service" << std::endl;
-    std::cout << "================================================================" << std::endl;
+    LOG_INFO << "Professor Hawkeinstein's Educational Foundation - Agent Service";
+    LOG_INFO << "================================================================";
     
     // Load configuration - try Docker path first, then local path
     Config config;
     if (!config.load("/app/config.json")) {
         if (!config.load("/home/steve/Professor_Hawkeinstein/app/cpp_agent/config.json")) {
-            std::cerr << "Warning: Could not load config, using defaults" << std::endl;
+            LOG_WARN << "Warning: Could not load config, using defaults";
         }
     }
     
-    std::cout << "llama-server URL: http://localhost:8090" << std::endl;
-    std::cout << "Model: " << config.modelName << std::endl;
-    std::cout << "Database: " << config.dbName << std::endl;
-    std::cout << "Listening on port: " << config.serverPort << std::endl;
+    LOG_INFO << "llama-server URL: http://localhost:8090";
+    LOG_INFO << "Model: " << config.modelName;
+    LOG_INFO << "Database: " << config.dbName;
+    LOG_INFO << "Listening on port: " << config.serverPort;
+    
+    Tracer::instance().configure(config.tracingEnabled, static_cast<std::size_t>(config.tracingSpansPerThread));
+    Logger::instance().start(config.logging);
     
     try {
         // Initialize agent manager
         AgentManager agentManager(config);
         
+        // Background generation jobs get their own database connection
+        std::unique_ptr<JobQueue> jobQueue;
+        if (config.jobsEnabled) {
+            try {
+                jobQueue = std::make_unique<JobQueue>(config, agentManager);
+            } catch (const std::exception& e) {
+                LOG_ERROR << "Job queue disabled: " << e.what();
+            }
+        }
+        
         // Start HTTP server
-        HTTPServer server(config.serverPort, agentManager, config);
+        HTTPServer server(config.serverPort, agentManager, config, jobQueue.get());
         server.start();
         
-        std::cout << "Agent service started successfully!" << std::endl;
-        std::cout << "Press Ctrl+C to stop..." << std::endl;
+        LOG_INFO << "Agent service started successfully!";
+        LOG_INFO << "Press Ctrl+C to stop...";
         
         // Keep running until signal received
         while (running) {
@@ -52,14 +70,25 @@ int main(int argc, char* argv[]) {
         }
         
         // Graceful shutdown
-        std::cout << "Stopping server..." << std::endl;
+        LOG_INFO << "Shutdown signal received (" << shutdownSignal.load() << ")...";
+        LOG_INFO << "Stopping server...";
         server.stop();
         
+        if (!config.tracingExportPath.empty()) {
+            if (Tracer::instance().writeChromeTrace(config.tracingExportPath)) {
+                LOG_INFO << "Trace written to " << config.tracingExportPath;
+            } else {
+                LOG_ERROR << "Failed to write trace to " << config.tracingExportPath;
+            }
+        }
+        
     } catch (const std::exception& e) {
-        std::cerr << "Fatal error: " << e.what() << std::endl;
+        LOG_ERROR << "Fatal error: " << e.what();
+        Logger::instance().stop();
         return 1;
     }
     
-    std::cout << "Agent service stopped." << std::endl;
+    LOG_INFO << "Agent service stopped.";
+    Logger::instance().stop();
     return 0;
 }
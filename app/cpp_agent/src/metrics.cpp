@@ -0,0 +1,199 @@
+#include "../include/metrics.h"
+#include <algorithm>
+#include <sstream>
+
+std::size_t Counter::shardIndex() {
+    static std::atomic<std::size_t> next{0};
+    thread_local const std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return index;
+}
+
+std::uint64_t Counter::value() const {
+    std::uint64_t total = 0;
+    for (const Shard& shard : shards_) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)), counts_(new std::atomic<std::uint64_t>[kBuckets]) {
+    std::sort(bounds_.begin(), bounds_.end());
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        counts_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+std::size_t Histogram::bucketFor(std::uint64_t micros) {
+    constexpr std::uint64_t linear = 1ULL << kSubBucketBits;
+    if (micros < linear) {
+        return static_cast<std::size_t>(micros);
+    }
+    micros = std::min<std::uint64_t>(micros, (1ULL << (kMaxOctave + 1)) - 1);
+    const int octave = 63 - __builtin_clzll(micros);
+    const std::uint64_t sub = (micros >> (octave - kSubBucketBits)) & (linear - 1);
+    return (static_cast<std::size_t>(octave - kSubBucketBits + 1) << kSubBucketBits) + sub;
+}
+
+std::uint64_t Histogram::bucketUpper(std::size_t index) {
+    constexpr std::size_t linear = 1u << kSubBucketBits;
+    if (index < linear) {
+        return index + 1;
+    }
+    const int shift = static_cast<int>(index >> kSubBucketBits) - 1;
+    const std::uint64_t sub = index & (linear - 1);
+    return ((linear + sub) << shift) + (1ULL << shift);
+}
+
+void Histogram::observeMicros(std::int64_t micros) {
+    const std::uint64_t value = micros > 0 ? static_cast<std::uint64_t>(micros) : 0;
+    counts_[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+    sumMicros_.inc(value);
+}
+
+std::uint64_t Histogram::countAtOrBelow(double seconds) const {
+    const std::uint64_t limit = static_cast<std::uint64_t>(std::max(0.0, seconds) * 1e6) + 1;
+    std::uint64_t total = 0;
+    std::uint64_t lower = 0;
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        const std::uint64_t upper = bucketUpper(i);
+        const std::uint64_t n = counts_[i].load(std::memory_order_relaxed);
+        if (upper > limit) {
+            // Split the bucket straddling the bound as if uniformly filled
+            total += n * (limit - lower) / (upper - lower);
+            break;
+        }
+        total += n;
+        lower = upper;
+    }
+    return total;
+}
+
+std::uint64_t Histogram::count() const {
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        total += counts_[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+double Histogram::quantile(double q) const {
+    const std::uint64_t total = count();
+    if (total == 0) {
+        return 0.0;
+    }
+    const std::uint64_t rank = static_cast<std::uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(total - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        seen += counts_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            const std::uint64_t lower = i == 0 ? 0 : bucketUpper(i - 1);
+            return static_cast<double>(lower + bucketUpper(i)) / 2e6;
+        }
+    }
+    return static_cast<double>(bucketUpper(kBuckets - 1)) / 1e6;
+}
+
+const std::vector<double>& Histogram::latencyBounds() {
+    static const std::vector<double> bounds = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5,
+                                               1.0,   2.5,    5.0,   10.0, 30.0,  60.0, 120.0, 300.0};
+    return bounds;
+}
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Counter& Metrics::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Family& family = families_[name];
+    if (family.type.empty()) {
+        family.type = "counter";
+        family.help = help;
+    }
+    auto& slot = family.counters[labels];
+    if (!slot) {
+        slot = std::make_unique<Counter>();
+    }
+    return *slot;
+}
+
+Gauge& Metrics::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Family& family = families_[name];
+    if (family.type.empty()) {
+        family.type = "gauge";
+        family.help = help;
+    }
+    auto& slot = family.gauges[labels];
+    if (!slot) {
+        slot = std::make_unique<Gauge>();
+    }
+    return *slot;
+}
+
+Histogram& Metrics::histogram(const std::string& name, const std::string& help, const std::string& labels,
+                              const std::vector<double>& bounds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Family& family = families_[name];
+    if (family.type.empty()) {
+        family.type = "histogram";
+        family.help = help;
+    }
+    auto& slot = family.histograms[labels];
+    if (!slot) {
+        slot = std::make_unique<Histogram>(bounds);
+    }
+    return *slot;
+}
+
+std::string Metrics::renderPrometheus() const {
+    std::ostringstream out;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto writeSample = [&](const std::string& name, const std::string& labels, auto value) {
+        out << name;
+        if (!labels.empty()) {
+            out << "{" << labels << "}";
+        }
+        out << " " << value << "\n";
+    };
+
+    for (const auto& [name, family] : families_) {
+        out << "# HELP " << name << " " << family.help << "\n";
+        out << "# TYPE " << name << " " << family.type << "\n";
+        for (const auto& [labels, counter] : family.counters) {
+            writeSample(name, labels, counter->value());
+        }
+        for (const auto& [labels, gauge] : family.gauges) {
+            writeSample(name, labels, gauge->value());
+        }
+        for (const auto& [labels, histogram] : family.histograms) {
+            const std::string prefix = labels.empty() ? "" : labels + ",";
+            for (double bound : histogram->bounds()) {
+                std::ostringstream le;
+                le << bound;
+                writeSample(name + "_bucket", prefix + metricLabel("le", le.str()), histogram->countAtOrBelow(bound));
+            }
+            writeSample(name + "_bucket", prefix + metricLabel("le", "+Inf"), histogram->count());
+            writeSample(name + "_sum", labels, histogram->sum());
+            writeSample(name + "_count", labels, histogram->count());
+        }
+    }
+    return out.str();
+}
+
+std::string metricLabel(const std::string& name, const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+            case '\\': escaped += "\\\\"; break;
+            case '"': escaped += "\\\""; break;
+            case '\n': escaped += "\\n"; break;
+            default: escaped += c; break;
+        }
+    }
+    return name + "=\"" + escaped + "\"";
+}
@@ -0,0 +1,159 @@
+#include "../include/model_router.h"
+#include "../include/llamacpp_client.h"
+#include "../include/logger.h"
+#include "../include/metrics.h"
+#include <limits>
+
+namespace {
+// Over-budget models still get every Nth request of their class so their
+// latency estimate can recover once they are fast again.
+constexpr std::uint64_t kProbeEvery = 20;
+constexpr std::size_t kMinLatencySamples = 10;
+
+bool parseClass(const std::string& name, RequestClass& out) {
+    if (name == "short") out = RequestClass::Short;
+    else if (name == "chat") out = RequestClass::Chat;
+    else if (name == "generation") out = RequestClass::Generation;
+    else return false;
+    return true;
+}
+}
+
+ModelRouter::ModelRouter(const std::map<std::string, std::shared_ptr<LlamaCppClient>>& clients, const Config& config)
+    : shortMaxChars_(config.routingShortMaxChars), generationMinTokens_(config.routingGenerationMinTokens) {
+    Metrics& metrics = Metrics::instance();
+    for (const auto& [name, client] : clients) {
+        auto backend = std::make_unique<Backend>();
+        backend->name = name;
+        backend->client = client.get();
+        for (RequestClass cls : {RequestClass::Short, RequestClass::Chat, RequestClass::Generation}) {
+            backend->requests[static_cast<int>(cls)] = &metrics.counter(
+                "model_route_requests_total", "Requests routed to a model, by request class",
+                metricLabel("model", name) + "," + metricLabel("class", className(cls)));
+        }
+        backends_[name] = std::move(backend);
+    }
+
+    for (const auto& [alias, target] : config.modelAliases) {
+        auto it = backends_.find(target);
+        if (it == backends_.end()) {
+            LOG_WARN << "[ModelRouter] Alias '" << alias << "' points at unknown model '" << target << "'";
+            continue;
+        }
+        aliases_[alias] = it->second.get();
+    }
+
+    default_ = lookup(config.defaultModel);
+    if (!default_ && !backends_.empty()) {
+        default_ = backends_.begin()->second.get();
+        LOG_WARN << "[ModelRouter] Default model '" << config.defaultModel << "' is not configured, using '"
+                 << default_->name << "'";
+    }
+
+    for (const auto& ruleConfig : config.routingRules) {
+        RequestClass cls;
+        if (!parseClass(ruleConfig.requestClass, cls)) {
+            LOG_WARN << "[ModelRouter] Ignoring rule for unknown request class '" << ruleConfig.requestClass << "'";
+            continue;
+        }
+        auto rule = std::make_unique<Rule>();
+        rule->maxLatencyMs = ruleConfig.maxLatencyMs;
+        for (const auto& model : ruleConfig.models) {
+            if (Backend* backend = lookup(model)) {
+                rule->candidates.push_back(backend);
+            } else {
+                LOG_WARN << "[ModelRouter] Rule for '" << ruleConfig.requestClass << "' names unknown model '"
+                         << model << "'";
+            }
+        }
+        if (!rule->candidates.empty()) {
+            LOG_INFO << "[ModelRouter] " << ruleConfig.requestClass << " requests -> " << rule->candidates.front()->name
+                     << (rule->candidates.size() > 1 ? " (+fallbacks)" : "");
+            rules_[static_cast<int>(cls)] = std::move(rule);
+        }
+    }
+}
+
+const char* ModelRouter::className(RequestClass requestClass) {
+    switch (requestClass) {
+        case RequestClass::Short: return "short";
+        case RequestClass::Chat: return "chat";
+        case RequestClass::Generation: return "generation";
+    }
+    return "chat";
+}
+
+ModelRouter::Backend* ModelRouter::lookup(const std::string& name) const {
+    auto it = backends_.find(name);
+    if (it != backends_.end()) {
+        return it->second.get();
+    }
+    auto alias = aliases_.find(name);
+    return alias != aliases_.end() ? alias->second : nullptr;
+}
+
+ModelRouter::Backend* ModelRouter::resolve(const std::string& modelName) const {
+    if (Backend* backend = lookup(modelName)) {
+        return backend;
+    }
+    if (default_) {
+        LOG_WARN << "[ModelRouter] Model '" << modelName << "' is not configured or aliased, using default '"
+                 << default_->name << "'";
+    }
+    return default_;
+}
+
+RequestClass ModelRouter::classify(const std::string& message, int maxTokens, const std::string& hint) const {
+    RequestClass cls;
+    if (!hint.empty() && parseClass(hint, cls)) {
+        return cls;
+    }
+    if (maxTokens >= generationMinTokens_) {
+        return RequestClass::Generation;
+    }
+    if (static_cast<int>(message.size()) <= shortMaxChars_) {
+        return RequestClass::Short;
+    }
+    return RequestClass::Chat;
+}
+
+ModelRouter::Backend* ModelRouter::route(Backend* pinned, RequestClass requestClass) {
+    const int index = static_cast<int>(requestClass);
+    Rule* rule = rules_[index].get();
+    Backend* chosen = pinned;
+
+    if (rule) {
+        chosen = rule->candidates.front();
+        if (rule->maxLatencyMs > 0) {
+            const std::uint64_t n = rule->routed.fetch_add(1, std::memory_order_relaxed);
+            const std::int64_t budget = static_cast<std::int64_t>(rule->maxLatencyMs) * 1000;
+            Backend* fastest = nullptr;
+            std::int64_t fastestP95 = std::numeric_limits<std::int64_t>::max();
+            chosen = nullptr;
+            for (std::size_t i = 0; i < rule->candidates.size() && !chosen; ++i) {
+                Backend* candidate = rule->candidates[i];
+                const std::int64_t p95 = candidate->latency[index].percentileMicros(0.95, kMinLatencySamples);
+                if (p95 < 0 || p95 <= budget || (i == 0 && n % kProbeEvery == 0)) {
+                    chosen = candidate;
+                } else if (p95 < fastestP95) {
+                    fastest = candidate;
+                    fastestP95 = p95;
+                }
+            }
+            if (!chosen) {
+                chosen = fastest;
+            }
+        }
+    }
+
+    if (chosen) {
+        chosen->requests[index]->inc();
+    }
+    return chosen;
+}
+
+void ModelRouter::record(Backend* backend, RequestClass requestClass, std::chrono::microseconds latency) {
+    if (backend) {
+        backend->latency[static_cast<int>(requestClass)].add(latency);
+    }
+}
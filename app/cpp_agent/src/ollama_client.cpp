@@ -1,5 +1,5 @@
 #include "../include/ollama_client.h"
-#include <iostream>
+#include "../include/logger.h"
 #include <sstream>
 #include <stdexcept>
 
@@ -12,7 +12,7 @@ OllamaClient::OllamaClient(const std::string& baseUrl, const std::string& modelN
         throw std::runtime_error("Failed to initialize CURL");
     }
     
-    std::cout << "Ollama client initialized: " << baseUrl << " with model " << modelName << std::endl;
+    LOG_INFO << "Ollama client initialized: " << baseUrl << " with model " << modelName;
 }
 
 OllamaClient::~OllamaClient() {
@@ -36,8 +36,8 @@ std::string OllamaClient::makeRequest(const std::string& endpoint, const Json::V
     Json::StreamWriterBuilder writer;
     std::string jsonPayload = Json::writeString(writer, payload);
     
-    std::cout << "[CURL] URL: " << url << std::endl;
-    std::cout << "[CURL] Payload: " << jsonPayload.substr(0, 100) << "..." << std::endl;
+    LOG_DEBUG << "[CURL] URL: " << url;
+    LOG_DEBUG << "[CURL] Payload: " << jsonPayload.substr(0, 100) << "...";
     
     // Set CURL options
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
@@ -53,13 +53,13 @@ std::string OllamaClient::makeRequest(const std::string& endpoint, const Json::V
     headers = curl_slist_append(headers, "Content-Type: application/json");
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     
-    std::cout << "[CURL] Starting request..." << std::endl;
+    LOG_DEBUG << "[CURL] Starting request...";
     
     // Perform request
     CURLcode res = curl_easy_perform(curl);
     curl_slist_free_all(headers);
     
-    std::cout << "[CURL] Request completed with code: " << res << std::endl;
+    LOG_DEBUG << "[CURL] Request completed with code: " << res;
     
     if (res != CURLE_OK) {
         throw std::runtime_error("CURL request failed: " + std::string(curl_easy_strerror(res)));
@@ -69,7 +69,7 @@ std::string OllamaClient::makeRequest(const std::string& endpoint, const Json::V
 }
 
 std::string OllamaClient::generate(const std::string& prompt, float temperature, int maxTokens) {
-    std::cout << "[Ollama] Generating response for prompt length: " << prompt.length() << std::endl;
+    LOG_INFO << "[Ollama] Generating response for prompt length: " << prompt.length();
     
     Json::Value payload;
     payload["model"] = modelName;
@@ -79,27 +79,27 @@ std::string OllamaClient::generate(const std::string& prompt, float temperature,
     payload["options"]["num_predict"] = maxTokens;
     
     try {
-        std::cout << "[Ollama] Sending request to: " << baseUrl << "/api/generate" << std::endl;
+        LOG_DEBUG << "[Ollama] Sending request to: " << baseUrl << "/api/generate";
         std::string response = makeRequest("/api/generate", payload);
-        std::cout << "[Ollama] Received response, parsing JSON..." << std::endl;
+        LOG_DEBUG << "[Ollama] Received response, parsing JSON...";
         // Parse response
         Json::Value responseJson;
         Json::CharReaderBuilder builder;
         std::stringstream ss(response);
         std::string errs;
         
-        std::cout << "[Ollama] Response length: " << response.length() << " bytes" << std::endl;
+        LOG_INFO << "[Ollama] Response length: " << response.length() << " bytes";
         
         if (!Json::parseFromStream(builder, ss, &responseJson, &errs)) {
-            std::cerr << "[Ollama] JSON parse error: " << errs << std::endl;
+            LOG_ERROR << "[Ollama] JSON parse error: " << errs;
             throw std::runtime_error("Failed to parse Ollama response: " + errs);
         }
         
-        std::cout << "[Ollama] JSON parsed successfully" << std::endl;
+        LOG_DEBUG << "[Ollama] JSON parsed successfully";
         
         if (responseJson.isMember("response")) {
             std::string result = responseJson["response"].asString();
-            std::cout << "[Ollama] Response obtained, length: " << result.length() << std::endl;
+            LOG_INFO << "[Ollama] Response obtained, length: " << result.length();
             return result;
         } else if (responseJson.isMember("error")) {
             throw std::runtime_error("Ollama error: " + responseJson["error"].asString());
@@ -108,7 +108,7 @@ std::string OllamaClient::generate(const std::string& prompt, float temperature,
         }
         
     } catch (const std::exception& e) {
-        std::cerr << "Error generating response: " << e.what() << std::endl;
+        LOG_ERROR << "Error generating response: " << e.what();
         throw;
     }
 }
@@ -142,7 +142,7 @@ std::vector<float> OllamaClient::getEmbedding(const std::string& text) {
         return embedding;
         
     } catch (const std::exception& e) {
-        std::cerr << "Error getting embedding: " << e.what() << std::endl;
+        LOG_ERROR << "Error getting embedding: " << e.what();
         throw;
     }
 }
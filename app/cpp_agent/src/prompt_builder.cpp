@@ -0,0 +1,156 @@
+#include "../include/prompt_builder.h"
+#include "../include/token_counter.h"
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+namespace {
+// Slack for BOS/template tokens and merges across the pieces we count separately.
+constexpr int kSafetyMarginTokens = 32;
+// Below this a truncated chunk carries too little to be worth including.
+constexpr int kMinTruncatedTokens = 48;
+const char* const kKnowledgeHeader = "Relevant knowledge:\n";
+
+std::string metaLine(const RetrievedChunk& chunk, bool withSimilarity) {
+    const std::string gradeLabel = chunk.gradeLevel.empty() ? "any" : chunk.gradeLevel;
+    const std::string subjectLabel = chunk.subject.empty() ? "any" : chunk.subject;
+
+    std::ostringstream line;
+    line << "[grade=" << gradeLabel
+         << " subject=" << subjectLabel
+         << " similarity=" << std::fixed << std::setprecision(2) << (withSimilarity ? chunk.similarity : 0.0f) << "]";
+    return line.str();
+}
+
+// Cuts `text` to at most `maxChars` at the last sentence end, or failing that
+// the last whitespace, so a chunk is never split inside a word.
+std::string cutAtBoundary(const std::string& text, std::size_t maxChars) {
+    if (text.size() <= maxChars) {
+        return text;
+    }
+    const std::string head = text.substr(0, maxChars);
+    std::size_t sentenceEnd = head.find_last_of(".!?\n");
+    if (sentenceEnd != std::string::npos && sentenceEnd >= maxChars / 2) {
+        return head.substr(0, sentenceEnd + 1);
+    }
+    std::size_t space = head.find_last_of(" \t");
+    if (space == std::string::npos || space == 0) {
+        return "";
+    }
+    return head.substr(0, space);
+}
+}
+
+PromptBuilder::PromptBuilder(TokenCounter& counter, int contextTokens)
+    : counter_(counter), contextTokens_(contextTokens) {
+}
+
+int PromptBuilder::chunkTokens(const RetrievedChunk& chunk) const {
+    // Counts stored at ingestion are only valid for the tokenizer they were
+    // taken with; chunks routed to another model are counted here
+    if (chunk.tokenCount >= 0 && chunk.tokenizer == counter_.model()) {
+        return chunk.tokenCount;
+    }
+    return counter_.count(chunk.text);
+}
+
+std::string PromptBuilder::truncateToTokens(const std::string& text, int tokens) const {
+    const int total = std::max(1, counter_.count(text));
+    double charsPerToken = static_cast<double>(text.size()) / total;
+    std::size_t targetChars = static_cast<std::size_t>(tokens * charsPerToken * 0.95);
+
+    for (int attempt = 0; attempt < 4 && targetChars > 0; ++attempt) {
+        std::string cut = cutAtBoundary(text, targetChars);
+        if (cut.empty()) {
+            return "";
+        }
+        int cutTokens = counter_.count(cut);
+        if (cutTokens <= tokens) {
+            return cut;
+        }
+        targetChars = static_cast<std::size_t>(cut.size() * (static_cast<double>(tokens) / cutTokens) * 0.95);
+    }
+    return "";
+}
+
+std::string PromptBuilder::build(const Agent& agent,
+                                 const std::string& userMessage,
+                                 const std::vector<RetrievedChunk>& chunks,
+                                 int maxTokens,
+                                 PromptBudget* budget) const {
+    PromptBudget local;
+    PromptBudget& b = budget ? *budget : local;
+    b = PromptBudget{};
+
+    const std::string head = agent.systemPrompt + "\n\n";
+    const std::string tail = "Student: " + userMessage + "\nProfessor Hawkeinstein: ";
+
+    b.contextTokens = contextTokens_;
+    b.reservedTokens = std::max(0, maxTokens);
+    b.fixedTokens = counter_.count(head) + counter_.count(tail) + counter_.count(kKnowledgeHeader) + 1;
+    b.budgetTokens = std::max(0, b.contextTokens - b.reservedTokens - b.fixedTokens - kSafetyMarginTokens);
+    b.chunksOffered = static_cast<int>(chunks.size());
+
+    // Highest similarity first; a chunk that does not fit is skipped so a
+    // smaller, lower-scored one can still use the remaining space.
+    std::vector<std::size_t> order(chunks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t c) {
+        return chunks[a].similarity > chunks[c].similarity;
+    });
+
+    std::vector<std::pair<std::size_t, std::string>> selected;
+    int remaining = b.budgetTokens;
+    std::size_t bestSkipped = chunks.size();
+
+    for (std::size_t idx : order) {
+        const RetrievedChunk& chunk = chunks[idx];
+        if (chunk.text.empty()) {
+            continue;
+        }
+        const int cost = counter_.count(metaLine(chunk, false) + "\n") + chunkTokens(chunk) + 1;
+        if (cost <= remaining) {
+            selected.emplace_back(idx, chunk.text);
+            remaining -= cost;
+        } else if (bestSkipped == chunks.size()) {
+            bestSkipped = idx;
+        }
+    }
+
+    // Fill what is left with the best chunk that did not fit whole, cut at a
+    // sentence or word boundary.
+    if (bestSkipped < chunks.size()) {
+        const RetrievedChunk& best = chunks[bestSkipped];
+        const int metaTokens = counter_.count(metaLine(best, false) + "\n") + 1;
+        const int available = remaining - metaTokens;
+        if (available >= kMinTruncatedTokens) {
+            std::string cut = truncateToTokens(best.text, available);
+            if (!cut.empty()) {
+                remaining -= metaTokens + counter_.count(cut);
+                selected.emplace_back(bestSkipped, std::move(cut));
+                b.truncated = true;
+            }
+        }
+    }
+
+    std::stable_sort(selected.begin(), selected.end(), [&](const auto& a, const auto& c) {
+        return chunks[a.first].similarity > chunks[c.first].similarity;
+    });
+
+    b.usedTokens = b.budgetTokens - remaining;
+    b.chunksInjected = static_cast<int>(selected.size());
+
+    std::ostringstream prompt;
+    prompt << head;
+    if (!selected.empty()) {
+        prompt << kKnowledgeHeader;
+        for (const auto& [idx, text] : selected) {
+            prompt << metaLine(chunks[idx], true) << "\n";
+            prompt << text << "\n";
+        }
+        prompt << "\n";
+    }
+    prompt << tail;
+    return prompt.str();
+}
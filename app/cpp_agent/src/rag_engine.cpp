@@ -1,29 +1,39 @@
 #include "../include/rag_engine.h"
+#include "../include/content_top_k.h"
 #include "../include/database.h"
 #include "../include/llamacpp_client.h"
 #include "../include/embedding_generator.h"
-#include <iostream>
+#include "../include/logger.h"
+#include "../include/metrics.h"
+#include "../include/tracer.h"
 #include <sstream>
 #include <unordered_map>
 #include <limits>
 #include <algorithm>
-#include <iomanip>
+#include <cmath>
 
 namespace {
 constexpr int kDefaultTopK = 5;
 constexpr float kDefaultSimilarityThreshold = 0.25f;
+// Over-fetch: rows per requested document, adapted from recent searches
+constexpr double kInitialOverfetch = 3.0;
+constexpr double kMaxOverfetch = 16.0;
+constexpr double kOverfetchHeadroom = 1.25;  // fetch a little more than the last searches needed
+constexpr double kOverfetchSmoothing = 0.2;  // weight of the newest search
+constexpr int kMaxCandidateRows = 256;
 }
 
-RAGEngine::RAGEngine(Database* db, LlamaCppClient* llamaClient) 
+RAGEngine::RAGEngine(Database* db, LlamaCppClient* llamaClient, EmbeddingCache* embeddingCache) 
     : database(db),
       llamaClient_(llamaClient),
       defaultTopK_(kDefaultTopK),
       similarityThreshold_(kDefaultSimilarityThreshold),
-      metric_("cosine") {
+      metric_("cosine"),
+      overfetch_(kInitialOverfetch) {
     if (llamaClient_) {
-        embeddingGenerator_ = std::make_unique<EmbeddingGenerator>(llamaClient_, 384);
+        embeddingGenerator_ = std::make_unique<EmbeddingGenerator>(llamaClient_, 384, embeddingCache);
     }
-    std::cout << "RAG Engine initialized" << std::endl;
+    LOG_INFO << "RAG Engine initialized";
 }
 
 RAGEngine::~RAGEngine() {
@@ -33,23 +43,32 @@ std::vector<RetrievedChunk> RAGEngine::search(const RAGSearchContext& context, c
     std::vector<RetrievedChunk> filtered;
 
     if (!database) {
-        std::cerr << "[RAGEngine] Database unavailable for search" << std::endl;
+        LOG_ERROR << "[RAGEngine] Database unavailable for search";
         return filtered;
     }
 
     if (!embeddingGenerator_) {
-        std::cerr << "[RAGEngine] Embedding generator unavailable" << std::endl;
+        LOG_ERROR << "[RAGEngine] Embedding generator unavailable";
         return filtered;
     }
 
     if (query.empty()) {
-        std::cerr << "[RAGEngine] Empty query provided" << std::endl;
+        LOG_WARN << "[RAGEngine] Empty query provided";
         return filtered;
     }
 
-    auto embedding = embeddingGenerator_->generate(query);
+    std::vector<float> embedding;
+    {
+        TraceSpan span("embed");
+        embedding = embeddingGenerator_->generate(query, context.deadline);
+    }
     if (embedding.empty()) {
-        std::cerr << "[RAGEngine] Failed to generate query embedding" << std::endl;
+        LOG_ERROR << "[RAGEngine] Failed to generate query embedding";
+        return filtered;
+    }
+
+    if (context.deadline.expired()) {
+        LOG_WARN << "[RAGEngine] Retrieval budget spent on the query embedding, skipping vector search";
         return filtered;
     }
 
@@ -62,25 +81,22 @@ std::vector<RetrievedChunk> RAGEngine::search(const RAGSearchContext& context, c
     filters.gradeLevel = context.gradeLevel;
     filters.subject = context.subject;
 
-    {
-        std::ostringstream filterLog;
-        filterLog << "[RAGEngine] RAGSearch filters agent=" << context.agentId
-                  << " scope=" << (filters.agentScope.empty() ? "any" : filters.agentScope)
-                  << " grade=" << (filters.gradeLevel.empty() ? "any" : filters.gradeLevel)
-                  << " subject=" << (filters.subject.empty() ? "any" : filters.subject)
-                  << " metric=" << effectiveMetric
-                  << " topK=" << effectiveTopK
-                  << " threshold=" << std::fixed << std::setprecision(2) << minSimilarityThreshold;
-        std::cout << filterLog.str() << std::endl;
-    }
-
-    auto candidates = database->vectorSearch(embedding, effectiveTopK, effectiveMetric, &filters);
-
-    std::unordered_map<int, RetrievedChunk> bestByContent;
-    size_t droppedThreshold = 0;
-    size_t droppedDuplicates = 0;
-    float minSimilarity = std::numeric_limits<float>::max();
-    float maxSimilarity = 0.0f;
+    LOG_DEBUG << "[RAGEngine] RAGSearch filters agent=" << context.agentId
+              << " scope=" << (filters.agentScope.empty() ? "any" : filters.agentScope)
+              << " grade=" << (filters.gradeLevel.empty() ? "any" : filters.gradeLevel)
+              << " subject=" << (filters.subject.empty() ? "any" : filters.subject)
+              << " metric=" << effectiveMetric
+              << " topK=" << effectiveTopK
+              << " threshold=" << logFixed(2) << minSimilarityThreshold;
+
+    static Histogram& searchLatency = Metrics::instance().histogram(
+        "rag_vector_search_duration_seconds", "Latency of the vector search query");
+    static Counter& candidatesTotal = Metrics::instance().counter(
+        "rag_vector_candidates_total", "Rows returned by vector search before threshold and dedup");
+    static Counter& refetchesTotal = Metrics::instance().counter(
+        "rag_vector_refetches_total", "Vector searches repeated with a larger limit to reach topK documents");
+    static Gauge& overfetchGauge = Metrics::instance().gauge(
+        "rag_vector_overfetch_percent", "Chunk rows fetched per requested document, in percent");
 
     auto toRetrieved = [](const VectorSearchResult& row) {
         RetrievedChunk chunk;
@@ -91,88 +107,141 @@ std::vector<RetrievedChunk> RAGEngine::search(const RAGSearchContext& context, c
         chunk.gradeLevel = row.gradeLevel;
         chunk.subject = row.subject;
         chunk.agentScope = row.agentScope;
+        chunk.tokenCount = row.tokenCount;
+        chunk.tokenizer = row.tokenizer;
         return chunk;
     };
 
-    for (const auto& candidate : candidates) {
-        if (candidate.similarity < minSimilarityThreshold) {
-            ++droppedThreshold;
-            std::ostringstream dropLog;
-            dropLog << "[RAGEngine] drop chunk content_id=" << candidate.contentId
-                    << " sim=" << std::fixed << std::setprecision(2) << candidate.similarity
-                    << " reason=below_threshold";
-            std::cout << dropLog.str() << std::endl;
-            continue;
+    // Rows come back by chunk, so several can belong to one document. Fetch
+    // topK times the learned over-fetch factor, group by content_id and, if
+    // that still yields fewer than topK documents while more rows exist,
+    // search again with twice the limit.
+    const int maxRows = std::max(effectiveTopK, kMaxCandidateRows);
+    int limit = std::min(maxRows, static_cast<int>(std::ceil(effectiveTopK * overfetch_.load())));
+    ContentTopK top(static_cast<std::size_t>(effectiveTopK),
+                    static_cast<std::size_t>(std::max(1, context.chunksPerContent)));
+    std::size_t fetched = 0;
+    size_t droppedThreshold = 0;
+    int refetches = 0;
+    while (true) {
+        std::vector<VectorSearchResult> candidates;
+        {
+            TraceSpan span("vector_search");
+            LatencyObserver latency(&searchLatency);
+            candidates = database->vectorSearch(embedding, limit, effectiveMetric, &filters);
+            candidatesTotal.inc(candidates.size());
+        }
+        fetched = candidates.size();
+
+        // Similarity falls monotonically down the rows, so the first one
+        // under the threshold ends the useful part of the result
+        bool belowThreshold = false;
+        droppedThreshold = 0;
+        for (const auto& candidate : candidates) {
+            if (candidate.similarity < minSimilarityThreshold) {
+                belowThreshold = true;
+                droppedThreshold = static_cast<size_t>(&candidates.back() - &candidate) + 1;
+                LOG_DEBUG_SAMPLED(20) << "[RAGEngine] drop " << droppedThreshold << " chunk(s) from content_id="
+                                      << candidate.contentId << " sim=" << logFixed(2) << candidate.similarity
+                                      << " reason=below_threshold";
+                break;
+            }
+            top.offer(toRetrieved(candidate));
         }
 
-        auto converted = toRetrieved(candidate);
-        auto it = bestByContent.find(candidate.contentId);
-        if (it == bestByContent.end()) {
-            bestByContent[candidate.contentId] = converted;
-        } else if (candidate.similarity > it->second.similarity) {
-            ++droppedDuplicates;
-            std::ostringstream dedupeLog;
-            dedupeLog << "[RAGEngine] dedupe replaced content_id=" << candidate.contentId
-                      << " old_sim=" << std::fixed << std::setprecision(2) << it->second.similarity
-                      << " new_sim=" << std::fixed << std::setprecision(2) << candidate.similarity;
-            std::cout << dedupeLog.str() << std::endl;
-            it->second = converted;
-        } else {
-            ++droppedDuplicates;
-            std::ostringstream dedupeLog;
-            dedupeLog << "[RAGEngine] dedupe dropped content_id=" << candidate.contentId
-                      << " sim=" << std::fixed << std::setprecision(2) << candidate.similarity;
-            std::cout << dedupeLog.str() << std::endl;
+        const bool exhausted = belowThreshold || static_cast<int>(candidates.size()) < limit;
+        if (top.full() || exhausted || limit >= maxRows || context.deadline.expired()) {
+            break;
         }
+        ++refetches;
+        refetchesTotal.inc();
+        limit = std::min(maxRows, limit * 2);
+        top.take();
     }
 
-    filtered.reserve(bestByContent.size());
-    for (const auto& entry : bestByContent) {
-        filtered.push_back(entry.second);
-        minSimilarity = std::min(minSimilarity, entry.second.similarity);
-        maxSimilarity = std::max(maxSimilarity, entry.second.similarity);
+    // Learn from searches that did find topK documents; a corpus (or filter)
+    // with fewer matches says nothing about duplicate rates
+    if (top.full()) {
+        const double needed = static_cast<double>(top.rowsToFill()) / effectiveTopK;
+        const double factor = std::min(kMaxOverfetch, std::max(1.0, needed * kOverfetchHeadroom));
+        overfetch_.store(overfetch_.load() * (1.0 - kOverfetchSmoothing) + factor * kOverfetchSmoothing);
+        overfetchGauge.set(static_cast<std::int64_t>(overfetch_.load() * 100.0));
     }
 
-    std::sort(filtered.begin(), filtered.end(), [](const RetrievedChunk& a, const RetrievedChunk& b) {
-        return a.similarity > b.similarity;
-    });
-
-    if (filtered.empty()) {
-        minSimilarity = 0.0f;
-        maxSimilarity = 0.0f;
+    const std::size_t documents = top.documents();
+    const size_t droppedDuplicates = top.duplicates();
+    filtered = top.take();
+    float minSimilarity = 0.0f;
+    float maxSimilarity = 0.0f;
+    if (!filtered.empty()) {
+        auto bounds = std::minmax_element(filtered.begin(), filtered.end(),
+                                          [](const RetrievedChunk& a, const RetrievedChunk& b) {
+                                              return a.similarity < b.similarity;
+                                          });
+        minSimilarity = bounds.first->similarity;
+        maxSimilarity = bounds.second->similarity;
     }
 
-    std::ostringstream log;
-    log << "[RAGEngine] RAGSearch metric=" << effectiveMetric
-        << " topK_req=" << effectiveTopK
-        << " candidates=" << candidates.size()
-        << " kept=" << filtered.size()
-        << " dropped_threshold=" << droppedThreshold
-        << " dropped_dedupe=" << droppedDuplicates
-        << " min_sim=" << std::fixed << std::setprecision(2) << minSimilarity
-        << " max_sim=" << std::fixed << std::setprecision(2) << maxSimilarity;
-    std::cout << log.str() << std::endl;
+    LOG_INFO << "[RAGEngine] RAGSearch metric=" << effectiveMetric
+             << " topK_req=" << effectiveTopK
+             << " candidates=" << fetched
+             << " refetches=" << refetches
+             << " documents=" << documents
+             << " kept=" << filtered.size()
+             << " dropped_threshold=" << droppedThreshold
+             << " dropped_dedupe=" << droppedDuplicates
+             << " overfetch=" << logFixed(2) << overfetch_.load()
+             << " min_sim=" << minSimilarity
+             << " max_sim=" << maxSimilarity;
 
     return filtered;
 }
 
+IngestionPipeline* RAGEngine::ingestion() {
+    if (!database || !llamaClient_) {
+        LOG_ERROR << "[RAGEngine] Indexing needs a database and an embedding client";
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(ingestionMutex_);
+    if (!ingestion_) {
+        ingestion_ = std::make_unique<IngestionPipeline>(*database, *llamaClient_, ingestionConfig_);
+    }
+    return ingestion_.get();
+}
+
+IngestionStats RAGEngine::indexContent(const std::vector<int>& contentIds, const IngestionOptions& options) {
+    IngestionPipeline* pipeline = ingestion();
+    if (!pipeline) {
+        IngestionStats stats;
+        stats.failed = static_cast<int>(contentIds.size());
+        return stats;
+    }
+    return pipeline->run(contentIds, options);
+}
+
 void RAGEngine::indexDocument(int agentId, int documentId, const std::string& content) {
     try {
-        // Generate embedding for the document
-        // TODO: Implement embeddings with llama.cpp
-        std::vector<float> embedding; // Placeholder
-        
-        if (embedding.empty()) {
-            std::cerr << "Failed to generate document embedding" << std::endl;
+        IngestionPipeline* pipeline = ingestion();
+        if (!pipeline) {
             return;
         }
-        
-        // Store embedding in database
-        database->storeEmbedding(documentId, embedding);
-        
-        std::cout << "Document " << documentId << " indexed successfully" << std::endl;
-        
+
+        // Keep the row's title, grade and subject for the chunk metadata
+        IndexableContent document;
+        if (!database->getContentForIndexing(documentId, document)) {
+            document.contentId = documentId;
+        }
+        document.text = content;
+
+        IngestionOptions options;
+        options.metadata["agent_id"] = std::to_string(agentId);
+        IngestionStats stats = pipeline->run(std::vector<IndexableContent>{document}, options);
+        if (stats.documents == 1) {
+            LOG_INFO << "Document " << documentId << " indexed successfully (" << stats.chunks << " chunks)";
+        } else {
+            LOG_ERROR << "Failed to index document " << documentId;
+        }
     } catch (const std::exception& e) {
-        std::cerr << "Document indexing error: " << e.what() << std::endl;
+        LOG_ERROR << "Document indexing error: " << e.what();
     }
 }
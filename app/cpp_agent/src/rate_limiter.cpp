@@ -0,0 +1,112 @@
+#include "../include/rate_limiter.h"
+#include "../include/metrics.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr std::size_t kProbeWindow = 8;
+// Keeps a real (user, agent) pair from ever encoding to 0, the free marker
+constexpr std::uint64_t kKeyTag = 0x5bd1e9955bd1e995ULL;
+}
+
+RateLimiter::RateLimiter(const RateLimitPolicy& policy)
+    : policy_(policy),
+      shardCount_(static_cast<std::size_t>(std::max(1, policy.shards))),
+      shardSize_(std::max(kProbeWindow, static_cast<std::size_t>(std::max(1, policy.maxTrackedUsers)) / shardCount_)),
+      entries_(new Entry[shardCount_ * shardSize_]),
+      // A zeroed state then reads as "last seen a day ago", i.e. a full bucket.
+      epoch_(std::chrono::steady_clock::now() - std::chrono::hours(24)) {
+    Metrics& metrics = Metrics::instance();
+    allowed_ = &metrics.counter("rate_limit_requests_total", "Chat requests checked against per-user rate limits",
+                                metricLabel("result", "allowed"));
+    limited_ = &metrics.counter("rate_limit_requests_total", "Chat requests checked against per-user rate limits",
+                                metricLabel("result", "limited"));
+    evictions_ = &metrics.counter("rate_limit_evictions_total",
+                                  "Rate limit buckets recycled for a new user because the table was full");
+}
+
+std::uint64_t RateLimiter::nowTicks() const {
+    const auto elapsed = std::chrono::steady_clock::now() - epoch_;
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / 10);
+}
+
+RateLimiter::Entry* RateLimiter::find(std::uint64_t key, std::uint64_t now) {
+    std::uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+    Entry* shard = &entries_[(h % shardCount_) * shardSize_];
+    const std::size_t start = static_cast<std::size_t>(h >> 32) % shardSize_;
+    const std::size_t window = std::min(kProbeWindow, shardSize_);
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        Entry* victim = nullptr;
+        std::uint64_t victimKey = 0;
+        std::uint64_t victimAge = 0;
+        for (std::size_t i = 0; i < window; ++i) {
+            Entry& entry = shard[(start + i) % shardSize_];
+            std::uint64_t current = entry.key.load(std::memory_order_acquire);
+            if (current == 0 && entry.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                return &entry;
+            }
+            if (current == key) {
+                return &entry;
+            }
+            const std::uint64_t stamp = entry.state.load(std::memory_order_relaxed) >> kTokenBits;
+            const std::uint64_t age = now > stamp ? now - stamp : 0;
+            if (!victim || age > victimAge) {
+                victim = &entry;
+                victimKey = current;
+                victimAge = age;
+            }
+        }
+        // A request racing the takeover may still see the previous owner's
+        // tokens once; the reset below then hands the new user a full bucket.
+        if (victim && victim->key.compare_exchange_strong(victimKey, key, std::memory_order_acq_rel)) {
+            victim->state.store(0, std::memory_order_relaxed);
+            evictions_->inc();
+            return victim;
+        }
+    }
+    return nullptr;
+}
+
+bool RateLimiter::tryAcquire(int userId, int agentId, int& retryAfterSeconds) {
+    retryAfterSeconds = 0;
+    const UserQuota& quota = policy_.forAgent(agentId);
+    if (!policy_.enabled || quota.requestsPerMinute <= 0.0 || policy_.exemptUsers.count(userId)) {
+        return true;
+    }
+
+    const std::uint64_t key =
+        ((static_cast<std::uint64_t>(static_cast<std::uint32_t>(userId)) << 32) | static_cast<std::uint32_t>(agentId)) ^
+        kKeyTag;
+    const std::uint64_t now = nowTicks();
+    Entry* entry = find(key, now);
+    if (!entry) {
+        // Heavy contention on one probe window; letting the request through
+        // is better than refusing a user who may be under their limit.
+        allowed_->inc();
+        return true;
+    }
+
+    const double capacity = std::min(std::max(1.0, quota.burst) * 1000.0, static_cast<double>(kTokenMask));
+    const double perTick = quota.requestsPerMinute * 1000.0 / 6000.0;  // millitokens per centisecond
+    std::uint64_t state = entry->state.load(std::memory_order_relaxed);
+    while (true) {
+        const std::uint64_t last = state >> kTokenBits;
+        // Another thread may have stored a slightly later timestamp
+        const std::uint64_t delta = now > last ? now - last : 0;
+        const double tokens = std::min(capacity, static_cast<double>(state & kTokenMask) +
+                                                     static_cast<double>(delta) * perTick);
+        if (tokens < 1000.0) {
+            retryAfterSeconds = std::max(1, static_cast<int>(std::ceil((1000.0 - tokens) / perTick / 100.0)));
+            limited_->inc();
+            return false;
+        }
+        const std::uint64_t stamp = std::max(now, last);
+        const std::uint64_t next = (stamp << kTokenBits) | static_cast<std::uint64_t>(tokens - 1000.0);
+        if (entry->state.compare_exchange_weak(state, next, std::memory_order_relaxed)) {
+            allowed_->inc();
+            return true;
+        }
+    }
+}
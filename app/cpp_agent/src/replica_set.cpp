@@ -0,0 +1,256 @@
+#include "../include/replica_set.h"
+#include "../include/logger.h"
+#include "../include/metrics.h"
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+namespace {
+std::mt19937& threadRng() {
+    thread_local std::mt19937 rng(std::random_device{}());
+    return rng;
+}
+
+constexpr int kMaxBackoffShift = 3;  // ejections last up to 8x ejectSeconds
+
+// Tie-break between equally loaded replicas; each class is compared like for like
+std::uint64_t latencyScore(const Replica* replica) {
+    std::uint64_t score = 0;
+    for (const auto& ewma : replica->ewmaMicros) {
+        score += ewma.load(std::memory_order_relaxed);
+    }
+    return score;
+}
+
+bool lessLoaded(const Replica* a, const Replica* b) {
+    int oa = a->outstanding.load(std::memory_order_relaxed);
+    int ob = b->outstanding.load(std::memory_order_relaxed);
+    if (oa != ob) {
+        return oa < ob;
+    }
+    return latencyScore(a) < latencyScore(b);
+}
+}
+
+LatencyClass latencyClass(const std::string& path) {
+    if (path == "/completion") return LatencyClass::Completion;
+    if (path == "/embedding") return LatencyClass::Embedding;
+    return LatencyClass::None;
+}
+
+ReplicaSet::ReplicaSet(const std::vector<std::string>& urls, int slotsPerReplica, const std::string& model,
+                       const LoadBalancerPolicy& policy)
+    : policy_(policy), model_(model) {
+    Metrics& metrics = Metrics::instance();
+    for (const auto& url : urls) {
+        auto replica = std::make_unique<Replica>();
+        replica->url = url;
+        replica->slots = std::make_unique<SlotTracker>(slotsPerReplica);
+
+        const std::string labels = metricLabel("model", model) + "," + metricLabel("replica", url);
+        replica->breaker = std::make_unique<CircuitBreaker>(
+            policy.breaker,
+            &metrics.gauge("llama_breaker_state", "Circuit breaker state: 0 closed, 1 half-open, 2 open", labels),
+            &metrics.counter("llama_breaker_opens_total", "Times the replica's circuit breaker tripped open", labels));
+        replica->outstandingGauge = &metrics.gauge("llama_replica_outstanding_requests",
+                                                   "Requests in flight to a llama-server replica", labels);
+        replica->healthyGauge = &metrics.gauge("llama_replica_healthy",
+                                               "1 if the replica is eligible for traffic, 0 while ejected", labels);
+        replica->requestsCounter = &metrics.counter("llama_replica_requests_total",
+                                                    "Requests sent to a llama-server replica", labels);
+        replica->failuresCounter = &metrics.counter("llama_replica_failures_total",
+                                                    "Failed requests to a llama-server replica", labels);
+        replica->ejectionsCounter = &metrics.counter("llama_replica_ejections_total",
+                                                     "Times a replica was ejected for being slow", labels);
+        replica->healthyGauge->set(1);
+        replicas_.push_back(std::move(replica));
+    }
+    rejections_ = &metrics.counter("llama_breaker_rejections_total",
+                                   "Requests failed fast because every replica's breaker was open",
+                                   metricLabel("model", model));
+}
+
+std::int64_t ReplicaSet::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::size_t ReplicaSet::healthyCount() const {
+    const std::int64_t now = nowMs();
+    return static_cast<std::size_t>(std::count_if(replicas_.begin(), replicas_.end(), [&](const auto& r) {
+        return !r->ejected(now) && r->breaker->state() == CircuitBreaker::State::Closed;
+    }));
+}
+
+Replica& ReplicaSet::leastOutstanding(const std::vector<Replica*>& candidates) const {
+    return **std::min_element(candidates.begin(), candidates.end(), lessLoaded);
+}
+
+Replica& ReplicaSet::pick(const Hash128* prefix) {
+    Replica* replica = tryPick(prefix, nullptr);
+    if (!replica) {
+        rejections_->inc();
+        throw std::runtime_error("llama-server unavailable: circuit open on all " + std::to_string(replicas_.size()) +
+                                 " replica(s) of " + model_);
+    }
+    return *replica;
+}
+
+Replica* ReplicaSet::tryPick(const Hash128* prefix, const Replica* exclude) {
+    const std::int64_t now = nowMs();
+    std::vector<Replica*> available;
+    std::vector<Replica*> healthy;
+    available.reserve(replicas_.size());
+    healthy.reserve(replicas_.size());
+    for (auto& replica : replicas_) {
+        if (replica.get() == exclude) {
+            continue;
+        }
+        const bool open = !replica->breaker->admits();
+        const bool ejected = replica->ejected(now);
+        replica->healthyGauge->set(open || ejected ? 0 : 1);
+        if (open) {
+            continue;
+        }
+        available.push_back(replica.get());
+        if (!ejected) {
+            healthy.push_back(replica.get());
+        }
+    }
+
+    // Only the chosen replica's breaker is asked for admission, since that
+    // claims a probe when it is half-open; a probe lost to a concurrent
+    // request moves the choice on to the next replica.
+    while (!available.empty()) {
+        Replica* choice = choose(prefix, available, healthy);
+        if (choice->breaker->available()) {
+            return choice;
+        }
+        available.erase(std::find(available.begin(), available.end(), choice));
+        healthy.erase(std::remove(healthy.begin(), healthy.end(), choice), healthy.end());
+    }
+    return nullptr;
+}
+
+Replica* ReplicaSet::choose(const Hash128* prefix, const std::vector<Replica*>& available,
+                            const std::vector<Replica*>& healthy) const {
+    if (healthy.empty()) {
+        // Slow ejection fails open: use the replica closest to recovery.
+        return *std::min_element(available.begin(), available.end(), [](const Replica* a, const Replica* b) {
+            return a->ejectedUntilMs.load() < b->ejectedUntilMs.load();
+        });
+    }
+
+    Replica* choice = nullptr;
+    if (healthy.size() == 1 || policy_.strategy == "least_outstanding") {
+        choice = &leastOutstanding(healthy);
+    } else {
+        std::uniform_int_distribution<std::size_t> dist(0, healthy.size() - 1);
+        std::size_t a = dist(threadRng());
+        std::size_t b = dist(threadRng());
+        while (b == a) {
+            b = dist(threadRng());
+        }
+        choice = lessLoaded(healthy[a], healthy[b]) ? healthy[a] : healthy[b];
+    }
+
+    if (prefix) {
+        for (Replica* replica : healthy) {
+            if (replica->slots->find(*prefix) < 0) {
+                continue;
+            }
+            // Reusing a warm prefix beats a cold replica unless the holder is
+            // already a full slot-set deeper in queue.
+            if (replica->outstanding.load() <= choice->outstanding.load() + replica->slots->slots()) {
+                return replica;
+            }
+            break;
+        }
+    }
+    return choice;
+}
+
+void ReplicaSet::onStart(Replica& replica) {
+    replica.outstanding.fetch_add(1, std::memory_order_relaxed);
+    replica.outstandingGauge->add(1);
+    replica.requestsCounter->inc();
+}
+
+void ReplicaSet::onSuccess(Replica& replica, std::chrono::microseconds latency, LatencyClass cls) {
+    replica.outstanding.fetch_sub(1, std::memory_order_relaxed);
+    replica.outstandingGauge->add(-1);
+    replica.breaker->onSuccess();
+    if (cls == LatencyClass::None) {
+        return;
+    }
+
+    const auto c = static_cast<std::size_t>(cls);
+    std::atomic<std::uint64_t>& ewma = replica.ewmaMicros[c];
+    const std::uint64_t sample = static_cast<std::uint64_t>(std::max<std::int64_t>(0, latency.count()));
+    const std::uint64_t current = ewma.load(std::memory_order_relaxed);
+    ewma.store(current == 0 ? sample : current - current / 8 + sample / 8, std::memory_order_relaxed);
+    const std::uint64_t samples = replica.samples[c].fetch_add(1, std::memory_order_relaxed) + 1;
+
+    if (replicas_.size() < 2 || samples < static_cast<std::uint64_t>(policy_.minSamplesForSlow)) {
+        return;
+    }
+
+    const std::int64_t now = nowMs();
+    std::uint64_t fastest = std::numeric_limits<std::uint64_t>::max();
+    for (const auto& other : replicas_) {
+        if (other.get() == &replica || other->ejected(now) ||
+            other->samples[c].load() < static_cast<std::uint64_t>(policy_.minSamplesForSlow)) {
+            continue;
+        }
+        fastest = std::min(fastest, other->ewmaMicros[c].load(std::memory_order_relaxed));
+    }
+    if (fastest != std::numeric_limits<std::uint64_t>::max() &&
+        static_cast<double>(ewma.load()) > policy_.slowFactor * static_cast<double>(fastest)) {
+        eject(replica, "slow");
+    }
+}
+
+void ReplicaSet::onFailure(Replica& replica) {
+    replica.outstanding.fetch_sub(1, std::memory_order_relaxed);
+    replica.outstandingGauge->add(-1);
+    replica.failuresCounter->inc();
+    if (replica.breaker->onFailure()) {
+        // The process may have restarted; don't trust its slot contents.
+        replica.slots->reset();
+        LOG_WARN << "[ReplicaSet] Circuit opened for " << model_ << " replica " << replica.url;
+    }
+}
+
+void ReplicaSet::onCancelled(Replica& replica) {
+    replica.outstanding.fetch_sub(1, std::memory_order_relaxed);
+    replica.outstandingGauge->add(-1);
+    replica.breaker->onCancelled();
+}
+
+void ReplicaSet::eject(Replica& replica, const char* reason) {
+    // The backoff only resets once the replica has stayed in for as long as
+    // the longest ejection; a single fast answer after coming back does not
+    // make it trustworthy again.
+    const std::int64_t now = nowMs();
+    const std::int64_t healthyForMs = now - replica.ejectedUntilMs.load(std::memory_order_relaxed);
+    int previous = replica.ejections.load(std::memory_order_relaxed);
+    if (healthyForMs > static_cast<std::int64_t>(policy_.ejectSeconds) * 1000 * (1 << kMaxBackoffShift)) {
+        previous = 0;
+    }
+    replica.ejections.store(previous + 1, std::memory_order_relaxed);
+    const int multiplier = 1 << std::min(previous, kMaxBackoffShift);
+    const std::int64_t until = now + static_cast<std::int64_t>(policy_.ejectSeconds) * 1000 * multiplier;
+
+    replica.ejectedUntilMs.store(until, std::memory_order_relaxed);
+    // Start fresh when it comes back so a stale average does not re-eject it.
+    for (std::size_t c = 0; c < kLatencyClasses; ++c) {
+        replica.ewmaMicros[c].store(0, std::memory_order_relaxed);
+        replica.samples[c].store(0, std::memory_order_relaxed);
+    }
+    replica.healthyGauge->set(0);
+    replica.ejectionsCounter->inc();
+
+    LOG_WARN << "[ReplicaSet] Ejected " << model_ << " replica " << replica.url << " (" << reason << ") for "
+             << policy_.ejectSeconds * multiplier << "s";
+}
@@ -0,0 +1,135 @@
+#include "../include/simhash.h"
+#include "../include/hashing.h"
+#include <algorithm>
+#include <cctype>
+#include <string>
+
+namespace {
+constexpr int kShingleWords = 3;
+
+bool isWordByte(unsigned char c) {
+    return std::isalnum(c) || c >= 0x80;  // UTF-8 letters stay inside words
+}
+}
+
+std::uint64_t simhash(std::string_view text) {
+    // Words, lowercased, joined by single spaces so that spacing and
+    // punctuation differences do not change the shingles
+    std::string words;
+    std::vector<std::size_t> starts;
+    words.reserve(text.size());
+    std::size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && !isWordByte(static_cast<unsigned char>(text[i]))) {
+            ++i;
+        }
+        if (i == text.size()) {
+            break;
+        }
+        if (!words.empty()) {
+            words += ' ';
+        }
+        starts.push_back(words.size());
+        while (i < text.size() && isWordByte(static_cast<unsigned char>(text[i]))) {
+            words += static_cast<char>(std::tolower(static_cast<unsigned char>(text[i])));
+            ++i;
+        }
+    }
+    if (starts.empty()) {
+        return 0;
+    }
+
+    int weights[64] = {};
+    const std::size_t shingles = starts.size() > kShingleWords ? starts.size() - kShingleWords + 1 : 1;
+    for (std::size_t s = 0; s < shingles; ++s) {
+        const std::size_t last = s + kShingleWords;
+        const std::size_t end = last < starts.size() ? starts[last] - 1 : words.size();
+        const std::uint64_t h = hash128(std::string_view(words).substr(starts[s], end - starts[s])).lo;
+        for (int bit = 0; bit < 64; ++bit) {
+            weights[bit] += (h >> bit) & 1 ? 1 : -1;
+        }
+    }
+
+    std::uint64_t signature = 0;
+    for (int bit = 0; bit < 64; ++bit) {
+        if (weights[bit] > 0) {
+            signature |= std::uint64_t(1) << bit;
+        }
+    }
+    return signature;
+}
+
+std::uint64_t signatureScope(std::string_view agentScope, std::string_view gradeLevel, std::string_view subject) {
+    std::string key;
+    key.reserve(agentScope.size() + gradeLevel.size() + subject.size() + 2);
+    key.append(agentScope).append(1, '\0').append(gradeLevel).append(1, '\0').append(subject);
+    return hash128(key).lo;
+}
+
+SimHashIndex::SimHashIndex(int maxDistance)
+    : maxDistance_(std::max(0, std::min(maxDistance, 15))),
+      bands_(maxDistance_ + 1),
+      bandBits_(64 / bands_),
+      buckets_(static_cast<std::size_t>(bands_)) {}
+
+std::uint64_t SimHashIndex::band(std::uint64_t signature, std::uint64_t scope, int b) const {
+    // The last band takes whatever bits 64 / bands leaves over
+    const int shift = b * bandBits_;
+    const int bits = b == bands_ - 1 ? 64 - shift : bandBits_;
+    const std::uint64_t mask = bits == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << bits) - 1;
+    // Scopes get disjoint buckets (up to hash collisions, which find() rejects)
+    return ((signature >> shift) & mask) ^ (scope * 0x9e3779b97f4a7c15ULL);
+}
+
+bool SimHashIndex::find(std::uint64_t signature, std::uint64_t scope, ChunkSignature& match, int& distance) const {
+    int best = maxDistance_ + 1;
+    for (int b = 0; b < bands_; ++b) {
+        auto bucket = buckets_[static_cast<std::size_t>(b)].find(band(signature, scope, b));
+        if (bucket == buckets_[static_cast<std::size_t>(b)].end()) {
+            continue;
+        }
+        for (std::uint32_t id : bucket->second) {
+            if (removed_[id] || entries_[id].scope != scope) {
+                continue;
+            }
+            const int d = hammingDistance(signature, entries_[id].simhash);
+            if (d < best) {
+                best = d;
+                match = entries_[id];
+                if (d == 0) {
+                    distance = 0;
+                    return true;
+                }
+            }
+        }
+    }
+    if (best > maxDistance_) {
+        return false;
+    }
+    distance = best;
+    return true;
+}
+
+void SimHashIndex::insert(const ChunkSignature& entry) {
+    const auto id = static_cast<std::uint32_t>(entries_.size());
+    entries_.push_back(entry);
+    removed_.push_back(false);
+    for (int b = 0; b < bands_; ++b) {
+        buckets_[static_cast<std::size_t>(b)][band(entry.simhash, entry.scope, b)].push_back(id);
+    }
+    byContent_[entry.contentId].push_back(id);
+    ++live_;
+}
+
+void SimHashIndex::removeContent(int contentId) {
+    auto it = byContent_.find(contentId);
+    if (it == byContent_.end()) {
+        return;
+    }
+    // Tombstones: bucket lists keep the ids, find() skips them
+    for (std::uint32_t id : it->second) {
+        removed_[id] = true;
+        --live_;
+    }
+    byContent_.erase(it);
+}
@@ -0,0 +1,85 @@
+#include "../include/slot_tracker.h"
+#include <algorithm>
+
+SlotTracker::SlotTracker(int slots) : slots_(static_cast<std::size_t>(std::max(1, slots))) {
+}
+
+SlotTracker::Assignment SlotTracker::acquire(const Hash128& prefix) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int holder = -1;
+    int lruIdle = -1;
+    int lruAny = 0;
+    for (int i = 0; i < static_cast<int>(slots_.size()); ++i) {
+        const Slot& slot = slots_[i];
+        if (slot.hasPrefix && slot.prefix == prefix && (holder < 0 || slot.inflight < slots_[holder].inflight)) {
+            holder = i;
+        }
+        if (slot.inflight == 0 && (lruIdle < 0 || slot.lastUsed < slots_[lruIdle].lastUsed)) {
+            lruIdle = i;
+        }
+        if (slot.lastUsed < slots_[lruAny].lastUsed) {
+            lruAny = i;
+        }
+    }
+
+    Assignment result;
+    if (holder >= 0 && (slots_[holder].inflight == 0 || lruIdle < 0)) {
+        result.slot = holder;
+        result.prefixHit = true;
+    } else {
+        result.slot = lruIdle >= 0 ? lruIdle : lruAny;
+        result.prefixHit = false;
+    }
+
+    Slot& chosen = slots_[result.slot];
+    result.idle = chosen.inflight == 0;
+    chosen.prefix = prefix;
+    chosen.hasPrefix = true;
+    chosen.inflight++;
+    chosen.lastUsed = ++clock_;
+    return result;
+}
+
+void SlotTracker::release(int slot) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (slot < 0 || slot >= static_cast<int>(slots_.size())) {
+        return;
+    }
+    Slot& s = slots_[slot];
+    if (s.inflight > 0) {
+        s.inflight--;
+    }
+    s.lastUsed = ++clock_;
+}
+
+void SlotTracker::assign(int slot, const Hash128& prefix) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (slot < 0 || slot >= static_cast<int>(slots_.size())) {
+        return;
+    }
+    slots_[slot].prefix = prefix;
+    slots_[slot].hasPrefix = true;
+}
+
+int SlotTracker::find(const Hash128& prefix) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < static_cast<int>(slots_.size()); ++i) {
+        if (slots_[i].hasPrefix && slots_[i].prefix == prefix) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void SlotTracker::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& slot : slots_) {
+        slot.hasPrefix = false;
+    }
+}
+
+int SlotTracker::busy() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(std::count_if(slots_.begin(), slots_.end(), [](const Slot& s) { return s.inflight > 0; }));
+}
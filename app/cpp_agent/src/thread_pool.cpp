@@ -0,0 +1,93 @@
+#include "../include/thread_pool.h"
+#include "../include/logger.h"
+#include <exception>
+
+namespace {
+// Set on pool threads so submit() can push to the caller's own deque
+thread_local const WorkStealingPool* currentPool = nullptr;
+thread_local std::size_t currentWorker = 0;
+}
+
+WorkStealingPool::WorkStealingPool(std::size_t threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+        queues_.push_back(std::make_unique<Worker>());
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    if (currentPool == this) {
+        std::lock_guard<std::mutex> lock(queues_[currentWorker]->mutex);
+        queues_[currentWorker]->tasks.push_front(std::move(task));
+    } else {
+        const std::size_t target = nextQueue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+        std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+        queues_[target]->tasks.push_back(std::move(task));
+    }
+    {
+        // Pairs with the predicate check in run() so a wakeup is never lost
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        pending_.fetch_add(1, std::memory_order_relaxed);
+    }
+    wake_.notify_one();
+}
+
+bool WorkStealingPool::take(std::size_t self, std::function<void()>& task) {
+    {
+        Worker& own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (std::size_t offset = 1; offset < queues_.size(); ++offset) {
+        Worker& victim = *queues_[(self + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(std::size_t self) {
+    currentPool = this;
+    currentWorker = self;
+    while (true) {
+        std::function<void()> task;
+        if (take(self, task)) {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            try {
+                task();
+            } catch (const std::exception& e) {
+                LOG_ERROR << "[WorkStealingPool] Task failed: " << e.what();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        wake_.wait(lock, [this] { return stopping_ || pending_.load(std::memory_order_relaxed) > 0; });
+        if (stopping_ && pending_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+    }
+}
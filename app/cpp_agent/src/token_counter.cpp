@@ -0,0 +1,54 @@
+#include "../include/token_counter.h"
+#include "../include/metrics.h"
+#include <utility>
+
+TokenCounter::TokenCounter(TokenizeFn tokenize, std::size_t capacity, const std::string& model)
+    : tokenize_(std::move(tokenize)), capacity_(capacity > 0 ? capacity : 1), model_(model) {
+    const std::string labels = model.empty() ? "" : metricLabel("model", model);
+    hitsTotal_ = &Metrics::instance().counter("token_count_cache_hits_total",
+                                              "Token counts served from the tokenizer cache", labels);
+    missesTotal_ = &Metrics::instance().counter("token_count_cache_misses_total",
+                                                "Token counts that required llama-server /tokenize", labels);
+}
+
+int TokenCounter::estimate(const std::string& text) {
+    // BPE vocabularies average ~4 bytes/token on English prose; 3 keeps the
+    // estimate on the safe side for math, code and non-ASCII text.
+    return static_cast<int>((text.size() + 2) / 3);
+}
+
+int TokenCounter::count(const std::string& text) {
+    if (text.empty()) {
+        return 0;
+    }
+
+    const Hash128 key = hash128(text);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            hitsTotal_->inc();
+            return it->second->second;
+        }
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    missesTotal_->inc();
+    int tokens = tokenize_ ? tokenize_(text) : -1;
+    if (tokens < 0) {
+        return estimate(text);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.count(key) == 0) {
+        lru_.emplace_front(key, tokens);
+        index_[key] = lru_.begin();
+        if (lru_.size() > capacity_) {
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+    }
+    return tokens;
+}
@@ -0,0 +1,191 @@
+#include "../include/tracer.h"
+#include "../include/metrics.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <jsoncpp/json/json.h>
+
+namespace {
+thread_local std::uint64_t currentTraceId = 0;
+}
+
+// Returns the thread's ring buffer to the pool when the thread exits.
+struct ThreadBufferHolder {
+    Tracer::ThreadBuffer* buffer = nullptr;
+    ~ThreadBufferHolder() {
+        if (buffer) {
+            buffer->inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+namespace {
+thread_local ThreadBufferHolder localHolder;
+}
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer() : epoch_(Clock::now()) {}
+
+void Tracer::configure(bool enabled, std::size_t spansPerThread) {
+    std::lock_guard<std::mutex> lock(buffersMutex_);
+    enabled_.store(enabled, std::memory_order_relaxed);
+    spansPerThread_ = std::max<std::size_t>(16, spansPerThread);
+}
+
+std::uint64_t Tracer::newTraceId() {
+    static std::mutex rngMutex;
+    static std::mt19937_64 rng(std::random_device{}());
+    std::lock_guard<std::mutex> lock(rngMutex);
+    std::uint64_t id = 0;
+    while (id == 0) {
+        id = rng();
+    }
+    return id;
+}
+
+std::uint64_t Tracer::currentTrace() {
+    return currentTraceId;
+}
+
+Tracer::ThreadBuffer* Tracer::localBuffer() {
+    if (localHolder.buffer) {
+        return localHolder.buffer;
+    }
+    // First span on this thread: adopt a buffer left by an exited thread, or
+    // allocate one. Only this path locks, once per thread.
+    std::lock_guard<std::mutex> lock(buffersMutex_);
+    ThreadBuffer* buffer = nullptr;
+    for (auto& candidate : buffers_) {
+        bool expected = false;
+        if (candidate->inUse.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            buffer = candidate.get();
+            break;
+        }
+    }
+    if (!buffer) {
+        auto created = std::make_unique<ThreadBuffer>();
+        created->capacity = spansPerThread_;
+        created->slots.reset(new Slot[created->capacity]);
+        created->inUse.store(true, std::memory_order_relaxed);
+        buffer = created.get();
+        buffers_.push_back(std::move(created));
+    }
+    buffer->threadId = nextThreadId_++;
+    localHolder.buffer = buffer;
+    return buffer;
+}
+
+Histogram* Tracer::stageHistogram(ThreadBuffer& buffer, const char* name) {
+    for (const auto& [cachedName, histogram] : buffer.histograms) {
+        if (cachedName == name) {
+            return histogram;
+        }
+    }
+    Histogram* histogram = &Metrics::instance().histogram(
+        "chat_stage_duration_seconds", "Time spent in each stage of the chat pipeline", metricLabel("stage", name));
+    buffer.histograms.emplace_back(name, histogram);
+    return histogram;
+}
+
+void Tracer::record(const char* name, Clock::time_point start, Clock::time_point end) {
+    if (!enabled()) {
+        return;
+    }
+    ThreadBuffer& buffer = *localBuffer();
+    const std::int64_t startUs = std::chrono::duration_cast<std::chrono::microseconds>(start - epoch_).count();
+    const std::int64_t durationUs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    stageHistogram(buffer, name)->observeMicros(durationUs);
+
+    // Single writer per buffer: odd seq marks the slot as being rewritten.
+    const std::uint64_t index = buffer.head.load(std::memory_order_relaxed);
+    Slot& slot = buffer.slots[index % buffer.capacity];
+    slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.traceId.store(currentTraceId, std::memory_order_relaxed);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.startUs.store(startUs, std::memory_order_relaxed);
+    slot.durationUs.store(durationUs, std::memory_order_relaxed);
+    slot.threadId.store(buffer.threadId, std::memory_order_relaxed);
+    slot.seq.store(2 * index + 2, std::memory_order_release);
+    buffer.head.store(index + 1, std::memory_order_release);
+}
+
+std::vector<Tracer::SpanCopy> Tracer::snapshot(std::uint64_t traceId) const {
+    std::vector<SpanCopy> spans;
+    std::lock_guard<std::mutex> lock(buffersMutex_);
+    for (const auto& buffer : buffers_) {
+        const std::uint64_t head = buffer->head.load(std::memory_order_acquire);
+        const std::uint64_t first = head > buffer->capacity ? head - buffer->capacity : 0;
+        for (std::uint64_t i = first; i < head; ++i) {
+            const Slot& slot = buffer->slots[i % buffer->capacity];
+            const std::uint64_t before = slot.seq.load(std::memory_order_acquire);
+            if (before != 2 * i + 2) {
+                continue;  // overwritten since we read head
+            }
+            SpanCopy copy{slot.traceId.load(std::memory_order_relaxed), slot.name.load(std::memory_order_relaxed),
+                          slot.startUs.load(std::memory_order_relaxed), slot.durationUs.load(std::memory_order_relaxed),
+                          slot.threadId.load(std::memory_order_relaxed)};
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != before) {
+                continue;
+            }
+            if (traceId == 0 || copy.traceId == traceId) {
+                spans.push_back(copy);
+            }
+        }
+    }
+    std::sort(spans.begin(), spans.end(),
+              [](const SpanCopy& a, const SpanCopy& b) { return a.startUs < b.startUs; });
+    return spans;
+}
+
+std::string Tracer::chromeTraceJson(std::uint64_t traceId) const {
+    Json::Value events(Json::arrayValue);
+    for (const SpanCopy& span : snapshot(traceId)) {
+        Json::Value event;
+        event["name"] = span.name;
+        event["cat"] = "chat";
+        event["ph"] = "X";
+        event["ts"] = static_cast<Json::Int64>(span.startUs);
+        event["dur"] = static_cast<Json::Int64>(span.durationUs);
+        event["pid"] = 1;
+        event["tid"] = span.threadId;
+        event["args"]["trace_id"] = traceIdHex(span.traceId);
+        events.append(event);
+    }
+    Json::Value root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, root);
+}
+
+bool Tracer::writeChromeTrace(const std::string& path, std::uint64_t traceId) const {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    out << chromeTraceJson(traceId);
+    return static_cast<bool>(out);
+}
+
+TraceScope::TraceScope(std::uint64_t traceId) : previous_(currentTraceId) {
+    currentTraceId = traceId;
+}
+
+TraceScope::~TraceScope() {
+    currentTraceId = previous_;
+}
+
+std::string traceIdHex(std::uint64_t traceId) {
+    std::ostringstream out;
+    out << std::hex << std::setfill('0') << std::setw(16) << traceId;
+    return out.str();
+}
@@ -0,0 +1,341 @@
+#include "../include/traffic_capture.h"
+#include "../include/logger.h"
+#include "../include/metrics.h"
+#include <jsoncpp/json/json.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+const char kMagic[8] = {'P', 'H', 'C', 'A', 'P', 1, 0, 0};
+constexpr std::size_t kSecretBytes = 32;
+
+template <typename T>
+void put(std::string& out, T value) {
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        out += static_cast<char>(static_cast<std::uint64_t>(value) >> (8 * i) & 0xff);
+    }
+}
+
+template <typename T>
+T get(const char*& p) {
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    p += sizeof(T);
+    return static_cast<T>(value);
+}
+
+// Same-length replacement for one word: letters for letters, digits for digits
+std::string pseudonym(const std::string& word, const std::string& secret) {
+    std::string out(word.size(), 'x');
+    std::uint64_t bits = 0;
+    int left = 0;
+    for (std::size_t i = 0; i < word.size(); ++i) {
+        if (left < 5) {
+            bits = captureDigest(secret, word + '#' + std::to_string(i));
+            left = 64;
+        }
+        const unsigned char c = static_cast<unsigned char>(word[i]);
+        if (std::isdigit(c)) {
+            out[i] = static_cast<char>('0' + (bits & 31) % 10);
+        } else if (std::isalpha(c)) {
+            const char base = std::isupper(c) ? 'A' : 'a';
+            out[i] = static_cast<char>(base + (bits & 31) % 26);
+        } else {
+            out[i] = word[i];  // UTF-8 continuation bytes and the like
+        }
+        bits >>= 5;
+        left -= 5;
+    }
+    return out;
+}
+
+std::string redactText(const std::string& text, const std::string& secret) {
+    std::string out;
+    out.reserve(text.size());
+    std::string word;
+    auto isWordByte = [](unsigned char c) { return std::isalnum(c) || c >= 0x80; };
+    for (char c : text) {
+        if (isWordByte(static_cast<unsigned char>(c))) {
+            word += c;
+            continue;
+        }
+        out += pseudonym(word, secret);
+        word.clear();
+        out += c;
+    }
+    out += pseudonym(word, secret);
+    return out;
+}
+
+void redactValue(Json::Value& value, const std::string& secret) {
+    if (value.isString()) {
+        value = redactText(value.asString(), secret);
+    } else if (value.isArray()) {
+        for (auto& item : value) {
+            redactValue(item, secret);
+        }
+    } else if (value.isObject()) {
+        for (const auto& key : value.getMemberNames()) {
+            redactValue(value[key], secret);
+        }
+    }
+}
+
+std::int64_t unixMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+struct CaptureMetrics {
+    Counter& records;
+    Counter& dropped;
+};
+
+CaptureMetrics& captureMetrics() {
+    static CaptureMetrics m{
+        Metrics::instance().counter("traffic_capture_records_total", "Requests written to the traffic capture"),
+        Metrics::instance().counter("traffic_capture_dropped_total",
+                                    "Requests not captured because the buffer or file was full"),
+    };
+    return m;
+}
+}
+
+CapturePayload parseCapturePayload(const std::string& name, CapturePayload fallback) {
+    std::string lower;
+    for (char c : name) {
+        lower += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    if (lower == "full") return CapturePayload::Full;
+    if (lower == "redacted") return CapturePayload::Redacted;
+    if (lower == "none") return CapturePayload::None;
+    return fallback;
+}
+
+std::uint64_t captureDigest(const std::string& secret, const std::string& data) {
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()),
+         reinterpret_cast<const unsigned char*>(data.data()), data.size(), mac, &length);
+    std::uint64_t digest = 0;
+    for (std::size_t i = 0; i < sizeof(digest); ++i) {
+        digest |= static_cast<std::uint64_t>(mac[i]) << (8 * i);
+    }
+    return digest;
+}
+
+std::string redactPayload(const std::string& body, const std::string& secret) {
+    Json::Value document;
+    Json::CharReaderBuilder reader;
+    std::stringstream ss(body);
+    std::string errs;
+    if (body.empty() || !Json::parseFromStream(reader, ss, &document, &errs)) {
+        return std::string(body.size(), 'x');
+    }
+    redactValue(document, secret);
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, document);
+}
+
+TrafficCapture::TrafficCapture(const CaptureOptions& options)
+    : options_(options), secret_(kSecretBytes, '\0'), steadyStart_(std::chrono::steady_clock::now()),
+      unixStartUs_(unixMicros()) {
+    if (RAND_bytes(reinterpret_cast<unsigned char*>(&secret_[0]), static_cast<int>(secret_.size())) != 1) {
+        throw std::runtime_error("Cannot generate a traffic capture secret");
+    }
+    file_ = std::fopen(options_.path.c_str(), "ab");
+    if (!file_) {
+        throw std::runtime_error("Cannot open traffic capture file " + options_.path + ": " + std::strerror(errno));
+    }
+    std::fseek(file_, 0, SEEK_END);
+    const long size = std::ftell(file_);
+    fileBytes_ = size > 0 ? static_cast<std::uint64_t>(size) : 0;
+    if (fileBytes_ == 0) {
+        std::fwrite(kMagic, 1, sizeof(kMagic), file_);
+        fileBytes_ = sizeof(kMagic);
+    }
+    captureMetrics();
+    pending_.reserve(options_.bufferBytes);
+    writer_ = std::thread(&TrafficCapture::run, this);
+    LOG_INFO << "[TrafficCapture] Appending requests to " << options_.path;
+}
+
+TrafficCapture::~TrafficCapture() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    flush();
+    std::fclose(file_);
+    OPENSSL_cleanse(&secret_[0], secret_.size());
+}
+
+void TrafficCapture::record(std::chrono::steady_clock::time_point received, std::uint32_t durationUs, int status,
+                            const std::string& method, const std::string& path, const std::string& body,
+                            std::uint32_t deadlineMs) {
+    std::string stored;
+    if (options_.payload == CapturePayload::Full) {
+        stored = body;
+    } else if (options_.payload == CapturePayload::Redacted) {
+        stored = redactPayload(body, secret_);
+    }
+
+    std::string encoded;
+    encoded.reserve(48 + method.size() + path.size() + stored.size());
+    put<std::uint32_t>(encoded, 0);  // size, patched below
+    put<std::int64_t>(encoded, unixStartUs_ + std::chrono::duration_cast<std::chrono::microseconds>(
+                                                  received - steadyStart_).count());
+    put<std::uint32_t>(encoded, durationUs);
+    put<std::uint16_t>(encoded, static_cast<std::uint16_t>(std::clamp(status, 0, 999)));
+    put<std::uint8_t>(encoded, static_cast<std::uint8_t>(options_.payload));
+    put<std::uint32_t>(encoded, deadlineMs);
+    put<std::uint64_t>(encoded, captureDigest(secret_, body));
+    put<std::uint32_t>(encoded, static_cast<std::uint32_t>(body.size()));
+    put<std::uint16_t>(encoded, static_cast<std::uint16_t>(std::min<std::size_t>(method.size(), 0xffff)));
+    encoded.append(method, 0, 0xffff);
+    put<std::uint16_t>(encoded, static_cast<std::uint16_t>(std::min<std::size_t>(path.size(), 0xffff)));
+    encoded.append(path, 0, 0xffff);
+    put<std::uint32_t>(encoded, static_cast<std::uint32_t>(stored.size()));
+    encoded += stored;
+    const auto size = static_cast<std::uint32_t>(encoded.size() - sizeof(std::uint32_t));
+    for (std::size_t i = 0; i < sizeof(size); ++i) {
+        encoded[i] = static_cast<char>(size >> (8 * i) & 0xff);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        if (pending_.size() + encoded.size() <= options_.bufferBytes) {
+            pending_ += encoded;
+            return;
+        }
+    }
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    captureMetrics().dropped.inc();
+}
+
+void TrafficCapture::run() {
+    std::unique_lock<std::mutex> lock(wakeMutex_);
+    while (!stopping_) {
+        wake_.wait_for(lock, std::chrono::milliseconds(std::max(1, options_.flushIntervalMs)));
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+void TrafficCapture::flush() {
+    std::string batch;
+    batch.reserve(options_.bufferBytes);
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        batch.swap(pending_);
+    }
+    if (batch.empty()) {
+        return;
+    }
+
+    // Whole records only, up to the size limit
+    std::size_t end = 0;
+    std::uint64_t records = 0;
+    while (end < batch.size()) {
+        const char* p = batch.data() + end;
+        const std::size_t recordBytes = sizeof(std::uint32_t) + get<std::uint32_t>(p);
+        if (fileBytes_ + end + recordBytes > options_.maxBytes) {
+            break;
+        }
+        end += recordBytes;
+        records++;
+    }
+    if (end > 0) {
+        std::fwrite(batch.data(), 1, end, file_);
+        std::fflush(file_);
+        fileBytes_ += end;
+        captureMetrics().records.inc(records);
+    }
+    if (end < batch.size()) {
+        std::uint64_t rejected = 0;
+        for (const char* p = batch.data() + end; p < batch.data() + batch.size();) {
+            const char* next = p;
+            p += sizeof(std::uint32_t) + get<std::uint32_t>(next);
+            rejected++;
+        }
+        dropped_.fetch_add(rejected, std::memory_order_relaxed);
+        captureMetrics().dropped.inc(rejected);
+        if (!full_) {
+            full_ = true;
+            LOG_WARN << "[TrafficCapture] " << options_.path << " reached "
+                     << options_.maxBytes / (1024 * 1024) << " MB, no longer capturing";
+        }
+    }
+}
+
+CaptureReader::CaptureReader(const std::string& path) {
+    file_ = std::fopen(path.c_str(), "rb");
+    if (!file_) {
+        throw std::runtime_error("Cannot open capture file " + path + ": " + std::strerror(errno));
+    }
+    char magic[sizeof(kMagic)];
+    if (std::fread(magic, 1, sizeof(magic), file_) != sizeof(magic) || std::memcmp(magic, kMagic, 6) != 0) {
+        std::fclose(file_);
+        throw std::runtime_error(path + " is not a traffic capture");
+    }
+}
+
+CaptureReader::~CaptureReader() {
+    std::fclose(file_);
+}
+
+bool CaptureReader::next(CapturedRequest& request) {
+    char sizeBytes[sizeof(std::uint32_t)];
+    if (std::fread(sizeBytes, 1, sizeof(sizeBytes), file_) != sizeof(sizeBytes)) {
+        return false;
+    }
+    const char* p = sizeBytes;
+    const std::uint32_t size = get<std::uint32_t>(p);
+    std::vector<char> data(size);
+    if (std::fread(data.data(), 1, size, file_) != size) {
+        return false;
+    }
+
+    const char* end = data.data() + size;
+    p = data.data();
+    auto need = [&](std::size_t bytes) { return static_cast<std::size_t>(end - p) >= bytes; };
+    if (!need(35)) {
+        return false;
+    }
+    request.arrivalUs = get<std::int64_t>(p);
+    request.durationUs = get<std::uint32_t>(p);
+    request.status = get<std::uint16_t>(p);
+    request.payload = static_cast<CapturePayload>(get<std::uint8_t>(p));
+    request.deadlineMs = get<std::uint32_t>(p);
+    request.bodyHash = get<std::uint64_t>(p);
+    request.bodyBytes = get<std::uint32_t>(p);
+    auto readString = [&](std::string& out, std::size_t lengthBytes) {
+        if (!need(lengthBytes)) {
+            return false;
+        }
+        const std::size_t length = lengthBytes == 2 ? get<std::uint16_t>(p) : get<std::uint32_t>(p);
+        if (!need(length)) {
+            return false;
+        }
+        out.assign(p, length);
+        p += length;
+        return true;
+    };
+    return readString(request.method, 2) && readString(request.path, 2) && readString(request.body, 4);
+}
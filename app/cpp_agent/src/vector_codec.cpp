@@ -0,0 +1,40 @@
+#include "../include/vector_codec.h"
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+std::string serializeVector(const std::vector<float>& embedding) {
+    std::ostringstream embStr;
+    embStr.setf(std::ios::fixed);
+    embStr << "[";
+    for (size_t i = 0; i < embedding.size(); ++i) {
+        if (i > 0) {
+            embStr << ",";
+        }
+        embStr << std::setprecision(8) << embedding[i];
+    }
+    embStr << "]";
+    return embStr.str();
+}
+
+std::vector<float> parseVector(const std::string& text) {
+    std::vector<float> values;
+    if (text.empty()) {
+        return values;
+    }
+
+    std::string trimmed = text;
+    if (trimmed.front() == '[' && trimmed.back() == ']') {
+        trimmed = trimmed.substr(1, trimmed.size() - 2);
+    }
+
+    std::stringstream ss(trimmed);
+    std::string token;
+    while (std::getline(ss, token, ',')) {
+        if (!token.empty()) {
+            values.push_back(static_cast<float>(std::atof(token.c_str())));
+        }
+    }
+
+    return values;
+}
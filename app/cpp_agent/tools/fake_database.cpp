@@ -0,0 +1,241 @@
+#include "fake_database.h"
+#include "mock_llama_server.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+struct Topic {
+    const char* name;
+    const char* subject;
+    const char* words;
+};
+
+const Topic kTopics[] = {
+    {"photosynthesis", "science", "photosynthesis chlorophyll sunlight leaves glucose oxygen carbon dioxide plants"},
+    {"the water cycle", "science", "water cycle evaporation condensation precipitation clouds rain runoff"},
+    {"volcanoes", "science", "volcano magma lava eruption crust tectonic plates ash"},
+    {"the solar system", "science", "solar system planets orbit sun moon gravity asteroid comet"},
+    {"food chains", "science", "food chain producers consumers predators prey decomposers energy"},
+    {"states of matter", "science", "solid liquid gas melting freezing particles temperature"},
+    {"electric circuits", "science", "circuit battery current voltage wire switch bulb resistance"},
+    {"the human heart", "science", "heart blood arteries veins pulse oxygen lungs circulation"},
+    {"fractions", "math", "fractions numerator denominator equivalent simplify halves quarters"},
+    {"multiplication", "math", "multiplication times tables product factors arrays groups"},
+    {"area and perimeter", "math", "area perimeter rectangle square length width units"},
+    {"place value", "math", "place value ones tens hundreds digits rounding"},
+    {"ratios", "math", "ratio proportion rate compare parts recipe scale"},
+    {"ancient Egypt", "history", "egypt pharaoh pyramids nile hieroglyphs mummies"},
+    {"the American Revolution", "history", "revolution colonies independence declaration patriots taxes"},
+    {"the Roman Empire", "history", "rome empire emperor legions aqueducts senate latin"},
+};
+constexpr int kTopicCount = sizeof(kTopics) / sizeof(kTopics[0]);
+
+const char* const kFiller[] = {"students", "can", "see", "how", "this", "works", "when", "we", "look", "at",
+                               "an", "example", "from", "everyday", "life", "and", "then", "explain", "why",
+                               "it", "matters"};
+constexpr int kFillerCount = sizeof(kFiller) / sizeof(kFiller[0]);
+
+// Sentences mixing the topic's words with filler, deterministic per document and chunk
+std::string chunkText(const Topic& topic, int contentId, int chunkIndex, int bytes) {
+    std::vector<std::string> words;
+    std::string list = topic.words;
+    for (std::size_t start = 0; start < list.size();) {
+        std::size_t end = list.find(' ', start);
+        if (end == std::string::npos) end = list.size();
+        words.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+
+    std::mt19937 rng(static_cast<std::uint32_t>(contentId * 131 + chunkIndex));
+    std::string text = "Lesson " + std::to_string(contentId) + " on " + topic.name + ".";
+    while (static_cast<int>(text.size()) < bytes) {
+        text += ' ';
+        text += rng() % 3 == 0 ? kFiller[rng() % kFillerCount] : words[rng() % words.size()];
+        if (rng() % 12 == 0) {
+            text += '.';
+        }
+    }
+    return text;
+}
+
+[[noreturn]] void unsupported(const char* call) {
+    throw std::runtime_error(std::string("FakeDatabase does not support ") + call);
+}
+}
+
+FakeDatabase::FakeDatabase(const FakeCorpus& corpus) : corpus_(corpus) {
+    for (int id = 1; id <= corpus_.agents; ++id) {
+        Agent agent{};
+        agent.id = id;
+        agent.name = "Tutor " + std::to_string(id);
+        agent.description = "Synthetic load test agent";
+        agent.systemPrompt = "You are " + agent.name + ", a patient tutor for elementary and middle school "
+                             "students. Explain ideas step by step with everyday examples, check understanding "
+                             "with a short question, and never give answers to graded work outright. Keep "
+                             "answers short, friendly and accurate, and say so when you are not sure.";
+        agent.modelName = corpus_.modelName;
+        agent.parameters["temperature"] = "0.7";
+        agent.parameters["max_tokens"] = "512";
+        agents_.push_back(agent);
+    }
+
+    static const char* const kGrades[] = {"grade_3", "grade_4", "grade_5", "grade_6", "grade_7", "grade_8"};
+    chunks_.reserve(static_cast<std::size_t>(corpus_.documents) * corpus_.chunksPerDocument);
+    for (int contentId = 1; contentId <= corpus_.documents; ++contentId) {
+        const Topic& topic = kTopics[contentId % kTopicCount];
+        for (int index = 0; index < corpus_.chunksPerDocument; ++index) {
+            Chunk chunk;
+            chunk.contentId = contentId;
+            chunk.chunkIndex = index;
+            chunk.text = chunkText(topic, contentId, index, corpus_.chunkBytes);
+            chunk.gradeLevel = kGrades[contentId % 6];
+            chunk.subject = topic.subject;
+            chunk.embedding = mockEmbedding(chunk.text, corpus_.dimensions);
+            chunks_.push_back(std::move(chunk));
+        }
+    }
+}
+
+const std::vector<std::string>& FakeDatabase::topics() {
+    static const std::vector<std::string> names = [] {
+        std::vector<std::string> result;
+        for (const Topic& topic : kTopics) {
+            result.push_back(std::string(topic.name) + " (" + topic.words + ")");
+        }
+        return result;
+    }();
+    return names;
+}
+
+Agent FakeDatabase::getAgent(int agentId) {
+    if (agentId < 1 || agentId > static_cast<int>(agents_.size())) {
+        throw std::runtime_error("Agent not found: " + std::to_string(agentId));
+    }
+    return agents_[static_cast<std::size_t>(agentId - 1)];
+}
+
+std::vector<Agent> FakeDatabase::getAllAgents() {
+    return agents_;
+}
+
+std::vector<Agent> FakeDatabase::getStudentVisibleAgents() {
+    return agents_;
+}
+
+void FakeDatabase::storeMemory(int, int, const std::string&, const std::string&) {
+    memories_++;
+}
+
+std::vector<std::string> FakeDatabase::getRAGDocuments(int, const std::vector<float>& embedding, int limit) {
+    std::vector<std::string> documents;
+    for (const auto& result : vectorSearch(embedding, limit)) {
+        documents.push_back(result.chunkText);
+    }
+    return documents;
+}
+
+std::vector<VectorSearchResult> FakeDatabase::vectorSearch(const std::vector<float>& embedding, int topK,
+                                                           const std::string& metric,
+                                                           const VectorSearchFilters* filters) {
+    const auto started = std::chrono::steady_clock::now();
+    std::vector<VectorSearchResult> results;
+    if (embedding.size() != static_cast<std::size_t>(corpus_.dimensions)) {
+        return results;
+    }
+    const bool useL2 = metric == "l2" || metric == "euclidean" || metric == "l2_distance";
+
+    // Same scoring as Database::vectorSearch: distance, then similarity in [0, 1]
+    std::vector<std::pair<float, const Chunk*>> scored;
+    scored.reserve(chunks_.size());
+    for (const Chunk& chunk : chunks_) {
+        // Synthetic chunks carry no agent_scope, so a scoped search matches nothing
+        if (filters && (filters->hasAgentScope() ||
+                        (filters->hasGradeLevel() && filters->gradeLevel != chunk.gradeLevel) ||
+                        (filters->hasSubject() && filters->subject != chunk.subject))) {
+            continue;
+        }
+        float dot = 0.0f;
+        float l2 = 0.0f;
+        for (std::size_t i = 0; i < embedding.size(); ++i) {
+            dot += embedding[i] * chunk.embedding[i];
+            const float d = embedding[i] - chunk.embedding[i];
+            l2 += d * d;
+        }
+        const float distance = useL2 ? std::sqrt(l2) : 1.0f - dot;
+        scored.emplace_back(distance, &chunk);
+    }
+    const std::size_t keep = std::min(scored.size(), static_cast<std::size_t>(topK > 0 ? topK : 5));
+    std::partial_sort(scored.begin(), scored.begin() + static_cast<std::ptrdiff_t>(keep), scored.end(),
+                      [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    for (std::size_t i = 0; i < keep; ++i) {
+        const Chunk& chunk = *scored[i].second;
+        VectorSearchResult row;
+        row.contentId = chunk.contentId;
+        row.chunkIndex = chunk.chunkIndex;
+        row.chunkText = chunk.text;
+        const float distance = std::max(scored[i].first, 0.0f);
+        row.similarity = std::clamp(useL2 ? 1.0f / (1.0f + distance) : 1.0f - distance, 0.0f, 1.0f);
+        row.gradeLevel = chunk.gradeLevel;
+        row.subject = chunk.subject;
+        results.push_back(std::move(row));
+    }
+
+    // Pad to the configured query latency; the scan itself counts toward it
+    std::this_thread::sleep_until(started + std::chrono::microseconds(
+        static_cast<long long>(corpus_.searchMs * 1000.0)));
+    return results;
+}
+
+std::vector<EmbeddingRow> FakeDatabase::getStoredEmbeddings(const std::string&) {
+    std::vector<EmbeddingRow> rows;
+    rows.reserve(chunks_.size());
+    for (const Chunk& chunk : chunks_) {
+        EmbeddingRow row;
+        row.contentId = chunk.contentId;
+        row.chunkIndex = chunk.chunkIndex;
+        row.model = corpus_.modelName;
+        row.embedding = chunk.embedding;
+        rows.push_back(std::move(row));
+    }
+    return rows;
+}
+
+std::vector<std::pair<std::string, std::string>> FakeDatabase::searchEducationalContent(const std::string&, int) {
+    return {};
+}
+
+bool FakeDatabase::getContentForIndexing(int, IndexableContent&) { unsupported("getContentForIndexing"); }
+std::vector<IndexableContent> FakeDatabase::getContentPage(int, int) { unsupported("getContentPage"); }
+void FakeDatabase::deleteEmbeddings(int, const std::string&) { unsupported("deleteEmbeddings"); }
+int FakeDatabase::insertEmbeddings(const std::vector<EmbeddingRow>&, const std::string&) {
+    unsupported("insertEmbeddings");
+}
+void FakeDatabase::replaceEmbeddings(const std::vector<int>&, const std::vector<EmbeddingRow>&,
+                                     const std::vector<ChunkDuplicateRow>&, const std::string&) {
+    unsupported("replaceEmbeddings");
+}
+void FakeDatabase::markContentEmbedded(int, int) { unsupported("markContentEmbedded"); }
+std::vector<ChunkSignature> FakeDatabase::getChunkSignatures(const std::string&) { unsupported("getChunkSignatures"); }
+void FakeDatabase::insertChunkDuplicates(const std::vector<ChunkDuplicateRow>&, const std::string&) {
+    unsupported("insertChunkDuplicates");
+}
+bool FakeDatabase::getReembedRun(const std::string&, ReembedRun&) { unsupported("getReembedRun"); }
+void FakeDatabase::saveReembedRun(const ReembedRun&) { unsupported("saveReembedRun"); }
+std::vector<IndexableContent> FakeDatabase::getContentToReembed(const std::string&, int, const std::string&) {
+    unsupported("getContentToReembed");
+}
+void FakeDatabase::createShadowEmbeddingsTable(const std::string&, bool) { unsupported("createShadowEmbeddingsTable"); }
+void FakeDatabase::swapEmbeddingsTable(const std::string&, bool) { unsupported("swapEmbeddingsTable"); }
+void FakeDatabase::refreshEmbeddingCounts() { unsupported("refreshEmbeddingCounts"); }
+std::vector<float> FakeDatabase::getEmbedding(int) { unsupported("getEmbedding"); }
+void FakeDatabase::setVectorIndexEfSearch(int) { unsupported("setVectorIndexEfSearch"); }
+void FakeDatabase::createJob(const GenerationJob&) { unsupported("createJob"); }
+void FakeDatabase::updateJob(const GenerationJob&) { unsupported("updateJob"); }
+bool FakeDatabase::getJob(const std::string&, GenerationJob&) { unsupported("getJob"); }
+std::vector<GenerationJob> FakeDatabase::getUnfinishedJobs() { unsupported("getUnfinishedJobs"); }
+int FakeDatabase::purgeFinishedJobs(int) { unsupported("purgeFinishedJobs"); }
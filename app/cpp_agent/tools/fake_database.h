@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "../include/database.h"
+
+// Shape of the synthetic corpus FakeDatabase is seeded with
+struct FakeCorpus {
+    int agents = 4;
+    int documents = 500;
+    int chunksPerDocument = 4;
+    int chunkBytes = 700;
+    int dimensions = 384;
+    std::string modelName;     // agents' model_name
+    double searchMs = 2.0;     // added to each vectorSearch, standing in for the query
+};
+
+// In-memory Database for load tests: agents, content_embeddings and memory
+// writes of the chat path. Chunk vectors come from mockEmbedding so queries
+// answered by MockLlamaServer find related chunks. The corpus is fixed at
+// construction, so vectorSearch is a lock-free exact scan; ingestion,
+// re-embedding and jobs are not supported and throw.
+class FakeDatabase : public Database {
+public:
+    explicit FakeDatabase(const FakeCorpus& corpus);
+
+    // Topics the synthetic chunks are about, to phrase matching questions
+    static const std::vector<std::string>& topics();
+    long memoriesStored() const { return memories_.load(); }
+
+    Agent getAgent(int agentId) override;
+    std::vector<Agent> getAllAgents() override;
+    std::vector<Agent> getStudentVisibleAgents() override;
+    void storeMemory(int userId, int agentId, const std::string& userMessage, const std::string& agentResponse) override;
+    std::vector<std::string> getRAGDocuments(int agentId, const std::vector<float>& embedding, int limit) override;
+    std::vector<VectorSearchResult> vectorSearch(const std::vector<float>& embedding,
+                                                 int topK = 5,
+                                                 const std::string& metric = "cosine",
+                                                 const VectorSearchFilters* filters = nullptr) override;
+    std::vector<std::pair<std::string, std::string>> searchEducationalContent(const std::string& query,
+                                                                              int limit = 3) override;
+
+    bool getContentForIndexing(int contentId, IndexableContent& content) override;
+    std::vector<IndexableContent> getContentPage(int afterContentId, int limit) override;
+    void deleteEmbeddings(int contentId, const std::string& table = "content_embeddings") override;
+    int insertEmbeddings(const std::vector<EmbeddingRow>& rows, const std::string& table = "content_embeddings") override;
+    void replaceEmbeddings(const std::vector<int>& contentIds, const std::vector<EmbeddingRow>& rows,
+                           const std::vector<ChunkDuplicateRow>& duplicates,
+                           const std::string& table = "content_embeddings") override;
+    void markContentEmbedded(int contentId, int embeddingCount) override;
+    std::vector<ChunkSignature> getChunkSignatures(const std::string& table = "content_embeddings") override;
+    void insertChunkDuplicates(const std::vector<ChunkDuplicateRow>& rows,
+                               const std::string& table = "content_embeddings") override;
+    bool getReembedRun(const std::string& runId, ReembedRun& run) override;
+    void saveReembedRun(const ReembedRun& run) override;
+    std::vector<IndexableContent> getContentToReembed(const std::string& table, int throughContentId,
+                                                      const std::string& changedSince) override;
+    void createShadowEmbeddingsTable(const std::string& table, bool reset) override;
+    void swapEmbeddingsTable(const std::string& table, bool keepOld) override;
+    void refreshEmbeddingCounts() override;
+    std::vector<float> getEmbedding(int embeddingId) override;
+    std::vector<EmbeddingRow> getStoredEmbeddings(const std::string& table = "content_embeddings") override;
+    void setVectorIndexEfSearch(int efSearch) override;
+    void createJob(const GenerationJob& job) override;
+    void updateJob(const GenerationJob& job) override;
+    bool getJob(const std::string& jobId, GenerationJob& job) override;
+    std::vector<GenerationJob> getUnfinishedJobs() override;
+    int purgeFinishedJobs(int olderThanDays) override;
+
+private:
+    struct Chunk {
+        int contentId;
+        int chunkIndex;
+        std::string text;
+        std::string gradeLevel;
+        std::string subject;
+        std::vector<float> embedding;
+    };
+
+    FakeCorpus corpus_;
+    std::vector<Agent> agents_;
+    std::vector<Chunk> chunks_;
+    std::atomic<long> memories_{0};
+};
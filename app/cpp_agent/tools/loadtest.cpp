@@ -0,0 +1,252 @@
+// loadtest: runs agent_service in-process against mock llama-servers and an
+// in-memory database, drives POST /agent/chat with open-loop Poisson arrivals
+// and reports throughput and latency percentiles. No models or MariaDB are
+// needed, so scheduler, pooling and caching changes can be compared on a
+// laptop.
+//
+//   loadtest [--config PATH] [--port N] [--rate R] [--duration S] [--users N]
+//            [--agents N] [--messages N] [--deadline-ms N] [--replicas N]
+//            [--slots N] [--prefill-ms X] [--decode-ms X] [--tokens N]
+//            [--embed-ms X] [--search-ms X] [--documents N] [--rate-limits]
+//            [--json] [--verbose]
+//
+// --config takes scheduling, balancing, hedging, cache, deadline and RAG
+// settings from a real config.json; every configured model is pointed at
+// the mock replicas. Rate limits are off unless --rate-limits is given.
+// Latency is measured from each request's scheduled arrival (see
+// open_loop_client.h).
+
+#include "fake_database.h"
+#include "mock_llama_server.h"
+#include "open_loop_client.h"
+#include "../include/agent_manager.h"
+#include "../include/config.h"
+#include "../include/http_server.h"
+#include "../include/logger.h"
+#include <curl/curl.h>
+#include <jsoncpp/json/json.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string configPath;
+    int port = 18080;
+    double rate = 5.0;       // requests per second
+    double duration = 30.0;  // seconds of arrivals
+    int users = 1000;
+    int agents = 4;
+    int messages = 200;      // distinct questions; fewer means more embedding cache hits
+    int deadlineMs = 0;      // X-Request-Deadline; 0 sends none
+    int replicas = 1;
+    MockLlamaTimings timings;
+    FakeCorpus corpus;
+    bool rateLimits = false;
+    bool json = false;
+    bool verbose = false;
+};
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--config") options.configPath = value();
+        else if (arg == "--port") options.port = std::atoi(value().c_str());
+        else if (arg == "--rate") options.rate = std::atof(value().c_str());
+        else if (arg == "--duration") options.duration = std::atof(value().c_str());
+        else if (arg == "--users") options.users = std::atoi(value().c_str());
+        else if (arg == "--agents") options.agents = std::atoi(value().c_str());
+        else if (arg == "--messages") options.messages = std::atoi(value().c_str());
+        else if (arg == "--deadline-ms") options.deadlineMs = std::atoi(value().c_str());
+        else if (arg == "--replicas") options.replicas = std::atoi(value().c_str());
+        else if (arg == "--slots") options.timings.slots = std::atoi(value().c_str());
+        else if (arg == "--prefill-ms") options.timings.prefillMsPerToken = std::atof(value().c_str());
+        else if (arg == "--decode-ms") options.timings.decodeMsPerToken = std::atof(value().c_str());
+        else if (arg == "--tokens") options.timings.completionTokens = std::atoi(value().c_str());
+        else if (arg == "--embed-ms") options.timings.embeddingMs = std::atof(value().c_str());
+        else if (arg == "--search-ms") options.corpus.searchMs = std::atof(value().c_str());
+        else if (arg == "--documents") options.corpus.documents = std::atoi(value().c_str());
+        else if (arg == "--rate-limits") options.rateLimits = true;
+        else if (arg == "--json") options.json = true;
+        else if (arg == "--verbose") options.verbose = true;
+        else return false;
+    }
+    options.corpus.agents = options.agents;
+    return options.rate > 0.0 && options.duration > 0.0 && options.users > 0 && options.agents > 0 &&
+           options.messages > 0 && options.replicas > 0 && options.timings.slots > 0 && options.port > 0;
+}
+
+// Questions phrased from the corpus topics so retrieval finds related chunks
+std::vector<std::string> questions(int count) {
+    const std::vector<std::string>& topics = FakeDatabase::topics();
+    std::vector<std::string> result;
+    for (int i = 0; i < count; ++i) {
+        result.push_back("Question " + std::to_string(i / static_cast<int>(topics.size()) + 1) +
+                         ": can you explain " + topics[static_cast<std::size_t>(i) % topics.size()] + "?");
+    }
+    return result;
+}
+
+// Every configured model (or the default one) served by the mock replicas
+void pointModelsAt(Config& config, const std::vector<std::unique_ptr<MockLlamaServer>>& mocks, int slots) {
+    if (config.models.empty()) {
+        config.models[config.defaultModel] = ModelConfig{};
+    }
+    for (auto& [name, model] : config.models) {
+        model.url = mocks.front()->url();
+        model.replicas.clear();
+        for (std::size_t i = 1; i < mocks.size(); ++i) {
+            model.replicas.push_back(mocks[i]->url());
+        }
+        model.parallel = slots;
+    }
+    config.llamaServerUrl = mocks.front()->url();
+}
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        LOG_ERROR << "usage: loadtest [--config PATH] [--port N] [--rate R] [--duration S] [--users N] "
+                     "[--agents N] [--messages N] [--deadline-ms N] [--replicas N] [--slots N] [--prefill-ms X] "
+                     "[--decode-ms X] [--tokens N] [--embed-ms X] [--search-ms X] [--documents N] "
+                     "[--rate-limits] [--json] [--verbose]";
+        return 2;
+    }
+
+    Config config;
+    if (!options.configPath.empty() && !config.load(options.configPath)) {
+        LOG_ERROR << "[LoadTest] Could not load " << options.configPath;
+        return 2;
+    }
+    config.serverPort = options.port;
+    config.jobsEnabled = false;
+    config.persistSlotStates = false;
+    config.embeddingCachePath.clear();
+    config.tracingExportPath.clear();
+    config.rateLimits.enabled = options.rateLimits;
+    if (!options.verbose) {
+        config.logging.level = LogLevel::Warn;
+    }
+    Logger::instance().start(config.logging);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    int status = 0;
+    try {
+        std::vector<std::unique_ptr<MockLlamaServer>> mocks;
+        for (int i = 0; i < options.replicas; ++i) {
+            mocks.push_back(std::make_unique<MockLlamaServer>(0, options.timings));
+            mocks.back()->start();
+        }
+        pointModelsAt(config, mocks, options.timings.slots);
+
+        options.corpus.modelName = config.defaultModel;
+        options.corpus.dimensions = options.timings.embeddingDimensions;
+        auto store = std::make_unique<FakeDatabase>(options.corpus);
+        FakeDatabase* database = store.get();
+        AgentManager agentManager(config, std::move(store));
+        HTTPServer server(config.serverPort, agentManager, config);
+        server.start();
+
+        // Open loop: arrivals follow the schedule whether or not earlier
+        // requests have finished
+        const std::vector<std::string> messages = questions(options.messages);
+        const std::string url = "http://127.0.0.1:" + std::to_string(config.serverPort) + "/agent/chat";
+        std::mt19937_64 rng(42);
+        std::exponential_distribution<double> gap(options.rate);
+        std::uniform_int_distribution<int> user(2, options.users + 1);  // 0 and 1 are system accounts
+        std::uniform_int_distribution<int> agent(1, options.agents);
+        std::uniform_int_distribution<int> message(0, options.messages - 1);
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "";
+
+        OpenLoopClient client;
+        const auto start = Clock::now();
+        const auto end = start + std::chrono::microseconds(static_cast<long long>(options.duration * 1e6));
+        auto next = start;
+        int sent = 0;
+        while (next < end) {
+            std::this_thread::sleep_until(next);
+            Json::Value request;
+            request["userId"] = user(rng);
+            request["agentId"] = agent(rng);
+            request["message"] = messages[static_cast<std::size_t>(message(rng))];
+            client.send("POST", url, Json::writeString(writer, request),
+                        static_cast<std::uint32_t>(options.deadlineMs), next);
+            sent++;
+            next += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap(rng)));
+        }
+        client.wait();
+        server.stop();
+
+        std::map<long, int> byStatus;
+        std::vector<double> latencies;
+        for (const OpenLoopSample& sample : client.samples()) {
+            byStatus[sample.status]++;
+            if (sample.status == 200) {
+                latencies.push_back(sample.latencyMs);
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        const double elapsed = std::chrono::duration<double>(
+            std::max(client.lastCompletion(), end) - start).count();
+        const double throughput = static_cast<double>(latencies.size()) / elapsed;
+        long completions = 0;
+        for (const auto& mock : mocks) {
+            completions += mock->completions();
+        }
+
+        if (options.json) {
+            Json::Value report;
+            report["offered_rate"] = options.rate;
+            report["duration_s"] = options.duration;
+            report["sent"] = sent;
+            for (const auto& [code, count] : byStatus) {
+                report["status"][std::to_string(code)] = count;
+            }
+            report["throughput_rps"] = throughput;
+            report["latency_ms"]["p50"] = percentile(latencies, 0.50);
+            report["latency_ms"]["p95"] = percentile(latencies, 0.95);
+            report["latency_ms"]["p99"] = percentile(latencies, 0.99);
+            report["latency_ms"]["max"] = latencies.empty() ? 0.0 : latencies.back();
+            report["llama_completions"] = static_cast<Json::Int64>(completions);
+            report["memories_stored"] = static_cast<Json::Int64>(database->memoriesStored());
+            Json::StreamWriterBuilder pretty;
+            std::cout << Json::writeString(pretty, report) << std::endl;
+        } else {
+            std::cout << std::fixed << std::setprecision(1)
+                      << "offered      " << options.rate << " req/s for " << options.duration << " s (" << sent
+                      << " requests)\n"
+                      << "status      ";
+            for (const auto& [code, count] : byStatus) {
+                std::cout << " " << (code == 0 ? std::string("error") : std::to_string(code)) << "=" << count;
+            }
+            std::cout << "\n"
+                      << std::setprecision(2) << "throughput   " << throughput << " req/s (200s)\n"
+                      << std::setprecision(1) << "latency ms   p50 " << percentile(latencies, 0.50) << "  p95 "
+                      << percentile(latencies, 0.95) << "  p99 " << percentile(latencies, 0.99) << "  max "
+                      << (latencies.empty() ? 0.0 : latencies.back()) << "\n"
+                      << "llama-server " << completions << " completions on " << mocks.size() << " mock replica(s)\n";
+        }
+        if (latencies.empty()) {
+            status = 1;
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR << "[LoadTest] " << e.what();
+        status = 1;
+    }
+
+    Logger::instance().stop();
+    return status;
+}
@@ -0,0 +1,403 @@
+#include "mock_llama_server.h"
+#include "../include/hashing.h"
+#include "../include/http_server.h"
+#include "../include/logger.h"
+#include "../include/token_counter.h"
+#include <jsoncpp/json/json.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::size_t kBytesPerToken = 4;  // TokenCounter::estimate
+
+const char* const kReplyWords[] = {"Plants", "use", "sunlight", "to", "turn", "water", "and", "carbon", "dioxide",
+                                   "into", "sugar", "and", "oxygen,", "which", "is", "why", "leaves", "face",
+                                   "the", "sun."};
+constexpr std::size_t kReplyWordCount = sizeof(kReplyWords) / sizeof(kReplyWords[0]);
+
+void sleepMs(double ms) {
+    if (ms > 0.0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long long>(ms * 1000.0)));
+    }
+}
+
+bool sendAll(int socket, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t n = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// Headers and a Content-Length body, answering Expect: 100-continue
+bool readRequest(int socket, std::string& request) {
+    char buffer[16384];
+    std::size_t headersEnd = std::string::npos;
+    bool continued = false;
+    while (true) {
+        if (headersEnd == std::string::npos) {
+            headersEnd = request.find("\r\n\r\n");
+        }
+        if (headersEnd != std::string::npos) {
+            if (!continued && !HTTPServer::headerValue(request, "Expect").empty()) {
+                continued = true;
+                if (!sendAll(socket, "HTTP/1.1 100 Continue\r\n\r\n")) {
+                    return false;
+                }
+            }
+            const std::string length = HTTPServer::headerValue(request, "Content-Length");
+            const std::size_t bodyBytes = length.empty() ? 0 : std::strtoul(length.c_str(), nullptr, 10);
+            if (request.size() >= headersEnd + 4 + bodyBytes) {
+                return true;
+            }
+        }
+        const ssize_t n = recv(socket, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            return false;
+        }
+        request.append(buffer, static_cast<std::size_t>(n));
+    }
+}
+
+std::size_t commonPrefix(const std::string& a, const std::string& b) {
+    const std::size_t n = std::min(a.size(), b.size());
+    return static_cast<std::size_t>(std::mismatch(a.begin(), a.begin() + n, b.begin()).first - a.begin());
+}
+
+Json::Value parseJson(const std::string& body) {
+    Json::Value value;
+    Json::CharReaderBuilder reader;
+    std::stringstream ss(body);
+    std::string errs;
+    if (!Json::parseFromStream(reader, ss, &value, &errs)) {
+        throw std::invalid_argument("Invalid JSON: " + errs);
+    }
+    return value;
+}
+
+std::string writeJson(const Json::Value& value) {
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, value);
+}
+
+Json::Value vectorJson(const std::vector<float>& vector) {
+    Json::Value values(Json::arrayValue);
+    for (float v : vector) {
+        values.append(v);
+    }
+    return values;
+}
+}
+
+std::vector<float> mockEmbedding(const std::string& text, int dimensions) {
+    std::vector<float> vector(static_cast<std::size_t>(std::max(1, dimensions)), 0.0f);
+    std::string word;
+    auto addWord = [&]() {
+        if (word.empty()) {
+            return;
+        }
+        const Hash128 h = hash128(word);
+        vector[h.lo % vector.size()] += 1.0f;
+        vector[h.hi % vector.size()] += 0.5f;
+        word.clear();
+    };
+    for (char c : text) {
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+            word += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        } else {
+            addWord();
+        }
+    }
+    addWord();
+
+    float norm = 0.0f;
+    for (float v : vector) {
+        norm += v * v;
+    }
+    if (norm == 0.0f) {
+        vector[0] = 1.0f;
+        return vector;
+    }
+    norm = std::sqrt(norm);
+    for (float& v : vector) {
+        v /= norm;
+    }
+    return vector;
+}
+
+MockLlamaServer::MockLlamaServer(int port, const MockLlamaTimings& timings)
+    : port_(port),
+      timings_(timings),
+      slotBusy_(static_cast<std::size_t>(std::max(1, timings.slots)), false),
+      slotPrompts_(static_cast<std::size_t>(std::max(1, timings.slots))) {}
+
+MockLlamaServer::~MockLlamaServer() {
+    stop();
+}
+
+void MockLlamaServer::start() {
+    serverSocket_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (serverSocket_ < 0) {
+        throw std::runtime_error("Failed to create socket");
+    }
+    int opt = 1;
+    setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port_));
+    if (bind(serverSocket_, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(serverSocket_, 512) < 0) {
+        close(serverSocket_);
+        serverSocket_ = -1;
+        throw std::runtime_error("Mock llama-server failed to listen on port " + std::to_string(port_));
+    }
+    if (port_ == 0) {
+        socklen_t length = sizeof(address);
+        getsockname(serverSocket_, reinterpret_cast<struct sockaddr*>(&address), &length);
+        port_ = ntohs(address.sin_port);
+    }
+
+    running_ = true;
+    acceptThread_ = std::thread(&MockLlamaServer::acceptLoop, this);
+    LOG_INFO << "[MockLlamaServer] Listening on " << url() << " (" << timings_.slots << " slots)";
+}
+
+void MockLlamaServer::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    shutdown(serverSocket_, SHUT_RDWR);
+    close(serverSocket_);
+    serverSocket_ = -1;
+    if (acceptThread_.joinable()) {
+        acceptThread_.join();
+    }
+    std::unique_lock<std::mutex> lock(connectionsMutex_);
+    connectionsDone_.wait(lock, [this] { return connections_ == 0; });
+}
+
+void MockLlamaServer::acceptLoop() {
+    while (running_) {
+        const int clientSocket = accept(serverSocket_, nullptr, nullptr);
+        if (clientSocket < 0) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex_);
+            ++connections_;
+        }
+        std::thread([this, clientSocket] {
+            handle(clientSocket);
+            close(clientSocket);
+            std::lock_guard<std::mutex> lock(connectionsMutex_);
+            if (--connections_ == 0) {
+                connectionsDone_.notify_all();
+            }
+        }).detach();
+    }
+}
+
+void MockLlamaServer::handle(int clientSocket) {
+    std::string request;
+    if (!readRequest(clientSocket, request)) {
+        return;
+    }
+    std::string method, path;
+    const std::string body = HTTPServer::parseHTTPRequest(request, method, path);
+
+    std::string response;
+    try {
+        if (path == "/completion" && method == "POST") {
+            bool streamed = false;
+            response = completion(clientSocket, body, streamed);
+            if (streamed) {
+                return;
+            }
+        } else if (path == "/embedding" && method == "POST") {
+            response = embedding(body);
+        } else if (path == "/tokenize" && method == "POST") {
+            response = tokenize(body);
+        } else if (path.rfind("/slots/", 0) == 0 && method == "POST") {
+            response = HTTPServer::createHTTPResponse(200, "{\"id_slot\":" + path.substr(7, path.find('?') - 7) + "}");
+        } else if (path == "/health") {
+            response = HTTPServer::createHTTPResponse(200, "{\"status\":\"ok\"}");
+        } else {
+            response = HTTPServer::createHTTPResponse(404, "{\"error\":{\"code\":404,\"message\":\"File Not Found\"}}");
+        }
+    } catch (const std::invalid_argument& e) {
+        Json::Value error;
+        error["error"]["code"] = 400;
+        error["error"]["message"] = e.what();
+        response = HTTPServer::createHTTPResponse(400, writeJson(error));
+    }
+    sendAll(clientSocket, response);
+}
+
+int MockLlamaServer::acquireSlot(int requested, const std::string& prompt, std::size_t& cachedBytes) {
+    std::unique_lock<std::mutex> lock(slotMutex_);
+    const int slots = static_cast<int>(slotBusy_.size());
+    if (requested >= slots) {
+        requested = -1;
+    }
+    int slot = -1;
+    slotFreed_.wait(lock, [&] {
+        if (requested >= 0) {
+            slot = slotBusy_[static_cast<std::size_t>(requested)] ? -1 : requested;
+            return slot >= 0;
+        }
+        std::size_t best = 0;
+        for (int i = 0; i < slots; ++i) {
+            if (slotBusy_[static_cast<std::size_t>(i)]) {
+                continue;
+            }
+            const std::size_t common = commonPrefix(slotPrompts_[static_cast<std::size_t>(i)], prompt);
+            if (slot < 0 || common > best) {
+                slot = i;
+                best = common;
+            }
+        }
+        return slot >= 0;
+    });
+    slotBusy_[static_cast<std::size_t>(slot)] = true;
+    cachedBytes = commonPrefix(slotPrompts_[static_cast<std::size_t>(slot)], prompt);
+    return slot;
+}
+
+void MockLlamaServer::releaseSlot(int slot, const std::string& prompt) {
+    {
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        slotBusy_[static_cast<std::size_t>(slot)] = false;
+        slotPrompts_[static_cast<std::size_t>(slot)] = prompt;
+    }
+    slotFreed_.notify_all();
+}
+
+std::string MockLlamaServer::completion(int clientSocket, const std::string& body, bool& streamed) {
+    const Json::Value request = parseJson(body);
+    const std::string prompt = request.get("prompt", "").asString();
+    const int nPredict = request.get("n_predict", -1).asInt();
+    const bool stream = request.get("stream", false).asBool();
+    const int tokens = nPredict >= 0 ? std::min(nPredict, timings_.completionTokens) : timings_.completionTokens;
+
+    std::size_t cachedBytes = 0;
+    const int slot = acquireSlot(request.get("id_slot", -1).asInt(), prompt, cachedBytes);
+    if (!request.get("cache_prompt", false).asBool()) {
+        cachedBytes = 0;
+    }
+    const int promptTokens = TokenCounter::estimate(prompt);
+    const int cachedTokens = std::min(promptTokens, static_cast<int>(cachedBytes / kBytesPerToken));
+    const double prefillMs = (promptTokens - cachedTokens) * timings_.prefillMsPerToken;
+    sleepMs(prefillMs);
+
+    std::string content;
+    int produced = 0;
+    streamed = stream;
+    if (stream) {
+        // Server-sent events, one per token; a client that hangs up (a
+        // preempted batch generation) ends the completion early
+        bool connected = sendAll(clientSocket,
+                                 "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nConnection: close\r\n\r\n");
+        for (; connected && produced < tokens; ++produced) {
+            sleepMs(timings_.decodeMsPerToken);
+            const std::string piece = std::string(kReplyWords[produced % kReplyWordCount]) + " ";
+            Json::Value event;
+            event["content"] = piece;
+            event["stop"] = false;
+            connected = sendAll(clientSocket, "data: " + writeJson(event) + "\n\n");
+            content += piece;
+        }
+        if (!connected) {
+            releaseSlot(slot, prompt + content);
+            return "";
+        }
+    } else {
+        sleepMs(tokens * timings_.decodeMsPerToken);
+        for (produced = 0; produced < tokens; ++produced) {
+            content += std::string(kReplyWords[produced % kReplyWordCount]) + " ";
+        }
+    }
+    releaseSlot(slot, prompt + content);
+    completions_++;
+
+    Json::Value response;
+    response["content"] = stream ? "" : content;
+    response["stop"] = true;
+    response["id_slot"] = slot;
+    response["tokens_predicted"] = produced;
+    // As llama-server reports them: tokens_cached is n_past, the cache hit
+    // is timings.cache_n
+    response["tokens_evaluated"] = promptTokens;
+    response["tokens_cached"] = promptTokens + produced;
+    Json::Value& timings = response["timings"];
+    timings["cache_n"] = cachedTokens;
+    timings["prompt_n"] = promptTokens - cachedTokens;
+    timings["prompt_ms"] = prefillMs;
+    timings["predicted_n"] = produced;
+    timings["predicted_ms"] = produced * timings_.decodeMsPerToken;
+    timings["predicted_per_token_ms"] = timings_.decodeMsPerToken;
+
+    if (stream) {
+        sendAll(clientSocket, "data: " + writeJson(response) + "\n\n");
+        return "";
+    }
+    return HTTPServer::createHTTPResponse(200, writeJson(response));
+}
+
+std::string MockLlamaServer::embedding(const std::string& body) {
+    const Json::Value request = parseJson(body);
+    const Json::Value& content = request["content"];
+    if (content.isArray()) {
+        // Batch: [{index, embedding}, ...]
+        sleepMs(content.size() * timings_.embeddingMs);
+        Json::Value items(Json::arrayValue);
+        for (Json::ArrayIndex i = 0; i < content.size(); ++i) {
+            Json::Value item;
+            item["index"] = i;
+            item["embedding"] = vectorJson(mockEmbedding(content[i].asString(), timings_.embeddingDimensions));
+            items.append(item);
+        }
+        return HTTPServer::createHTTPResponse(200, writeJson(items));
+    }
+    sleepMs(timings_.embeddingMs);
+    Json::Value response;
+    response["embedding"] = vectorJson(mockEmbedding(content.asString(), timings_.embeddingDimensions));
+    return HTTPServer::createHTTPResponse(200, writeJson(response));
+}
+
+std::string MockLlamaServer::tokenize(const std::string& body) {
+    const Json::Value request = parseJson(body);
+    const std::string text = request.get("content", "").asString();
+    const bool withPieces = request.get("with_pieces", false).asBool();
+
+    Json::Value tokens(Json::arrayValue);
+    for (std::size_t pos = 0; pos < text.size(); pos += kBytesPerToken) {
+        const int id = static_cast<int>(pos / kBytesPerToken);
+        if (withPieces) {
+            Json::Value token;
+            token["id"] = id;
+            token["piece"] = text.substr(pos, kBytesPerToken);
+            tokens.append(token);
+        } else {
+            tokens.append(id);
+        }
+    }
+    Json::Value response;
+    response["tokens"] = tokens;
+    return HTTPServer::createHTTPResponse(200, writeJson(response));
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Timing model of a llama-server process: `slots` completions run at once
+// (more queue for a slot), each sleeping prefill for the prompt tokens its
+// slot has not cached and then decode per generated token.
+struct MockLlamaTimings {
+    int slots = 2;
+    double prefillMsPerToken = 0.5;
+    double decodeMsPerToken = 20.0;
+    int completionTokens = 64;  // generated per completion unless n_predict is lower
+    double embeddingMs = 5.0;   // per text embedded
+    int embeddingDimensions = 384;
+};
+
+// Deterministic bag-of-words vector: words are hashed into dimensions and
+// the result normalized, so texts sharing words are close under cosine.
+std::vector<float> mockEmbedding(const std::string& text, int dimensions);
+
+// In-process stand-in for llama-server on 127.0.0.1:port, speaking the parts
+// of its HTTP API that LlamaCppClient uses: /completion (plain and streamed),
+// /embedding (single and batch), /tokenize, /slots and /health. Tokens are
+// TokenCounter::estimate's four bytes each. One thread per connection;
+// every response closes its connection.
+class MockLlamaServer {
+public:
+    MockLlamaServer(int port, const MockLlamaTimings& timings);
+    ~MockLlamaServer();
+
+    void start();
+    void stop();
+    int port() const { return port_; }
+    std::string url() const { return "http://127.0.0.1:" + std::to_string(port_); }
+    long completions() const { return completions_.load(); }
+
+private:
+    int port_;
+    MockLlamaTimings timings_;
+    int serverSocket_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread acceptThread_;
+
+    // Connections still being answered; stop() waits for them
+    std::mutex connectionsMutex_;
+    std::condition_variable connectionsDone_;
+    int connections_ = 0;
+
+    // Slots and the prompt each one last processed (its KV cache)
+    std::mutex slotMutex_;
+    std::condition_variable slotFreed_;
+    std::vector<bool> slotBusy_;
+    std::vector<std::string> slotPrompts_;
+    std::atomic<long> completions_{0};
+
+    void acceptLoop();
+    void handle(int clientSocket);
+    // Slot `requested` or, for -1, the free slot sharing the longest prefix
+    // with `prompt`; blocks while none is free
+    int acquireSlot(int requested, const std::string& prompt, std::size_t& cachedBytes);
+    void releaseSlot(int slot, const std::string& prompt);
+
+    std::string completion(int clientSocket, const std::string& body, bool& streamed);
+    std::string embedding(const std::string& body);
+    std::string tokenize(const std::string& body);
+};
@@ -0,0 +1,70 @@
+#include "open_loop_client.h"
+#include <curl/curl.h>
+#include <algorithm>
+#include <thread>
+
+namespace {
+std::size_t discardBody(char*, std::size_t size, std::size_t nmemb, void*) {
+    return size * nmemb;
+}
+}
+
+void OpenLoopClient::send(const std::string& method, const std::string& url, const std::string& body,
+                          std::uint32_t deadlineMs, Clock::time_point scheduled, std::size_t tag) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        outstanding_++;
+    }
+    std::thread(&OpenLoopClient::perform, this, method, url, body, deadlineMs, scheduled, tag).detach();
+}
+
+void OpenLoopClient::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&] { return outstanding_ == 0; });
+}
+
+void OpenLoopClient::perform(std::string method, std::string url, std::string body, std::uint32_t deadlineMs,
+                             Clock::time_point scheduled, std::size_t tag) {
+    long status = 0;
+    CURL* curl = curl_easy_init();
+    if (curl) {
+        struct curl_slist* headers = nullptr;
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        if (method == "POST" || method == "PUT") {
+            headers = curl_slist_append(headers, "Content-Type: application/json");
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(body.size()));
+        }
+        if (method != "GET" && method != "POST") {
+            curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
+        }
+        if (deadlineMs > 0) {
+            headers = curl_slist_append(headers, ("X-Request-Deadline: " + std::to_string(deadlineMs)).c_str());
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discardBody);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 600L);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        if (curl_easy_perform(curl) == CURLE_OK) {
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        }
+        curl_slist_free_all(headers);
+        curl_easy_cleanup(curl);
+    }
+
+    const auto finished = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples_.push_back({status, std::chrono::duration<double, std::milli>(finished - scheduled).count(), tag});
+    lastCompletion_ = std::max(lastCompletion_, finished);
+    if (--outstanding_ == 0) {
+        done_.notify_all();
+    }
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const std::size_t rank = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
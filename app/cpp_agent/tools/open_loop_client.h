@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct OpenLoopSample {
+    long status;  // HTTP status, 0 when the request failed below HTTP
+    double latencyMs;  // from the scheduled send time
+    std::size_t tag;   // caller's index for the request
+};
+
+// Open-loop HTTP driver shared by loadtest and replay: each request runs on
+// its own detached thread from the moment it is sent, so arrivals follow the
+// caller's schedule whether or not earlier requests have finished. Latency
+// is measured from the scheduled time, so time spent waiting behind an
+// overloaded service is counted rather than hidden.
+class OpenLoopClient {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Sends a JSON body for POST and PUT, none otherwise; deadlineMs > 0 adds
+    // X-Request-Deadline
+    void send(const std::string& method, const std::string& url, const std::string& body,
+              std::uint32_t deadlineMs, Clock::time_point scheduled, std::size_t tag = 0);
+    // Blocks until every request sent so far has completed
+    void wait();
+
+    // Valid after wait()
+    const std::vector<OpenLoopSample>& samples() const { return samples_; }
+    Clock::time_point lastCompletion() const { return lastCompletion_; }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable done_;
+    std::vector<OpenLoopSample> samples_;
+    int outstanding_ = 0;
+    Clock::time_point lastCompletion_;
+
+    void perform(std::string method, std::string url, std::string body, std::uint32_t deadlineMs,
+                 Clock::time_point scheduled, std::size_t tag);
+};
+
+// Nearest-rank percentile of ascending `sorted`, 0 when empty
+double percentile(const std::vector<double>& sorted, double p);
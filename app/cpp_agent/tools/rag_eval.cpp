@@ -0,0 +1,522 @@
+// rag_eval: measures what a vector search mode costs in retrieval quality
+// and speed. Loads the stored chunk vectors (or a synthetic corpus), computes
+// exact top-k ground truth by brute force, then runs each mode over the same
+// queries and reports recall@k, nDCG@k, QPS, p99 latency and memory.
+//
+//   rag_eval [--config PATH | --synthetic N] [--table NAME] [--queries FILE]
+//            [--sample-queries N] [--noise X] [--k N] [--modes LIST]
+//            [--ef LIST] [--rerank LIST] [--json]
+//
+// Modes:
+//   exact    fp32 scan in process, the ground truth itself (latency baseline)
+//   int8     scan over per-vector scaled int8 copies, the best k * rerank
+//            rescored in fp32; swept over --rerank (default 1,4)
+//   mariadb  Database::vectorSearch through the HNSW vector index, swept over
+//            mhnsw_ef_search (--ef, default 10,20,40,80,160); needs --config
+//            and searches content_embeddings, so it rejects another --table
+//
+// Queries are the lines of --queries, embedded with the default model's
+// llama-server (or mockEmbedding for a synthetic corpus); without a file,
+// --sample-queries stored vectors (default 200) are perturbed by --noise
+// (default 0.1, relative) so they are near, but not on, a stored chunk.
+// nDCG gains are the exact cosine similarities of the returned chunks, so a
+// miss that returns a near tie costs little. Searches run one at a time;
+// QPS is single-threaded.
+
+#include "fake_database.h"
+#include "mock_llama_server.h"
+#include "open_loop_client.h"
+#include "../include/config.h"
+#include "../include/database.h"
+#include "../include/llamacpp_client.h"
+#include "../include/logger.h"
+#include <jsoncpp/json/json.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string configPath;
+    int synthetic = 0;  // documents in a synthetic corpus; 0 reads the database
+    std::string table = "content_embeddings";
+    std::string queriesPath;
+    int sampleQueries = 200;
+    double noise = 0.1;
+    int k = 10;
+    std::vector<std::string> modes = {"exact", "int8", "mariadb"};
+    std::vector<int> efSearch = {10, 20, 40, 80, 160};
+    std::vector<int> rerank = {1, 4};
+    bool json = false;
+};
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+std::vector<int> intList(const std::string& list) {
+    std::vector<int> values;
+    for (const std::string& item : splitList(list)) {
+        values.push_back(std::atoi(item.c_str()));
+    }
+    return values;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--config") options.configPath = value();
+        else if (arg == "--synthetic") options.synthetic = std::atoi(value().c_str());
+        else if (arg == "--table") options.table = value();
+        else if (arg == "--queries") options.queriesPath = value();
+        else if (arg == "--sample-queries") options.sampleQueries = std::atoi(value().c_str());
+        else if (arg == "--noise") options.noise = std::atof(value().c_str());
+        else if (arg == "--k") options.k = std::atoi(value().c_str());
+        else if (arg == "--modes") options.modes = splitList(value());
+        else if (arg == "--ef") options.efSearch = intList(value());
+        else if (arg == "--rerank") options.rerank = intList(value());
+        else if (arg == "--json") options.json = true;
+        else return false;
+    }
+    if (options.configPath.empty() && options.synthetic == 0) {
+        options.synthetic = 2000;
+    }
+    auto positive = [](const std::vector<int>& values) {
+        return std::all_of(values.begin(), values.end(), [](int v) { return v > 0; });
+    };
+    return options.k > 0 && options.sampleQueries > 0 && options.noise >= 0.0 && options.synthetic >= 0 &&
+           positive(options.efSearch) && positive(options.rerank);
+}
+
+// Row-major unit vectors, so cosine similarity is a dot product
+struct Corpus {
+    int dimensions = 0;
+    std::vector<float> vectors;
+    std::vector<std::uint64_t> keys;  // content id << 32 | chunk index
+    std::unordered_map<std::uint64_t, std::size_t> rowOf;
+
+    std::size_t size() const { return keys.size(); }
+    const float* row(std::size_t i) const { return vectors.data() + i * static_cast<std::size_t>(dimensions); }
+};
+
+std::uint64_t chunkKey(int contentId, int chunkIndex) {
+    return static_cast<std::uint64_t>(static_cast<std::uint32_t>(contentId)) << 32 |
+           static_cast<std::uint32_t>(chunkIndex);
+}
+
+bool normalize(std::vector<float>& v) {
+    double norm = 0.0;
+    for (float x : v) norm += static_cast<double>(x) * x;
+    if (norm <= 0.0) return false;
+    const float scale = static_cast<float>(1.0 / std::sqrt(norm));
+    for (float& x : v) x *= scale;
+    return true;
+}
+
+Corpus loadCorpus(Database& database, const std::string& table) {
+    Corpus corpus;
+    for (EmbeddingRow& row : database.getStoredEmbeddings(table)) {
+        if (corpus.dimensions == 0) {
+            corpus.dimensions = static_cast<int>(row.embedding.size());
+        }
+        if (static_cast<int>(row.embedding.size()) != corpus.dimensions || !normalize(row.embedding)) {
+            continue;
+        }
+        const std::uint64_t key = chunkKey(row.contentId, row.chunkIndex);
+        if (!corpus.rowOf.emplace(key, corpus.keys.size()).second) {
+            continue;  // same chunk under another model; vectorSearch may return either
+        }
+        corpus.keys.push_back(key);
+        corpus.vectors.insert(corpus.vectors.end(), row.embedding.begin(), row.embedding.end());
+    }
+    return corpus;
+}
+
+float dot(const float* a, const float* b, int n) {
+    float sum = 0.0f;
+    for (int i = 0; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+using Scored = std::pair<float, std::size_t>;  // similarity, corpus row
+
+void keepBest(std::vector<Scored>& scored, std::size_t k) {
+    k = std::min(k, scored.size());
+    std::partial_sort(scored.begin(), scored.begin() + static_cast<std::ptrdiff_t>(k), scored.end(),
+                      [](const Scored& a, const Scored& b) { return a.first > b.first; });
+    scored.resize(k);
+}
+
+std::vector<std::size_t> exactSearch(const Corpus& corpus, const std::vector<float>& query, int k) {
+    std::vector<Scored> scored(corpus.size());
+    for (std::size_t i = 0; i < corpus.size(); ++i) {
+        scored[i] = {dot(query.data(), corpus.row(i), corpus.dimensions), i};
+    }
+    keepBest(scored, static_cast<std::size_t>(k));
+    std::vector<std::size_t> rows;
+    for (const Scored& s : scored) rows.push_back(s.second);
+    return rows;
+}
+
+// Symmetric per-vector int8: x ~ scale * q with q in [-127, 127]
+struct Int8Index {
+    int dimensions = 0;
+    std::vector<std::int8_t> codes;
+    std::vector<float> scales;
+
+    static float quantize(const float* v, int n, std::int8_t* out) {
+        float peak = 0.0f;
+        for (int i = 0; i < n; ++i) peak = std::max(peak, std::fabs(v[i]));
+        const float scale = peak > 0.0f ? peak / 127.0f : 1.0f;
+        for (int i = 0; i < n; ++i) {
+            out[i] = static_cast<std::int8_t>(std::lround(v[i] / scale));
+        }
+        return scale;
+    }
+
+    explicit Int8Index(const Corpus& corpus)
+        : dimensions(corpus.dimensions), codes(corpus.vectors.size()), scales(corpus.size()) {
+        for (std::size_t i = 0; i < corpus.size(); ++i) {
+            scales[i] = quantize(corpus.row(i), dimensions, codes.data() + i * static_cast<std::size_t>(dimensions));
+        }
+    }
+
+    std::size_t bytes() const { return codes.size() + scales.size() * sizeof(float); }
+
+    std::vector<std::size_t> search(const Corpus& corpus, const std::vector<float>& query, int k, int rerank) const {
+        std::vector<std::int8_t> q(static_cast<std::size_t>(dimensions));
+        const float queryScale = quantize(query.data(), dimensions, q.data());
+        std::vector<Scored> scored(scales.size());
+        for (std::size_t i = 0; i < scales.size(); ++i) {
+            const std::int8_t* code = codes.data() + i * static_cast<std::size_t>(dimensions);
+            std::int32_t sum = 0;
+            for (int d = 0; d < dimensions; ++d) sum += static_cast<std::int32_t>(q[d]) * code[d];
+            scored[i] = {static_cast<float>(sum) * queryScale * scales[i], i};
+        }
+        keepBest(scored, static_cast<std::size_t>(k) * static_cast<std::size_t>(rerank));
+        if (rerank > 1) {
+            for (Scored& s : scored) s.first = dot(query.data(), corpus.row(s.second), dimensions);
+            keepBest(scored, static_cast<std::size_t>(k));
+        }
+        std::vector<std::size_t> rows;
+        for (const Scored& s : scored) rows.push_back(s.second);
+        return rows;
+    }
+};
+
+struct ModeResult {
+    std::string name;
+    double recall = 0.0;
+    double ndcg = 0.0;
+    double qps = 0.0;
+    double p50Ms = 0.0;
+    double p99Ms = 0.0;
+    long long memoryBytes = -1;  // -1 when not known (the database's index)
+};
+
+class Evaluator {
+public:
+    Evaluator(const Corpus& corpus, const std::vector<std::vector<float>>& queries, int k)
+        : corpus_(corpus), queries_(queries), k_(k) {
+        for (const auto& query : queries_) {
+            truth_.push_back(exactSearch(corpus_, query, k_));
+        }
+    }
+
+    // `search` returns corpus rows, best first; rows < 0 are chunks missing from the corpus
+    template <typename Search>
+    ModeResult run(const std::string& name, long long memoryBytes, Search search) const {
+        ModeResult result;
+        result.name = name;
+        result.memoryBytes = memoryBytes;
+        std::vector<double> latencies;
+        double seconds = 0.0;
+        for (std::size_t q = 0; q < queries_.size(); ++q) {
+            const auto started = Clock::now();
+            const std::vector<long long> rows = search(queries_[q]);
+            const double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+            seconds += elapsed;
+            latencies.push_back(elapsed * 1000.0);
+            result.recall += recall(truth_[q], rows);
+            result.ndcg += ndcg(queries_[q], truth_[q], rows);
+        }
+        const double n = static_cast<double>(queries_.size());
+        result.recall /= n;
+        result.ndcg /= n;
+        result.qps = seconds > 0.0 ? n / seconds : 0.0;
+        std::sort(latencies.begin(), latencies.end());
+        result.p50Ms = percentile(latencies, 0.50);
+        result.p99Ms = percentile(latencies, 0.99);
+        return result;
+    }
+
+private:
+    const Corpus& corpus_;
+    const std::vector<std::vector<float>>& queries_;
+    int k_;
+    std::vector<std::vector<std::size_t>> truth_;
+
+    double recall(const std::vector<std::size_t>& truth, const std::vector<long long>& rows) const {
+        if (truth.empty()) return 1.0;
+        std::size_t hits = 0;
+        for (long long row : rows) {
+            if (row >= 0 && std::find(truth.begin(), truth.end(), static_cast<std::size_t>(row)) != truth.end()) {
+                hits++;
+            }
+        }
+        return static_cast<double>(hits) / static_cast<double>(truth.size());
+    }
+
+    double ndcg(const std::vector<float>& query, const std::vector<std::size_t>& truth,
+                const std::vector<long long>& rows) const {
+        auto gain = [&](std::size_t row) {
+            return std::max(0.0, static_cast<double>(dot(query.data(), corpus_.row(row), corpus_.dimensions)));
+        };
+        double ideal = 0.0;
+        for (std::size_t i = 0; i < truth.size(); ++i) ideal += gain(truth[i]) / std::log2(i + 2.0);
+        double actual = 0.0;
+        for (std::size_t i = 0; i < rows.size() && i < truth.size(); ++i) {
+            if (rows[i] >= 0) actual += gain(static_cast<std::size_t>(rows[i])) / std::log2(i + 2.0);
+        }
+        return ideal > 0.0 ? actual / ideal : 1.0;
+    }
+};
+
+std::vector<long long> toRows(const std::vector<std::size_t>& rows) {
+    return std::vector<long long>(rows.begin(), rows.end());
+}
+
+std::vector<std::string> readLines(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty()) lines.push_back(line);
+    }
+    return lines;
+}
+
+// Topic questions in varied wording, like a class asking about the synthetic lessons
+std::vector<std::string> syntheticQuestions(int count) {
+    std::vector<std::vector<std::string>> topicWords;
+    for (const std::string& topic : FakeDatabase::topics()) {
+        const std::size_t open = topic.find('(');
+        std::stringstream ss(topic.substr(open + 1, topic.size() - open - 2));
+        std::vector<std::string> words;
+        std::string word;
+        while (ss >> word) words.push_back(word);
+        topicWords.push_back(words);
+    }
+    static const char* const kOpeners[] = {"why do", "how are", "what happens to", "can you explain",
+                                           "what is the link between"};
+    std::mt19937 rng(7);
+    std::vector<std::string> questions;
+    for (int i = 0; i < count; ++i) {
+        const auto& words = topicWords[rng() % topicWords.size()];
+        questions.push_back(std::string(kOpeners[rng() % 5]) + " " + words[rng() % words.size()] + " and " +
+                            words[rng() % words.size()] + " " + words[rng() % words.size()] + "?");
+    }
+    return questions;
+}
+
+std::vector<std::vector<float>> sampleQueries(const Corpus& corpus, int count, double noise) {
+    std::mt19937_64 rng(11);
+    std::uniform_int_distribution<std::size_t> pick(0, corpus.size() - 1);
+    // Per-component sigma so the perturbation has norm ~ noise
+    std::normal_distribution<float> jitter(0.0f, static_cast<float>(noise / std::sqrt(corpus.dimensions)));
+    std::vector<std::vector<float>> queries;
+    for (int i = 0; i < count; ++i) {
+        const float* row = corpus.row(pick(rng));
+        std::vector<float> query(row, row + corpus.dimensions);
+        for (float& x : query) x += jitter(rng);
+        if (normalize(query)) queries.push_back(std::move(query));
+    }
+    return queries;
+}
+
+std::unique_ptr<LlamaCppClient> makeClient(const Config& config) {
+    auto it = config.models.find(config.defaultModel);
+    if (it == config.models.end()) {
+        return std::make_unique<LlamaCppClient>(config.llamaServerUrl, config.modelsBasePath + "/" + config.defaultModel,
+                                                config.maxContextLength, config.temperature);
+    }
+    const ModelConfig& mc = it->second;
+    return std::make_unique<LlamaCppClient>(mc.replicaUrls(), config.modelsBasePath + "/" + mc.file, mc.ctxSize,
+                                            config.temperature, mc.parallel, config.loadBalancing);
+}
+
+bool wants(const Options& options, const std::string& mode) {
+    return std::find(options.modes.begin(), options.modes.end(), mode) != options.modes.end();
+}
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        LOG_ERROR << "usage: rag_eval [--config PATH | --synthetic N] [--table NAME] [--queries FILE] "
+                     "[--sample-queries N] [--noise X] [--k N] [--modes exact,int8,mariadb] [--ef LIST] "
+                     "[--rerank LIST] [--json]";
+        return 2;
+    }
+
+    // Recall would be scored against another table's ground truth
+    if (wants(options, "mariadb") && options.synthetic == 0 && options.table != "content_embeddings") {
+        LOG_ERROR << "[RagEval] mariadb mode searches content_embeddings only; drop it from --modes to evaluate "
+                  << options.table;
+        return 2;
+    }
+
+    Config config;
+    if (!options.configPath.empty() && !config.load(options.configPath)) {
+        LOG_ERROR << "[RagEval] Could not load " << options.configPath;
+        return 2;
+    }
+    config.logging.level = LogLevel::Warn;
+    Logger::instance().start(config.logging);
+
+    int status = 0;
+    try {
+        std::unique_ptr<Database> database;
+        if (options.synthetic > 0) {
+            FakeCorpus fake;
+            fake.documents = options.synthetic;
+            fake.searchMs = 0.0;
+            fake.modelName = config.defaultModel;
+            database = std::make_unique<FakeDatabase>(fake);
+        } else {
+            database = std::make_unique<Database>(config.dbHost, config.dbPort, config.dbName, config.dbUser,
+                                                  config.dbPassword);
+        }
+        const auto loadStarted = Clock::now();
+        const Corpus corpus = loadCorpus(*database, options.table);
+        if (corpus.size() == 0) {
+            throw std::runtime_error("No embeddings in " + options.table);
+        }
+
+        std::vector<std::vector<float>> queries;
+        if (!options.queriesPath.empty() || options.synthetic > 0) {
+            const std::vector<std::string> texts = options.queriesPath.empty()
+                ? syntheticQuestions(options.sampleQueries) : readLines(options.queriesPath);
+            std::unique_ptr<LlamaCppClient> client = options.synthetic > 0 ? nullptr : makeClient(config);
+            for (const std::string& text : texts) {
+                std::vector<float> query = client ? client->embed(text, corpus.dimensions)
+                                                  : mockEmbedding(text, corpus.dimensions);
+                if (static_cast<int>(query.size()) == corpus.dimensions && normalize(query)) {
+                    queries.push_back(std::move(query));
+                }
+            }
+        } else {
+            queries = sampleQueries(corpus, options.sampleQueries, options.noise);
+        }
+        if (queries.empty()) {
+            throw std::runtime_error("No usable queries");
+        }
+
+        const Evaluator evaluator(corpus, queries, options.k);
+        const double loadSeconds = std::chrono::duration<double>(Clock::now() - loadStarted).count();
+        std::vector<ModeResult> results;
+        if (wants(options, "exact")) {
+            results.push_back(evaluator.run("exact", static_cast<long long>(corpus.vectors.size() * sizeof(float)),
+                                            [&](const std::vector<float>& query) {
+                                                return toRows(exactSearch(corpus, query, options.k));
+                                            }));
+        }
+        if (wants(options, "int8")) {
+            const Int8Index index(corpus);
+            for (int rerank : options.rerank) {
+                results.push_back(evaluator.run(
+                    "int8 rerank=" + std::to_string(rerank), static_cast<long long>(index.bytes()),
+                    [&](const std::vector<float>& query) {
+                        return toRows(index.search(corpus, query, options.k, rerank));
+                    }));
+            }
+        }
+        if (wants(options, "mariadb") && options.synthetic == 0) {
+            for (int ef : options.efSearch) {
+                database->setVectorIndexEfSearch(ef);
+                results.push_back(evaluator.run(
+                    "mariadb ef_search=" + std::to_string(ef), -1, [&](const std::vector<float>& query) {
+                        std::vector<long long> rows;
+                        for (const VectorSearchResult& hit : database->vectorSearch(query, options.k, "cosine")) {
+                            auto it = corpus.rowOf.find(chunkKey(hit.contentId, hit.chunkIndex));
+                            rows.push_back(it == corpus.rowOf.end() ? -1 : static_cast<long long>(it->second));
+                        }
+                        return rows;
+                    }));
+            }
+        }
+
+        if (options.json) {
+            Json::Value report;
+            report["corpus"] = options.synthetic > 0 ? "synthetic" : options.table;
+            report["chunks"] = static_cast<Json::Int64>(corpus.size());
+            report["dimensions"] = corpus.dimensions;
+            report["queries"] = static_cast<Json::Int64>(queries.size());
+            report["k"] = options.k;
+            for (const ModeResult& r : results) {
+                Json::Value mode;
+                mode["mode"] = r.name;
+                mode["recall"] = r.recall;
+                mode["ndcg"] = r.ndcg;
+                mode["qps"] = r.qps;
+                mode["latency_ms"]["p50"] = r.p50Ms;
+                mode["latency_ms"]["p99"] = r.p99Ms;
+                if (r.memoryBytes >= 0) {
+                    mode["memory_bytes"] = static_cast<Json::Int64>(r.memoryBytes);
+                }
+                report["modes"].append(mode);
+            }
+            Json::StreamWriterBuilder pretty;
+            std::cout << Json::writeString(pretty, report) << std::endl;
+        } else {
+            std::cout << (options.synthetic > 0 ? "synthetic corpus" : options.table) << ": " << corpus.size()
+                      << " chunks x " << corpus.dimensions << ", " << queries.size() << " queries, k=" << options.k
+                      << " (loaded with ground truth in " << std::fixed << std::setprecision(1) << loadSeconds
+                      << " s)\n"
+                      << std::left << std::setw(22) << "mode" << std::right << std::setw(9) << "recall"
+                      << std::setw(9) << "nDCG" << std::setw(10) << "QPS" << std::setw(10) << "p50 ms"
+                      << std::setw(10) << "p99 ms" << std::setw(12) << "memory MB" << "\n";
+            for (const ModeResult& r : results) {
+                std::cout << std::left << std::setw(22) << r.name << std::right << std::setprecision(4)
+                          << std::setw(9) << r.recall << std::setw(9) << r.ndcg << std::setprecision(1)
+                          << std::setw(10) << r.qps << std::setprecision(3) << std::setw(10) << r.p50Ms
+                          << std::setw(10) << r.p99Ms << std::setprecision(1) << std::setw(12);
+                if (r.memoryBytes < 0) {
+                    std::cout << "-";
+                } else {
+                    std::cout << static_cast<double>(r.memoryBytes) / (1024.0 * 1024.0);
+                }
+                std::cout << "\n";
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR << "[RagEval] " << e.what();
+        status = 1;
+    }
+
+    Logger::instance().stop();
+    return status;
+}
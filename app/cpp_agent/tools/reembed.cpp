@@ -0,0 +1,228 @@
+// reembed: rebuilds every chunk embedding into a shadow table and swaps it
+// in for content_embeddings when the whole corpus is done. Progress is
+// checkpointed per page in embedding_reembed_runs, so rerunning with the same
+// --run-id after a crash or Ctrl+C continues where it stopped. Before the
+// swap, documents that failed on their page and documents edited since the
+// run started are embedded again.
+//
+//   reembed [--config PATH] [--run-id ID] [--model NAME] [--table NAME]
+//           [--page-size N] [--share S] [--restart] [--no-swap] [--keep-old]
+//           [--allow-failures]
+//
+// --share caps the fraction of the embedding server's slots the run keeps
+// busy (default 0.5) so chat traffic on the same llama-server is not starved.
+// llama-server spreads the chunks of one /embedding request over its slots,
+// so the cap covers chunks in flight: workers times batch size, paced by the
+// ingestion duty cycle for the part of the share that is not a whole slot.
+
+#include "../include/config.h"
+#include "../include/database.h"
+#include "../include/ingestion_pipeline.h"
+#include "../include/llamacpp_client.h"
+#include "../include/logger.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+namespace {
+std::atomic<bool> stopRequested(false);
+
+void signalHandler(int) {
+    stopRequested = true;
+}
+
+struct Options {
+    std::string configPath;
+    std::string runId = "reembed";
+    std::string model;
+    std::string table = "content_embeddings_next";
+    int pageSize = 100;
+    double share = 0.5;
+    bool restart = false;
+    bool swap = true;
+    bool keepOld = false;
+    bool allowFailures = false;
+};
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--config") options.configPath = value();
+        else if (arg == "--run-id") options.runId = value();
+        else if (arg == "--model") options.model = value();
+        else if (arg == "--table") options.table = value();
+        else if (arg == "--page-size") options.pageSize = std::atoi(value().c_str());
+        else if (arg == "--share") options.share = std::atof(value().c_str());
+        else if (arg == "--restart") options.restart = true;
+        else if (arg == "--no-swap") options.swap = false;
+        else if (arg == "--keep-old") options.keepOld = true;
+        else if (arg == "--allow-failures") options.allowFailures = true;
+        else return false;
+    }
+    return !options.runId.empty() && options.pageSize > 0 && options.share > 0.0 && options.share <= 1.0;
+}
+
+std::unique_ptr<LlamaCppClient> makeClient(const Config& config, const std::string& model) {
+    auto it = config.models.find(model);
+    if (it == config.models.end()) {
+        LOG_WARN << "[Reembed] Model " << model << " is not configured, using " << config.llamaServerUrl;
+        return std::make_unique<LlamaCppClient>(config.llamaServerUrl, config.modelsBasePath + "/" + model,
+                                                config.maxContextLength, config.temperature);
+    }
+    const ModelConfig& mc = it->second;
+    return std::make_unique<LlamaCppClient>(mc.replicaUrls(), config.modelsBasePath + "/" + mc.file, mc.ctxSize,
+                                            config.temperature, mc.parallel, config.loadBalancing);
+}
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        LOG_ERROR << "usage: reembed [--config PATH] [--run-id ID] [--model NAME] [--table NAME] "
+                     "[--page-size N] [--share 0-1] [--restart] [--no-swap] [--keep-old] [--allow-failures]";
+        return 2;
+    }
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    Config config;
+    const bool loaded = options.configPath.empty()
+        ? config.load("/app/config.json") || config.load("config.json")
+        : config.load(options.configPath);
+    if (!loaded) {
+        LOG_WARN << "[Reembed] Could not load config, using defaults";
+    }
+    Logger::instance().start(config.logging);
+
+    int status = 0;
+    try {
+        const std::string model = options.model.empty() ? config.defaultModel : options.model;
+        std::unique_ptr<LlamaCppClient> client = makeClient(config, model);
+
+        // Whole slots of the share are enforced by concurrency: at most
+        // workers * batchSize chunks are in flight. The fraction of a slot left over
+        // (all of the share when it is under one slot) is enforced by the
+        // pipeline's duty cycle, workers resting between requests.
+        const int slots = static_cast<int>(client->replicas().size()) * client->replicas().at(0).slots->slots();
+        const double target = options.share * slots;
+        const int inFlight = std::max(1, static_cast<int>(std::floor(target)));
+        IngestionConfig ingestion = config.ingestion;
+        ingestion.batchSize = std::max(1, std::min(ingestion.batchSize, inFlight));
+        ingestion.workers = std::max(1, std::min(ingestion.workers, inFlight / ingestion.batchSize));
+        ingestion.backendShare = std::min(1.0, target / (ingestion.workers * ingestion.batchSize));
+
+        // Pages are read on their own connection so the pipeline's inserts
+        // never wait behind a streaming read.
+        Database reader(config.dbHost, config.dbPort, config.dbName, config.dbUser, config.dbPassword);
+        Database writer(config.dbHost, config.dbPort, config.dbName, config.dbUser, config.dbPassword);
+        IngestionPipeline pipeline(writer, *client, ingestion);
+
+        ReembedRun run;
+        const bool resuming = !options.restart && writer.getReembedRun(options.runId, run);
+        if (resuming && run.status == "completed") {
+            LOG_INFO << "[Reembed] Run " << run.id << " already completed; use --restart to run it again";
+            Logger::instance().stop();
+            return 0;
+        }
+        if (resuming) {
+            if (run.shadowTable != options.table) {
+                LOG_WARN << "[Reembed] Run " << run.id << " writes to " << run.shadowTable << ", continuing there";
+            }
+            LOG_INFO << "[Reembed] Resuming run " << run.id << " after content " << run.lastContentId << " ("
+                     << run.documents << " documents done)";
+        } else {
+            run = ReembedRun();
+            run.id = options.runId;
+            run.shadowTable = options.table;
+        }
+        run.status = "running";
+        run.error.clear();
+        writer.createShadowEmbeddingsTable(run.shadowTable, !resuming);
+        writer.saveReembedRun(run);
+        if (run.startedAt.empty()) {
+            writer.getReembedRun(run.id, run);  // for the start time the database stamped
+        }
+
+        IngestionOptions ingestOptions;
+        ingestOptions.table = run.shadowTable;
+        ingestOptions.markContent = false;  // counts are recomputed after the swap
+        ingestOptions.exclusiveTable = true;
+
+        LOG_INFO << "[Reembed] Embedding with " << model << " on " << ingestion.workers << " worker(s) of "
+                 << ingestion.batchSize << " chunks, busy " << logFixed(2) << ingestion.backendShare
+                 << " of the time (share " << options.share << " of " << slots << " slots), into "
+                 << run.shadowTable;
+        const auto start = std::chrono::steady_clock::now();
+        int documentsThisSession = 0;
+        int duplicatesThisSession = 0;
+        while (!stopRequested) {
+            std::vector<IndexableContent> page = reader.getContentPage(run.lastContentId, options.pageSize);
+            if (page.empty()) {
+                break;
+            }
+            const IngestionStats stats = pipeline.run(page, ingestOptions);
+            run.documents += stats.documents;
+            run.chunks += stats.chunks;
+            duplicatesThisSession += stats.duplicates;
+            run.failed += stats.failed;
+            run.lastContentId = page.back().contentId;
+            writer.saveReembedRun(run);
+
+            documentsThisSession += stats.documents;
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            LOG_INFO << "[Reembed] Checkpoint at content " << run.lastContentId << ": " << run.documents
+                     << " documents, " << run.chunks << " chunks, " << run.failed << " failed ("
+                     << duplicatesThisSession << " duplicate chunks collapsed this session, " << logFixed(1)
+                     << documentsThisSession / std::max(elapsed, 1e-3) << " docs/s)";
+        }
+
+        // Pages only move forward: documents that failed on theirs, including
+        // in an earlier session, and documents edited after theirs was read
+        // are redone here. Those still failing keep the run from swapping.
+        if (!stopRequested) {
+            std::vector<IndexableContent> stale =
+                reader.getContentToReembed(run.shadowTable, run.lastContentId, run.startedAt);
+            IngestionStats stats;
+            if (!stale.empty()) {
+                LOG_INFO << "[Reembed] Embedding " << stale.size()
+                         << " documents again (failed earlier or edited since the run started)";
+                stats = pipeline.run(stale, ingestOptions);
+                LOG_INFO << "[Reembed] " << stats.documents << " of them embedded, " << stats.failed << " failed";
+            }
+            run.failed = stats.failed;
+            writer.saveReembedRun(run);
+        }
+
+        if (stopRequested) {
+            LOG_INFO << "[Reembed] Interrupted; rerun with --run-id " << run.id << " to resume";
+            status = 130;
+        } else if (run.failed > 0 && !options.allowFailures) {
+            run.status = "failed";
+            run.error = std::to_string(run.failed) + " documents failed to embed; not swapped";
+            writer.saveReembedRun(run);
+            LOG_ERROR << "[Reembed] " << run.error << " (--allow-failures swaps anyway)";
+            status = 1;
+        } else if (!options.swap) {
+            LOG_INFO << "[Reembed] Done; " << run.shadowTable << " left in place (--no-swap)";
+        } else {
+            writer.swapEmbeddingsTable(run.shadowTable, options.keepOld);
+            writer.refreshEmbeddingCounts();
+            run.status = "completed";
+            writer.saveReembedRun(run);
+            LOG_INFO << "[Reembed] Swapped " << run.shadowTable << " in as content_embeddings (" << run.documents
+                     << " documents, " << run.chunks << " chunks)";
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR << "[Reembed] " << e.what();
+        status = 1;
+    }
+
+    Logger::instance().stop();
+    return status;
+}
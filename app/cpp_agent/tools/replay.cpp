@@ -0,0 +1,233 @@
+// replay: re-issues requests recorded by the service's traffic capture
+// (config "capture") against a running build, keeping their original
+// inter-arrival times, and reports latency by route next to what the
+// capture measured, so real classroom load shapes can be compared across
+// versions.
+//
+//   replay --capture FILE [--target URL] [--speed N] [--path P]...
+//          [--limit N] [--max-gap-s S] [--json]
+//
+// --speed 4 replays four times faster. Gaps longer than --max-gap-s (default
+// 60) are shortened to it, so captures spanning nights or restarts replay
+// without long idle stretches. --path keeps only requests to those paths.
+// Requests whose body was captured with payload "none" cannot be resent and
+// are skipped. Replayed chat requests store memories and POST /jobs creates
+// jobs on the target, so point it at a test deployment.
+//
+// Captured latency is measured by the server from reading the request to
+// sending the response; replayed latency by the client from each request's
+// scheduled time (open_loop_client.h), so a replay at --speed 1 against the
+// same build reads slightly higher.
+
+#include "open_loop_client.h"
+#include "../include/traffic_capture.h"
+#include <curl/curl.h>
+#include <jsoncpp/json/json.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string capturePath;
+    std::string target = "http://127.0.0.1:8080";
+    double speed = 1.0;
+    std::set<std::string> paths;  // empty replays every path
+    long limit = 0;               // 0 replays the whole capture
+    double maxGapS = 60.0;
+    bool json = false;
+};
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--capture") options.capturePath = value();
+        else if (arg == "--target") options.target = value();
+        else if (arg == "--speed") options.speed = std::atof(value().c_str());
+        else if (arg == "--path") options.paths.insert(value());
+        else if (arg == "--limit") options.limit = std::atol(value().c_str());
+        else if (arg == "--max-gap-s") options.maxGapS = std::atof(value().c_str());
+        else if (arg == "--json") options.json = true;
+        else return false;
+    }
+    while (!options.target.empty() && options.target.back() == '/') {
+        options.target.pop_back();
+    }
+    return !options.capturePath.empty() && !options.target.empty() && options.speed > 0.0 &&
+           options.maxGapS > 0.0 && options.limit >= 0;
+}
+
+// Route label as in the service's http_* metrics, so ids do not split routes
+std::string routeOf(const std::string& method, const std::string& fullPath) {
+    const std::string path = fullPath.substr(0, fullPath.find('?'));
+    if (path.rfind("/jobs/", 0) == 0) return method + " /jobs/{id}";
+    if (path.rfind("/agent/", 0) == 0 && path != "/agent/chat" && path != "/agent/list") {
+        return method + " /agent/{id}";
+    }
+    return method + " " + path;
+}
+
+struct RouteReport {
+    std::map<long, int> replayedStatus;
+    std::map<long, int> capturedStatus;
+    std::vector<double> replayedMs;  // 200s only, as in loadtest
+    std::vector<double> capturedMs;
+};
+
+Json::Value latencyJson(std::vector<double>& latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    Json::Value json;
+    json["p50"] = percentile(latencies, 0.50);
+    json["p95"] = percentile(latencies, 0.95);
+    json["p99"] = percentile(latencies, 0.99);
+    json["max"] = latencies.empty() ? 0.0 : latencies.back();
+    return json;
+}
+
+std::string statusText(const std::map<long, int>& byStatus) {
+    std::string text;
+    for (const auto& [code, count] : byStatus) {
+        text += " " + (code == 0 ? std::string("error") : std::to_string(code)) + "=" + std::to_string(count);
+    }
+    return text;
+}
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "usage: replay --capture FILE [--target URL] [--speed N] [--path P]... [--limit N] "
+                     "[--max-gap-s S] [--json]" << std::endl;
+        return 2;
+    }
+
+    // Load the selected records up front so reading the file never delays a send
+    std::vector<CapturedRequest> requests;
+    long skippedNoPayload = 0;
+    try {
+        CaptureReader reader(options.capturePath);
+        CapturedRequest request;
+        while (reader.next(request)) {
+            if (!options.paths.empty() && !options.paths.count(request.path.substr(0, request.path.find('?')))) {
+                continue;
+            }
+            if (request.payload == CapturePayload::None && request.bodyBytes > 0) {
+                skippedNoPayload++;
+                continue;
+            }
+            requests.push_back(std::move(request));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "replay: " << e.what() << std::endl;
+        return 2;
+    }
+    // Concurrent requests finish, and are recorded, out of arrival order
+    std::stable_sort(requests.begin(), requests.end(),
+                     [](const CapturedRequest& a, const CapturedRequest& b) { return a.arrivalUs < b.arrivalUs; });
+    if (options.limit > 0 && static_cast<long>(requests.size()) > options.limit) {
+        requests.resize(static_cast<std::size_t>(options.limit));
+    }
+    if (requests.empty()) {
+        std::cerr << "replay: no requests to replay in " << options.capturePath << std::endl;
+        return 1;
+    }
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    OpenLoopClient client;
+    const auto start = Clock::now();
+    double offsetS = 0.0;  // capture time from the first request, after gap capping
+    for (std::size_t i = 0; i < requests.size(); ++i) {
+        if (i > 0) {
+            const double gapS = static_cast<double>(requests[i].arrivalUs - requests[i - 1].arrivalUs) / 1e6;
+            offsetS += std::min(gapS, options.maxGapS);
+        }
+        const auto scheduled = start + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(offsetS / options.speed));
+        std::this_thread::sleep_until(scheduled);
+        const CapturedRequest& request = requests[i];
+        client.send(request.method, options.target + request.path, request.body, request.deadlineMs, scheduled, i);
+    }
+    const auto lastSend = Clock::now();
+    client.wait();
+    const double elapsed = std::chrono::duration<double>(std::max(client.lastCompletion(), lastSend) - start).count();
+
+    std::map<std::string, RouteReport> routes;
+    for (const CapturedRequest& request : requests) {
+        RouteReport& route = routes[routeOf(request.method, request.path)];
+        route.capturedStatus[request.status]++;
+        if (request.status == 200) {
+            route.capturedMs.push_back(request.durationUs / 1000.0);
+        }
+    }
+    long ok = 0;
+    for (const OpenLoopSample& sample : client.samples()) {
+        const CapturedRequest& request = requests[sample.tag];
+        RouteReport& route = routes[routeOf(request.method, request.path)];
+        route.replayedStatus[sample.status]++;
+        if (sample.status == 200) {
+            route.replayedMs.push_back(sample.latencyMs);
+            ok++;
+        }
+    }
+    const double captureSpanS = offsetS;
+
+    if (options.json) {
+        Json::Value report;
+        report["capture"] = options.capturePath;
+        report["target"] = options.target;
+        report["speed"] = options.speed;
+        report["requests"] = static_cast<Json::Int64>(requests.size());
+        report["skipped_no_payload"] = static_cast<Json::Int64>(skippedNoPayload);
+        report["capture_span_s"] = captureSpanS;
+        report["elapsed_s"] = elapsed;
+        report["throughput_rps"] = static_cast<double>(ok) / elapsed;
+        for (auto& [name, route] : routes) {
+            Json::Value& json = report["routes"][name];
+            for (const auto& [code, count] : route.replayedStatus) {
+                json["status"][std::to_string(code)] = count;
+            }
+            for (const auto& [code, count] : route.capturedStatus) {
+                json["captured_status"][std::to_string(code)] = count;
+            }
+            json["latency_ms"] = latencyJson(route.replayedMs);
+            json["captured_latency_ms"] = latencyJson(route.capturedMs);
+        }
+        Json::StreamWriterBuilder pretty;
+        std::cout << Json::writeString(pretty, report) << std::endl;
+    } else {
+        std::cout << std::fixed << std::setprecision(1)
+                  << "replayed     " << requests.size() << " requests from " << captureSpanS << " s of capture at "
+                  << options.speed << "x in " << elapsed << " s";
+        if (skippedNoPayload > 0) {
+            std::cout << " (" << skippedNoPayload << " skipped, no payload)";
+        }
+        std::cout << "\n" << std::setprecision(2) << "throughput   " << static_cast<double>(ok) / elapsed
+                  << " req/s (200s)\n";
+        for (auto& [name, route] : routes) {
+            const Json::Value replayed = latencyJson(route.replayedMs);
+            const Json::Value captured = latencyJson(route.capturedMs);
+            std::cout << std::setprecision(1) << name << "\n"
+                      << "  status    " << statusText(route.replayedStatus) << "   (captured"
+                      << statusText(route.capturedStatus) << ")\n";
+            for (const auto& [label, latency] : {std::make_pair("replayed", &replayed),
+                                                 std::make_pair("captured", &captured)}) {
+                std::cout << "  " << label << "   p50 " << (*latency)["p50"].asDouble() << "  p95 "
+                          << (*latency)["p95"].asDouble() << "  p99 " << (*latency)["p99"].asDouble() << "  max "
+                          << (*latency)["max"].asDouble() << " ms\n";
+            }
+        }
+    }
+
+    curl_global_cleanup();
+    return ok > 0 ? 0 : 1;
+}
@@ -0,0 +1,29 @@
+-- Migration 016: Generation Jobs
+-- Created: October 18, 2026
+-- Purpose: Persist long-running agent generations (lessons, question banks,
+-- course outlines) submitted through the agent service's POST /jobs, so they
+-- run outside the HTTP request and survive agent service restarts.
+
+CREATE TABLE IF NOT EXISTS generation_jobs (
+    job_id CHAR(32) NOT NULL PRIMARY KEY COMMENT 'Random hex id returned by POST /jobs',
+    status ENUM('queued', 'running', 'succeeded', 'failed') NOT NULL DEFAULT 'queued',
+    user_id INT NOT NULL,
+    agent_id INT NOT NULL,
+    message MEDIUMTEXT NOT NULL,
+    rag_context MEDIUMTEXT NULL,
+    result MEDIUMTEXT NULL,
+    error TEXT NULL,
+    attempts INT NOT NULL DEFAULT 0 COMMENT 'Times a worker picked the job up (restarts re-queue running jobs)',
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    started_at TIMESTAMP NULL,
+    finished_at TIMESTAMP NULL,
+    updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+
+    -- Recovery scan on startup and retention cleanup
+    INDEX idx_status_created (status, created_at),
+    INDEX idx_finished (finished_at)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+-- Verification:
+-- SHOW COLUMNS FROM generation_jobs;
+-- SELECT status, COUNT(*) FROM generation_jobs GROUP BY status;
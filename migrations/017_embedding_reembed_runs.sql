@@ -0,0 +1,24 @@
+-- Migration 017: Re-embedding Runs
+-- Created: October 18, 2026
+-- Purpose: Checkpoints for the agent service's `reembed` tool, which rebuilds
+-- every chunk embedding into a shadow copy of content_embeddings and swaps
+-- it in when done. A run interrupted by a crash resumes after the last
+-- checkpointed content_id instead of starting over.
+
+CREATE TABLE IF NOT EXISTS embedding_reembed_runs (
+    run_id VARCHAR(64) NOT NULL PRIMARY KEY,
+    shadow_table VARCHAR(64) NOT NULL COMMENT 'Table the run writes into, swapped with content_embeddings at the end',
+    status ENUM('running', 'completed', 'failed') NOT NULL DEFAULT 'running',
+    last_content_id BIGINT NOT NULL DEFAULT 0 COMMENT 'Every content_id up to here is embedded into shadow_table',
+    documents INT NOT NULL DEFAULT 0,
+    chunks INT NOT NULL DEFAULT 0,
+    failed INT NOT NULL DEFAULT 0,
+    error TEXT NULL,
+    started_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+    finished_at TIMESTAMP NULL
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+-- Verification:
+-- SHOW COLUMNS FROM embedding_reembed_runs;
+-- SELECT run_id, status, last_content_id, documents, chunks FROM embedding_reembed_runs;
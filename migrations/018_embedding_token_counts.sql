@@ -0,0 +1,15 @@
+-- Migration 018: Per-chunk Token Counts
+-- Created: October 18, 2026
+-- Purpose: The agent service's ingestion pipeline stores each chunk's token
+-- count under the embedding model's tokenizer, so prompt assembly can budget
+-- retrieved chunks without calling /tokenize at query time. model_used
+-- records which model's tokenizer the count belongs to; counts for any other
+-- model are ignored. Rows embedded before this migration keep NULL and are
+-- counted on demand.
+
+ALTER TABLE content_embeddings
+ADD COLUMN IF NOT EXISTS token_count INT NULL COMMENT 'Tokens in text_chunk under model_used''s tokenizer' AFTER text_chunk;
+
+-- Verification:
+-- SHOW COLUMNS FROM content_embeddings LIKE 'token_count';
+-- SELECT model_used, COUNT(*), AVG(token_count) FROM content_embeddings GROUP BY model_used;
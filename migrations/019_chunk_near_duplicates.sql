@@ -0,0 +1,30 @@
+-- Migration 019: Near-duplicate Chunk Collapsing
+-- Created: October 18, 2026
+-- Purpose: Generated lessons repeat a lot of boilerplate. The agent service's
+-- ingestion pipeline now computes a 64-bit SimHash for every chunk and, when a
+-- chunk is within ingestion.dedup_distance bits of one already stored, records
+-- a back-reference to that canonical chunk instead of embedding it again, so
+-- near-identical chunks stop crowding the vector index and the RAG top-k.
+--
+-- content_embeddings_duplicates is paired with content_embeddings; `reembed`
+-- builds and swaps a <shadow table>_duplicates copy alongside its shadow table.
+-- Chunks stored before this migration have no simhash and are never matched
+-- until they are re-embedded.
+
+ALTER TABLE content_embeddings
+ADD COLUMN IF NOT EXISTS simhash BIGINT UNSIGNED NULL COMMENT 'SimHash of text_chunk word 3-shingles';
+
+CREATE TABLE IF NOT EXISTS content_embeddings_duplicates (
+    content_id BIGINT NOT NULL,
+    chunk_index INT NOT NULL,
+    canonical_content_id BIGINT NOT NULL COMMENT 'content_embeddings row standing in for this chunk',
+    canonical_chunk_index INT NOT NULL,
+    hamming_distance TINYINT UNSIGNED NOT NULL,
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    PRIMARY KEY (content_id, chunk_index),
+    INDEX idx_canonical (canonical_content_id, canonical_chunk_index)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+-- Verification:
+-- SHOW COLUMNS FROM content_embeddings LIKE 'simhash';
+-- SELECT COUNT(*) AS collapsed, AVG(hamming_distance) FROM content_embeddings_duplicates;
@@ -0,0 +1,16 @@
+-- Migration 020: Content Edit Timestamps
+-- Created: October 18, 2026
+-- Purpose: The agent service's `reembed` tool pages through
+-- educational_content by content_id; a document edited after its page was
+-- embedded would be swapped in with its old text. updated_at lets the run
+-- re-embed every document changed since it started before swapping. The
+-- service's own embedding bookkeeping (has_embeddings, embedding_count,
+-- last_embedded) leaves updated_at unchanged.
+
+ALTER TABLE educational_content
+ADD COLUMN IF NOT EXISTS updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+ADD INDEX IF NOT EXISTS idx_updated_at (updated_at);
+
+-- Verification:
+-- SHOW COLUMNS FROM educational_content LIKE 'updated_at';
+-- SELECT content_id, updated_at FROM educational_content ORDER BY updated_at DESC LIMIT 5;
@@ -0,0 +1,13 @@
+-- Migration 021: Indexing Jobs
+-- Created: October 18, 2026
+-- Purpose: The agent service's POST /rag/index now queues its work on the
+-- generation job queue instead of embedding on the HTTP request thread.
+-- kind tells those jobs apart from generations; an index job keeps its
+-- request body in message and its ingestion counts (JSON) in result.
+
+ALTER TABLE generation_jobs
+ADD COLUMN IF NOT EXISTS kind ENUM('generation', 'index') NOT NULL DEFAULT 'generation' AFTER job_id;
+
+-- Verification:
+-- SHOW COLUMNS FROM generation_jobs LIKE 'kind';
+-- SELECT kind, status, COUNT(*) FROM generation_jobs GROUP BY kind, status;
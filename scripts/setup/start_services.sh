@@ -30,6 +30,10 @@ sleep 2
 
 export LD_LIBRARY_PATH="/home/steve/Professor_Hawkeinstein/llama.cpp/build/bin:$LD_LIBRARY_PATH"
 
+# Saved KV slot states (agent_service restores agent system prompts from here)
+SLOT_SAVE_DIR="/home/steve/Professor_Hawkeinstein/cache/slots"
+mkdir -p "$SLOT_SAVE_DIR"
+
 if [ "$MULTI_MODEL" = "1" ]; then
     echo "*** MULTI-MODEL MODE ENABLED ***"
     echo ""
@@ -46,6 +50,7 @@ if [ "$MULTI_MODEL" = "1" ]; then
         --cache-reuse 256 \
         --parallel 2 \
         --cont-batching \
+        --slot-save-path "$SLOT_SAVE_DIR" \
         > /tmp/llama_server_qwen.log 2>&1 &
 
     LLAMA_QWEN_PID=$!
@@ -73,6 +78,7 @@ if [ "$MULTI_MODEL" = "1" ]; then
         --cache-reuse 256 \
         --parallel 2 \
         --cont-batching \
+        --slot-save-path "$SLOT_SAVE_DIR" \
         > /tmp/llama_server_llama2.log 2>&1 &
 
     LLAMA_LLAMA2_PID=$!
@@ -104,6 +110,7 @@ else
         --cache-reuse 256 \
         --parallel 2 \
         --cont-batching \
+        --slot-save-path "$SLOT_SAVE_DIR" \
         > /tmp/llama_server.log 2>&1 &
 
     LLAMA_PID=$!
@@ -1,6 +1,8 @@
 #!/bin/bash
 # Warmup script for llama-server to improve first-request performance
 # This sends a minimal prompt to populate caches
+# Per-agent system prompts are prefilled (and saved/restored via
+# --slot-save-path) by agent_service itself at startup.
 
 echo "Waiting for llama-server to be ready..."
 until curl -s http://localhost:8090/health > /dev/null 2>&1; do